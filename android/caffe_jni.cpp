@@ -262,6 +262,48 @@ Java_com_distro_1caffe_1demo_CaffeTrain_getAcc(JNIEnv *env, jobject thiz, jint s
 }
 
 
+static jint add_batch(JNIEnv *env, jfloatArray data, jfloatArray labels,
+                      bool wait)
+{
+  CaffeTrain *caffe_train = CaffeTrain::Get();
+  jfloat *data_ptr = env->GetFloatArrayElements(data, 0);
+  if (data_ptr == NULL) {
+    return -1; /* out of memory error thrown */
+  }
+  jfloat *labels_ptr = env->GetFloatArrayElements(labels, 0);
+  if (labels_ptr == NULL) {
+    env->ReleaseFloatArrayElements(data, data_ptr, JNI_ABORT);
+    return -1; /* out of memory error thrown */
+  }
+  int result = caffe_train->AddBatch(data_ptr, env->GetArrayLength(data),
+                                     labels_ptr, env->GetArrayLength(labels),
+                                     wait);
+  // The arrays are only read, so there is nothing to copy back.
+  env->ReleaseFloatArrayElements(labels, labels_ptr, JNI_ABORT);
+  env->ReleaseFloatArrayElements(data, data_ptr, JNI_ABORT);
+  return result;
+}
+
+/**
+ * Feeds a batch to the training net from a producer thread, while another
+ * thread trains on the previous one. Blocks while the batch ring is full, so
+ * it must not be called on the training thread.
+ */
+JNIEXPORT jint JNICALL
+Java_com_distro_1caffe_1demo_CaffeTrain_AddBatch(JNIEnv *env, jobject thiz, jfloatArray data, jfloatArray labels)
+{
+  return add_batch(env, data, labels, true);
+}
+
+/**
+ * Like AddBatch, but returns 1 instead of blocking while the ring is full.
+ */
+JNIEXPORT jint JNICALL
+Java_com_distro_1caffe_1demo_CaffeTrain_TryAddBatch(JNIEnv *env, jobject thiz, jfloatArray data, jfloatArray labels)
+{
+  return add_batch(env, data, labels, false);
+}
+
 JNIEXPORT jfloatArray JNICALL
 Java_com_distro_1caffe_1demo_CaffeTrain_Get_Current_State(JNIEnv *env, jobject thiz)
 {
@@ -19,6 +19,7 @@
 #include <glog/logging.h>
 
 #include "caffe/util/signal_handler.h"
+#include "caffe/util/weight_registry.hpp"
 
 using std::clock;
 using std::clock_t;
@@ -89,6 +90,10 @@ CaffeMobile::CaffeMobile(const string &model_path,
   clock_t t_start = clock();
   net_.reset(new Net<float>(model_path, caffe::TEST));
   net_->CopyTrainedLayersFrom(weights_path);
+  if (!solver_param.weight_model().empty()) {
+    caffe::WeightRegistry<float>::Attach(solver_param.weight_model(),
+                                         net_.get());
+  }
   clock_t t_end = clock();
   LOG(INFO) << "Loading time: " << 1000.0 * (t_end - t_start) / CLOCKS_PER_SEC
             << " ms.";
@@ -107,6 +112,11 @@ CaffeMobile::CaffeMobile(const string &model_path,
 
 CaffeMobile::~CaffeMobile() { net_.reset(); }
 
+bool CaffeMobile::RefreshWeights() {
+  return caffe::WeightRegistry<float>::attached(net_.get()) &&
+         caffe::WeightRegistry<float>::Refresh(net_.get());
+}
+
 void CaffeMobile::SetMean(const vector<float> &mean_values) {
   CHECK_EQ(mean_values.size(), num_channels_)
       << "Number of mean values doesn't match channels of input layer.";
@@ -230,6 +240,7 @@ vector<float> CaffeMobile::Forward(const cv::Mat &img) {
 
   Preprocess(img, &input_channels);
 
+  RefreshWeights();
   clock_t t_start = clock();
   net_->Forward();
   clock_t t_end = clock();
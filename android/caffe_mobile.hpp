@@ -31,6 +31,11 @@ public:
   vector<vector<float>> ExtractFeatures(const cv::Mat &img,
                                         const string &str_blob_names);
 
+  // With weight_model set in the solver descriptor, the net shares its
+  // weights with the training net of a CaffeTrain naming the same model.
+  // Moves the net to the latest trained weights; Forward does this first.
+  bool RefreshWeights();
+
 private:
   static CaffeMobile *caffe_mobile_;
   static string model_path_;
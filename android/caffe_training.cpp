@@ -75,6 +75,12 @@ CaffeTrain::CaffeTrain(const string &solver_path)
   solver = shared_ptr<caffe::Solver<float> >(caffe::SolverRegistry<float>::CreateSolver(solver_param));
 
   solver->SetActionFunction(signal_handler.GetActionFunction());
+
+  const vector<shared_ptr<Layer<float> > > &layers = solver->net()->layers();
+  for (size_t i = 0; i < layers.size() && !memory_data_; ++i) {
+    memory_data_ =
+        boost::dynamic_pointer_cast<MemoryDataLayer<float> >(layers[i]);
+  }
 }
 
 CaffeTrain::~CaffeTrain() {}
@@ -146,6 +152,32 @@ float CaffeTrain::getAcc()
   return this->solver->stored_accuracy;
 }
 
+int CaffeTrain::AddBatch(const float *data, int data_count,
+                         const float *labels, int label_count, bool wait)
+{
+  if (!memory_data_) {
+    LOG(ERROR) << "The training net has no MemoryData layer";
+    return -1;
+  }
+  if (memory_data_->buffers() == 0) {
+    LOG(ERROR) << "The MemoryData layer needs memory_data_param.buffers";
+    return -1;
+  }
+  const int batch_size = memory_data_->batch_size();
+  const int item_size = memory_data_->channels() * memory_data_->height() *
+                        memory_data_->width();
+  if (data_count != batch_size * item_size || label_count != batch_size) {
+    LOG(ERROR) << "Expected a batch of " << batch_size << " items of "
+               << item_size << " values";
+    return -1;
+  }
+  if (!wait) {
+    return memory_data_->TryAddBatch(data, labels) ? 0 : 1;
+  }
+  memory_data_->AddBatch(data, labels);
+  return 0;
+}
+
 void CaffeTrain::OneIter() {
   LOG(INFO) << "Solving ";
   // LOG(INFO) << "Learning Rate Policy: " << param_.lr_policy();
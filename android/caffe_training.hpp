@@ -77,6 +77,13 @@ public:
   char *GetNewNet();
   void SetNormalizeScale(int scale);
   float getAcc();
+  // Copies a batch into the ring of the net's MemoryData layer; returns -1
+  // if the net has no such layer, the layer has no memory_data_param.buffers,
+  // or the sizes do not match it. With wait, it waits while the ring is full,
+  // so it must run on another thread than the training, which frees batches;
+  // without, it returns 1 instead.
+  int AddBatch(const float *data, int data_count, const float *labels,
+               int label_count, bool wait = true);
 
 private:
   static CaffeTrain *caffe_train_;
@@ -87,7 +94,11 @@ private:
   /*My new solver object*/
   SolverParameter solver_param;
 
+  /*With weight_model set, its training net shares weights with CaffeMobile*/
   shared_ptr<caffe::Solver<float> > solver;
+
+  /*The MemoryData layer of the training net, if any*/
+  shared_ptr<MemoryDataLayer<float> > memory_data_;
 };
 
 } // namespace caffe
@@ -8,7 +8,9 @@
 #include "caffe/common.hpp"
 #include "caffe/internal_thread.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/datum_view.hpp"
 #include "caffe/util/db.hpp"
+#include "caffe/util/ring_queue.hpp"
 
 namespace caffe {
 
@@ -19,28 +21,32 @@ namespace caffe {
  * databases are read sequentially, and that each solver accesses a different
  * subset of the database. Data is distributed to solvers in a round-robin
  * way to keep parallel training deterministic.
+ * Datums are passed as DatumViews, which point into the db's pages where the
+ * backend allows it, so plain uint8 records are not copied.
  */
 class DataReader {
  public:
   explicit DataReader(const LayerParameter& param);
   ~DataReader();
 
-  inline BlockingQueue<Datum*>& free() const {
+  inline RingQueue<DatumView*>& free() const {
     return queue_pair_->free_;
   }
-  inline BlockingQueue<Datum*>& full() const {
+  inline RingQueue<DatumView*>& full() const {
     return queue_pair_->full_;
   }
 
  protected:
-  // Queue pairs are shared between a body and its readers
+  // Queue pairs are shared between a body and its readers; each queue has
+  // the body's thread on one end and the reader's prefetch thread on the
+  // other.
   class QueuePair {
    public:
     explicit QueuePair(int size);
     ~QueuePair();
 
-    BlockingQueue<Datum*> free_;
-    BlockingQueue<Datum*> full_;
+    RingQueue<DatumView*> free_;
+    RingQueue<DatumView*> full_;
 
   DISABLE_COPY_AND_ASSIGN(QueuePair);
   };
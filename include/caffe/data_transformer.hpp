@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/datum_view.hpp"
 
 namespace caffe {
 
@@ -25,6 +26,13 @@ class DataTransformer {
    */
   void InitRand();
 
+  /**
+   * @brief Restart the random number stream from the given seed (if the
+   *    transformation needs random numbers), e.g. to give each item of a
+   *    batch its own reproducible stream.
+   */
+  void SeedRand(unsigned int seed);
+
   /**
    * @brief Applies the transformation defined in the data layer's
    * transform_param block to the data.
@@ -37,6 +45,12 @@ class DataTransformer {
    */
   void Transform(const Datum& datum, Blob<Dtype>* transformed_blob);
 
+  /**
+   * @brief Applies the transformation to a Datum read from a db, reading
+   *    the pixels in place when the Datum is viewed.
+   */
+  void Transform(const DatumView& datum, Blob<Dtype>* transformed_blob);
+
   /**
    * @brief Applies the transformation defined in the data layer's
    * transform_param block to a vector of Datum.
@@ -98,6 +112,7 @@ class DataTransformer {
    *    Datum containing the data to be transformed.
    */
   vector<int> InferBlobShape(const Datum& datum);
+  vector<int> InferBlobShape(const DatumView& datum);
   /**
    * @brief Infers the shape of transformed_blob will have when
    *    the transformation is applied to the data.
@@ -139,6 +154,10 @@ class DataTransformer {
   virtual int Rand(int n);
 
   void Transform(const Datum& datum, Dtype* transformed_data);
+  // Transforms datum_channels x datum_height x datum_width values of data.
+  template <typename Src>
+  void TransformData(const Src* data, const int datum_channels,
+      const int datum_height, const int datum_width, Dtype* transformed_data);
   // Tranformation parameters
   TransformationParameter param_;
 
@@ -294,6 +294,16 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Return whether running Forward again on the same bottom blobs
+   *        gives the same top blobs and has no other effect.
+   *
+   * Gradient checkpointing frees the tops of such layers after the forward
+   * pass and recomputes them for Backward. Layers that draw random numbers
+   * or update state in Forward should override this to return false.
+   */
+  virtual inline bool ForwardIsRepeatable() const { return true; }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -6,7 +6,9 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/half_matrix.hpp"
 #include "caffe/util/im2col.hpp"
+#include "caffe/util/sparse_matrix.hpp"
 
 namespace caffe {
 
@@ -28,6 +30,11 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline bool EqualNumBottomTopBlobs() const { return true; }
 
+  /// @brief The CSR copy of the weights; active() while Forward uses it.
+  inline const SparseMatrix<Dtype>& sparse_weight() const {
+    return sparse_weight_;
+  }
+
  protected:
   // Helper functions that abstract away the column buffer and gemm arguments.
   // The last argument in forward_cpu_gemm is so that we can skip the im2col if
@@ -92,6 +99,12 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   bool bias_term_;
   bool is_1x1_;
   bool force_nd_im2col_;
+  /// @brief CSR copy of pruned weights; forward_cpu_gemm uses it while
+  ///        active (ConvolutionLayer refreshes it in the TEST phase).
+  SparseMatrix<Dtype> sparse_weight_;
+  /// @brief 16-bit copy of the weights, used the same way when the weights
+  ///        are not sparse and weight_precision is set.
+  HalfMatrix<Dtype> half_weight_;
 
  private:
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
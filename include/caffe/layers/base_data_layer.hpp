@@ -8,7 +8,8 @@
 #include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
-#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/ring_queue.hpp"
 
 namespace caffe {
 
@@ -48,7 +49,12 @@ class BaseDataLayer : public Layer<Dtype> {
 template <typename Dtype>
 class Batch {
  public:
+  Batch() : load_ms_(0) {}
   Blob<Dtype> data_, label_;
+  // The tops after data and label, for layers with more (e.g. HDF5Data).
+  vector<shared_ptr<Blob<Dtype> > > extra_;
+  // The time the prefetch thread took to load this batch.
+  double load_ms_;
 };
 
 template <typename Dtype>
@@ -62,21 +68,69 @@ class BasePrefetchingDataLayer :
   void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
+  /**
+   * @brief Points the tops at the next loaded batch instead of copying it;
+   *        the batch goes back to the prefetch thread on the next Forward.
+   *
+   * So while the net runs, only prefetch_count() - 1 batches can load, and
+   * prefetch should be at least 2 for loading to overlap the net. A layer
+   * computing in place on a top writes into the batch: its output replaces
+   * the loaded data until the prefetch thread refills the batch.
+   */
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  /// @brief Copies the next loaded batch to the tops on the GPU.
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
-  // Prefetches batches (asynchronously if to GPU memory)
-  static const int PREFETCH_COUNT = 3;
+  /**
+   * @brief The number of batches in the prefetch ring, initially
+   *        DataParameter.prefetch; see DataParameter.prefetch_max.
+   */
+  inline int prefetch_count() const { return prefetch_.size(); }
+  /// @brief The number of batches consumed by Forward so far.
+  inline int batches_consumed() const { return batches_consumed_; }
+  /**
+   * @brief The number of those batches for which Forward had to wait on the
+   *        prefetch thread, i.e. for which the net was input-bound, and the
+   *        total time spent waiting.
+   */
+  inline int prefetch_stalls() const { return prefetch_stalls_; }
+  inline double prefetch_stall_ms() const { return prefetch_stall_ms_; }
+  /// @brief Occupancy statistics of the queue of loaded batches.
+  inline QueueStats prefetch_queue_stats() const {
+    return prefetch_full_.stats();
+  }
 
  protected:
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
+  // Pops the next full batch for Forward, recording any stall.
+  Batch<Dtype>* next_batch();
+  // Adds a batch shaped like the given one to the ring, if the depth and
+  // memory limits allow it.
+  void GrowPrefetch(const Batch<Dtype>& like);
+
+  int batches_consumed_;
+  int prefetch_stalls_;
+  double prefetch_stall_ms_;
 
-  Batch<Dtype> prefetch_[PREFETCH_COUNT];
-  BlockingQueue<Batch<Dtype>*> prefetch_free_;
-  BlockingQueue<Batch<Dtype>*> prefetch_full_;
+  // Moving averages of the time to load a batch and of the time the net
+  // takes to consume one, and the timer for the latter.
+  double load_ms_average_;
+  double consume_ms_average_;
+  CPUTimer consume_timer_;
+  // The batch that the tops point to on the CPU, returned to the free queue
+  // by the next Forward.
+  Batch<Dtype>* prefetch_current_;
+
+  // Prefetches batches (asynchronously if to GPU memory)
+  vector<shared_ptr<Batch<Dtype> > > prefetch_;
+  int prefetch_max_;
+  size_t prefetch_memory_limit_;
+  // Batches move between the prefetch thread and the thread running Forward.
+  RingQueue<Batch<Dtype>*> prefetch_free_;
+  RingQueue<Batch<Dtype>*> prefetch_full_;
 
   Blob<Dtype> transformed_data_;
 };
@@ -6,16 +6,17 @@
 #include "caffe/blob.hpp"
 #include "caffe/data_reader.hpp"
 #include "caffe/data_transformer.hpp"
-#include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
 template <typename Dtype>
-class DataLayer : public BasePrefetchingDataLayer<Dtype> {
+class DataLayer : public BasePrefetchingDataLayer<Dtype>,
+    public ParallelTask {
  public:
   explicit DataLayer(const LayerParameter& param);
   virtual ~DataLayer();
@@ -28,10 +29,33 @@ class DataLayer : public BasePrefetchingDataLayer<Dtype> {
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline int MaxTopBlobs() const { return 2; }
 
+  /**
+   * @brief The number of datums for which load_batch had to wait on the
+   *        DataReader, i.e. for which reading (rather than decoding and
+   *        transformation) was the bottleneck.
+   */
+  inline int reader_stalls() const { return reader_stalls_; }
+
  protected:
   virtual void load_batch(Batch<Dtype>* batch);
+  // Transforms one item of the batch being loaded.
+  virtual void Run(int item_id, int thread);
 
   DataReader reader_;
+  int reader_stalls_;
+
+  // Parallel transformation (data_param.transform_threads > 0).
+  shared_ptr<ThreadPool> transform_pool_;
+  // The transformers and items of the transform threads.
+  vector<shared_ptr<DataTransformer<Dtype> > > transformers_;
+  vector<shared_ptr<Blob<Dtype> > > transformed_items_;
+  // The batch being loaded: its datums and random seeds.
+  vector<DatumView*> batch_datums_;
+  vector<unsigned int> item_seeds_;
+  unsigned int item_seed_base_;
+  size_t item_count_;
+  Dtype* top_data_;
+  Dtype* top_label_;
 };
 
 }  // namespace caffe
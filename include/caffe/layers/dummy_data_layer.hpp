@@ -31,6 +31,13 @@ class DummyDataLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "DummyData"; }
   virtual inline int ExactNumBottomBlobs() const { return 0; }
   virtual inline int MinTopBlobs() const { return 1; }
+  // Refilling the tops from a non-constant filler draws random numbers.
+  virtual inline bool ForwardIsRepeatable() const {
+    for (int i = 0; i < refill_.size(); ++i) {
+      if (refill_[i]) { return false; }
+    }
+    return true;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
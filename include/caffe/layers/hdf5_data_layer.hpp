@@ -7,6 +7,7 @@
 #include <vector>
 
 #include "caffe/blob.hpp"
+#include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 
@@ -17,44 +18,49 @@ namespace caffe {
 /**
  * @brief Provides data to the Net from HDF5 files.
  *
- * TODO(dox): thorough documentation for Forward and proto params.
+ * Each top is the dataset of the same name. The prefetch thread reads the
+ * files in chunks of HDF5DataParameter.chunk_size rows, as hyperslabs of the
+ * datasets, so that only a chunk of a file is in memory and reading overlaps
+ * with the net's computation.
  */
 template <typename Dtype>
-class HDF5DataLayer : public Layer<Dtype> {
+class HDF5DataLayer : public BasePrefetchingDataLayer<Dtype> {
  public:
   explicit HDF5DataLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : BasePrefetchingDataLayer<Dtype>(param), file_id_(-1) {}
   virtual ~HDF5DataLayer();
-  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
-  // Data layers should be shared by multiple solvers in parallel
-  virtual inline bool ShareInParallel() const { return true; }
-  // Data layers have no bottoms, so reshaping is trivial.
-  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top) {}
 
   virtual inline const char* type() const { return "HDF5Data"; }
   virtual inline int ExactNumBottomBlobs() const { return 0; }
   virtual inline int MinTopBlobs() const { return 1; }
 
  protected:
-  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top);
-  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top);
-  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
-      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
-  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
-      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
-  virtual void LoadHDF5FileData(const char* filename);
+  virtual void load_batch(Batch<Dtype>* batch);
+  // Opens the current file of the permutation, closing the previous one.
+  virtual void OpenHDF5File(const char* filename);
+  // Loads the current chunk of the open file into hdf_blobs_.
+  virtual void LoadHDF5Chunk();
+  // Moves on to the next chunk, of the next file at the end of a file.
+  void NextChunk();
+  void CloseHDF5File();
+  void Shuffle(vector<unsigned int>* permutation);
 
   std::vector<std::string> hdf_filenames_;
   unsigned int num_files_;
   unsigned int current_file_;
+  hid_t file_id_;
+  hsize_t file_rows_;
+  hsize_t chunk_rows_;
+  unsigned int current_chunk_;
   hsize_t current_row_;
+  // The rows of the current chunk, one blob per top.
   std::vector<shared_ptr<Blob<Dtype> > > hdf_blobs_;
   std::vector<unsigned int> data_permutation_;
+  std::vector<unsigned int> chunk_permutation_;
   std::vector<unsigned int> file_permutation_;
+  shared_ptr<Caffe::RNG> prefetch_rng_;
 };
 
 }  // namespace caffe
@@ -11,19 +11,27 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/image_cache.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
 /**
  * @brief Provides data to the Net from image files.
  *
+ * The images of a batch are decoded and transformed by
+ * ImageDataParameter.decode_threads threads, and decoded images can be kept
+ * in an LRU cache (ImageDataParameter.decoded_cache_mb).
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
-class ImageDataLayer : public BasePrefetchingDataLayer<Dtype> {
+class ImageDataLayer : public BasePrefetchingDataLayer<Dtype>,
+    public ParallelTask {
  public:
   explicit ImageDataLayer(const LayerParameter& param)
-      : BasePrefetchingDataLayer<Dtype>(param) {}
+      : BasePrefetchingDataLayer<Dtype>(param), top_data_(NULL),
+        top_label_(NULL) {}
   virtual ~ImageDataLayer();
   virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -36,9 +44,26 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Dtype> {
   shared_ptr<Caffe::RNG> prefetch_rng_;
   virtual void ShuffleImages();
   virtual void load_batch(Batch<Dtype>* batch);
+  // Decodes and transforms one item of the batch being loaded.
+  virtual void Run(int item_id, int thread);
+  // Reads an image through the cache, if any.
+  cv::Mat ReadImage(const string& filename);
 
   vector<std::pair<std::string, int> > lines_;
   int lines_id_;
+
+  shared_ptr<ThreadPool> decode_pool_;
+  shared_ptr<ImageCache> image_cache_;
+  // The transformers and items of the decode threads.
+  vector<shared_ptr<DataTransformer<Dtype> > > transformers_;
+  vector<shared_ptr<Blob<Dtype> > > transformed_items_;
+  // The batch being loaded: its lines, random seeds (with decode threads),
+  // and the already decoded first image.
+  vector<int> item_lines_;
+  vector<unsigned int> item_seeds_;
+  cv::Mat first_image_;
+  Dtype* top_data_;
+  Dtype* top_label_;
 };
 
 
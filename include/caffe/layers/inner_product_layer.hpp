@@ -6,6 +6,8 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/half_matrix.hpp"
+#include "caffe/util/sparse_matrix.hpp"
 
 namespace caffe {
 
@@ -29,6 +31,11 @@ class InnerProductLayer : public Layer<Dtype> {
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  /// @brief The CSR copy of the weights; active() while Forward uses it.
+  inline const SparseMatrix<Dtype>& sparse_weight() const {
+    return sparse_weight_;
+  }
+
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -45,6 +52,10 @@ class InnerProductLayer : public Layer<Dtype> {
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
   bool transpose_;  ///< if true, assume transposed weights
+  /// CSR copy of pruned weights, used by Forward_cpu in the TEST phase.
+  SparseMatrix<Dtype> sparse_weight_;
+  /// 16-bit copy of the weights, used likewise when weight_precision is set.
+  HalfMatrix<Dtype> half_weight_;
 };
 
 }  // namespace caffe
@@ -56,6 +56,10 @@ class LRNLayer : public Layer<Dtype> {
   virtual void WithinChannelBackward(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  // Computes y = x * scale^-beta_ elementwise.
+  void ScalePower_cpu(const int n, const Dtype* scale, const Dtype* x,
+      Dtype* y) const;
+
   int size_;
   int pre_pad_;
   Dtype alpha_;
@@ -69,6 +73,9 @@ class LRNLayer : public Layer<Dtype> {
   // Fields used for normalization ACROSS_CHANNELS
   // scale_ stores the intermediate summing results
   Blob<Dtype> scale_;
+  // Per-tile scratch for the backward pass: a ring of size_ rows holding the
+  // ratios inside the sliding window, followed by one row for their sum.
+  Blob<Dtype> window_buffer_;
 
   // Fields used for normalization WITHIN_CHANNEL
   shared_ptr<SplitLayer<Dtype> > split_layer_;
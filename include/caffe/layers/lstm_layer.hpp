@@ -50,6 +50,9 @@ class LSTMLayer : public RecurrentLayer<Dtype> {
   explicit LSTMLayer(const LayerParameter& param)
       : RecurrentLayer<Dtype>(param) {}
 
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
   virtual inline const char* type() const { return "LSTM"; }
 
  protected:
@@ -58,6 +61,22 @@ class LSTMLayer : public RecurrentLayer<Dtype> {
   virtual void RecurrentOutputBlobNames(vector<string>* names) const;
   virtual void RecurrentInputShapes(vector<BlobShape>* shapes) const;
   virtual void OutputBlobNames(vector<string>* names) const;
+
+  virtual inline bool HasFusedCpu() const { return true; }
+  virtual void FusedForward_cpu();
+  virtual void FusedBackward_cpu(bool propagate_x, bool propagate_static);
+
+  /// @brief The activated gates [i, f, o, g] of every timestep; the diff
+  ///        holds the gradient w.r.t. the gate pre-activations.
+  Blob<Dtype> gates_;
+  /// @brief The cell state @f$ c_t @f$ of every timestep.
+  Blob<Dtype> cell_;
+  /// @brief @f$ \delta_t h_{t-1} @f$ for every timestep, kept for the
+  ///        @f$ W_{hc} @f$ gradient.
+  Blob<Dtype> hidden_conted_;
+  /// @brief The gradients flowing back into @f$ h_{t-1} @f$ (data) and
+  ///        @f$ c_{t-1} @f$ (diff) during backpropagation through time.
+  Blob<Dtype> state_diff_;
 };
 
 /**
@@ -8,19 +8,25 @@
 #include "caffe/proto/caffe.pb.h"
 
 #include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/ring_queue.hpp"
 
 namespace caffe {
 
 /**
  * @brief Provides data to the Net from memory.
  *
+ * With memory_data_param.buffers > 0, AddDatumVector, AddMatVector and
+ * AddBatch copy each batch into the next free one of a ring of preallocated
+ * batches, waiting while none is free, and Forward waits for the next added
+ * batch. One producer thread can thus add batch N + 1 while the net consumes
+ * batch N, without allocating as long as the shapes do not change.
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
 class MemoryDataLayer : public BaseDataLayer<Dtype> {
  public:
-  explicit MemoryDataLayer(const LayerParameter& param)
-      : BaseDataLayer<Dtype>(param), has_new_data_(false) {}
+  explicit MemoryDataLayer(const LayerParameter& param);
   virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
@@ -34,12 +40,25 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
       const vector<int>& labels);
 #endif  // USE_OPENCV
 
+  /**
+   * @brief Copies a batch of batch_size() items of untransformed data and
+   *        their labels into the ring; requires buffers > 0.
+   *
+   * Waits while the ring is full, so it must not be called on the thread
+   * running Forward, which is the one freeing batches.
+   */
+  void AddBatch(const Dtype* data, const Dtype* labels);
+  /// @brief Like AddBatch, but returns false instead of waiting.
+  bool TryAddBatch(const Dtype* data, const Dtype* labels);
+
   // Reset should accept const pointers, but can't, because the memory
   //  will be given to Blob, which is mutable
   void Reset(Dtype* data, Dtype* label, int n);
+  // With buffers, the batch size must only change while no batch is added.
   void set_batch_size(int new_size);
 
   int batch_size() { return batch_size_; }
+  int buffers() { return buffers_.size(); }
   int channels() { return channels_; }
   int height() { return height_; }
   int width() { return width_; }
@@ -56,6 +75,20 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
   Blob<Dtype> added_data_;
   Blob<Dtype> added_label_;
   bool has_new_data_;
+
+  // Returns the next free batch of the ring, shaped for batch_size_ items;
+  // without wait, NULL if there is none.
+  Batch<Dtype>* free_batch(bool wait = true);
+  // Copies data and labels into a free batch, and queues it.
+  void PushBatch(Batch<Dtype>* batch, const Dtype* data, const Dtype* labels);
+
+  // The ring of batches (memory_data_param.buffers > 0), and the batch the
+  // tops point to, returned to the free queue by the next Forward.
+  vector<shared_ptr<Batch<Dtype> > > buffers_;
+  RingQueue<Batch<Dtype>*> free_;
+  RingQueue<Batch<Dtype>*> full_;
+  Batch<Dtype>* current_;
+  Blob<Dtype> transformed_data_;
 };
 
 }  // namespace caffe
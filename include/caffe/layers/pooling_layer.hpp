@@ -44,6 +44,18 @@ class PoolingLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  // Max pooling of one channel plane that records the argmax of each window
+  // into mask (or top_mask).  top_data may be NULL to rebuild the mask only.
+  void MaxPoolPlaneWithMask_cpu(const Dtype* bottom_data, Dtype* top_data,
+      int* mask, Dtype* top_mask);
+  // Max or average pooling of one channel plane without an argmax mask.
+  // Rows of a window are first reduced into row_buffer_, which is contiguous
+  // and vectorizes, and the row is then reduced across each window's width.
+  void SeparablePoolPlane_cpu(const Dtype* bottom_data, Dtype* top_data,
+      bool max_pool);
+  // Recompute max_idx_ from bottom when forward skipped writing it.
+  void RebuildMaxIdx_cpu(const Blob<Dtype>* bottom);
+
   int kernel_h_, kernel_w_;
   int stride_h_, stride_w_;
   int pad_h_, pad_w_;
@@ -51,8 +63,13 @@ class PoolingLayer : public Layer<Dtype> {
   int height_, width_;
   int pooled_height_, pooled_width_;
   bool global_pooling_;
+  // Output columns [begin, end) whose windows need no clipping.
+  int interior_w_begin_, interior_w_end_;
   Blob<Dtype> rand_idx_;
   Blob<int> max_idx_;
+  // False when the last forward pass did not write max_idx_ (TEST phase).
+  bool max_idx_valid_;
+  Blob<Dtype> row_buffer_;
 };
 
 }  // namespace caffe
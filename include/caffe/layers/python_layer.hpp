@@ -39,6 +39,7 @@ class PythonLayer : public Layer<Dtype> {
   }
 
   virtual inline const char* type() const { return "Python"; }
+  virtual inline bool ForwardIsRepeatable() const { return false; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -58,6 +58,8 @@ class RecurrentLayer : public Layer<Dtype> {
     // Can't propagate to sequence continuation indicators.
     return bottom_index != 1;
   }
+  // Forward carries the hidden state over to the next call.
+  virtual inline bool ForwardIsRepeatable() const { return false; }
 
  protected:
   /**
@@ -95,6 +97,76 @@ class RecurrentLayer : public Layer<Dtype> {
    */
   virtual void OutputBlobNames(vector<string>* names) const = 0;
 
+  /**
+   * @brief Whether the subclass implements FusedForward_cpu and
+   *        FusedBackward_cpu, which replace the unrolled net in CPU mode.
+   */
+  virtual inline bool HasFusedCpu() const { return false; }
+
+  /**
+   * @brief Runs the whole recurrence natively, reading the inputs of the
+   *        unrolled net (x_input_blob_, cont_input_blob_, ...) and writing its
+   *        outputs (output_blobs_ and recur_output_blobs_).
+   */
+  virtual void FusedForward_cpu() { NOT_IMPLEMENTED; }
+
+  /**
+   * @brief Backpropagates through time natively, accumulating the parameter
+   *        gradients and, if requested, the input gradients.
+   */
+  virtual void FusedBackward_cpu(bool propagate_x, bool propagate_static) {
+    NOT_IMPLEMENTED;
+  }
+
+  /**
+   * @brief Returns the net unrolled over num_timesteps timesteps, taking the
+   *        shapes of its inputs from bottom.
+   */
+  shared_ptr<Net<Dtype> > UnrolledNet(const vector<Blob<Dtype>*>& bottom,
+      int num_timesteps);
+  /// @brief Points the inputs and outputs of the layer into unrolled_net_.
+  void ConnectUnrolledNet();
+  /**
+   * @brief Gives the layer inputs and outputs of its own, shaped after those
+   *        of net, for the fused path to use without unrolled_net_.
+   */
+  void SetUpFusedBlobs(const Net<Dtype>& net);
+  /**
+   * @brief Makes unrolled_net_ ready to run on the current parameters,
+   *        building it first if the layer has not yet needed it.
+   */
+  void PrepareUnrolledNet(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  /// @brief Whether Forward_cpu and Backward_cpu take the fused path.
+  inline bool use_fused_cpu() const {
+    return fused_cpu_ && Caffe::mode() == Caffe::CPU;
+  }
+
+  /**
+   * @brief Computes the time-varying input projection of every timestep,
+   *        @f$ W_x x_t + b (+ W_{static} x_{static}) @f$, into the data of
+   *        the @f$ (T \times N \times D) @f$ blob pre_gates using one GEMM
+   *        over all @f$ T N @f$ rows. Uses blobs_[0], blobs_[1] and, with a
+   *        static input, blobs_[2].
+   */
+  void FusedInputTransform_cpu(Blob<Dtype>* pre_gates);
+
+  /**
+   * @brief Writes @f$ \delta_{t,n} h_n @f$ for each of the N_ rows of h into
+   *        h_conted, returning false if every stream starts a new sequence
+   *        (so that the recurrent GEMM can be skipped).
+   */
+  bool ContHidden_cpu(const int dim, const Dtype* cont_t, const Dtype* h,
+      Dtype* h_conted) const;
+
+  /**
+   * @brief The backward pass of FusedInputTransform_cpu given the gradient
+   *        in the diff of pre_gates.
+   */
+  void FusedInputTransformBackward_cpu(const Blob<Dtype>& pre_gates,
+      bool propagate_x, bool propagate_static);
+
   /**
    * @param bottom input Blob vector (length 2-3)
    *
@@ -147,7 +219,10 @@ class RecurrentLayer : public Layer<Dtype> {
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
-  /// @brief A Net to implement the Recurrent functionality.
+  /**
+   * @brief A Net to implement the Recurrent functionality; with the fused
+   *        path, only built once the layer runs it.
+   */
   shared_ptr<Net<Dtype> > unrolled_net_;
 
   /// @brief The number of independent streams to process simultaneously.
@@ -180,6 +255,17 @@ class RecurrentLayer : public Layer<Dtype> {
   Blob<Dtype>* x_input_blob_;
   Blob<Dtype>* x_static_input_blob_;
   Blob<Dtype>* cont_input_blob_;
+
+  /// @brief Whether the fused CPU kernels are enabled for this layer.
+  bool fused_cpu_;
+  /// @brief The inputs and outputs of the fused path without unrolled_net_.
+  vector<shared_ptr<Blob<Dtype> > > fused_blobs_;
+  /// @brief The shapes of the outputs for a single timestep.
+  vector<vector<int> > output_shapes_;
+  /// @brief A vector of @f$ T N @f$ ones, used to add and reduce biases.
+  Blob<Dtype> bias_multiplier_;
+  /// @brief The per-stream static input projection (and its gradient).
+  Blob<Dtype> static_transform_;
 };
 
 }  // namespace caffe
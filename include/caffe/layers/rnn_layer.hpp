@@ -32,6 +32,9 @@ class RNNLayer : public RecurrentLayer<Dtype> {
   explicit RNNLayer(const LayerParameter& param)
       : RecurrentLayer<Dtype>(param) {}
 
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
   virtual inline const char* type() const { return "RNN"; }
 
  protected:
@@ -40,6 +43,23 @@ class RNNLayer : public RecurrentLayer<Dtype> {
   virtual void RecurrentOutputBlobNames(vector<string>* names) const;
   virtual void RecurrentInputShapes(vector<BlobShape>* shapes) const;
   virtual void OutputBlobNames(vector<string>* names) const;
+
+  virtual inline bool HasFusedCpu() const { return true; }
+  virtual void FusedForward_cpu();
+  virtual void FusedBackward_cpu(bool propagate_x, bool propagate_static);
+
+  /// @brief The hidden state @f$ h_t @f$ of every timestep; the diff holds
+  ///        the gradient w.r.t. its pre-activation.
+  Blob<Dtype> hidden_;
+  /// @brief @f$ \delta_t h_{t-1} @f$ for every timestep, kept for the
+  ///        @f$ W_{hh} @f$ gradient.
+  Blob<Dtype> hidden_conted_;
+  /// @brief The gradient w.r.t. the output pre-activation
+  ///        @f$ W_{ho} h_t + b_o @f$.
+  Blob<Dtype> output_delta_;
+  /// @brief The gradient flowing back into @f$ h_{t-1} @f$ during
+  ///        backpropagation through time.
+  Blob<Dtype> hidden_diff_;
 };
 
 }  // namespace caffe
@@ -107,10 +107,19 @@ class SoftmaxWithLossLayer : public LossLayer<Dtype> {
   virtual Dtype get_normalizer(
       LossParameter_NormalizationMode normalization_mode, int valid_count);
 
+  /// Computes log(sum(exp(x))) over the softmax axis into log_normalizer_.
+  void ComputeLogNormalizer_cpu(const Dtype* bottom_data);
+
   /// The internal SoftmaxLayer used to map predictions to a distribution.
   shared_ptr<Layer<Dtype> > softmax_layer_;
   /// prob stores the output probability predictions from the SoftmaxLayer.
+  /// The CPU path only fills it when the probabilities are a top blob.
   Blob<Dtype> prob_;
+  /// log_normalizer stores log(sum(exp(x))) for each softmax when the CPU
+  /// path computes the loss and gradient directly from the predictions.
+  Blob<Dtype> log_normalizer_;
+  /// sum_exp is an intermediate Blob to hold temporary results.
+  Blob<Dtype> sum_exp_;
   /// bottom vector holder used in call to the underlying SoftmaxLayer::Forward
   vector<Blob<Dtype>*> softmax_bottom_vec_;
   /// top vector holder used in call to the underlying SoftmaxLayer::Forward
@@ -11,6 +11,8 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/image_cache.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -18,13 +20,20 @@ namespace caffe {
  * @brief Provides data to the Net from windows of images files, specified
  *        by a window data file.
  *
+ * The windows of a batch are decoded, cropped and warped by
+ * WindowDataParameter.decode_threads threads, and decoded images can be kept
+ * in an LRU cache (WindowDataParameter.decoded_cache_mb), so that the windows
+ * of an image share a single decode.
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
-class WindowDataLayer : public BasePrefetchingDataLayer<Dtype> {
+class WindowDataLayer : public BasePrefetchingDataLayer<Dtype>,
+    public ParallelTask {
  public:
   explicit WindowDataLayer(const LayerParameter& param)
-      : BasePrefetchingDataLayer<Dtype>(param) {}
+      : BasePrefetchingDataLayer<Dtype>(param), top_data_(NULL),
+        top_label_(NULL) {}
   virtual ~WindowDataLayer();
   virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -36,6 +45,10 @@ class WindowDataLayer : public BasePrefetchingDataLayer<Dtype> {
  protected:
   virtual unsigned int PrefetchRand();
   virtual void load_batch(Batch<Dtype>* batch);
+  // Decodes, crops and warps one window of the batch being loaded.
+  virtual void Run(int item_id, int thread);
+  // Reads the image of a window through the cache, if any.
+  cv::Mat ReadImage(int image_index);
 
   shared_ptr<Caffe::RNG> prefetch_rng_;
   vector<std::pair<std::string, vector<int> > > image_database_;
@@ -48,6 +61,14 @@ class WindowDataLayer : public BasePrefetchingDataLayer<Dtype> {
   bool has_mean_values_;
   bool cache_images_;
   vector<std::pair<std::string, Datum > > image_database_cache_;
+
+  shared_ptr<ThreadPool> decode_pool_;
+  shared_ptr<ImageCache> image_cache_;
+  // The batch being loaded: its windows and whether to mirror them.
+  vector<const vector<float>*> item_windows_;
+  vector<bool> item_mirrors_;
+  Dtype* top_data_;
+  Dtype* top_label_;
 };
 
 }  // namespace caffe
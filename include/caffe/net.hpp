@@ -11,6 +11,7 @@
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/dag_scheduler.hpp"
 
 namespace caffe {
 
@@ -27,7 +28,7 @@ class Net {
   explicit Net(const string& param_file, Phase phase,
       const int level = 0, const vector<string>* stages = NULL,
       const Net* root_net = NULL);
-  virtual ~Net() {}
+  virtual ~Net();
 
   /// @brief Initialize a network with a NetParameter.
   void Init(const NetParameter& param);
@@ -99,12 +100,26 @@ class Net {
    * called manually.
    */
   void ShareWeights();
+  /**
+   * @brief Moves the data and the diffs of all learnable parameters into two
+   *        contiguous arenas, leaving the parameter blobs as views into them.
+   *
+   * Note: this is called by Net::Init if flat_params is set, and must run
+   * after ShareWeights, as sharers see the arenas through their owners.
+   */
+  void FlattenParams();
 
   /**
    * @brief For an already initialized net, implicitly copies (i.e., using no
    *        additional memory) the pre-trained layers from another Net.
    */
   void ShareTrainedLayersWith(const Net* other);
+  /**
+   * @brief Gives the parameters data of their own, copied from the data they
+   *        share with other nets (see WeightRegistry); shared blobs within
+   *        the net keep sharing with their owners.
+   */
+  void OwnParamData();
   // For an already initialized net, CopyTrainedLayersFrom() copies the already
   // trained layers from another net parameter instance.
   /**
@@ -178,6 +193,23 @@ class Net {
   inline const vector<Blob<Dtype>*>& learnable_params() const {
     return learnable_params_;
   }
+  /// @brief returns whether the learnable parameters live in flat arenas
+  inline bool has_flat_params() const { return flat_params_ != NULL; }
+  /// @brief returns the blob whose data and diff are the arenas, if any
+  inline const shared_ptr<Blob<Dtype> >& flat_params() const {
+    return flat_params_;
+  }
+  /// @brief returns the total count of the learnable parameters
+  inline int flat_count() const {
+    return has_flat_params() ? flat_params_->count() : 0;
+  }
+  /**
+   * @brief returns the arenas of the learnable parameters, in the order of
+   *        learnable_params(). The data or diff of every parameter is first
+   *        brought to the CPU and marked as modified.
+   */
+  Dtype* mutable_flat_cpu_data();
+  Dtype* mutable_flat_cpu_diff();
   /// @brief returns the learnable parameter learning rate multipliers
   inline const vector<float>& params_lr() const { return params_lr_; }
   inline const vector<bool>& has_params_lr() const { return has_params_lr_; }
@@ -192,6 +224,10 @@ class Net {
     return param_names_index_;
   }
   inline const vector<int>& param_owners() const { return param_owners_; }
+  /// @brief returns the (layer, blob) index of each parameter
+  inline const vector<pair<int, int> >& param_layer_indices() const {
+    return param_layer_indices_;
+  }
   inline const vector<string>& param_display_names() const {
     return param_display_names_;
   }
@@ -242,6 +278,29 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /// @brief The forward and backward pass of layers in [start, end], without
+  ///        checkpointing.
+  Dtype ForwardLayers(int start, int end);
+  void BackwardLayers(int start, int end);
+  /// @brief The memory holding the data of each blob; the tops of split
+  ///        layers count as the data of their bottom.
+  void MapDataMemory(map<const Blob<Dtype>*, const void*>* data_memory) const;
+
+  /// @brief Builds the schedulers that run independent layers concurrently.
+  void InitLayerSchedulers(int num_threads);
+  /// @brief Whether the layer schedulers should run the current pass.
+  bool use_layer_schedulers() const;
+
+  /// @brief Splits the net into segments at the checkpoint layers and picks
+  ///        the blobs to free and the layers to recompute in each.
+  void InitCheckpoints(const NetParameter& param);
+  /// @brief The last layer of a checkpoint segment.
+  int segment_end(int segment) const;
+  /// @brief Recomputes the freed blobs of a segment, up to layer end.
+  void RecomputeSegment(int segment, int end);
+  /// @brief Frees the recomputable data (and diffs) of a segment.
+  void ReleaseSegment(int segment, bool release_diff);
+
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
@@ -302,12 +361,35 @@ class Net {
   /// the weight decay multipliers for learnable_params_
   vector<float> params_weight_decay_;
   vector<bool> has_params_decay_;
+  /// The contiguous data and diff arenas of learnable_params_, if flattened
+  shared_ptr<Blob<Dtype> > flat_params_;
+  /// Whether Forward may write parameters, e.g. the statistics of BatchNorm
+  /// in TRAIN, and so runs as an update (see WeightRegistry)
+  bool forward_writes_params_;
+  /// Run the layers in dependency order on layer_pool_, if layer_threads is
+  /// set; layer_losses_ collects the forward losses of each layer.
+  shared_ptr<ThreadPool> layer_pool_;
+  shared_ptr<DagScheduler> forward_scheduler_;
+  shared_ptr<DagScheduler> backward_scheduler_;
+  vector<Dtype> layer_losses_;
+  /// The first layer of each checkpoint segment, if checkpointing; for each
+  /// segment, the layers rerun in Backward, the blobs whose data and diff
+  /// are freed, and whether they currently are
+  vector<int> segment_begins_;
+  vector<vector<int> > segment_recompute_;
+  vector<vector<Blob<Dtype>*> > segment_data_;
+  vector<vector<Blob<Dtype>*> > segment_diff_;
+  vector<bool> segment_released_;
   /// The bytes of memory used by this net
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
   /// The root net that actually holds the shared layers in data parallelism
   const Net* const root_net_;
+
+ private:
+  class LayerTask;
+
   DISABLE_COPY_AND_ASSIGN(Net);
 };
 
@@ -0,0 +1,96 @@
+#ifndef CAFFE_NET_PIPELINE_HPP_
+#define CAFFE_NET_PIPELINE_HPP_
+
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/ring_queue.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Runs the forward pass of a net as a pipeline: the layers are split
+ *        into consecutive stages, each run by its own thread, so that
+ *        consecutive micro-batches are in different stages at the same time.
+ *
+ * Each micro-batch in flight needs its own activations, so the pipeline
+ * holds one replica of the net per slot, all sharing the parameters of
+ * net(); load trained weights into net() and every slot sees them. Slots
+ * move between the stages through bounded queues, in submission order:
+ *
+ *   int slot = pipeline.Acquire();
+ *   // fill pipeline.net(slot)->input_blobs()
+ *   pipeline.Submit(slot);
+ *   ...
+ *   slot = pipeline.Collect();
+ *   // read pipeline.net(slot)->output_blobs()
+ *   pipeline.Release(slot);
+ *
+ * There are num_stages + 1 slots, so that the caller can fill or read one
+ * while every stage is busy. Only the forward pass of TEST nets is pipelined:
+ * in TRAIN, layers such as BatchNorm update their shared blobs in Forward.
+ */
+template <typename Dtype>
+class NetPipeline {
+ public:
+  /**
+   * @brief Builds the replicas of the net and starts the stages.
+   *
+   * @param layer_times the forward time of each layer, e.g. as reported by
+   *        `caffe time`, to balance the stages by; if empty, the layers are
+   *        timed on net().
+   */
+  NetPipeline(const NetParameter& param, int num_stages,
+      const vector<double>& layer_times = vector<double>());
+  ~NetPipeline();
+
+  /// @brief The net whose parameters all slots share.
+  inline Net<Dtype>* net() const { return nets_[0].get(); }
+  inline Net<Dtype>* net(int slot) const { return nets_[slot].get(); }
+  inline int num_slots() const { return nets_.size(); }
+  inline int num_stages() const { return stage_begins_.size(); }
+  /// @brief The index of the first layer of each stage.
+  inline const vector<int>& stage_begins() const { return stage_begins_; }
+
+  /// @brief Blocks until a slot is free, and returns it for filling.
+  int Acquire();
+  /// @brief Starts the forward pass of a filled slot.
+  void Submit(int slot);
+  /// @brief Blocks until the oldest submitted slot is through all stages,
+  ///        and returns it.
+  int Collect();
+  /// @brief The loss of the last forward pass of a collected slot.
+  inline Dtype loss(int slot) const { return losses_[slot]; }
+  /// @brief Returns a collected slot to the free ones.
+  void Release(int slot);
+
+  /**
+   * @brief Splits layers with the given times into at most num_stages
+   *        consecutive, nonempty stages, minimizing the time of the slowest
+   *        one. Returns the index of the first layer of each stage.
+   */
+  static vector<int> Partition(const vector<double>& layer_times,
+      int num_stages);
+
+ private:
+  class Stage;
+
+  // Times each layer of net() over a few forward passes.
+  vector<double> ProfileLayers();
+
+  vector<shared_ptr<Net<Dtype> > > nets_;
+  vector<int> stage_begins_;
+  vector<Dtype> losses_;
+  // queues_[s] feeds stage s; the last queue holds finished slots.
+  vector<shared_ptr<RingQueue<int> > > queues_;
+  RingQueue<int> free_;
+  vector<shared_ptr<Stage> > stages_;
+
+  DISABLE_COPY_AND_ASSIGN(NetPipeline);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_NET_PIPELINE_HPP_
@@ -2,6 +2,8 @@
 #define CAFFE_SGD_SOLVERS_HPP_
 
 #include <string>
+#include <typeinfo>
+#include <utility>
 #include <vector>
 
 #include "caffe/solver.hpp"
@@ -10,6 +12,7 @@
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/io.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
@@ -46,7 +49,38 @@ class SGDSolver : public Solver<Dtype> {
   virtual void Normalize(int param_id);
   virtual void Regularize(int param_id);
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  /**
+   * @brief Computes the update value of elements [begin, end) of a parameter
+   *        on the CPU, reading and writing the diff and the history once.
+   *
+   * Uses the pointers gathered by GatherCPUPointers(param_id), so that
+   * disjoint ranges can be updated on different threads.
+   */
+  virtual void ComputeUpdateValueCPU(int param_id, Dtype rate, int begin,
+      int end);
+  /**
+   * @brief The class whose ComputeUpdateValueCPU, Normalize and Regularize
+   *        match ApplyUpdateCPU.
+   *
+   * ApplyUpdate only takes the fused CPU path for solvers of exactly this
+   * class, so that a subclass overriding ComputeUpdateValue (or Normalize or
+   * Regularize) alone still has it called. A subclass that keeps the fused
+   * path consistent with its overrides returns its own class.
+   */
+  virtual const std::type_info& fused_update_type() const {
+    return typeid(SGDSolver<Dtype>);
+  }
+  /// @brief The scale Normalize applies to the accumulated gradients.
+  virtual Dtype AccumNormalization();
   virtual void ClipGradients();
+  /**
+   * @brief Normalizes, regularizes, computes the update value and updates
+   *        all parameters in CPU mode, one cache-sized chunk at a time, so
+   *        that each chunk is read from memory once.
+   */
+  void ApplyUpdateCPU(Dtype rate);
+  void UpdateChunk(int chunk, Dtype rate, Dtype normalization, bool l1);
+  void GatherCPUPointers(int param_id);
   virtual void SnapshotSolverState(const string& model_filename);
   virtual void SnapshotSolverStateToBinaryProto(const string& model_filename);
   virtual void SnapshotSolverStateToHDF5(const string& model_filename);
@@ -57,6 +91,15 @@ class SGDSolver : public Solver<Dtype> {
   // temp maintains other information that might be needed in computation
   //   of gradients/updates and is not needed in snapshots
   vector<shared_ptr<Blob<Dtype> > > history_, update_, temp_;
+  // CPU pointers to the data and diff of each learnable param and to each
+  // history blob, gathered on the solver thread for ComputeUpdateValueCPU.
+  vector<Dtype*> data_ptrs_, diff_ptrs_, history_ptrs_;
+  // The param_id and offset at which each chunk of ApplyUpdateCPU starts.
+  vector<pair<int, int> > update_chunks_;
+  shared_ptr<ThreadPool> update_pool_;
+
+ private:
+  class UpdateTask;
 
   DISABLE_COPY_AND_ASSIGN(SGDSolver);
 };
@@ -72,6 +115,11 @@ class NesterovSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeUpdateValueCPU(int param_id, Dtype rate, int begin,
+      int end);
+  virtual const std::type_info& fused_update_type() const {
+    return typeid(NesterovSolver<Dtype>);
+  }
 
   DISABLE_COPY_AND_ASSIGN(NesterovSolver);
 };
@@ -87,6 +135,11 @@ class AdaGradSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeUpdateValueCPU(int param_id, Dtype rate, int begin,
+      int end);
+  virtual const std::type_info& fused_update_type() const {
+    return typeid(AdaGradSolver<Dtype>);
+  }
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with AdaGrad.";
@@ -107,6 +160,11 @@ class RMSPropSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeUpdateValueCPU(int param_id, Dtype rate, int begin,
+      int end);
+  virtual const std::type_info& fused_update_type() const {
+    return typeid(RMSPropSolver<Dtype>);
+  }
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with RMSProp.";
@@ -131,6 +189,11 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
  protected:
   void AdaDeltaPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeUpdateValueCPU(int param_id, Dtype rate, int begin,
+      int end);
+  virtual const std::type_info& fused_update_type() const {
+    return typeid(AdaDeltaSolver<Dtype>);
+  }
 
   DISABLE_COPY_AND_ASSIGN(AdaDeltaSolver);
 };
@@ -155,6 +218,11 @@ class AdamSolver : public SGDSolver<Dtype> {
  protected:
   void AdamPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeUpdateValueCPU(int param_id, Dtype rate, int begin,
+      int end);
+  virtual const std::type_info& fused_update_type() const {
+    return typeid(AdamSolver<Dtype>);
+  }
 
   DISABLE_COPY_AND_ASSIGN(AdamSolver);
 };
@@ -178,9 +246,12 @@ class DistroSolver : public SGDSolver<Dtype> {
   virtual int SetNet(istream *instream);
   virtual void SetNormalizeScale(int scale);
 
-  virtual void Normalize(int param_id);
-
  protected:
+  virtual Dtype AccumNormalization();
+  virtual const std::type_info& fused_update_type() const {
+    return typeid(DistroSolver<Dtype>);
+  }
+
   int merged_cnt;
   int normalize_scale;
   shared_ptr<Net<Dtype> > pair_net;
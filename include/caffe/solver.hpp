@@ -2,11 +2,14 @@
 #define CAFFE_SOLVER_HPP_
 #include <boost/function.hpp>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "caffe/net.hpp"
 #include "caffe/solver_factory.hpp"
 
+namespace boost { class thread; }
+
 #include <iostream>
 using std::ostream;
 using std::istream;
@@ -81,7 +84,10 @@ class Solver {
   // function that produces a SolverState protocol buffer that needs to be
   // written to disk together with the learned net.
   void Snapshot();
-  virtual ~Solver() {}
+  // Blocks until the snapshot being written in the background, if any, is
+  // on disk.
+  void WaitForSnapshot();
+  virtual ~Solver();
   inline const SolverParameter& param() const { return param_; }
   inline shared_ptr<Net<Dtype> > net() { return net_; }
   inline const vector<shared_ptr<Net<Dtype> > >& test_nets() {
@@ -117,6 +123,10 @@ class Solver {
   string SnapshotFilename(const string extension);
   string SnapshotToBinaryProto();
   string SnapshotToHDF5();
+  // Writes proto to filename once the snapshot is staged, on a background
+  // thread with snapshot_async; the solver state is written this way too.
+  void WriteSnapshotProto(shared_ptr<const google::protobuf::Message> proto,
+      const string& filename);
   // The test routine
   void TestAll();
   void Test(const int test_net_id = 0);
@@ -135,6 +145,17 @@ class Solver {
   vector<Dtype> losses_;
   Dtype smoothed_loss_;
 
+  // The protos of the snapshot being staged, with their files, and the
+  // thread writing the last snapshot.
+  vector<pair<shared_ptr<const google::protobuf::Message>, string> >
+      snapshot_protos_;
+  shared_ptr<boost::thread> snapshot_thread_;
+  // For incremental snapshots: copies of the params of the last full
+  // snapshot, by layer and blob, its file, and the snapshots taken since.
+  vector<shared_ptr<Blob<Dtype> > > snapshot_base_;
+  string snapshot_base_file_;
+  int snapshots_since_full_;
+
 
   // The root solver that holds root nets (actually containing shared layers)
   // in data parallelism
@@ -4,6 +4,7 @@
 #include <cstdlib>
 
 #include "caffe/common.hpp"
+#include "caffe/util/host_allocator.hpp"
 
 namespace caffe {
 
@@ -12,27 +13,31 @@ namespace caffe {
 // The improvement in performance seems negligible in the single GPU case,
 // but might be more significant for parallel training. Most importantly,
 // it improved stability for large models on many GPUs.
-inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
+// Otherwise the HostAllocator serves it, from its pool if selected.
+inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda,
+    bool* use_pool) {
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
     CUDA_CHECK(cudaMallocHost(ptr, size));
     *use_cuda = true;
+    *use_pool = false;
     return;
   }
 #endif
-  *ptr = malloc(size);
+  *ptr = HostAllocator::Allocate(size, use_pool);
   *use_cuda = false;
   CHECK(*ptr) << "host allocation of size " << size << " failed";
 }
 
-inline void CaffeFreeHost(void* ptr, bool use_cuda) {
+inline void CaffeFreeHost(void* ptr, size_t size, bool use_cuda,
+    bool use_pool) {
 #ifndef CPU_ONLY
   if (use_cuda) {
     CUDA_CHECK(cudaFreeHost(ptr));
     return;
   }
 #endif
-  free(ptr);
+  HostAllocator::Free(ptr, size, use_pool);
 }
 
 
@@ -46,12 +51,14 @@ class SyncedMemory {
  public:
   SyncedMemory()
       : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(0), head_(UNINITIALIZED),
-        own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
-        gpu_device_(-1) {}
+        own_cpu_data_(false), cpu_malloc_use_cuda_(false),
+        cpu_malloc_use_pool_(false), own_gpu_data_(false), gpu_device_(-1),
+        version_(0) {}
   explicit SyncedMemory(size_t size)
       : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
-        own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
-        gpu_device_(-1) {}
+        own_cpu_data_(false), cpu_malloc_use_cuda_(false),
+        cpu_malloc_use_pool_(false), own_gpu_data_(false), gpu_device_(-1),
+        version_(0) {}
   ~SyncedMemory();
   const void* cpu_data();
   void set_cpu_data(void* data);
@@ -62,6 +69,18 @@ class SyncedMemory {
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
   SyncedHead head() { return head_; }
   size_t size() { return size_; }
+  /**
+   * @brief A counter bumped on every mutable access or set_*_data call, so
+   *        that derived representations of the contents (e.g. a compressed
+   *        copy of a weight matrix) can tell whether they are stale.
+   */
+  size_t version() const { return version_; }
+  /**
+   * @brief Frees the host and device memory, keeping the size; the next
+   *        access allocates it again, zero-filled. Memory set from outside
+   *        with set_*_data is left alone.
+   */
+  void Release();
 
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);
@@ -76,8 +95,10 @@ class SyncedMemory {
   SyncedHead head_;
   bool own_cpu_data_;
   bool cpu_malloc_use_cuda_;
+  bool cpu_malloc_use_pool_;
   bool own_gpu_data_;
   int gpu_device_;
+  size_t version_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
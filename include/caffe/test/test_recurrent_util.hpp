@@ -0,0 +1,78 @@
+#ifndef CAFFE_TEST_RECURRENT_UTIL_H_
+#define CAFFE_TEST_RECURRENT_UTIL_H_
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Checks that a recurrent layer of type LayerType set up by layer_param,
+// which enables the fused CPU path, computes the same outputs and gradients
+// as the unrolled net it replaces. The bottom blobs are (x, cont, x_static).
+template <template <typename> class LayerType, typename Dtype>
+void CheckFusedMatchesUnrolled(const LayerParameter& layer_param,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ASSERT_EQ(3, bottom.size());
+  LayerParameter unrolled_param(layer_param);
+  unrolled_param.mutable_recurrent_param()->set_fused_cpu(false);
+  Blob<Dtype> unrolled_top;
+  vector<Blob<Dtype>*> unrolled_top_vec(1, &unrolled_top);
+  Blob<Dtype> bottom_diff, static_diff;
+  Caffe::set_random_seed(1701);
+  LayerType<Dtype> unrolled_layer(unrolled_param);
+  unrolled_layer.SetUp(bottom, unrolled_top_vec);
+  Caffe::set_random_seed(1701);
+  LayerType<Dtype> layer(layer_param);
+  layer.SetUp(bottom, top);
+
+  const Dtype kEpsilon = 1e-5;
+  vector<bool> propagate_down(3, true);
+  propagate_down[1] = false;
+  unrolled_layer.Forward(bottom, unrolled_top_vec);
+  Blob<Dtype> top_diff(unrolled_top.shape());
+  FillerParameter filler_param;
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(&top_diff);
+  caffe_copy(top_diff.count(), top_diff.cpu_data(),
+             unrolled_top.mutable_cpu_diff());
+  unrolled_layer.Backward(unrolled_top_vec, propagate_down, bottom);
+  bottom_diff.CopyFrom(*bottom[0], true, true);
+  static_diff.CopyFrom(*bottom[2], true, true);
+
+  layer.Forward(bottom, top);
+  for (int i = 0; i < unrolled_top.count(); ++i) {
+    EXPECT_NEAR(unrolled_top.cpu_data()[i], top[0]->cpu_data()[i], kEpsilon);
+  }
+  caffe_copy(unrolled_top.count(), unrolled_top.cpu_diff(),
+             top[0]->mutable_cpu_diff());
+  layer.Backward(top, propagate_down, bottom);
+  for (int i = 0; i < bottom_diff.count(); ++i) {
+    EXPECT_NEAR(bottom_diff.cpu_diff()[i], bottom[0]->cpu_diff()[i],
+                kEpsilon);
+  }
+  for (int i = 0; i < static_diff.count(); ++i) {
+    EXPECT_NEAR(static_diff.cpu_diff()[i], bottom[2]->cpu_diff()[i],
+                kEpsilon);
+  }
+  ASSERT_EQ(unrolled_layer.blobs().size(), layer.blobs().size());
+  for (int j = 0; j < layer.blobs().size(); ++j) {
+    const Blob<Dtype>& expected = *unrolled_layer.blobs()[j];
+    const Blob<Dtype>& actual = *layer.blobs()[j];
+    ASSERT_EQ(expected.count(), actual.count());
+    for (int i = 0; i < actual.count(); ++i) {
+      EXPECT_NEAR(expected.cpu_data()[i], actual.cpu_data()[i], kEpsilon);
+      EXPECT_NEAR(expected.cpu_diff()[i], actual.cpu_diff()[i], kEpsilon)
+          << "param " << j << "; i = " << i;
+    }
+  }
+}
+
+}  // namespace caffe
+
+#endif  // CAFFE_TEST_RECURRENT_UTIL_H_
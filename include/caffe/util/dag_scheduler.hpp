@@ -0,0 +1,77 @@
+#ifndef CAFFE_UTIL_DAG_SCHEDULER_HPP_
+#define CAFFE_UTIL_DAG_SCHEDULER_HPP_
+
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/ring_queue.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Runs the nodes of a directed acyclic graph on a ThreadPool, each
+ *        as soon as the nodes it depends on have finished.
+ *
+ * The pool threads share one queue of ready nodes, so that a thread that
+ * finishes a node picks up whichever node became ready next, e.g. from
+ * another branch of the graph.
+ */
+class DagScheduler {
+ public:
+  /**
+   * @param predecessors the nodes each node depends on
+   * @param pool the threads to run nodes on; a pool of size 0 runs them on
+   *        the calling thread
+   */
+  DagScheduler(const vector<vector<int> >& predecessors,
+      shared_ptr<ThreadPool> pool);
+
+  inline int num_nodes() const { return predecessors_.size(); }
+  inline const vector<int>& predecessors(int node) const {
+    return predecessors_[node];
+  }
+
+  /**
+   * @brief Runs task->Run(node, thread) for the nodes in [begin, end],
+   *        ignoring dependencies on nodes outside of it; blocks until done.
+   */
+  void Run(int begin, int end, ParallelTask* task);
+
+  /**
+   * @brief The dependencies between steps that access shared resources
+   *        (e.g. the memory of blobs): each step depends on the last earlier
+   *        step that writes a resource it reads or writes, and on the steps
+   *        since then that read a resource it writes.
+   *
+   * @param order the steps, in the order they must appear to run in
+   * @param reads the resources each step reads, indexed by step
+   * @param writes the resources each step writes, indexed by step
+   * @return the predecessors of each step
+   */
+  static vector<vector<int> > Dependencies(const vector<int>& order,
+      const vector<vector<const void*> >& reads,
+      const vector<vector<const void*> >& writes);
+
+ private:
+  class Worker;
+
+  vector<vector<int> > predecessors_;
+  vector<vector<int> > successors_;
+  shared_ptr<ThreadPool> pool_;
+  // The state of the current run.
+  int begin_;
+  int end_;
+  boost::scoped_array<boost::atomic<int> > pending_;
+  boost::atomic<int> remaining_;
+  RingQueue<int> ready_;
+
+  DISABLE_COPY_AND_ASSIGN(DagScheduler);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DAG_SCHEDULER_HPP_
@@ -0,0 +1,72 @@
+#ifndef CAFFE_UTIL_DATUM_VIEW_HPP_
+#define CAFFE_UTIL_DATUM_VIEW_HPP_
+
+#include <stdint.h>
+
+#include <cstddef>
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief A Datum read from a db, which for plain uint8 Datums only parses the
+ *        header fields and points at the pixel bytes inside the serialized
+ *        record, e.g. in the db's mapped pages, instead of copying them.
+ *
+ * Encoded and float Datums are parsed into an owned Datum, available through
+ * datum(). A view must not outlive the bytes it was parsed from.
+ */
+class DatumView {
+ public:
+  DatumView()
+      : is_view_(false), channels_(0), height_(0), width_(0), label_(0),
+        data_(NULL), data_size_(0) {}
+
+  /// @brief Parses a serialized Datum, in place if possible.
+  void Parse(const char* bytes, size_t size);
+  /// @brief Parses a serialized Datum into the owned Datum.
+  void Parse(const string& bytes);
+
+  /// @brief Whether the pixels are viewed in place (uint8, not encoded).
+  inline bool is_view() const { return is_view_; }
+  inline const Datum& datum() const {
+    DCHECK(!is_view_);
+    return datum_;
+  }
+
+  inline int channels() const {
+    return is_view_ ? channels_ : datum_.channels();
+  }
+  inline int height() const { return is_view_ ? height_ : datum_.height(); }
+  inline int width() const { return is_view_ ? width_ : datum_.width(); }
+  inline int label() const { return is_view_ ? label_ : datum_.label(); }
+  /// @brief The viewed uint8 pixels, channels() x height() x width().
+  inline const uint8_t* data() const {
+    DCHECK(is_view_);
+    return data_;
+  }
+  inline size_t data_size() const { return data_size_; }
+
+ private:
+  // Reads the fields of a uint8 Datum without copying the pixels; returns
+  // false if the Datum needs a full parse (encoded, float or malformed).
+  bool ParseInPlace(const char* bytes, size_t size);
+
+  Datum datum_;
+  bool is_view_;
+  int channels_;
+  int height_;
+  int width_;
+  int label_;
+  const uint8_t* data_;
+  size_t data_size_;
+
+  DISABLE_COPY_AND_ASSIGN(DatumView);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DATUM_VIEW_HPP_
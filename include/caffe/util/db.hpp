@@ -19,6 +19,17 @@ class Cursor {
   virtual string key() = 0;
   virtual string value() = 0;
   virtual bool valid() = 0;
+  /**
+   * @brief Points data at the current value without copying it, if the
+   *        backend supports that. The view stays valid as long as the cursor
+   *        (e.g. the cursor's read transaction), even after the cursor moves.
+   */
+  virtual bool value_view(const char** data, size_t* size) { return false; }
+  /**
+   * @brief Makes every pass from SeekToFirst visit the records in a new
+   *        random order, if the backend supports random access.
+   */
+  virtual bool Shuffle(unsigned int seed) { return false; }
 
   DISABLE_COPY_AND_ASSIGN(Cursor);
 };
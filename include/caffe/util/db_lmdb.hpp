@@ -35,6 +35,12 @@ class LMDBCursor : public Cursor {
         mdb_value_.mv_size);
   }
   virtual bool valid() { return valid_; }
+  // Values live in the pages mapped for the cursor's read-only transaction.
+  virtual bool value_view(const char** data, size_t* size) {
+    *data = static_cast<const char*>(mdb_value_.mv_data);
+    *size = mdb_value_.mv_size;
+    return true;
+  }
 
  private:
   void Seek(MDB_cursor_op op) {
@@ -0,0 +1,127 @@
+#ifndef CAFFE_UTIL_DB_MMAP_HPP
+#define CAFFE_UTIL_DB_MMAP_HPP
+
+#include <stdint.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "caffe/util/db.hpp"
+
+namespace caffe { namespace db {
+
+/**
+ * A directory of append-only shard files, read through mmap.
+ *
+ * Each shard (shard_00000, shard_00001, ...) holds the keys and values of its
+ * records back to back, followed by a fixed-size index entry per record and a
+ * footer:
+ *
+ *   record 0 key, record 0 value, record 1 key, ...
+ *   padding to 8 bytes
+ *   MmapIndexEntry[count]
+ *   MmapFooter
+ *
+ * so any record can be located in O(1) without reading the others. The files
+ * use the byte order of the machine that wrote them. New shards are started
+ * after kMmapShardBytes so that each mapping stays small enough for 32-bit
+ * address spaces.
+ */
+struct MmapIndexEntry {
+  uint64_t offset;
+  uint32_t key_size;
+  uint32_t value_size;
+};
+
+struct MmapFooter {
+  uint64_t index_offset;
+  uint64_t count;
+  char magic[8];
+};
+
+const size_t kMmapShardBytes = 256 << 20;
+
+class MmapDB;
+
+class MmapCursor : public Cursor {
+ public:
+  explicit MmapCursor(const MmapDB* db);
+  virtual void SeekToFirst();
+  virtual void Next();
+  virtual string key();
+  virtual string value();
+  virtual bool valid() { return position_ < order_.size(); }
+  virtual bool value_view(const char** data, size_t* size);
+  virtual bool Shuffle(unsigned int seed);
+
+ private:
+  // Looks up the record at the current position.
+  const MmapIndexEntry& entry(const char** shard) const;
+
+  const MmapDB* db_;
+  // The records in visiting order, a new permutation every pass if shuffled.
+  vector<uint32_t> order_;
+  size_t position_;
+  shared_ptr<Caffe::RNG> rng_;
+};
+
+class MmapTransaction : public Transaction {
+ public:
+  explicit MmapTransaction(MmapDB* db) : db_(db) { }
+  virtual void Put(const string& key, const string& value);
+  virtual void Commit();
+
+ private:
+  MmapDB* db_;
+
+  DISABLE_COPY_AND_ASSIGN(MmapTransaction);
+};
+
+class MmapDB : public DB {
+ public:
+  explicit MmapDB(size_t max_shard_bytes = kMmapShardBytes)
+    : num_records_(0), max_shard_bytes_(max_shard_bytes), file_(NULL),
+      num_shards_(0), shard_bytes_(0) { }
+  virtual ~MmapDB() { Close(); }
+  virtual void Open(const string& source, Mode mode);
+  virtual void Close();
+  virtual MmapCursor* NewCursor();
+  virtual MmapTransaction* NewTransaction();
+
+  inline size_t num_records() const { return num_records_; }
+  inline int num_shards() const { return shards_.size(); }
+
+ private:
+  friend class MmapCursor;
+  friend class MmapTransaction;
+
+  struct Shard {
+    const char* data;
+    size_t size;
+    const MmapIndexEntry* index;
+  };
+
+  void MapShard(const string& filename);
+  // Writing: appends a record to the open shard, and writes its index.
+  void Append(const string& key, const string& value);
+  void Flush();
+  void FinishShard();
+
+  string source_;
+  // The mapped shards, and the number of records up to the end of each.
+  vector<Shard> shards_;
+  vector<size_t> shard_ends_;
+  size_t num_records_;
+  // The writer's open shard, its number and size, and its index so far.
+  size_t max_shard_bytes_;
+  FILE* file_;
+  int num_shards_;
+  uint64_t shard_bytes_;
+  vector<MmapIndexEntry> index_;
+};
+
+}  // namespace db
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DB_MMAP_HPP
@@ -0,0 +1,120 @@
+#ifndef CAFFE_UTIL_HALF_HPP_
+#define CAFFE_UTIL_HALF_HPP_
+
+#include <stdint.h>
+
+#include <cstring>
+#include <string>
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+inline uint32_t float_bits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+inline float bits_float(uint32_t bits) {
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/// @brief Rounds a float to the nearest IEEE 754 half, ties to even.
+inline uint16_t float_to_fp16(float value) {
+  uint32_t f = float_bits(value);
+  const uint32_t sign = f & 0x80000000u;
+  f ^= sign;
+  uint32_t h;
+  if (f >= 0x47800000u) {
+    // Too large for a half: infinity, or a quiet NaN.
+    h = f > 0x7f800000u ? 0x7e00 : 0x7c00;
+  } else if (f < 0x38800000u) {
+    // Subnormal half or zero; adding 0.5 lets the FPU do the rounding.
+    h = float_bits(bits_float(f) + 0.5f) - 0x3f000000u;
+  } else {
+    // Rebias the exponent and round the 13 dropped mantissa bits.
+    const uint32_t mantissa_odd = (f >> 13) & 1;
+    f += 0xc8000fffu + mantissa_odd;
+    h = f >> 13;
+  }
+  return static_cast<uint16_t>(h | (sign >> 16));
+}
+
+inline float fp16_to_float(uint16_t half) {
+  const uint32_t shifted_exponent = 0x7c00u << 13;
+  uint32_t f = (half & 0x7fffu) << 13;
+  const uint32_t exponent = f & shifted_exponent;
+  f += (127 - 15) << 23;
+  if (exponent == shifted_exponent) {
+    f += (128 - 16) << 23;  // infinity or NaN
+  } else if (exponent == 0) {
+    // Subnormal half: renormalize through the FPU.
+    f += 1 << 23;
+    f = float_bits(bits_float(f) - bits_float(113u << 23));
+  }
+  return bits_float(f | ((half & 0x8000u) << 16));
+}
+
+/// @brief Rounds a float to the nearest bfloat16, ties to even.
+inline uint16_t float_to_bf16(float value) {
+  uint32_t f = float_bits(value);
+  if ((f & 0x7fffffffu) > 0x7f800000u) {
+    return static_cast<uint16_t>((f >> 16) | 0x40);  // keep NaNs quiet
+  }
+  f += 0x7fffu + ((f >> 16) & 1);
+  return static_cast<uint16_t>(f >> 16);
+}
+
+inline float bf16_to_float(uint16_t half) {
+  return bits_float(static_cast<uint32_t>(half) << 16);
+}
+
+inline uint16_t float_to_half(float value, BlobProto::Precision precision) {
+  return precision == BlobProto::BFLOAT16 ?
+      float_to_bf16(value) : float_to_fp16(value);
+}
+
+inline float half_to_float(uint16_t half, BlobProto::Precision precision) {
+  return precision == BlobProto::BFLOAT16 ?
+      bf16_to_float(half) : fp16_to_float(half);
+}
+
+/// @brief The number of values in the little-endian 16-bit bytes of a
+///        BlobProto half_data or half_diff field.
+inline int half_count(const std::string& bytes) {
+  return bytes.size() / 2;
+}
+
+/// @brief The i-th value of a BlobProto half_data or half_diff field.
+inline float half_value(const std::string& bytes, int i,
+    BlobProto::Precision precision) {
+  const unsigned char* b = reinterpret_cast<const unsigned char*>(
+      bytes.data()) + 2 * i;
+  return half_to_float(static_cast<uint16_t>(b[0] | (b[1] << 8)), precision);
+}
+
+/// @brief Appends value to a BlobProto half_data or half_diff field.
+inline void append_half(float value, BlobProto::Precision precision,
+    std::string* bytes) {
+  const uint16_t half = float_to_half(value, precision);
+  bytes->push_back(static_cast<char>(half & 0xff));
+  bytes->push_back(static_cast<char>(half >> 8));
+}
+
+/**
+ * @brief Rewrites the data and diff of a BlobProto in the given precision:
+ *        FLOAT16 and BFLOAT16 move them to half_data and half_diff, FLOAT
+ *        moves them back to data and diff. Compressed sparse rows stay
+ *        compressed.
+ */
+void ConvertBlobPrecision(BlobProto* blob, BlobProto::Precision precision);
+
+/// @brief ConvertBlobPrecision for the blobs of every layer of a net.
+void ConvertNetPrecision(NetParameter* net, BlobProto::Precision precision);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HALF_HPP_
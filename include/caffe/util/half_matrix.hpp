@@ -0,0 +1,78 @@
+#ifndef CAFFE_UTIL_HALF_MATRIX_HPP_
+#define CAFFE_UTIL_HALF_MATRIX_HPP_
+
+#include <boost/weak_ptr.hpp>
+#include <stdint.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A 16-bit (fp16 or bfloat16) copy of a weight Blob, viewed as a
+ *        (rows x cols) matrix, with the products needed by the InnerProduct
+ *        and Convolution layers.
+ *
+ * The products expand cache-sized panels of rows back to Dtype and hand
+ * them to the BLAS, so that the weights stream from memory at half the
+ * bytes. As with SparseMatrix, the copy is rebuilt only when the weights
+ * change, and holds a weak reference to the memory it was built from.
+ */
+template <typename Dtype>
+class HalfMatrix {
+ public:
+  HalfMatrix()
+      : rows_(0), cols_(0), panel_rows_(0), precision_(BlobProto::FLOAT),
+        source_version_(0) {}
+
+  /**
+   * @brief Refreshes the 16-bit copy of weights if they changed since the
+   *        last call, and returns whether the precision is a 16-bit one,
+   *        i.e., whether the products should be used.
+   */
+  bool Update(const Blob<Dtype>& weights, const int rows,
+      const BlobProto::Precision precision);
+
+  inline bool active() const { return precision_ != BlobProto::FLOAT; }
+  inline int rows() const { return rows_; }
+  inline int cols() const { return cols_; }
+
+  /**
+   * @brief C = A[row_begin:row_end, :] * B, where B is (cols x N) and C is
+   *        ((row_end - row_begin) x N), all row-major.
+   */
+  void Multiply(const int row_begin, const int row_end, const int N,
+      const Dtype* B, Dtype* C);
+
+  /// @brief C = B * A^T, where B is (M x cols) and C is (M x rows).
+  void MultiplyTransposedLeft(const int M, const Dtype* B, Dtype* C);
+
+  /// @brief C = B * A, where B is (M x rows) and C is (M x cols).
+  void MultiplyLeft(const int M, const Dtype* B, Dtype* C);
+
+ private:
+  // Expands rows [row_begin, row_end) into panel_.
+  void ExpandRows(const int row_begin, const int row_end);
+
+  int rows_;
+  int cols_;
+  int panel_rows_;
+  BlobProto::Precision precision_;
+  std::vector<uint16_t> values_;
+  std::vector<Dtype> panel_;
+  // The weights this copy was built from, and their version at the time.
+  boost::weak_ptr<SyncedMemory> source_;
+  size_t source_version_;
+
+  DISABLE_COPY_AND_ASSIGN(HalfMatrix);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HALF_MATRIX_HPP_
@@ -2,7 +2,9 @@
 #ifndef CAFFE_UTIL_HDF5_H_
 #define CAFFE_UTIL_HDF5_H_
 
+#include <boost/thread.hpp>
 #include <string>
+#include <vector>
 
 #include "hdf5.h"
 #include "hdf5_hl.h"
@@ -11,6 +13,14 @@
 
 namespace caffe {
 
+/**
+ * @brief Returns the dimensions of a dataset without reading it, checking
+ *        that their number is in [min_dim, max_dim] and that the data are
+ *        numbers.
+ */
+std::vector<hsize_t> hdf5_get_nd_dataset_dims(
+    hid_t file_id, const char* dataset_name_, int min_dim, int max_dim);
+
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
@@ -21,6 +31,15 @@ void hdf5_load_nd_dataset(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
     Blob<Dtype>* blob);
 
+/**
+ * @brief Loads rows [row_begin, row_begin + num_rows) of a dataset, i.e. a
+ *        hyperslab along its first axis, reshaping blob accordingly.
+ */
+template <typename Dtype>
+void hdf5_load_nd_dataset_rows(
+    hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
+    hsize_t row_begin, hsize_t num_rows, Blob<Dtype>* blob);
+
 template <typename Dtype>
 void hdf5_save_nd_dataset(
     const hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob,
@@ -35,6 +54,13 @@ void hdf5_save_string(hid_t loc_id, const string& dataset_name,
 int hdf5_get_num_links(hid_t loc_id);
 string hdf5_get_name_by_idx(hid_t loc_id, int idx);
 
+/**
+ * @brief Serializes HDF5 calls from different threads, e.g. of the HDF5Data
+ *        prefetch threads and of snapshots, as the library is not in general
+ *        built thread-safe.
+ */
+boost::mutex& hdf5_mutex();
+
 }  // namespace caffe
 
 #endif   // CAFFE_UTIL_HDF5_H_
@@ -0,0 +1,68 @@
+#ifndef CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+#define CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+
+#include <stdint.h>
+
+#include <cstddef>
+
+namespace caffe {
+
+/// @brief Usage statistics of the pooled HostAllocator.
+struct HostAllocatorStats {
+  HostAllocatorStats()
+      : bytes_in_use(0), peak_bytes_in_use(0), bytes_cached(0),
+        allocations(0), hits(0) {}
+
+  /// @brief The fraction of allocations served from the pool.
+  inline double hit_rate() const {
+    return allocations > 0 ? static_cast<double>(hits) / allocations : 0;
+  }
+
+  // Bytes handed out and not yet freed, rounded up to their size class.
+  size_t bytes_in_use;
+  size_t peak_bytes_in_use;
+  // Bytes of freed buffers kept for reuse.
+  size_t bytes_cached;
+  uint64_t allocations;
+  uint64_t hits;
+};
+
+/**
+ * @brief Allocates the host memory of SyncedMemory.
+ *
+ * MALLOC uses plain malloc. POOL rounds sizes up to one of four size classes
+ * per power of two, aligns buffers to 64 bytes for SIMD, and keeps freed
+ * buffers for reuse by later allocations of the same class, so that nets
+ * whose blobs are reshaped to varying input sizes, or nets created one
+ * after the other, stop going through malloc. The pool is shared by all
+ * threads and nets of the process.
+ */
+class HostAllocator {
+ public:
+  enum Type { MALLOC, POOL };
+
+  /// @brief Selects the allocator of subsequent allocations.
+  static void set_type(Type type);
+  static Type type();
+  /// @brief Bounds the bytes the pool caches; larger frees go back to the
+  ///        system. The default of 0 means no bound.
+  static void set_max_bytes_cached(size_t bytes);
+
+  /// @brief Allocates size bytes; sets pooled if the pool served them.
+  static void* Allocate(size_t size, bool* pooled);
+  /// @brief Frees a buffer of the given size returned by Allocate.
+  static void Free(void* ptr, size_t size, bool pooled);
+  /// @brief Returns the buffers cached by the pool to the system.
+  static void ReleaseCached();
+
+  static HostAllocatorStats stats();
+  /// @brief The size class the pool rounds an allocation of size bytes to.
+  static size_t SizeClass(size_t size);
+
+ private:
+  HostAllocator() {}
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HOST_ALLOCATOR_HPP_
@@ -0,0 +1,56 @@
+#ifndef CAFFE_UTIL_IMAGE_CACHE_HPP_
+#define CAFFE_UTIL_IMAGE_CACHE_HPP_
+
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "caffe/common.hpp"
+
+namespace boost { class mutex; }
+
+namespace caffe {
+
+/**
+ * @brief A thread-safe LRU cache of decoded images, keyed by e.g. their path,
+ *        that holds at most a given number of bytes of pixels.
+ *
+ * Images are shared with the callers, which must not modify them in place.
+ */
+class ImageCache {
+ public:
+  explicit ImageCache(size_t capacity);
+
+  /// @brief Returns the cached image for key, or an empty Mat.
+  cv::Mat Get(const string& key);
+  /// @brief Caches an image, evicting the least recently used ones to fit.
+  void Put(const string& key, const cv::Mat& image);
+
+  /// @brief The bytes of pixels held.
+  size_t size() const;
+  int hits() const;
+  int misses() const;
+
+ private:
+  typedef std::list<std::pair<string, cv::Mat> > Entries;
+
+  // Most recently used first.
+  Entries entries_;
+  std::map<string, Entries::iterator> index_;
+  const size_t capacity_;
+  size_t size_;
+  int hits_;
+  int misses_;
+  shared_ptr<boost::mutex> mutex_;
+
+  DISABLE_COPY_AND_ASSIGN(ImageCache);
+};
+
+}  // namespace caffe
+
+#endif  // USE_OPENCV
+#endif  // CAFFE_UTIL_IMAGE_CACHE_HPP_
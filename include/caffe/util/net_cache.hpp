@@ -0,0 +1,54 @@
+#ifndef CAFFE_UTIL_NET_CACHE_HPP_
+#define CAFFE_UTIL_NET_CACHE_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief A process-wide cache of net definitions, so that nets built again
+ *        from the same definition (test nets, replicas, switching models
+ *        back and forth) skip parsing, upgrading, filtering and inserting
+ *        splits.
+ *
+ * Entries are keyed by a hash of the prototxt contents or of the serialized
+ * NetParameter, and kept with those bytes to match them on a hit, so an
+ * edited file is picked up on the next read. With a directory set, the
+ * definitions read from prototxt files are also stored there in binary form,
+ * with the prototxt and under the version of the cache format. Later
+ * processes load them instead of parsing text when the prototxt matches.
+ * Failing to store them only warns.
+ */
+class NetCache {
+ public:
+  /// @brief Reads and upgrades the NetParameter in a prototxt file.
+  static void ReadNetParams(const string& param_file, NetParameter* param);
+  /**
+   * @brief The NetParameter a Net is built from: param filtered by its
+   *        NetState, with split layers inserted.
+   */
+  static shared_ptr<const NetParameter> Compile(const NetParameter& param);
+  /// @brief The compiled NetParameter of a prototxt file, with state merged
+  ///        into the state of the file.
+  static shared_ptr<const NetParameter> Get(const string& param_file,
+      const NetState& state);
+
+  /// @brief Sets the directory to keep definitions in; empty for none.
+  static void set_directory(const string& directory);
+  static string directory();
+  /// @brief Drops the definitions held in memory.
+  static void Clear();
+  /// @brief The lookups served from memory or the directory, and the rest.
+  static int hits();
+  static int misses();
+
+ private:
+  NetCache() {}
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_NET_CACHE_HPP_
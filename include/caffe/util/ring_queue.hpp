@@ -0,0 +1,94 @@
+#ifndef CAFFE_UTIL_RING_QUEUE_HPP_
+#define CAFFE_UTIL_RING_QUEUE_HPP_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/// @brief Occupancy statistics of a RingQueue since its construction.
+struct QueueStats {
+  QueueStats()
+      : pushes(0), pops(0), full_waits(0), empty_waits(0), parks(0),
+        occupancy_sum(0), max_occupancy(0) {}
+
+  /// @brief The mean number of items in the queue seen by a pop.
+  inline double mean_occupancy() const {
+    return pops > 0 ? static_cast<double>(occupancy_sum) / pops : 0;
+  }
+
+  uint64_t pushes;
+  uint64_t pops;
+  // Pushes that found the queue full and pops or peeks that found it empty,
+  // and how many of those waits outlasted spinning and blocked.
+  uint64_t full_waits;
+  uint64_t empty_waits;
+  uint64_t parks;
+  // The number of items in the queue seen by each pop, this one included.
+  uint64_t occupancy_sum;
+  uint64_t max_occupancy;
+};
+
+/**
+ * @brief A bounded, lock-free alternative to BlockingQueue for hand-offs
+ *        between a known set of threads.
+ *
+ * Items live in a ring of capacity() slots, each tagged with a sequence
+ * number (Vyukov's bounded queue), so that a push and a pop only synchronize
+ * on the slot they use. In SPSC mode a single producer thread and a single
+ * consumer thread at a time may use the queue, and claim slots without
+ * atomic read-modify-writes; MPMC mode allows any number of either.
+ * Waiting on a full or empty queue spins briefly, then blocks on a condition
+ * variable, which is an interruption point as for BlockingQueue; the spin
+ * budget adapts to how long the waits turn out to be.
+ */
+template<typename T>
+class RingQueue {
+ public:
+  enum Mode { SPSC, MPMC };
+
+  /// @brief The capacity is rounded up to a power of two.
+  RingQueue(size_t capacity, Mode mode);
+
+  /// @brief Pushes an item, waiting while the queue is full.
+  void push(const T& t);
+
+  bool try_push(const T& t);
+
+  bool try_pop(T* t);
+
+  // This logs a message if the threads needs to be blocked
+  // useful for detecting e.g. when data feeding is too slow
+  T pop(const string& log_on_wait = "");
+
+  // Peeking is only allowed in SPSC mode, from the consumer thread.
+  bool try_peek(T* t);
+
+  // Return element without removing it
+  T peek();
+
+  size_t size() const;
+  size_t capacity() const;
+  QueueStats stats() const;
+
+ protected:
+  /**
+   Keep the ring and the synchronization fields out of the header, as for
+   BlockingQueue, to avoid including boost/thread.hpp and boost/atomic.hpp.
+   */
+  class state;
+
+  // Waits until the queue is not full (for_push) or not empty.
+  void wait(bool for_push, const string& log_on_wait);
+
+  shared_ptr<state> state_;
+
+DISABLE_COPY_AND_ASSIGN(RingQueue);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_RING_QUEUE_HPP_
@@ -0,0 +1,75 @@
+#ifndef CAFFE_UTIL_SPARSE_MATRIX_HPP_
+#define CAFFE_UTIL_SPARSE_MATRIX_HPP_
+
+#include <boost/weak_ptr.hpp>
+
+#include <cstddef>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A compressed sparse row (CSR) copy of a weight Blob, viewed as a
+ *        (rows x cols) matrix, with the sparse-dense products needed by the
+ *        InnerProduct and Convolution layers.
+ *
+ * The copy is rebuilt only when the weights change (as tracked by
+ * SyncedMemory::version()), so layers can call Update on every forward pass.
+ * It holds a weak reference to the memory it was built from, so that new
+ * weights at the address of freed ones are not taken for the same.
+ */
+template <typename Dtype>
+class SparseMatrix {
+ public:
+  SparseMatrix()
+      : rows_(0), cols_(0), source_version_(0),
+        threshold_(0), active_(false) {}
+
+  /**
+   * @brief Refreshes the CSR copy of weights if they changed since the last
+   *        call, and returns whether at least a threshold fraction of the
+   *        weights are zero, i.e., whether the sparse products should be used.
+   */
+  bool Update(const Blob<Dtype>& weights, const int rows,
+      const float threshold);
+
+  inline bool active() const { return active_; }
+  inline int rows() const { return rows_; }
+  inline int cols() const { return cols_; }
+  inline int nnz() const { return values_.size(); }
+
+  /**
+   * @brief C = A[row_begin:row_end, :] * B, where B is (cols x N) and C is
+   *        ((row_end - row_begin) x N), all row-major.
+   */
+  void Multiply(const int row_begin, const int row_end, const int N,
+      const Dtype* B, Dtype* C) const;
+
+  /// @brief C = B * A^T, where B is (M x cols) and C is (M x rows).
+  void MultiplyTransposedLeft(const int M, const Dtype* B, Dtype* C) const;
+
+  /// @brief C = B * A, where B is (M x rows) and C is (M x cols).
+  void MultiplyLeft(const int M, const Dtype* B, Dtype* C) const;
+
+ private:
+  int rows_;
+  int cols_;
+  std::vector<Dtype> values_;
+  std::vector<int> col_index_;
+  std::vector<int> row_ptr_;
+  // The weights this copy was built from, and their version at the time.
+  boost::weak_ptr<SyncedMemory> source_;
+  size_t source_version_;
+  float threshold_;
+  bool active_;
+
+  DISABLE_COPY_AND_ASSIGN(SparseMatrix);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SPARSE_MATRIX_HPP_
@@ -0,0 +1,45 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_HPP_
+#define CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Work split into independent items, to be run by a ThreadPool.
+ */
+class ParallelTask {
+ public:
+  virtual ~ParallelTask() {}
+  /// @brief Processes one item, on the pool thread with the given index.
+  virtual void Run(int item, int thread) = 0;
+};
+
+/**
+ * @brief A fixed set of threads that run the items of a ParallelTask.
+ *
+ * Thread t runs items t, t + size(), ..., so that per-thread state (e.g. a
+ * DataTransformer) needs no locking. A pool of size 0 runs all items on the
+ * calling thread, as thread 0.
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  inline int size() const { return workers_.size(); }
+  /// @brief Runs task->Run(i, t) for i in [0, count); blocks until done.
+  void Run(ParallelTask* task, int count);
+
+ private:
+  class Worker;
+  vector<shared_ptr<Worker> > workers_;
+
+  DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_THREAD_POOL_HPP_
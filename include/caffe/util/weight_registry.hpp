@@ -0,0 +1,66 @@
+#ifndef CAFFE_UTIL_WEIGHT_REGISTRY_HPP_
+#define CAFFE_UTIL_WEIGHT_REGISTRY_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A process-wide registry through which nets of one model, such as a
+ *        training net and the nets evaluating or serving it, share the data
+ *        of their parameters instead of holding a copy each.
+ *
+ * Parameters are matched by layer name and blob index. The first net attached
+ * to a model publishes its parameters; later nets drop theirs for the
+ * published ones, and publish those the model lacks. A net writes its
+ * parameters between BeginUpdate and EndUpdate (Net::Update, Net::Forward of
+ * TRAIN nets whose layers update statistics, CopyTrainedLayersFrom and the
+ * solvers do): while SNAPSHOT readers share its data, BeginUpdate first gives
+ * the writer a copy, which EndUpdate publishes as the next version of the
+ * model. Snapshot readers keep their version until they Refresh, which only
+ * moves them to completed versions, so they may run on other threads than
+ * the writer. FOLLOW readers always share the latest version, moved along by
+ * the writer, and so must not run while it updates. Parameters written
+ * otherwise, e.g. directly through Blob::mutable_cpu_data, bypass the copy.
+ *
+ * A net with flat parameters that shares data published by another net gets
+ * it copied back into its arena when it begins to update.
+ */
+template <typename Dtype>
+class WeightRegistry {
+ public:
+  enum Mode { SNAPSHOT, FOLLOW };
+
+  /**
+   * @brief Attaches net to the model, and returns the name of the model;
+   *        an empty name attaches it to a new model of its own.
+   */
+  static string Attach(const string& model, Net<Dtype>* net,
+      Mode mode = SNAPSHOT);
+  /// @brief Detaches net, if attached; Net's destructor calls this.
+  static void Detach(const Net<Dtype>* net);
+  /// @brief Makes the data of net safe to write; see above. Calls nest.
+  static void BeginUpdate(Net<Dtype>* net);
+  /// @brief Publishes the data written since the matching BeginUpdate.
+  static void EndUpdate(Net<Dtype>* net);
+  /**
+   * @brief Moves net to the latest completed version of its model; returns
+   *        whether it moved.
+   */
+  static bool Refresh(Net<Dtype>* net);
+
+  static bool attached(const Net<Dtype>* net);
+  /// @brief The latest version of a model, and the version a net shares.
+  static int version(const string& model);
+  static int version(const Net<Dtype>* net);
+
+ private:
+  WeightRegistry() {}
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_WEIGHT_REGISTRY_HPP_
@@ -4,6 +4,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -469,7 +470,41 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   }
   // copy data
   Dtype* data_vec = mutable_cpu_data();
-  if (proto.double_data_size() > 0) {
+  const BlobProto::Precision precision = proto.precision();
+  const bool use_half = precision != BlobProto::FLOAT;
+  if (use_half) {
+    CHECK_EQ(proto.half_data().size() % 2, 0);
+    CHECK_EQ(proto.half_diff().size() % 2, 0);
+  }
+  if (proto.sparse_row_ptr_size() > 0) {
+    // Expand compressed sparse row storage.
+    CHECK_GT(num_axes(), 0);
+    const int rows = shape(0);
+    const int cols = rows > 0 ? count_ / rows : 0;
+    CHECK_EQ(rows + 1, proto.sparse_row_ptr_size());
+    const bool use_double = proto.double_data_size() > 0;
+    const int nnz = use_half ? half_count(proto.half_data()) :
+        use_double ? proto.double_data_size() : proto.data_size();
+    CHECK_EQ(nnz, proto.sparse_col_index_size());
+    CHECK_EQ(nnz, proto.sparse_row_ptr(rows));
+    caffe_memset(count_ * sizeof(Dtype), 0, data_vec);
+    for (int r = 0; r < rows; ++r) {
+      for (int j = proto.sparse_row_ptr(r); j < proto.sparse_row_ptr(r + 1);
+           ++j) {
+        const int c = proto.sparse_col_index(j);
+        CHECK_GE(c, 0);
+        CHECK_LT(c, cols);
+        data_vec[r * cols + c] =
+            use_half ? half_value(proto.half_data(), j, precision) :
+            use_double ? proto.double_data(j) : proto.data(j);
+      }
+    }
+  } else if (use_half) {
+    CHECK_EQ(count_, half_count(proto.half_data()));
+    for (int i = 0; i < count_; ++i) {
+      data_vec[i] = half_value(proto.half_data(), i, precision);
+    }
+  } else if (proto.double_data_size() > 0) {
     CHECK_EQ(count_, proto.double_data_size());
     for (int i = 0; i < count_; ++i) {
       data_vec[i] = proto.double_data(i);
@@ -480,7 +515,13 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
       data_vec[i] = proto.data(i);
     }
   }
-  if (proto.double_diff_size() > 0) {
+  if (use_half && !proto.half_diff().empty()) {
+    CHECK_EQ(count_, half_count(proto.half_diff()));
+    Dtype* diff_vec = mutable_cpu_diff();
+    for (int i = 0; i < count_; ++i) {
+      diff_vec[i] = half_value(proto.half_diff(), i, precision);
+    }
+  } else if (proto.double_diff_size() > 0) {
     CHECK_EQ(count_, proto.double_diff_size());
     Dtype* diff_vec = mutable_cpu_diff();
     for (int i = 0; i < count_; ++i) {
@@ -503,6 +544,9 @@ void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
   }
   proto->clear_double_data();
   proto->clear_double_diff();
+  proto->clear_precision();
+  proto->clear_half_data();
+  proto->clear_half_diff();
   const double* data_vec = cpu_data();
   for (int i = 0; i < count_; ++i) {
     proto->add_double_data(data_vec[i]);
@@ -523,6 +567,9 @@ void Blob<float>::ToProto(BlobProto* proto, bool write_diff) const {
   }
   proto->clear_data();
   proto->clear_diff();
+  proto->clear_precision();
+  proto->clear_half_data();
+  proto->clear_half_diff();
   const float* data_vec = cpu_data();
   for (int i = 0; i < count_; ++i) {
     proto->add_data(data_vec[i]);
@@ -1,4 +1,5 @@
 #include <boost/thread.hpp>
+#include <algorithm>
 #include <map>
 #include <string>
 #include <vector>
@@ -7,6 +8,7 @@
 #include "caffe/data_reader.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -17,7 +19,9 @@ static boost::mutex bodies_mutex_;
 
 DataReader::DataReader(const LayerParameter& param)
     : queue_pair_(new QueuePair(  //
-        param.data_param().prefetch() * param.data_param().batch_size())) {
+        std::max(param.data_param().prefetch(),
+                 param.data_param().prefetch_max()) *
+        param.data_param().batch_size())) {
   // Get or create a body
   boost::mutex::scoped_lock lock(bodies_mutex_);
   string key = source_key(param);
@@ -41,15 +45,17 @@ DataReader::~DataReader() {
 
 //
 
-DataReader::QueuePair::QueuePair(int size) {
+DataReader::QueuePair::QueuePair(int size)
+    : free_(size, RingQueue<DatumView*>::SPSC),
+      full_(size, RingQueue<DatumView*>::SPSC) {
   // Initialize the free queue with requested number of datums
   for (int i = 0; i < size; ++i) {
-    free_.push(new Datum());
+    free_.push(new DatumView());
   }
 }
 
 DataReader::QueuePair::~QueuePair() {
-  Datum* datum;
+  DatumView* datum;
   while (free_.try_pop(&datum)) {
     delete datum;
   }
@@ -74,6 +80,12 @@ void DataReader::Body::InternalThreadEntry() {
   shared_ptr<db::DB> db(db::GetDB(param_.data_param().backend()));
   db->Open(param_.data_param().source(), db::READ);
   shared_ptr<db::Cursor> cursor(db->NewCursor());
+  CHECK(cursor->valid()) << "Data source " << param_.data_param().source()
+      << " has no records.";
+  if (param_.data_param().shuffle()) {
+    CHECK(cursor->Shuffle(caffe_rng_rand()))
+        << "Shuffling requires a backend with random access, e.g. MMAP";
+  }
   vector<shared_ptr<QueuePair> > qps;
   try {
     int solver_count = param_.phase() == TRAIN ? Caffe::solver_count() : 1;
@@ -103,9 +115,16 @@ void DataReader::Body::InternalThreadEntry() {
 }
 
 void DataReader::Body::read_one(db::Cursor* cursor, QueuePair* qp) {
-  Datum* datum = qp->free_.pop();
-  // TODO deserialize in-place instead of copy?
-  datum->ParseFromString(cursor->value());
+  DatumView* datum = qp->free_.pop();
+  const char* data;
+  size_t size;
+  if (cursor->value_view(&data, &size)) {
+    // Parse in place; the pixels of uint8 Datums are not even copied, as the
+    // view stays valid while the cursor lives.
+    datum->Parse(data, size);
+  } else {
+    datum->Parse(cursor->value());
+  }
   qp->full_.push(datum);
 
   // go to the next iter
@@ -113,6 +132,8 @@ void DataReader::Body::read_one(db::Cursor* cursor, QueuePair* qp) {
   if (!cursor->valid()) {
     DLOG(INFO) << "Restarting data prefetching from start.";
     cursor->SeekToFirst();
+    CHECK(cursor->valid()) << "Data source " << param_.data_param().source()
+        << " has no records.";
   }
 }
 
@@ -38,41 +38,120 @@ DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
   }
 }
 
+namespace {
+
+enum MeanMode { kNoMean, kMeanValues, kMeanFile };
+
+// Transforms one cropped row of width source elements into dst: converts to
+// Dtype, subtracts the mean (per element for kMeanFile, per channel for
+// kMeanValues) and scales, writing the row in reverse order if kMirror.
+// The options are template arguments, so the loop body has no branches and
+// vectorizes.
+template <typename Dtype, typename Src, bool kMirror, int kMean>
+void TransformRow(const Src* src, const Dtype* mean_row,
+    const Dtype mean_value, const Dtype scale, const int width, Dtype* dst) {
+  Dtype* out = kMirror ? dst + width - 1 : dst;
+  const int step = kMirror ? -1 : 1;
+  for (int w = 0; w < width; ++w) {
+    Dtype value = static_cast<Dtype>(src[w]);
+    if (kMean == kMeanFile) {
+      value -= mean_row[w];
+    } else if (kMean == kMeanValues) {
+      value -= mean_value;
+    }
+    out[w * step] = value * scale;
+  }
+}
+
+template <typename Dtype, typename Src, bool kMirror, int kMean>
+void TransformCrop(const Src* src, const Dtype* mean,
+    const Dtype* channel_means, const int channel_mean_step,
+    const Dtype scale, const int channels, const int src_height,
+    const int src_width, const int h_off, const int w_off, const int height,
+    const int width, Dtype* dst) {
+  for (int c = 0; c < channels; ++c) {
+    const Dtype mean_value = (kMean == kMeanValues) ?
+        channel_means[c * channel_mean_step] : 0;
+    for (int h = 0; h < height; ++h) {
+      const int src_offset = (c * src_height + h_off + h) * src_width + w_off;
+      TransformRow<Dtype, Src, kMirror, kMean>(src + src_offset,
+          (kMean == kMeanFile) ? mean + src_offset : NULL, mean_value, scale,
+          width, dst + (c * height + h) * width);
+    }
+  }
+}
+
+// Selects the TransformCrop specialization for the runtime options.
+template <typename Dtype, typename Src>
+void DispatchTransformCrop(const bool mirror, const MeanMode mean_mode,
+    const Src* src, const Dtype* mean, const Dtype* channel_means,
+    const int channel_mean_step, const Dtype scale, const int channels,
+    const int src_height, const int src_width, const int h_off,
+    const int w_off, const int height, const int width, Dtype* dst) {
+  typedef void (*TransformCropFn)(const Src*, const Dtype*, const Dtype*,
+      const int, const Dtype, const int, const int, const int, const int,
+      const int, const int, const int, Dtype*);
+  static const TransformCropFn kernels[2][3] = {
+    { &TransformCrop<Dtype, Src, false, kNoMean>,
+      &TransformCrop<Dtype, Src, false, kMeanValues>,
+      &TransformCrop<Dtype, Src, false, kMeanFile> },
+    { &TransformCrop<Dtype, Src, true, kNoMean>,
+      &TransformCrop<Dtype, Src, true, kMeanValues>,
+      &TransformCrop<Dtype, Src, true, kMeanFile> }
+  };
+  kernels[mirror][mean_mode](src, mean, channel_means, channel_mean_step,
+      scale, channels, src_height, src_width, h_off, w_off, height, width,
+      dst);
+}
+
+}  // namespace
+
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const Datum& datum,
                                        Dtype* transformed_data) {
   const string& data = datum.data();
-  const int datum_channels = datum.channels();
-  const int datum_height = datum.height();
-  const int datum_width = datum.width();
+  if (data.size() > 0) {
+    TransformData(reinterpret_cast<const uint8_t*>(data.data()),
+        datum.channels(), datum.height(), datum.width(), transformed_data);
+  } else {
+    TransformData(datum.float_data().data(), datum.channels(),
+        datum.height(), datum.width(), transformed_data);
+  }
+}
 
+template<typename Dtype>
+template<typename Src>
+void DataTransformer<Dtype>::TransformData(const Src* data,
+    const int datum_channels, const int datum_height, const int datum_width,
+    Dtype* transformed_data) {
   const int crop_size = param_.crop_size();
   const Dtype scale = param_.scale();
   const bool do_mirror = param_.mirror() && Rand(2);
   const bool has_mean_file = param_.has_mean_file();
-  const bool has_uint8 = data.size() > 0;
   const bool has_mean_values = mean_values_.size() > 0;
 
   CHECK_GT(datum_channels, 0);
   CHECK_GE(datum_height, crop_size);
   CHECK_GE(datum_width, crop_size);
 
-  Dtype* mean = NULL;
+  MeanMode mean_mode = kNoMean;
+  const Dtype* mean = NULL;
   if (has_mean_file) {
     CHECK_EQ(datum_channels, data_mean_.channels());
     CHECK_EQ(datum_height, data_mean_.height());
     CHECK_EQ(datum_width, data_mean_.width());
-    mean = data_mean_.mutable_cpu_data();
+    mean = data_mean_.cpu_data();
+    mean_mode = kMeanFile;
   }
+  const Dtype* channel_means = NULL;
+  int channel_mean_step = 0;
   if (has_mean_values) {
     CHECK(mean_values_.size() == 1 || mean_values_.size() == datum_channels) <<
      "Specify either 1 mean_value or as many as channels: " << datum_channels;
-    if (datum_channels > 1 && mean_values_.size() == 1) {
-      // Replicate the mean_value for simplicity
-      for (int c = 1; c < datum_channels; ++c) {
-        mean_values_.push_back(mean_values_[0]);
-      }
-    }
+    // A single mean_value applies to every channel
+    channel_means = &mean_values_[0];
+    channel_mean_step = mean_values_.size() > 1;
+    mean_mode = kMeanValues;
   }
 
   int height = datum_height;
@@ -93,37 +172,9 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
     }
   }
 
-  Dtype datum_element;
-  int top_index, data_index;
-  for (int c = 0; c < datum_channels; ++c) {
-    for (int h = 0; h < height; ++h) {
-      for (int w = 0; w < width; ++w) {
-        data_index = (c * datum_height + h_off + h) * datum_width + w_off + w;
-        if (do_mirror) {
-          top_index = (c * height + h) * width + (width - 1 - w);
-        } else {
-          top_index = (c * height + h) * width + w;
-        }
-        if (has_uint8) {
-          datum_element =
-            static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
-        } else {
-          datum_element = datum.float_data(data_index);
-        }
-        if (has_mean_file) {
-          transformed_data[top_index] =
-            (datum_element - mean[data_index]) * scale;
-        } else {
-          if (has_mean_values) {
-            transformed_data[top_index] =
-              (datum_element - mean_values_[c]) * scale;
-          } else {
-            transformed_data[top_index] = datum_element * scale;
-          }
-        }
-      }
-    }
-  }
+  DispatchTransformCrop(do_mirror, mean_mode, data, mean, channel_means,
+      channel_mean_step, scale, datum_channels, datum_height, datum_width,
+      h_off, w_off, height, width, transformed_data);
 }
 
 
@@ -181,6 +232,41 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   Transform(datum, transformed_data);
 }
 
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const DatumView& datum,
+                                       Blob<Dtype>* transformed_blob) {
+  if (!datum.is_view()) {
+    return Transform(datum.datum(), transformed_blob);
+  }
+  const int crop_size = param_.crop_size();
+  const int datum_channels = datum.channels();
+  const int datum_height = datum.height();
+  const int datum_width = datum.width();
+
+  // Check dimensions.
+  const int channels = transformed_blob->channels();
+  const int height = transformed_blob->height();
+  const int width = transformed_blob->width();
+  const int num = transformed_blob->num();
+
+  CHECK_EQ(channels, datum_channels);
+  CHECK_LE(height, datum_height);
+  CHECK_LE(width, datum_width);
+  CHECK_GE(num, 1);
+
+  if (crop_size) {
+    CHECK_EQ(crop_size, height);
+    CHECK_EQ(crop_size, width);
+  } else {
+    CHECK_EQ(datum_height, height);
+    CHECK_EQ(datum_width, width);
+  }
+
+  // Read the pixels straight from the viewed record.
+  TransformData(datum.data(), datum_channels, datum_height, datum_width,
+      transformed_blob->mutable_cpu_data());
+}
+
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const vector<Datum> & datum_vector,
                                        Blob<Dtype>* transformed_blob) {
@@ -474,6 +560,25 @@ vector<int> DataTransformer<Dtype>::InferBlobShape(const Datum& datum) {
   return shape;
 }
 
+template<typename Dtype>
+vector<int> DataTransformer<Dtype>::InferBlobShape(const DatumView& datum) {
+  if (!datum.is_view()) {
+    return InferBlobShape(datum.datum());
+  }
+  const int crop_size = param_.crop_size();
+  // Check dimensions.
+  CHECK_GT(datum.channels(), 0);
+  CHECK_GE(datum.height(), crop_size);
+  CHECK_GE(datum.width(), crop_size);
+  // Build BlobShape.
+  vector<int> shape(4);
+  shape[0] = 1;
+  shape[1] = datum.channels();
+  shape[2] = (crop_size)? crop_size: datum.height();
+  shape[3] = (crop_size)? crop_size: datum.width();
+  return shape;
+}
+
 template<typename Dtype>
 vector<int> DataTransformer<Dtype>::InferBlobShape(
     const vector<Datum> & datum_vector) {
@@ -531,6 +636,20 @@ void DataTransformer<Dtype>::InitRand() {
   }
 }
 
+template <typename Dtype>
+void DataTransformer<Dtype>::SeedRand(unsigned int seed) {
+  const bool needs_rand = param_.mirror() ||
+      (phase_ == TRAIN && param_.crop_size());
+  if (!needs_rand) {
+    return;
+  }
+  if (rng_) {
+    static_cast<caffe::rng_t*>(rng_->generator())->seed(seed);
+  } else {
+    rng_.reset(new Caffe::RNG(seed));
+  }
+}
+
 template <typename Dtype>
 int DataTransformer<Dtype>::Rand(int n) {
   CHECK(rng_);
@@ -263,6 +263,24 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
     }
     col_buff = col_buffer_.cpu_data();
   }
+  if (sparse_weight_.active()) {
+    const int group_rows = conv_out_channels_ / group_;
+    for (int g = 0; g < group_; ++g) {
+      sparse_weight_.Multiply(group_rows * g, group_rows * (g + 1),
+          conv_out_spatial_dim_, col_buff + col_offset_ * g,
+          output + output_offset_ * g);
+    }
+    return;
+  }
+  if (half_weight_.active()) {
+    const int group_rows = conv_out_channels_ / group_;
+    for (int g = 0; g < group_; ++g) {
+      half_weight_.Multiply(group_rows * g, group_rows * (g + 1),
+          conv_out_spatial_dim_, col_buff + col_offset_ * g,
+          output + output_offset_ * g);
+    }
+    return;
+  }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
         group_, conv_out_spatial_dim_, kernel_dim_,
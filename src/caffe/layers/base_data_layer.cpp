@@ -1,4 +1,5 @@
 #include <boost/thread.hpp>
+#include <algorithm>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -7,7 +8,8 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
-#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/ring_queue.hpp"
 
 namespace caffe {
 
@@ -36,32 +38,61 @@ template <typename Dtype>
 BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
-      prefetch_free_(), prefetch_full_() {
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_free_.push(&prefetch_[i]);
+      batches_consumed_(0), prefetch_stalls_(0), prefetch_stall_ms_(0),
+      load_ms_average_(0), consume_ms_average_(0), prefetch_current_(NULL),
+      prefetch_(param.data_param().prefetch()),
+      prefetch_max_(param.data_param().prefetch_max()),
+      prefetch_memory_limit_(
+          static_cast<size_t>(param.data_param().prefetch_memory_mb()) << 20),
+      prefetch_free_(std::max(param.data_param().prefetch(),
+          param.data_param().prefetch_max()), RingQueue<Batch<Dtype>*>::SPSC),
+      prefetch_full_(prefetch_free_.capacity(),
+          RingQueue<Batch<Dtype>*>::SPSC) {
+  CHECK_GT(prefetch_.size(), 0) << "Prefetch queue must hold a batch.";
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i].reset(new Batch<Dtype>());
+    prefetch_free_.push(prefetch_[i].get());
   }
 }
 
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (is_started()) {
+    // Set up again, e.g. to reread the source: stop the prefetch thread and
+    // return every batch to the free queue.
+    StopInternalThread();
+    Batch<Dtype>* batch;
+    while (prefetch_free_.try_pop(&batch)) {}
+    while (prefetch_full_.try_pop(&batch)) {}
+    prefetch_current_ = NULL;
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      prefetch_free_.push(prefetch_[i].get());
+    }
+  }
   BaseDataLayer<Dtype>::LayerSetUp(bottom, top);
   // Before starting the prefetch thread, we make cpu_data and gpu_data
   // calls so that the prefetch thread does not accidentally make simultaneous
   // cudaMalloc calls when the main thread is running. In some GPUs this
   // seems to cause failures if we do not so.
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_[i].data_.mutable_cpu_data();
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i]->data_.mutable_cpu_data();
     if (this->output_labels_) {
-      prefetch_[i].label_.mutable_cpu_data();
+      prefetch_[i]->label_.mutable_cpu_data();
+    }
+    for (int j = 0; j < prefetch_[i]->extra_.size(); ++j) {
+      prefetch_[i]->extra_[j]->mutable_cpu_data();
     }
   }
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
-    for (int i = 0; i < PREFETCH_COUNT; ++i) {
-      prefetch_[i].data_.mutable_gpu_data();
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      prefetch_[i]->data_.mutable_gpu_data();
       if (this->output_labels_) {
-        prefetch_[i].label_.mutable_gpu_data();
+        prefetch_[i]->label_.mutable_gpu_data();
+      }
+      for (int j = 0; j < prefetch_[i]->extra_.size(); ++j) {
+        prefetch_[i]->extra_[j]->mutable_gpu_data();
       }
     }
   }
@@ -82,8 +113,10 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 
   try {
+    CPUTimer timer;
     while (!must_stop()) {
       Batch<Dtype>* batch = prefetch_free_.pop();
+      timer.Start();
       load_batch(batch);
 #ifndef CPU_ONLY
       if (Caffe::mode() == Caffe::GPU) {
@@ -91,6 +124,7 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
         CUDA_CHECK(cudaStreamSynchronize(stream));
       }
 #endif
+      batch->load_ms_ = timer.MicroSeconds() / 1000;
       prefetch_full_.push(batch);
     }
   } catch (boost::thread_interrupted&) {
@@ -103,25 +137,106 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 }
 
+// Exponential moving average over roughly the last ten values.
+static double update_average(double average, double value, int count) {
+  return count == 1 ? value : 0.9 * average + 0.1 * value;
+}
+
+template <typename Dtype>
+Batch<Dtype>* BasePrefetchingDataLayer<Dtype>::next_batch() {
+  if (batches_consumed_ > 0) {
+    // The time the net took since the previous batch.
+    consume_ms_average_ = update_average(consume_ms_average_,
+        consume_timer_.MicroSeconds() / 1000, batches_consumed_);
+  }
+  ++batches_consumed_;
+  Batch<Dtype>* batch;
+  if (!prefetch_full_.try_pop(&batch)) {
+    ++prefetch_stalls_;
+    CPUTimer timer;
+    timer.Start();
+    batch = prefetch_full_.pop("Data layer prefetch queue empty");
+    prefetch_stall_ms_ += timer.MilliSeconds();
+    // Past the initial fill, a stall although batches load faster than they
+    // are consumed means that loading is bursty, and a deeper queue absorbs
+    // the bursts. (If loading is just slow, depth does not help.)
+    if (batches_consumed_ > prefetch_.size() &&
+        load_ms_average_ < consume_ms_average_) {
+      GrowPrefetch(*batch);
+    }
+  }
+  load_ms_average_ = update_average(load_ms_average_, batch->load_ms_,
+      batches_consumed_);
+  consume_timer_.Start();
+  return batch;
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::GrowPrefetch(const Batch<Dtype>& like) {
+  if (prefetch_.size() >= prefetch_max_) {
+    return;
+  }
+  size_t batch_count = like.data_.count() + like.label_.count();
+  for (int i = 0; i < like.extra_.size(); ++i) {
+    batch_count += like.extra_[i]->count();
+  }
+  const size_t batch_bytes = batch_count * sizeof(Dtype);
+  if (prefetch_memory_limit_ > 0 &&
+      (prefetch_.size() + 1) * batch_bytes > prefetch_memory_limit_) {
+    return;
+  }
+  // Allocate on this thread, as in LayerSetUp, so that the prefetch thread
+  // only reuses memory.
+  shared_ptr<Batch<Dtype> > batch(new Batch<Dtype>());
+  batch->data_.ReshapeLike(like.data_);
+  batch->data_.mutable_cpu_data();
+  if (this->output_labels_) {
+    batch->label_.ReshapeLike(like.label_);
+    batch->label_.mutable_cpu_data();
+  }
+  for (int i = 0; i < like.extra_.size(); ++i) {
+    batch->extra_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    batch->extra_[i]->ReshapeLike(*like.extra_[i]);
+    batch->extra_[i]->mutable_cpu_data();
+  }
+#ifndef CPU_ONLY
+  if (Caffe::mode() == Caffe::GPU) {
+    batch->data_.mutable_gpu_data();
+    if (this->output_labels_) {
+      batch->label_.mutable_gpu_data();
+    }
+    for (int i = 0; i < batch->extra_.size(); ++i) {
+      batch->extra_[i]->mutable_gpu_data();
+    }
+  }
+#endif
+  prefetch_.push_back(batch);
+  prefetch_free_.push(batch.get());
+  LOG(INFO) << this->layer_param_.name() << " prefetch queue grown to "
+      << prefetch_.size() << " batches";
+}
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
-  // Reshape to loaded data.
-  top[0]->ReshapeLike(batch->data_);
-  // Copy the data
-  caffe_copy(batch->data_.count(), batch->data_.cpu_data(),
-             top[0]->mutable_cpu_data());
-  DLOG(INFO) << "Prefetch copied";
+  // The previous batch is no longer referenced by the tops.
+  if (prefetch_current_) {
+    prefetch_free_.push(prefetch_current_);
+  }
+  prefetch_current_ = next_batch();
+  // Reshape to loaded data and point the tops at it without copying.
+  top[0]->ReshapeLike(prefetch_current_->data_);
+  top[0]->set_cpu_data(prefetch_current_->data_.mutable_cpu_data());
   if (this->output_labels_) {
     // Reshape to loaded labels.
-    top[1]->ReshapeLike(batch->label_);
-    // Copy the labels.
-    caffe_copy(batch->label_.count(), batch->label_.cpu_data(),
-        top[1]->mutable_cpu_data());
+    top[1]->ReshapeLike(prefetch_current_->label_);
+    top[1]->set_cpu_data(prefetch_current_->label_.mutable_cpu_data());
+  }
+  for (int i = 0; i < prefetch_current_->extra_.size(); ++i) {
+    Blob<Dtype>* extra = prefetch_current_->extra_[i].get();
+    top[i + 2]->ReshapeLike(*extra);
+    top[i + 2]->set_cpu_data(extra->mutable_cpu_data());
   }
-
-  prefetch_free_.push(batch);
 }
 
 #ifdef CPU_ONLY
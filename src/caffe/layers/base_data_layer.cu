@@ -7,7 +7,12 @@ namespace caffe {
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_gpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  // Batches are copied to the tops on the GPU, so no batch stays in use.
+  if (prefetch_current_) {
+    prefetch_free_.push(prefetch_current_);
+    prefetch_current_ = NULL;
+  }
+  Batch<Dtype>* batch = next_batch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(batch->data_);
   // Copy the data
@@ -20,6 +25,11 @@ void BasePrefetchingDataLayer<Dtype>::Forward_gpu(
     caffe_copy(batch->label_.count(), batch->label_.gpu_data(),
         top[1]->mutable_gpu_data());
   }
+  for (int i = 0; i < batch->extra_.size(); ++i) {
+    top[i + 2]->ReshapeLike(*batch->extra_[i]);
+    caffe_copy(batch->extra_[i]->count(), batch->extra_[i]->gpu_data(),
+        top[i + 2]->mutable_gpu_data());
+  }
   // Ensure the copy is synchronous wrt the host, so that the next batch isn't
   // copied in meanwhile.
   CUDA_CHECK(cudaStreamSynchronize(cudaStreamDefault));
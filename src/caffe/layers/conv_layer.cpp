@@ -25,6 +25,15 @@ template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
+  if (this->phase_ == TEST) {
+    // Deployed pruned models multiply by the nonzero weights only, and
+    // others may keep their weights in 16 bits.
+    if (!this->sparse_weight_.Update(*this->blobs_[0], this->num_output_,
+        this->layer_param_.convolution_param().sparse_threshold())) {
+      this->half_weight_.Update(*this->blobs_[0], this->num_output_,
+          this->layer_param_.convolution_param().weight_precision());
+    }
+  }
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
@@ -11,15 +11,34 @@
 
 namespace caffe {
 
+namespace {
+
+// Mixes the layer's seed with an item's position in the data stream, so that
+// consecutive items get well separated random streams.
+unsigned int item_seed(unsigned int seed, size_t item) {
+  uint64_t x = (static_cast<uint64_t>(seed) << 32) ^ item;
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return static_cast<unsigned int>(x);
+}
+
+}  // namespace
+
 template <typename Dtype>
 DataLayer<Dtype>::DataLayer(const LayerParameter& param)
   : BasePrefetchingDataLayer<Dtype>(param),
-    reader_(param) {
+    reader_(param), reader_stalls_(0), item_seed_base_(0), item_count_(0),
+    top_data_(NULL), top_label_(NULL) {
 }
 
 template <typename Dtype>
 DataLayer<Dtype>::~DataLayer() {
   this->StopInternalThread();
+  // Finish any items in flight before the batch state goes away.
+  transform_pool_.reset();
 }
 
 template <typename Dtype>
@@ -27,7 +46,7 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const int batch_size = this->layer_param_.data_param().batch_size();
   // Read a data point, and use it to initialize the top blob.
-  Datum& datum = *(reader_.full().peek());
+  DatumView& datum = *(reader_.full().peek());
 
   // Use data_transformer to infer the expected blob shape from datum.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
@@ -35,8 +54,8 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // Reshape top[0] and prefetch_data according to the batch_size.
   top_shape[0] = batch_size;
   top[0]->Reshape(top_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   LOG(INFO) << "output data size: " << top[0]->num() << ","
       << top[0]->channels() << "," << top[0]->height() << ","
@@ -45,10 +64,25 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   if (this->output_labels_) {
     vector<int> label_shape(1, batch_size);
     top[1]->Reshape(label_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-      this->prefetch_[i].label_.Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->label_.Reshape(label_shape);
     }
   }
+  // Transform threads, each with its own DataTransformer.
+  const int num_threads = this->layer_param_.data_param().transform_threads();
+  transform_pool_.reset();
+  transformers_.clear();
+  transformed_items_.clear();
+  if (num_threads > 0) {
+    item_seed_base_ = caffe_rng_rand();
+    transform_pool_.reset(new ThreadPool(num_threads));
+    for (int i = 0; i < num_threads; ++i) {
+      transformers_.push_back(shared_ptr<DataTransformer<Dtype> >(
+          new DataTransformer<Dtype>(this->transform_param_, this->phase_)));
+      transformed_items_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    }
+    LOG(INFO) << "Transforming data with " << num_threads << " threads";
+  }
 }
 
 // This function is called on prefetch thread
@@ -65,7 +99,7 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   // Reshape according to the first datum of each batch
   // on single input batches allows for inputs of varying dimension.
   const int batch_size = this->layer_param_.data_param().batch_size();
-  Datum& datum = *(reader_.full().peek());
+  DatumView& datum = *(reader_.full().peek());
   // Use data_transformer to infer the expected blob shape from datum.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
   this->transformed_data_.Reshape(top_shape);
@@ -79,29 +113,78 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   if (this->output_labels_) {
     top_label = batch->label_.mutable_cpu_data();
   }
-  for (int item_id = 0; item_id < batch_size; ++item_id) {
+  if (!transform_pool_) {
+    for (int item_id = 0; item_id < batch_size; ++item_id) {
+      timer.Start();
+      // get a datum
+      if (reader_.full().size() == 0) {
+        ++reader_stalls_;
+      }
+      DatumView& datum = *(reader_.full().pop("Waiting for data"));
+      read_time += timer.MicroSeconds();
+      timer.Start();
+      // Apply data transformations (mirror, scale, crop...)
+      int offset = batch->data_.offset(item_id);
+      this->transformed_data_.set_cpu_data(top_data + offset);
+      this->data_transformer_->Transform(datum, &(this->transformed_data_));
+      // Copy label.
+      if (this->output_labels_) {
+        top_label[item_id] = datum.label();
+      }
+      trans_time += timer.MicroSeconds();
+
+      reader_.free().push(&datum);
+    }
+  } else {
+    // Read the whole batch, then let the transform threads fill disjoint
+    // slots of it in parallel.
     timer.Start();
-    // get a datum
-    Datum& datum = *(reader_.full().pop("Waiting for data"));
+    batch_datums_.resize(batch_size);
+    item_seeds_.resize(batch_size);
+    for (int item_id = 0; item_id < batch_size; ++item_id) {
+      if (reader_.full().size() == 0) {
+        ++reader_stalls_;
+      }
+      batch_datums_[item_id] = reader_.full().pop("Waiting for data");
+      item_seeds_[item_id] = item_seed(item_seed_base_, item_count_++);
+    }
     read_time += timer.MicroSeconds();
     timer.Start();
-    // Apply data transformations (mirror, scale, crop...)
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(top_data + offset);
-    this->data_transformer_->Transform(datum, &(this->transformed_data_));
-    // Copy label.
-    if (this->output_labels_) {
-      top_label[item_id] = datum.label();
+    top_shape[0] = 1;
+    for (int i = 0; i < transformed_items_.size(); ++i) {
+      transformed_items_[i]->Reshape(top_shape);
     }
+    top_data_ = top_data;
+    top_label_ = top_label;
+    transform_pool_->Run(this, batch_size);
     trans_time += timer.MicroSeconds();
-
-    reader_.free().push(const_cast<Datum*>(&datum));
+    for (int item_id = 0; item_id < batch_size; ++item_id) {
+      reader_.free().push(batch_datums_[item_id]);
+    }
   }
   timer.Stop();
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  DLOG(INFO) << " Reader stalls: " << reader_stalls_;
+  DLOG(INFO) << "  Reader queue: " << reader_.full().stats().mean_occupancy()
+             << " datums on average";
+}
+
+// This function is called on a transform thread
+template <typename Dtype>
+void DataLayer<Dtype>::Run(int item_id, int thread) {
+  const DatumView& datum = *batch_datums_[item_id];
+  DataTransformer<Dtype>* transformer = transformers_[thread].get();
+  Blob<Dtype>* transformed_data = transformed_items_[thread].get();
+  transformer->SeedRand(item_seeds_[item_id]);
+  transformed_data->set_cpu_data(
+      top_data_ + item_id * transformed_data->count());
+  transformer->Transform(datum, transformed_data);
+  if (top_label_) {
+    top_label_[item_id] = datum.label();
+  }
 }
 
 INSTANTIATE_CLASS(DataLayer);
@@ -1,12 +1,6 @@
 #ifdef USE_HDF5
-/*
-TODO:
-- load file in a separate thread ("prefetch")
-- can be smarter about the memcpy call instead of doing it row-by-row
-  :: use util functions caffe_copy, and Blob->offset()
-  :: don't forget to update hdf5_daa_layer.cu accordingly
-- add ability to shuffle filenames if flag is set
-*/
+#include <algorithm>
+#include <climits>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
@@ -17,60 +11,148 @@ TODO:
 
 #include "caffe/layers/hdf5_data_layer.hpp"
 #include "caffe/util/hdf5.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
 template <typename Dtype>
-HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() { }
+HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() {
+  this->StopInternalThread();
+  CloseHDF5File();
+}
 
-// Load data and label from HDF5 filename into the class property blobs.
 template <typename Dtype>
-void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
-  DLOG(INFO) << "Loading HDF5 file: " << filename;
-  hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
-  if (file_id < 0) {
-    LOG(FATAL) << "Failed opening HDF5 file: " << filename;
+void HDF5DataLayer<Dtype>::CloseHDF5File() {
+  if (file_id_ >= 0) {
+    boost::mutex::scoped_lock lock(hdf5_mutex());
+    herr_t status = H5Fclose(file_id_);
+    CHECK_GE(status, 0) << "Failed to close HDF5 file";
+    file_id_ = -1;
   }
+}
 
-  int top_size = this->layer_param_.top_size();
-  hdf_blobs_.resize(top_size);
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::Shuffle(vector<unsigned int>* permutation) {
+  caffe::rng_t* prefetch_rng =
+      static_cast<caffe::rng_t*>(prefetch_rng_->generator());
+  shuffle(permutation->begin(), permutation->end(), prefetch_rng);
+}
+
+// Open an HDF5 file, checking its datasets, and split it into chunks.
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::OpenHDF5File(const char* filename) {
+  CloseHDF5File();
+  DLOG(INFO) << "Opening HDF5 file: " << filename;
+  boost::mutex::scoped_lock lock(hdf5_mutex());
+  file_id_ = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+  if (file_id_ < 0) {
+    LOG(FATAL) << "Failed opening HDF5 file: " << filename;
+  }
 
   const int MIN_DATA_DIM = 1;
   const int MAX_DATA_DIM = INT_MAX;
 
+  // Only the shapes of the datasets are read here.
+  const int top_size = this->layer_param_.top_size();
   for (int i = 0; i < top_size; ++i) {
-    hdf_blobs_[i] = shared_ptr<Blob<Dtype> >(new Blob<Dtype>());
-    hdf5_load_nd_dataset(file_id, this->layer_param_.top(i).c_str(),
-        MIN_DATA_DIM, MAX_DATA_DIM, hdf_blobs_[i].get());
+    const vector<hsize_t> dims = hdf5_get_nd_dataset_dims(file_id_,
+        this->layer_param_.top(i).c_str(), MIN_DATA_DIM, MAX_DATA_DIM);
+    if (i == 0) {
+      file_rows_ = dims[0];
+    }
+    CHECK_EQ(dims[0], file_rows_);
+    // The rows are copied into batches shaped by the first file.
+    if (i < hdf_blobs_.size()) {
+      hsize_t row_count = 1;
+      for (int j = 1; j < dims.size(); ++j) {
+        row_count *= dims[j];
+      }
+      CHECK_EQ(row_count, static_cast<hsize_t>(hdf_blobs_[i]->count(1)))
+          << "Rows of " << this->layer_param_.top(i) << " in " << filename
+          << " differ in size from those of the first file";
+    }
   }
+  CHECK_GT(file_rows_, 0) << "Empty HDF5 file: " << filename;
+
+  const hsize_t chunk_size = this->layer_param_.hdf5_data_param().chunk_size();
+  chunk_rows_ = chunk_size > 0 ? std::min(chunk_size, file_rows_) : file_rows_;
+  const int num_chunks = (file_rows_ + chunk_rows_ - 1) / chunk_rows_;
+  chunk_permutation_.resize(num_chunks);
+  for (int i = 0; i < num_chunks; ++i) {
+    chunk_permutation_[i] = i;
+  }
+  if (this->layer_param_.hdf5_data_param().shuffle()) {
+    Shuffle(&chunk_permutation_);
+  }
+  current_chunk_ = 0;
+  DLOG(INFO) << "Opened " << file_rows_ << " rows in " << num_chunks
+             << " chunks";
+}
 
-  herr_t status = H5Fclose(file_id);
-  CHECK_GE(status, 0) << "Failed to close HDF5 file: " << filename;
-
-  // MinTopBlobs==1 guarantees at least one top blob
-  CHECK_GE(hdf_blobs_[0]->num_axes(), 1) << "Input must have at least 1 axis.";
-  const int num = hdf_blobs_[0]->shape(0);
-  for (int i = 1; i < top_size; ++i) {
-    CHECK_EQ(hdf_blobs_[i]->shape(0), num);
+// Load the rows of the current chunk of each dataset into the chunk blobs.
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::LoadHDF5Chunk() {
+  const hsize_t row_begin = chunk_permutation_[current_chunk_] * chunk_rows_;
+  const hsize_t num_rows = std::min(chunk_rows_, file_rows_ - row_begin);
+  const int top_size = this->layer_param_.top_size();
+  hdf_blobs_.resize(top_size);
+  {
+    boost::mutex::scoped_lock lock(hdf5_mutex());
+    for (int i = 0; i < top_size; ++i) {
+      if (!hdf_blobs_[i]) {
+        hdf_blobs_[i].reset(new Blob<Dtype>());
+      }
+      hdf5_load_nd_dataset_rows(file_id_, this->layer_param_.top(i).c_str(),
+          1, INT_MAX, row_begin, num_rows, hdf_blobs_[i].get());
+    }
   }
   // Default to identity permutation.
-  data_permutation_.clear();
-  data_permutation_.resize(hdf_blobs_[0]->shape(0));
-  for (int i = 0; i < hdf_blobs_[0]->shape(0); i++)
+  data_permutation_.resize(num_rows);
+  for (int i = 0; i < num_rows; ++i) {
     data_permutation_[i] = i;
-
+  }
   // Shuffle if needed.
   if (this->layer_param_.hdf5_data_param().shuffle()) {
-    std::random_shuffle(data_permutation_.begin(), data_permutation_.end());
-    DLOG(INFO) << "Successully loaded " << hdf_blobs_[0]->shape(0)
-               << " rows (shuffled)";
-  } else {
-    DLOG(INFO) << "Successully loaded " << hdf_blobs_[0]->shape(0) << " rows";
+    Shuffle(&data_permutation_);
+  }
+  current_row_ = 0;
+  DLOG(INFO) << "Loaded rows " << row_begin << " to " << row_begin + num_rows;
+}
+
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::NextChunk() {
+  const bool shuffle = this->layer_param_.hdf5_data_param().shuffle();
+  if (num_files_ == 1 && chunk_permutation_.size() == 1) {
+    // The only chunk stays loaded.
+    current_row_ = 0;
+    if (shuffle) {
+      Shuffle(&data_permutation_);
+    }
+    return;
+  }
+  if (++current_chunk_ == chunk_permutation_.size()) {
+    if (num_files_ > 1) {
+      if (++current_file_ == num_files_) {
+        current_file_ = 0;
+        if (shuffle) {
+          Shuffle(&file_permutation_);
+        }
+        DLOG(INFO) << "Looping around to first file.";
+      }
+      OpenHDF5File(hdf_filenames_[file_permutation_[current_file_]].c_str());
+    } else {
+      current_chunk_ = 0;
+      if (shuffle) {
+        Shuffle(&chunk_permutation_);
+      }
+    }
   }
+  LoadHDF5Chunk();
 }
 
 template <typename Dtype>
-void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+void HDF5DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   // Refuse transformation parameters since HDF5 is totally generic.
   CHECK(!this->layer_param_.has_transform_param()) <<
@@ -103,64 +185,64 @@ void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
 
   // Shuffle if needed.
+  prefetch_rng_.reset(new Caffe::RNG(caffe_rng_rand()));
   if (this->layer_param_.hdf5_data_param().shuffle()) {
-    std::random_shuffle(file_permutation_.begin(), file_permutation_.end());
+    Shuffle(&file_permutation_);
   }
 
-  // Load the first HDF5 file and initialize the line counter.
-  LoadHDF5FileData(hdf_filenames_[file_permutation_[current_file_]].c_str());
-  current_row_ = 0;
+  // Load the first chunk of the first HDF5 file.
+  OpenHDF5File(hdf_filenames_[file_permutation_[current_file_]].c_str());
+  LoadHDF5Chunk();
 
   // Reshape blobs.
   const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
   const int top_size = this->layer_param_.top_size();
   vector<int> top_shape;
   for (int i = 0; i < top_size; ++i) {
-    top_shape.resize(hdf_blobs_[i]->num_axes());
+    top_shape = hdf_blobs_[i]->shape();
     top_shape[0] = batch_size;
-    for (int j = 1; j < top_shape.size(); ++j) {
-      top_shape[j] = hdf_blobs_[i]->shape(j);
-    }
     top[i]->Reshape(top_shape);
+    for (int j = 0; j < this->prefetch_.size(); ++j) {
+      Batch<Dtype>* batch = this->prefetch_[j].get();
+      if (i == 0) {
+        batch->data_.Reshape(top_shape);
+      } else if (i == 1) {
+        batch->label_.Reshape(top_shape);
+      } else {
+        batch->extra_.resize(top_size - 2);
+        if (!batch->extra_[i - 2]) {
+          batch->extra_[i - 2].reset(new Blob<Dtype>());
+        }
+        batch->extra_[i - 2]->Reshape(top_shape);
+      }
+    }
   }
 }
 
+// This function is called on prefetch thread
 template <typename Dtype>
-void HDF5DataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top) {
+void HDF5DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
+  const int top_size = this->layer_param_.top_size();
+  vector<Dtype*> top_data(top_size);
+  for (int j = 0; j < top_size; ++j) {
+    Blob<Dtype>* blob = j == 0 ? &batch->data_ :
+        j == 1 ? &batch->label_ : batch->extra_[j - 2].get();
+    top_data[j] = blob->mutable_cpu_data();
+  }
   for (int i = 0; i < batch_size; ++i, ++current_row_) {
     if (current_row_ == hdf_blobs_[0]->shape(0)) {
-      if (num_files_ > 1) {
-        ++current_file_;
-        if (current_file_ == num_files_) {
-          current_file_ = 0;
-          if (this->layer_param_.hdf5_data_param().shuffle()) {
-            std::random_shuffle(file_permutation_.begin(),
-                                file_permutation_.end());
-          }
-          DLOG(INFO) << "Looping around to first file.";
-        }
-        LoadHDF5FileData(
-            hdf_filenames_[file_permutation_[current_file_]].c_str());
-      }
-      current_row_ = 0;
-      if (this->layer_param_.hdf5_data_param().shuffle())
-        std::random_shuffle(data_permutation_.begin(), data_permutation_.end());
+      NextChunk();
     }
-    for (int j = 0; j < this->layer_param_.top_size(); ++j) {
-      int data_dim = top[j]->count() / top[j]->shape(0);
+    for (int j = 0; j < top_size; ++j) {
+      const int data_dim = hdf_blobs_[j]->count(1);
       caffe_copy(data_dim,
           &hdf_blobs_[j]->cpu_data()[data_permutation_[current_row_]
-            * data_dim], &top[j]->mutable_cpu_data()[i * data_dim]);
+            * data_dim], &top_data[j][i * data_dim]);
     }
   }
 }
 
-#ifdef CPU_ONLY
-STUB_GPU_FORWARD(HDF5DataLayer, Forward);
-#endif
-
 INSTANTIATE_CLASS(HDF5DataLayer);
 REGISTER_LAYER_CLASS(HDF5Data);
 
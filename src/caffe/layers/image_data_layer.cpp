@@ -20,6 +20,8 @@ namespace caffe {
 template <typename Dtype>
 ImageDataLayer<Dtype>::~ImageDataLayer<Dtype>() {
   this->StopInternalThread();
+  // Finish any items in flight before the batch state goes away.
+  decode_pool_.reset();
 }
 
 template <typename Dtype>
@@ -27,7 +29,6 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const int new_height = this->layer_param_.image_data_param().new_height();
   const int new_width  = this->layer_param_.image_data_param().new_width();
-  const bool is_color  = this->layer_param_.image_data_param().is_color();
   string root_folder = this->layer_param_.image_data_param().root_folder();
 
   CHECK((new_height == 0 && new_width == 0) ||
@@ -66,10 +67,14 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
     CHECK_GT(lines_.size(), skip) << "Not enough points to skip";
     lines_id_ = skip;
   }
+  // Decoded images are cached as read, i.e. resized.
+  const size_t cache_mb =
+      this->layer_param_.image_data_param().decoded_cache_mb();
+  if (cache_mb > 0) {
+    image_cache_.reset(new ImageCache(cache_mb << 20));
+  }
   // Read an image, and use it to initialize the top blob.
-  cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-                                    new_height, new_width, is_color);
-  CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
+  cv::Mat cv_img = ReadImage(root_folder + lines_[lines_id_].first);
   // Use data_transformer to infer the expected blob shape from a cv_image.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_img);
   this->transformed_data_.Reshape(top_shape);
@@ -77,8 +82,8 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int batch_size = this->layer_param_.image_data_param().batch_size();
   CHECK_GT(batch_size, 0) << "Positive batch size required";
   top_shape[0] = batch_size;
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   top[0]->Reshape(top_shape);
 
@@ -88,9 +93,41 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // label
   vector<int> label_shape(1, batch_size);
   top[1]->Reshape(label_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].label_.Reshape(label_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->label_.Reshape(label_shape);
+  }
+  // Decode threads, each with its own DataTransformer.
+  const int num_threads =
+      this->layer_param_.image_data_param().decode_threads();
+  decode_pool_.reset(new ThreadPool(num_threads));
+  transformers_.clear();
+  transformed_items_.clear();
+  for (int i = 0; i < num_threads; ++i) {
+    transformers_.push_back(shared_ptr<DataTransformer<Dtype> >(
+        new DataTransformer<Dtype>(this->transform_param_, this->phase_)));
+    transformed_items_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  if (num_threads > 0) {
+    LOG(INFO) << "Decoding images with " << num_threads << " threads";
+  }
+}
+
+template <typename Dtype>
+cv::Mat ImageDataLayer<Dtype>::ReadImage(const string& filename) {
+  cv::Mat cv_img;
+  if (image_cache_) {
+    cv_img = image_cache_->Get(filename);
+  }
+  if (!cv_img.data) {
+    const ImageDataParameter& param = this->layer_param_.image_data_param();
+    cv_img = ReadImageToCVMat(filename, param.new_height(), param.new_width(),
+                              param.is_color());
+    CHECK(cv_img.data) << "Could not load " << filename;
+    if (image_cache_) {
+      image_cache_->Put(filename, cv_img);
+    }
   }
+  return cv_img;
 }
 
 template <typename Dtype>
@@ -105,51 +142,39 @@ template <typename Dtype>
 void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CPUTimer batch_timer;
   batch_timer.Start();
-  double read_time = 0;
-  double trans_time = 0;
-  CPUTimer timer;
   CHECK(batch->data_.count());
   CHECK(this->transformed_data_.count());
   ImageDataParameter image_data_param = this->layer_param_.image_data_param();
   const int batch_size = image_data_param.batch_size();
-  const int new_height = image_data_param.new_height();
-  const int new_width = image_data_param.new_width();
-  const bool is_color = image_data_param.is_color();
   string root_folder = image_data_param.root_folder();
 
   // Reshape according to the first image of each batch
   // on single input batches allows for inputs of varying dimension.
-  cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-      new_height, new_width, is_color);
-  CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
+  first_image_ = ReadImage(root_folder + lines_[lines_id_].first);
   // Use data_transformer to infer the expected blob shape from a cv_img.
-  vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_img);
+  vector<int> top_shape = this->data_transformer_->InferBlobShape(first_image_);
   this->transformed_data_.Reshape(top_shape);
+  for (int i = 0; i < transformed_items_.size(); ++i) {
+    transformed_items_[i]->Reshape(top_shape);
+  }
   // Reshape batch according to the batch_size.
   top_shape[0] = batch_size;
   batch->data_.Reshape(top_shape);
 
-  Dtype* prefetch_data = batch->data_.mutable_cpu_data();
-  Dtype* prefetch_label = batch->label_.mutable_cpu_data();
+  top_data_ = batch->data_.mutable_cpu_data();
+  top_label_ = batch->label_.mutable_cpu_data();
 
-  // datum scales
+  // Pick the lines (and with decode threads, the random seeds) of the batch
+  // in order, then decode and transform its items in parallel.
   const int lines_size = lines_.size();
+  item_lines_.resize(batch_size);
+  item_seeds_.resize(batch_size);
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    // get a blob
-    timer.Start();
     CHECK_GT(lines_size, lines_id_);
-    cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-        new_height, new_width, is_color);
-    CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
-    read_time += timer.MicroSeconds();
-    timer.Start();
-    // Apply transformations (mirror, crop...) to the image
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(prefetch_data + offset);
-    this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
-    trans_time += timer.MicroSeconds();
-
-    prefetch_label[item_id] = lines_[lines_id_].second;
+    item_lines_[item_id] = lines_id_;
+    if (!transformers_.empty()) {
+      item_seeds_[item_id] = caffe_rng_rand();
+    }
     // go to the next iter
     lines_id_++;
     if (lines_id_ >= lines_size) {
@@ -161,10 +186,36 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       }
     }
   }
+  decode_pool_->Run(this, batch_size);
+  first_image_.release();
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
-  DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
-  DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  if (image_cache_) {
+    DLOG(INFO) << "   Cache hits: " << image_cache_->hits() << " of "
+               << image_cache_->hits() + image_cache_->misses();
+  }
+}
+
+// This function is called on prefetch thread, or a decode thread
+template <typename Dtype>
+void ImageDataLayer<Dtype>::Run(int item_id, int thread) {
+  const std::pair<std::string, int>& line = lines_[item_lines_[item_id]];
+  // The first image was decoded already to shape the batch.
+  cv::Mat cv_img = item_id == 0 ? first_image_ :
+      ReadImage(this->layer_param_.image_data_param().root_folder()
+                + line.first);
+  // Apply transformations (mirror, crop...) to the image
+  DataTransformer<Dtype>* transformer = this->data_transformer_.get();
+  Blob<Dtype>* transformed_data = &this->transformed_data_;
+  if (!transformers_.empty()) {
+    transformer = transformers_[thread].get();
+    transformer->SeedRand(item_seeds_[item_id]);
+    transformed_data = transformed_items_[thread].get();
+  }
+  transformed_data->set_cpu_data(
+      top_data_ + item_id * transformed_data->count());
+  transformer->Transform(cv_img, transformed_data);
+  top_label_[item_id] = line.second;
 }
 
 INSTANTIATE_CLASS(ImageDataLayer);
@@ -85,10 +85,29 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
-      M_, N_, K_, (Dtype)1.,
-      bottom_data, weight, (Dtype)0., top_data);
+  // Deployed pruned models multiply by the nonzero weights only.
+  if (this->phase_ == TEST && sparse_weight_.Update(*this->blobs_[0],
+      transpose_ ? K_ : N_,
+      this->layer_param_.inner_product_param().sparse_threshold())) {
+    if (transpose_) {
+      sparse_weight_.MultiplyLeft(M_, bottom_data, top_data);
+    } else {
+      sparse_weight_.MultiplyTransposedLeft(M_, bottom_data, top_data);
+    }
+  } else if (this->phase_ == TEST && half_weight_.Update(*this->blobs_[0],
+      transpose_ ? K_ : N_,
+      this->layer_param_.inner_product_param().weight_precision())) {
+    if (transpose_) {
+      half_weight_.MultiplyLeft(M_, bottom_data, top_data);
+    } else {
+      half_weight_.MultiplyTransposedLeft(M_, bottom_data, top_data);
+    }
+  } else {
+    const Dtype* weight = this->blobs_[0]->cpu_data();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
+        M_, N_, K_, (Dtype)1.,
+        bottom_data, weight, (Dtype)0., top_data);
+  }
   if (bias_term_) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
         bias_multiplier_.cpu_data(),
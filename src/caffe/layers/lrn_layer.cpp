@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/lrn_layer.hpp"
@@ -5,6 +6,10 @@
 
 namespace caffe {
 
+// ACROSS_CHANNELS walks each image in tiles of this many spatial positions,
+// so that the channels inside the sliding window stay in cache.
+static const int kLRNTileSize = 512;
+
 template <typename Dtype>
 void LRNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -78,6 +83,8 @@ void LRNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   case LRNParameter_NormRegion_ACROSS_CHANNELS:
     top[0]->Reshape(num_, channels_, height_, width_);
     scale_.Reshape(num_, channels_, height_, width_);
+    window_buffer_.Reshape(1, 1, size_ + 1,
+        std::min(kLRNTileSize, height_ * width_));
     break;
   case LRNParameter_NormRegion_WITHIN_CHANNEL:
     split_layer_->Reshape(bottom, split_top_vec_);
@@ -104,51 +111,78 @@ void LRNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void LRNLayer<Dtype>::ScalePower_cpu(const int n, const Dtype* scale,
+    const Dtype* x, Dtype* y) const {
+  if (beta_ == Dtype(0.75)) {
+    // The AlexNet/GoogLeNet setting: s^-0.75 = 1 / (sqrt(s) * sqrt(sqrt(s))).
+    for (int i = 0; i < n; ++i) {
+      const Dtype root = std::sqrt(scale[i]);
+      y[i] = x[i] / (root * std::sqrt(root));
+    }
+  } else {
+    for (int i = 0; i < n; ++i) {
+      y[i] = x[i] * std::pow(scale[i], -beta_);
+    }
+  }
+}
+
 template <typename Dtype>
 void LRNLayer<Dtype>::CrossChannelForward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   Dtype* scale_data = scale_.mutable_cpu_data();
-  // start with the constant value
-  for (int i = 0; i < scale_.count(); ++i) {
-    scale_data[i] = k_;
-  }
-  Blob<Dtype> padded_square(1, channels_ + size_ - 1, height_, width_);
-  Dtype* padded_square_data = padded_square.mutable_cpu_data();
-  caffe_set(padded_square.count(), Dtype(0), padded_square_data);
-  Dtype alpha_over_size = alpha_ / size_;
-  // go through the images
+  const int spatial_dim = height_ * width_;
+  const Dtype alpha_over_size = alpha_ / size_;
   for (int n = 0; n < num_; ++n) {
-    // compute the padded square
-    caffe_sqr(channels_ * height_ * width_,
-        bottom_data + bottom[0]->offset(n),
-        padded_square_data + padded_square.offset(0, pre_pad_));
-    // Create the first channel scale
-    for (int c = 0; c < size_; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c),
-          scale_data + scale_.offset(n, 0));
-    }
-    for (int c = 1; c < channels_; ++c) {
-      // copy previous scale
-      caffe_copy<Dtype>(height_ * width_,
-          scale_data + scale_.offset(n, c - 1),
-          scale_data + scale_.offset(n, c));
-      // add head
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c + size_ - 1),
-          scale_data + scale_.offset(n, c));
-      // subtract tail
-      caffe_axpy<Dtype>(height_ * width_, -alpha_over_size,
-          padded_square_data + padded_square.offset(0, c - 1),
-          scale_data + scale_.offset(n, c));
+    for (int tile = 0; tile < spatial_dim; tile += kLRNTileSize) {
+      const int len = std::min(kLRNTileSize, spatial_dim - tile);
+      const Dtype* x = bottom_data + bottom[0]->offset(n) + tile;
+      Dtype* scale = scale_data + scale_.offset(n) + tile;
+      Dtype* y = top_data + top[0]->offset(n) + tile;
+      // The first channel sums the squares of channels [0, pre_pad_].
+      for (int i = 0; i < len; ++i) {
+        scale[i] = k_;
+      }
+      for (int c = 0; c <= pre_pad_ && c < channels_; ++c) {
+        const Dtype* head = x + c * spatial_dim;
+        for (int i = 0; i < len; ++i) {
+          scale[i] += alpha_over_size * head[i] * head[i];
+        }
+      }
+      ScalePower_cpu(len, scale, x, y);
+      // Every later channel slides the window by one: add the square of the
+      // new head channel and subtract that of the dropped tail channel.
+      for (int c = 1; c < channels_; ++c) {
+        const Dtype* prev = scale + (c - 1) * spatial_dim;
+        Dtype* cur = scale + c * spatial_dim;
+        const int head_c = c + pre_pad_;
+        const int tail_c = c - pre_pad_ - 1;
+        if (head_c < channels_ && tail_c >= 0) {
+          const Dtype* head = x + head_c * spatial_dim;
+          const Dtype* tail = x + tail_c * spatial_dim;
+          for (int i = 0; i < len; ++i) {
+            cur[i] = prev[i] + alpha_over_size *
+                (head[i] * head[i] - tail[i] * tail[i]);
+          }
+        } else if (head_c < channels_) {
+          const Dtype* head = x + head_c * spatial_dim;
+          for (int i = 0; i < len; ++i) {
+            cur[i] = prev[i] + alpha_over_size * head[i] * head[i];
+          }
+        } else if (tail_c >= 0) {
+          const Dtype* tail = x + tail_c * spatial_dim;
+          for (int i = 0; i < len; ++i) {
+            cur[i] = prev[i] - alpha_over_size * tail[i] * tail[i];
+          }
+        } else {
+          caffe_copy(len, prev, cur);
+        }
+        ScalePower_cpu(len, cur, x + c * spatial_dim, y + c * spatial_dim);
+      }
     }
   }
-
-  // In the end, compute output
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, top_data);
-  caffe_mul<Dtype>(scale_.count(), top_data, bottom_data, top_data);
 }
 
 template <typename Dtype>
@@ -185,48 +219,51 @@ void LRNLayer<Dtype>::CrossChannelBackward_cpu(
   const Dtype* bottom_data = bottom[0]->cpu_data();
   const Dtype* scale_data = scale_.cpu_data();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  Blob<Dtype> padded_ratio(1, channels_ + size_ - 1, height_, width_);
-  Blob<Dtype> accum_ratio(1, 1, height_, width_);
-  Dtype* padded_ratio_data = padded_ratio.mutable_cpu_data();
-  Dtype* accum_ratio_data = accum_ratio.mutable_cpu_data();
-  // We hack a little bit by using the diff() to store an additional result
-  Dtype* accum_ratio_times_bottom = accum_ratio.mutable_cpu_diff();
-  caffe_set(padded_ratio.count(), Dtype(0), padded_ratio_data);
-  Dtype cache_ratio_value = 2. * alpha_ * beta_ / size_;
-
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, bottom_diff);
-  caffe_mul<Dtype>(scale_.count(), top_diff, bottom_diff, bottom_diff);
-
-  // go through individual data
-  int inverse_pre_pad = size_ - (size_ + 1) / 2;
+  const int spatial_dim = height_ * width_;
+  const Dtype cache_ratio_value = 2. * alpha_ * beta_ / size_;
+  // ratio(c) = diff_c * y_c / s_c is kept in a ring of size_ rows.  The row
+  // that receives ratio(c + pre_pad_) is the one that held
+  // ratio(c - pre_pad_ - 1), which is exactly what leaves the window.
+  Dtype* ring = window_buffer_.mutable_cpu_data();
+  Dtype* accum = ring + size_ * window_buffer_.width();
   for (int n = 0; n < num_; ++n) {
-    int block_offset = scale_.offset(n);
-    // first, compute diff_i * y_i / s_i
-    caffe_mul<Dtype>(channels_ * height_ * width_,
-        top_diff + block_offset, top_data + block_offset,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad));
-    caffe_div<Dtype>(channels_ * height_ * width_,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad),
-        scale_data + block_offset,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad));
-    // Now, compute the accumulated ratios and the bottom diff
-    caffe_set(accum_ratio.count(), Dtype(0), accum_ratio_data);
-    for (int c = 0; c < size_ - 1; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, 1.,
-          padded_ratio_data + padded_ratio.offset(0, c), accum_ratio_data);
-    }
-    for (int c = 0; c < channels_; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, 1.,
-          padded_ratio_data + padded_ratio.offset(0, c + size_ - 1),
-          accum_ratio_data);
-      // compute bottom diff
-      caffe_mul<Dtype>(height_ * width_,
-          bottom_data + top[0]->offset(n, c),
-          accum_ratio_data, accum_ratio_times_bottom);
-      caffe_axpy<Dtype>(height_ * width_, -cache_ratio_value,
-          accum_ratio_times_bottom, bottom_diff + top[0]->offset(n, c));
-      caffe_axpy<Dtype>(height_ * width_, -1.,
-          padded_ratio_data + padded_ratio.offset(0, c), accum_ratio_data);
+    const int block_offset = scale_.offset(n);
+    for (int tile = 0; tile < spatial_dim; tile += kLRNTileSize) {
+      const int len = std::min(kLRNTileSize, spatial_dim - tile);
+      const int offset = block_offset + tile;
+      caffe_set(window_buffer_.count(), Dtype(0), ring);
+      for (int c = 0; c < pre_pad_ && c < channels_; ++c) {
+        const int o = offset + c * spatial_dim;
+        Dtype* slot = ring + (c % size_) * len;
+        for (int i = 0; i < len; ++i) {
+          slot[i] = top_diff[o + i] * top_data[o + i] / scale_data[o + i];
+          accum[i] += slot[i];
+        }
+      }
+      for (int c = 0; c < channels_; ++c) {
+        const int head_c = c + pre_pad_;
+        Dtype* slot = ring + (head_c % size_) * len;
+        if (head_c < channels_) {
+          const int o = offset + head_c * spatial_dim;
+          for (int i = 0; i < len; ++i) {
+            const Dtype ratio =
+                top_diff[o + i] * top_data[o + i] / scale_data[o + i];
+            accum[i] += ratio - slot[i];
+            slot[i] = ratio;
+          }
+        } else {
+          for (int i = 0; i < len; ++i) {
+            accum[i] -= slot[i];
+            slot[i] = 0;
+          }
+        }
+        const int o = offset + c * spatial_dim;
+        ScalePower_cpu(len, scale_data + o, top_diff + o, bottom_diff + o);
+        for (int i = 0; i < len; ++i) {
+          bottom_diff[o + i] -=
+              cache_ratio_value * bottom_data[o + i] * accum[i];
+        }
+      }
     }
   }
 }
@@ -1,3 +1,4 @@
+#include <cmath>
 #include <string>
 #include <vector>
 
@@ -10,6 +11,22 @@
 
 namespace caffe {
 
+namespace {
+
+// The same activations as LSTMUnitLayer, so that the fused path reproduces
+// the unrolled net.
+template <typename Dtype>
+inline Dtype lstm_sigmoid(Dtype x) {
+  return 1. / (1. + exp(-x));
+}
+
+template <typename Dtype>
+inline Dtype lstm_tanh(Dtype x) {
+  return 2. * lstm_sigmoid(2. * x) - 1.;
+}
+
+}  // namespace
+
 template <typename Dtype>
 void LSTMLayer<Dtype>::RecurrentInputBlobNames(vector<string>* names) const {
   names->resize(2);
@@ -238,6 +255,136 @@ void LSTMLayer<Dtype>::FillUnrolledNet(NetParameter* net_param) const {
   net_param->add_layer()->CopyFrom(output_concat_layer);
 }
 
+template <typename Dtype>
+void LSTMLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  RecurrentLayer<Dtype>::Reshape(bottom, top);
+  if (!this->fused_cpu_) { return; }
+  const int num_output = this->layer_param_.recurrent_param().num_output();
+  vector<int> shape(3);
+  shape[0] = this->T_;
+  shape[1] = this->N_;
+  shape[2] = 4 * num_output;
+  gates_.Reshape(shape);
+  shape[2] = num_output;
+  cell_.Reshape(shape);
+  hidden_conted_.Reshape(shape);
+  shape[0] = 1;
+  state_diff_.Reshape(shape);
+}
+
+template <typename Dtype>
+void LSTMLayer<Dtype>::FusedForward_cpu() {
+  const int T = this->T_;
+  const int N = this->N_;
+  const int H = this->layer_param_.recurrent_param().num_output();
+  const int G = 4 * H;
+  // All timesteps' input projections at once; afterwards each timestep only
+  // needs the recurrent GEMM and the elementwise cell update.
+  this->FusedInputTransform_cpu(&gates_);
+  const Dtype* W_hc = this->blobs_[2 + this->static_input_]->cpu_data();
+  const Dtype* cont = this->cont_input_blob_->cpu_data();
+  Dtype* gate_data = gates_.mutable_cpu_data();
+  Dtype* cell_data = cell_.mutable_cpu_data();
+  Dtype* h_conted = hidden_conted_.mutable_cpu_data();
+  Dtype* h_data = this->output_blobs_[0]->mutable_cpu_data();
+  const Dtype* h_prev = this->recur_input_blobs_[0]->cpu_data();
+  const Dtype* c_prev = this->recur_input_blobs_[1]->cpu_data();
+  for (int t = 0; t < T; ++t) {
+    const Dtype* cont_t = cont + t * N;
+    Dtype* gate_t = gate_data + t * N * G;
+    Dtype* c_t = cell_data + t * N * H;
+    Dtype* h_t = h_data + t * N * H;
+    Dtype* h_conted_t = h_conted + t * N * H;
+    if (this->ContHidden_cpu(H, cont_t, h_prev, h_conted_t)) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, N, G, H, Dtype(1),
+          h_conted_t, W_hc, Dtype(1), gate_t);
+    }
+    for (int n = 0; n < N; ++n) {
+      Dtype* gate = gate_t + n * G;
+      for (int d = 0; d < H; ++d) {
+        const Dtype i = lstm_sigmoid(gate[d]);
+        const Dtype f = (cont_t[n] == 0) ? 0 :
+            (cont_t[n] * lstm_sigmoid(gate[1 * H + d]));
+        const Dtype o = lstm_sigmoid(gate[2 * H + d]);
+        const Dtype g = lstm_tanh(gate[3 * H + d]);
+        const Dtype c = f * c_prev[n * H + d] + i * g;
+        c_t[n * H + d] = c;
+        h_t[n * H + d] = o * lstm_tanh(c);
+        gate[d] = i;
+        gate[1 * H + d] = f;
+        gate[2 * H + d] = o;
+        gate[3 * H + d] = g;
+      }
+    }
+    h_prev = h_t;
+    c_prev = c_t;
+  }
+  caffe_copy(N * H, h_prev, this->recur_output_blobs_[0]->mutable_cpu_data());
+  caffe_copy(N * H, c_prev, this->recur_output_blobs_[1]->mutable_cpu_data());
+}
+
+template <typename Dtype>
+void LSTMLayer<Dtype>::FusedBackward_cpu(bool propagate_x,
+    bool propagate_static) {
+  const int T = this->T_;
+  const int N = this->N_;
+  const int H = this->layer_param_.recurrent_param().num_output();
+  const int G = 4 * H;
+  const Dtype* W_hc = this->blobs_[2 + this->static_input_]->cpu_data();
+  const Dtype* cont = this->cont_input_blob_->cpu_data();
+  const Dtype* gate_data = gates_.cpu_data();
+  const Dtype* cell_data = cell_.cpu_data();
+  const Dtype* h_diff = this->output_blobs_[0]->cpu_diff();
+  Dtype* gate_diff = gates_.mutable_cpu_diff();
+  Dtype* h_next_diff = state_diff_.mutable_cpu_data();
+  Dtype* c_next_diff = state_diff_.mutable_cpu_diff();
+  // Nothing flows back from beyond the last timestep.
+  caffe_set(N * H, Dtype(0), h_next_diff);
+  caffe_set(N * H, Dtype(0), c_next_diff);
+  for (int t = T - 1; t >= 0; --t) {
+    const Dtype* c_prev = (t > 0) ? cell_data + (t - 1) * N * H :
+        this->recur_input_blobs_[1]->cpu_data();
+    const Dtype* gate_t = gate_data + t * N * G;
+    const Dtype* c_t = cell_data + t * N * H;
+    const Dtype* h_diff_t = h_diff + t * N * H;
+    Dtype* gate_diff_t = gate_diff + t * N * G;
+    for (int n = 0; n < N; ++n) {
+      const Dtype* gate = gate_t + n * G;
+      Dtype* dgate = gate_diff_t + n * G;
+      for (int d = 0; d < H; ++d) {
+        const int k = n * H + d;
+        const Dtype i = gate[d];
+        const Dtype f = gate[1 * H + d];
+        const Dtype o = gate[2 * H + d];
+        const Dtype g = gate[3 * H + d];
+        const Dtype tanh_c = lstm_tanh(c_t[k]);
+        const Dtype dh = h_diff_t[k] + h_next_diff[k];
+        const Dtype c_term_diff =
+            c_next_diff[k] + dh * o * (1 - tanh_c * tanh_c);
+        c_next_diff[k] = c_term_diff * f;
+        dgate[d] = c_term_diff * g * i * (1 - i);
+        dgate[1 * H + d] = c_term_diff * c_prev[k] * f * (1 - f);
+        dgate[2 * H + d] = dh * tanh_c * o * (1 - o);
+        dgate[3 * H + d] = c_term_diff * i * (1 - g * g);
+      }
+    }
+    if (t > 0) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, N, H, G, Dtype(1),
+          gate_diff_t, W_hc, Dtype(0), h_next_diff);
+      const Dtype* cont_t = cont + t * N;
+      for (int n = 0; n < N; ++n) {
+        caffe_scal(H, cont_t[n], h_next_diff + n * H);
+      }
+    }
+  }
+  // The recurrent weight gradient over all timesteps in a single GEMM.
+  caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, G, H, T * N, Dtype(1),
+      gate_diff, hidden_conted_.cpu_data(), Dtype(1),
+      this->blobs_[2 + this->static_input_]->mutable_cpu_diff());
+  this->FusedInputTransformBackward_cpu(gates_, propagate_x, propagate_static);
+}
+
 INSTANTIATE_CLASS(LSTMLayer);
 REGISTER_LAYER_CLASS(LSTM);
 
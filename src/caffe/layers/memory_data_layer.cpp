@@ -2,12 +2,23 @@
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
 
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/memory_data_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+template <typename Dtype>
+MemoryDataLayer<Dtype>::MemoryDataLayer(const LayerParameter& param)
+    : BaseDataLayer<Dtype>(param), has_new_data_(false),
+      free_(std::max(param.memory_data_param().buffers(), 1u),
+            RingQueue<Batch<Dtype>*>::SPSC),
+      full_(free_.capacity(), RingQueue<Batch<Dtype>*>::SPSC),
+      current_(NULL) {
+}
+
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
      const vector<Blob<Dtype>*>& top) {
@@ -28,16 +39,62 @@ void MemoryDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   labels_ = NULL;
   added_data_.cpu_data();
   added_label_.cpu_data();
+  // Allocate the ring up front, so that adding batches reuses its memory.
+  const int buffers = this->layer_param_.memory_data_param().buffers();
+  for (int i = buffers_.size(); i < buffers; ++i) {
+    shared_ptr<Batch<Dtype> > batch(new Batch<Dtype>());
+    batch->data_.Reshape(batch_size_, channels_, height_, width_);
+    batch->label_.Reshape(batch_size_, 1, 1, 1);
+    batch->data_.mutable_cpu_data();
+    batch->label_.mutable_cpu_data();
+    buffers_.push_back(batch);
+    free_.push(batch.get());
+  }
+  transformed_data_.Reshape(1, channels_, height_, width_);
+}
+
+template <typename Dtype>
+Batch<Dtype>* MemoryDataLayer<Dtype>::free_batch(bool wait) {
+  Batch<Dtype>* batch = NULL;
+  if (wait) {
+    batch = free_.pop();
+  } else if (!free_.try_pop(&batch)) {
+    return NULL;
+  }
+  // Only reallocates if the batch size grew.
+  batch->data_.Reshape(batch_size_, channels_, height_, width_);
+  batch->label_.Reshape(batch_size_, 1, 1, 1);
+  return batch;
 }
 
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::AddDatumVector(const vector<Datum>& datum_vector) {
-  CHECK(!has_new_data_) <<
-      "Can't add data until current data has been consumed.";
   size_t num = datum_vector.size();
   CHECK_GT(num, 0) << "There is no datum to add.";
   CHECK_EQ(num % batch_size_, 0) <<
       "The added data must be a multiple of the batch size.";
+  if (!buffers_.empty()) {
+    // Transform each item into its slot of the next free batch.
+    Batch<Dtype>* batch = NULL;
+    for (int item_id = 0; item_id < num; ++item_id) {
+      const int batch_item = item_id % batch_size_;
+      if (batch_item == 0) {
+        batch = free_batch();
+      }
+      transformed_data_.set_cpu_data(batch->data_.mutable_cpu_data() +
+                                     batch->data_.offset(batch_item));
+      this->data_transformer_->Transform(datum_vector[item_id],
+                                         &transformed_data_);
+      batch->label_.mutable_cpu_data()[batch_item] =
+          datum_vector[item_id].label();
+      if (batch_item == batch_size_ - 1) {
+        full_.push(batch);
+      }
+    }
+    return;
+  }
+  CHECK(!has_new_data_) <<
+      "Can't add data until current data has been consumed.";
   added_data_.Reshape(num, channels_, height_, width_);
   added_label_.Reshape(num, 1, 1, 1);
   // Apply data transformations (mirror, scale, crop...)
@@ -58,11 +115,29 @@ template <typename Dtype>
 void MemoryDataLayer<Dtype>::AddMatVector(const vector<cv::Mat>& mat_vector,
     const vector<int>& labels) {
   size_t num = mat_vector.size();
-  CHECK(!has_new_data_) <<
-      "Can't add mat until current data has been consumed.";
   CHECK_GT(num, 0) << "There is no mat to add";
   CHECK_EQ(num % batch_size_, 0) <<
       "The added data must be a multiple of the batch size.";
+  if (!buffers_.empty()) {
+    Batch<Dtype>* batch = NULL;
+    for (int item_id = 0; item_id < num; ++item_id) {
+      const int batch_item = item_id % batch_size_;
+      if (batch_item == 0) {
+        batch = free_batch();
+      }
+      transformed_data_.set_cpu_data(batch->data_.mutable_cpu_data() +
+                                     batch->data_.offset(batch_item));
+      this->data_transformer_->Transform(mat_vector[item_id],
+                                         &transformed_data_);
+      batch->label_.mutable_cpu_data()[batch_item] = labels[item_id];
+      if (batch_item == batch_size_ - 1) {
+        full_.push(batch);
+      }
+    }
+    return;
+  }
+  CHECK(!has_new_data_) <<
+      "Can't add mat until current data has been consumed.";
   added_data_.Reshape(num, channels_, height_, width_);
   added_label_.Reshape(num, 1, 1, 1);
   // Apply data transformations (mirror, scale, crop...)
@@ -79,8 +154,35 @@ void MemoryDataLayer<Dtype>::AddMatVector(const vector<cv::Mat>& mat_vector,
 }
 #endif  // USE_OPENCV
 
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::AddBatch(const Dtype* data, const Dtype* labels) {
+  CHECK(!buffers_.empty()) << "AddBatch requires memory_data_param.buffers";
+  PushBatch(free_batch(), data, labels);
+}
+
+template <typename Dtype>
+bool MemoryDataLayer<Dtype>::TryAddBatch(const Dtype* data,
+    const Dtype* labels) {
+  CHECK(!buffers_.empty()) << "TryAddBatch requires memory_data_param.buffers";
+  Batch<Dtype>* batch = free_batch(false);
+  if (!batch) {
+    return false;
+  }
+  PushBatch(batch, data, labels);
+  return true;
+}
+
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::PushBatch(Batch<Dtype>* batch, const Dtype* data,
+    const Dtype* labels) {
+  caffe_copy(batch->data_.count(), data, batch->data_.mutable_cpu_data());
+  caffe_copy(batch_size_, labels, batch->label_.mutable_cpu_data());
+  full_.push(batch);
+}
+
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::Reset(Dtype* data, Dtype* labels, int n) {
+  CHECK(buffers_.empty()) << "Reset can't be used with buffers; use AddBatch";
   CHECK(data);
   CHECK(labels);
   CHECK_EQ(n % batch_size_, 0) << "n must be a multiple of batch size";
@@ -107,6 +209,18 @@ void MemoryDataLayer<Dtype>::set_batch_size(int new_size) {
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (!buffers_.empty()) {
+    // The previous batch is no longer referenced by the tops.
+    if (current_) {
+      free_.push(current_);
+    }
+    current_ = full_.pop("Waiting for MemoryData batches");
+    top[0]->ReshapeLike(current_->data_);
+    top[0]->set_cpu_data(current_->data_.mutable_cpu_data());
+    top[1]->ReshapeLike(current_->label_);
+    top[1]->set_cpu_data(current_->label_.mutable_cpu_data());
+    return;
+  }
   CHECK(data_) << "MemoryDataLayer needs to be initialized by calling Reset";
   top[0]->Reshape(batch_size_, channels_, height_, width_);
   top[1]->Reshape(batch_size_, 1, 1, 1);
@@ -10,6 +10,106 @@ namespace caffe {
 using std::min;
 using std::max;
 
+namespace {
+
+// Computes the range [begin, end) of output positions along one axis whose
+// pooling window lies entirely inside the input.
+void interior_range(int pooled, int size, int kernel, int stride, int pad,
+    int* begin, int* end) {
+  *begin = min((pad + stride - 1) / stride, pooled);
+  *end = (size + pad - kernel >= 0) ?
+      min((size + pad - kernel) / stride + 1, pooled) : 0;
+  *end = max(*end, *begin);
+}
+
+template <typename Dtype>
+struct MaxReducer {
+  static inline Dtype apply(Dtype a, Dtype b) { return a > b ? a : b; }
+};
+
+template <typename Dtype>
+struct SumReducer {
+  static inline Dtype apply(Dtype a, Dtype b) { return a + b; }
+};
+
+// Reduces rows [hstart, hend) of a plane elementwise into row.
+template <typename Dtype, typename Reducer>
+void reduce_rows(const Dtype* bottom_data, int width, int hstart, int hend,
+    Dtype* row) {
+  caffe_copy(width, bottom_data + hstart * width, row);
+  for (int h = hstart + 1; h < hend; ++h) {
+    const Dtype* src = bottom_data + h * width;
+    for (int w = 0; w < width; ++w) {
+      row[w] = Reducer::apply(row[w], src[w]);
+    }
+  }
+}
+
+// Reduces row[wstart, wend) after clipping the window to [0, width).
+template <typename Dtype, typename Reducer>
+inline Dtype reduce_clipped(const Dtype* row, int width, int wstart,
+    int wend) {
+  wstart = max(wstart, 0);
+  wend = min(wend, width);
+  Dtype acc = row[wstart];
+  for (int w = wstart + 1; w < wend; ++w) {
+    acc = Reducer::apply(acc, row[w]);
+  }
+  return acc;
+}
+
+// Reduces a row across the width of each pooling window, writing one output
+// per window.  Windows in [wbegin, wend) need no clipping, and the common 2-
+// and 3-wide kernels get unrolled loops there.
+template <typename Dtype, typename Reducer>
+void reduce_windows(const Dtype* row, int width, int pooled_width,
+    int kernel_w, int stride_w, int pad_w, int wbegin, int wend,
+    Dtype* top_data) {
+  for (int pw = 0; pw < wbegin; ++pw) {
+    top_data[pw] = reduce_clipped<Dtype, Reducer>(row, width,
+        pw * stride_w - pad_w, pw * stride_w - pad_w + kernel_w);
+  }
+  const Dtype* src = row + wbegin * stride_w - pad_w;
+  if (kernel_w == 2) {
+    for (int pw = wbegin; pw < wend; ++pw, src += stride_w) {
+      top_data[pw] = Reducer::apply(src[0], src[1]);
+    }
+  } else if (kernel_w == 3) {
+    for (int pw = wbegin; pw < wend; ++pw, src += stride_w) {
+      top_data[pw] = Reducer::apply(Reducer::apply(src[0], src[1]), src[2]);
+    }
+  } else {
+    for (int pw = wbegin; pw < wend; ++pw, src += stride_w) {
+      Dtype acc = src[0];
+      for (int k = 1; k < kernel_w; ++k) {
+        acc = Reducer::apply(acc, src[k]);
+      }
+      top_data[pw] = acc;
+    }
+  }
+  for (int pw = wend; pw < pooled_width; ++pw) {
+    top_data[pw] = reduce_clipped<Dtype, Reducer>(row, width,
+        pw * stride_w - pad_w, pw * stride_w - pad_w + kernel_w);
+  }
+}
+
+// Scans one (already clipped) window for its first maximum.
+template <typename Dtype>
+inline void max_window(const Dtype* bottom_data, int width, int hstart,
+    int hend, int wstart, int wend, Dtype* maxval, int* maxidx) {
+  for (int h = hstart; h < hend; ++h) {
+    const Dtype* src = bottom_data + h * width;
+    for (int w = wstart; w < wend; ++w) {
+      if (src[w] > *maxval) {
+        *maxval = src[w];
+        *maxidx = h * width + w;
+      }
+    }
+  }
+}
+
+}  // namespace
+
 template <typename Dtype>
 void PoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -120,102 +220,161 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     rand_idx_.Reshape(bottom[0]->num(), channels_, pooled_height_,
       pooled_width_);
   }
+  max_idx_valid_ = false;
+  interior_range(pooled_width_, width_, kernel_w_, stride_w_, pad_w_,
+      &interior_w_begin_, &interior_w_end_);
+  row_buffer_.Reshape(vector<int>(1, width_));
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::MaxPoolPlaneWithMask_cpu(const Dtype* bottom_data,
+      Dtype* top_data, int* mask, Dtype* top_mask) {
+  for (int ph = 0; ph < pooled_height_; ++ph) {
+    const int hstart = max(ph * stride_h_ - pad_h_, 0);
+    const int hend = min(ph * stride_h_ - pad_h_ + kernel_h_, height_);
+    for (int pw = 0; pw < pooled_width_; ++pw) {
+      int wstart = pw * stride_w_ - pad_w_;
+      int wend = wstart + kernel_w_;
+      if (pw < interior_w_begin_ || pw >= interior_w_end_) {
+        wstart = max(wstart, 0);
+        wend = min(wend, width_);
+      }
+      Dtype maxval = -FLT_MAX;
+      int maxidx = -1;
+      max_window(bottom_data, width_, hstart, hend, wstart, wend,
+          &maxval, &maxidx);
+      const int pool_index = ph * pooled_width_ + pw;
+      if (top_data) {
+        top_data[pool_index] = maxval;
+      }
+      if (top_mask) {
+        top_mask[pool_index] = static_cast<Dtype>(maxidx);
+      } else {
+        mask[pool_index] = maxidx;
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::SeparablePoolPlane_cpu(const Dtype* bottom_data,
+      Dtype* top_data, bool max_pool) {
+  Dtype* row = row_buffer_.mutable_cpu_data();
+  for (int ph = 0; ph < pooled_height_; ++ph) {
+    const int hstart = max(ph * stride_h_ - pad_h_, 0);
+    const int hend = min(ph * stride_h_ - pad_h_ + kernel_h_, height_);
+    Dtype* top_row = top_data + ph * pooled_width_;
+    if (max_pool) {
+      reduce_rows<Dtype, MaxReducer<Dtype> >(bottom_data, width_,
+          hstart, hend, row);
+      reduce_windows<Dtype, MaxReducer<Dtype> >(row, width_, pooled_width_,
+          kernel_w_, stride_w_, pad_w_, interior_w_begin_, interior_w_end_,
+          top_row);
+    } else {
+      reduce_rows<Dtype, SumReducer<Dtype> >(bottom_data, width_,
+          hstart, hend, row);
+      reduce_windows<Dtype, SumReducer<Dtype> >(row, width_, pooled_width_,
+          kernel_w_, stride_w_, pad_w_, interior_w_begin_, interior_w_end_,
+          top_row);
+      // The divisor counts padding, as in the reference implementation.
+      const int pool_h = min(ph * stride_h_ - pad_h_ + kernel_h_,
+          height_ + pad_h_) - (ph * stride_h_ - pad_h_);
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        const int pool_w = min(pw * stride_w_ - pad_w_ + kernel_w_,
+            width_ + pad_w_) - (pw * stride_w_ - pad_w_);
+        top_row[pw] /= pool_h * pool_w;
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::RebuildMaxIdx_cpu(const Blob<Dtype>* bottom) {
+  const Dtype* bottom_data = bottom->cpu_data();
+  int* mask = max_idx_.mutable_cpu_data();
+  for (int i = 0; i < bottom->num() * channels_; ++i) {
+    MaxPoolPlaneWithMask_cpu(bottom_data, NULL, mask, NULL);
+    bottom_data += bottom->offset(0, 1);
+    mask += max_idx_.offset(0, 1);
+  }
+  max_idx_valid_ = true;
 }
 
-// TODO(Yangqing): Is there a faster way to do pooling in the channel-first
-// case?
 template <typename Dtype>
 void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  const int top_count = top[0]->count();
+  const int num_planes = bottom[0]->num() * channels_;
+  const int plane_size = height_ * width_;
   // We'll output the mask to top[1] if it's of size >1.
   const bool use_top_mask = top.size() > 1;
+  // Nothing reads max_idx_ in the TEST phase, so it is only rebuilt if
+  // Backward is called anyway.
+  const bool need_mask = use_top_mask || this->phase_ != TEST;
   int* mask = NULL;  // suppress warnings about uninitalized variables
   Dtype* top_mask = NULL;
   // Different pooling methods. We explicitly do the switch outside the for
   // loop to save time, although this results in more code.
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
-    // Initialize
+    if (!need_mask) {
+      max_idx_valid_ = false;
+      if (global_pooling_) {
+        for (int i = 0; i < num_planes; ++i) {
+          Dtype maxval = bottom_data[0];
+          for (int j = 1; j < plane_size; ++j) {
+            maxval = MaxReducer<Dtype>::apply(maxval, bottom_data[j]);
+          }
+          top_data[i] = maxval;
+          bottom_data += plane_size;
+        }
+      } else {
+        for (int i = 0; i < num_planes; ++i) {
+          SeparablePoolPlane_cpu(bottom_data, top_data, true);
+          bottom_data += bottom[0]->offset(0, 1);
+          top_data += top[0]->offset(0, 1);
+        }
+      }
+      break;
+    }
     if (use_top_mask) {
       top_mask = top[1]->mutable_cpu_data();
-      caffe_set(top_count, Dtype(-1), top_mask);
     } else {
       mask = max_idx_.mutable_cpu_data();
-      caffe_set(top_count, -1, mask);
+      max_idx_valid_ = true;
     }
-    caffe_set(top_count, Dtype(-FLT_MAX), top_data);
     // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_);
-            int wend = min(wstart + kernel_w_, width_);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            const int pool_index = ph * pooled_width_ + pw;
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                const int index = h * width_ + w;
-                if (bottom_data[index] > top_data[pool_index]) {
-                  top_data[pool_index] = bottom_data[index];
-                  if (use_top_mask) {
-                    top_mask[pool_index] = static_cast<Dtype>(index);
-                  } else {
-                    mask[pool_index] = index;
-                  }
-                }
-              }
-            }
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
-        }
+    for (int i = 0; i < num_planes; ++i) {
+      MaxPoolPlaneWithMask_cpu(bottom_data, top_data, mask, top_mask);
+      // compute offset
+      bottom_data += bottom[0]->offset(0, 1);
+      top_data += top[0]->offset(0, 1);
+      if (use_top_mask) {
+        top_mask += top[0]->offset(0, 1);
+      } else {
+        mask += top[0]->offset(0, 1);
       }
     }
     break;
   case PoolingParameter_PoolMethod_AVE:
-    for (int i = 0; i < top_count; ++i) {
-      top_data[i] = 0;
-    }
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                top_data[ph * pooled_width_ + pw] +=
-                    bottom_data[h * width_ + w];
-              }
-            }
-            top_data[ph * pooled_width_ + pw] /= pool_size;
-          }
+    if (global_pooling_) {
+      for (int i = 0; i < num_planes; ++i) {
+        Dtype sum = 0;
+        for (int j = 0; j < plane_size; ++j) {
+          sum += bottom_data[j];
         }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
+        top_data[i] = sum / plane_size;
+        bottom_data += plane_size;
       }
+      break;
+    }
+    // The main loop
+    for (int i = 0; i < num_planes; ++i) {
+      SeparablePoolPlane_cpu(bottom_data, top_data, false);
+      // compute offset
+      bottom_data += bottom[0]->offset(0, 1);
+      top_data += top[0]->offset(0, 1);
     }
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
@@ -247,6 +406,9 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     if (use_top_mask) {
       top_mask = top[1]->cpu_data();
     } else {
+      if (!max_idx_valid_) {
+        RebuildMaxIdx_cpu(bottom[0]);
+      }
       mask = max_idx_.cpu_data();
     }
     for (int n = 0; n < top[0]->num(); ++n) {
@@ -47,6 +47,53 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     CHECK_EQ(N_, bottom[2]->shape(0));
   }
 
+  // The fused CPU path bypasses the unrolled net, so it is disabled when the
+  // net's debug_info is requested.
+  fused_cpu_ = HasFusedCpu() &&
+      this->layer_param_.recurrent_param().fused_cpu() &&
+      !this->layer_param_.recurrent_param().debug_info();
+
+  // With the fused path, the layer holds the inputs and outputs itself, and
+  // the parameters come from the net unrolled over a single timestep: its
+  // layers fill them as the first timestep of the full net does, the later
+  // timesteps only sharing them. The full net is built if it is ever run.
+  shared_ptr<Net<Dtype> > net = UnrolledNet(bottom, fused_cpu_ ? 1 : T_);
+  if (fused_cpu_) {
+    SetUpFusedBlobs(*net);
+  } else {
+    unrolled_net_ = net;
+    ConnectUnrolledNet();
+  }
+
+  CHECK_EQ(top.size() - num_hidden_exposed, output_names.size())
+      << "OutputBlobNames must provide an output blob name for each top.";
+
+  // This layer's parameters are any parameters in the layers of the unrolled
+  // net. We only want one copy of each parameter, so check that the parameter
+  // is "owned" by the layer, rather than shared with another.
+  this->blobs_.clear();
+  for (int i = 0; i < net->params().size(); ++i) {
+    if (net->param_owners()[i] == -1) {
+      LOG(INFO) << "Adding parameter " << i << ": "
+                << net->param_display_names()[i];
+      this->blobs_.push_back(net->params()[i]);
+    }
+  }
+  // Check that param_propagate_down is set for all of the parameters in the
+  // unrolled net; set param_propagate_down to true in this layer.
+  for (int i = 0; i < net->layers().size(); ++i) {
+    for (int j = 0; j < net->layers()[i]->blobs().size(); ++j) {
+      CHECK(net->layers()[i]->param_propagate_down(j))
+          << "param_propagate_down not set for layer " << i << ", param " << j;
+    }
+  }
+  this->param_propagate_down_.clear();
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+}
+
+template <typename Dtype>
+shared_ptr<Net<Dtype> > RecurrentLayer<Dtype>::UnrolledNet(
+    const vector<Blob<Dtype>*>& bottom, int num_timesteps) {
   // Create a NetParameter; setup the inputs that aren't unique to particular
   // recurrent architectures.
   NetParameter net_param;
@@ -56,15 +103,15 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   InputParameter* input_param = input_layer_param->mutable_input_param();
   input_layer_param->add_top("x");
   BlobShape input_shape;
-  for (int i = 0; i < bottom[0]->num_axes(); ++i) {
+  input_shape.add_dim(num_timesteps);
+  for (int i = 1; i < bottom[0]->num_axes(); ++i) {
     input_shape.add_dim(bottom[0]->shape(i));
   }
   input_param->add_shape()->CopyFrom(input_shape);
 
   input_shape.Clear();
-  for (int i = 0; i < bottom[1]->num_axes(); ++i) {
-    input_shape.add_dim(bottom[1]->shape(i));
-  }
+  input_shape.add_dim(num_timesteps);
+  input_shape.add_dim(bottom[1]->shape(1));
   input_layer_param->add_top("cont");
   input_param->add_shape()->CopyFrom(input_shape);
 
@@ -78,8 +125,11 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
 
   // Call the child's FillUnrolledNet implementation to specify the unrolled
-  // recurrent architecture.
+  // recurrent architecture, which spans T_ timesteps.
+  const int T = T_;
+  T_ = num_timesteps;
   this->FillUnrolledNet(&net_param);
+  T_ = T;
 
   // Prepend this layer's name to the names of each layer in the unrolled net.
   const string& layer_name = this->layer_param_.name();
@@ -93,21 +143,32 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // Add "pseudo-losses" to all outputs to force backpropagation.
   // (Setting force_backward is too aggressive as we may not need to backprop to
   // all inputs, e.g., the sequence continuation indicators.)
-  vector<string> pseudo_losses(output_names.size());
+  vector<string> output_names;
+  OutputBlobNames(&output_names);
   for (int i = 0; i < output_names.size(); ++i) {
     LayerParameter* layer = net_param.add_layer();
-    pseudo_losses[i] = output_names[i] + "_pseudoloss";
-    layer->set_name(pseudo_losses[i]);
+    layer->set_name(output_names[i] + "_pseudoloss");
     layer->set_type("Reduction");
     layer->add_bottom(output_names[i]);
-    layer->add_top(pseudo_losses[i]);
+    layer->add_top(output_names[i] + "_pseudoloss");
     layer->add_loss_weight(1);
   }
 
   // Create the unrolled net.
-  unrolled_net_.reset(new Net<Dtype>(net_param));
-  unrolled_net_->set_debug_info(
-      this->layer_param_.recurrent_param().debug_info());
+  shared_ptr<Net<Dtype> > net(new Net<Dtype>(net_param));
+  net->set_debug_info(this->layer_param_.recurrent_param().debug_info());
+  return net;
+}
+
+template <typename Dtype>
+void RecurrentLayer<Dtype>::ConnectUnrolledNet() {
+  vector<string> output_names;
+  OutputBlobNames(&output_names);
+  vector<string> recur_input_names;
+  RecurrentInputBlobNames(&recur_input_names);
+  vector<string> recur_output_names;
+  RecurrentOutputBlobNames(&recur_output_names);
+  const int num_recur_blobs = recur_input_names.size();
 
   // Setup pointers to the inputs.
   x_input_blob_ = CHECK_NOTNULL(unrolled_net_->blob_by_name("x").get());
@@ -128,8 +189,6 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
 
   // Setup pointers to outputs.
-  CHECK_EQ(top.size() - num_hidden_exposed, output_names.size())
-      << "OutputBlobNames must provide an output blob name for each top.";
   output_blobs_.resize(output_names.size());
   for (int i = 0; i < output_names.size(); ++i) {
     output_blobs_[i] =
@@ -141,28 +200,6 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   CHECK_EQ(2 + num_recur_blobs + static_input_,
            unrolled_net_->input_blobs().size());
 
-  // This layer's parameters are any parameters in the layers of the unrolled
-  // net. We only want one copy of each parameter, so check that the parameter
-  // is "owned" by the layer, rather than shared with another.
-  this->blobs_.clear();
-  for (int i = 0; i < unrolled_net_->params().size(); ++i) {
-    if (unrolled_net_->param_owners()[i] == -1) {
-      LOG(INFO) << "Adding parameter " << i << ": "
-                << unrolled_net_->param_display_names()[i];
-      this->blobs_.push_back(unrolled_net_->params()[i]);
-    }
-  }
-  // Check that param_propagate_down is set for all of the parameters in the
-  // unrolled net; set param_propagate_down to true in this layer.
-  for (int i = 0; i < unrolled_net_->layers().size(); ++i) {
-    for (int j = 0; j < unrolled_net_->layers()[i]->blobs().size(); ++j) {
-      CHECK(unrolled_net_->layers()[i]->param_propagate_down(j))
-          << "param_propagate_down not set for layer " << i << ", param " << j;
-    }
-  }
-  this->param_propagate_down_.clear();
-  this->param_propagate_down_.resize(this->blobs_.size(), true);
-
   // Set the diffs of recurrent outputs to 0 -- we can't backpropagate across
   // batches.
   for (int i = 0; i < recur_output_blobs_.size(); ++i) {
@@ -173,10 +210,89 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // Check that the last output_names.size() layers are the pseudo-losses;
   // set last_layer_index so that we don't actually run these layers.
   const vector<string>& layer_names = unrolled_net_->layer_names();
-  last_layer_index_ = layer_names.size() - 1 - pseudo_losses.size();
+  last_layer_index_ = layer_names.size() - 1 - output_names.size();
   for (int i = last_layer_index_ + 1, j = 0; i < layer_names.size(); ++i, ++j) {
-    CHECK_EQ(layer_names[i], pseudo_losses[j]);
+    CHECK_EQ(layer_names[i], output_names[j] + "_pseudoloss");
+  }
+}
+
+template <typename Dtype>
+void RecurrentLayer<Dtype>::SetUpFusedBlobs(const Net<Dtype>& net) {
+  vector<string> output_names;
+  OutputBlobNames(&output_names);
+  vector<string> recur_input_names;
+  RecurrentInputBlobNames(&recur_input_names);
+  const int num_recur_blobs = recur_input_names.size();
+
+  fused_blobs_.clear();
+  const int num_blobs =
+      2 + static_input_ + 2 * num_recur_blobs + output_names.size();
+  for (int i = 0; i < num_blobs; ++i) {
+    fused_blobs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  int blob_id = 0;
+  x_input_blob_ = fused_blobs_[blob_id++].get();
+  cont_input_blob_ = fused_blobs_[blob_id++].get();
+  if (static_input_) {
+    x_static_input_blob_ = fused_blobs_[blob_id++].get();
+  }
+  recur_input_blobs_.resize(num_recur_blobs);
+  recur_output_blobs_.resize(num_recur_blobs);
+  for (int i = 0; i < num_recur_blobs; ++i) {
+    recur_input_blobs_[i] = fused_blobs_[blob_id++].get();
+    recur_output_blobs_[i] = fused_blobs_[blob_id++].get();
+    recur_output_blobs_[i]->ReshapeLike(
+        *CHECK_NOTNULL(net.blob_by_name(recur_input_names[i]).get()));
+    caffe_set(recur_output_blobs_[i]->count(), Dtype(0),
+              recur_output_blobs_[i]->mutable_cpu_diff());
+  }
+  // The outputs concatenate the timesteps along the first axis.
+  output_blobs_.resize(output_names.size());
+  output_shapes_.resize(output_names.size());
+  for (int i = 0; i < output_names.size(); ++i) {
+    output_blobs_[i] = fused_blobs_[blob_id++].get();
+    output_shapes_[i] =
+        CHECK_NOTNULL(net.blob_by_name(output_names[i]).get())->shape();
+  }
+}
+
+template <typename Dtype>
+void RecurrentLayer<Dtype>::PrepareUnrolledNet(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!fused_cpu_) {
+    // Hacky fix for test time: reshare all the internal shared blobs, which
+    // may currently point to a stale owner blob that was dropped when
+    // Solver::Test called test_net->ShareTrainedLayersWith(net_.get()).
+    // TODO: somehow make this work non-hackily.
+    if (this->phase_ == TEST) {
+      unrolled_net_->ShareWeights();
+    }
+    return;
+  }
+  if (!unrolled_net_) {
+    LOG(INFO) << "Building the unrolled net of fused layer "
+              << this->layer_param_.name();
+    unrolled_net_ = UnrolledNet(bottom, T_);
+    const vector<Blob<Dtype>*> recur_output_blobs(recur_output_blobs_);
+    ConnectUnrolledNet();
+    // Carry the hidden state over into the net.
+    for (int i = 0; i < recur_output_blobs_.size(); ++i) {
+      recur_output_blobs_[i]->CopyFrom(*recur_output_blobs[i], false, true);
+    }
+    fused_blobs_.clear();
+    Reshape(bottom, top);
+  }
+  // The parameters of the net share this layer's, which may since have been
+  // shared with another layer's.
+  const vector<shared_ptr<Blob<Dtype> > >& params = unrolled_net_->params();
+  for (int i = 0, j = 0; i < params.size(); ++i) {
+    if (unrolled_net_->param_owners()[i] >= 0) { continue; }
+    CHECK_LT(j, this->blobs_.size());
+    params[i]->ShareData(*this->blobs_[j]);
+    params[i]->ShareDiff(*this->blobs_[j]);
+    ++j;
   }
+  unrolled_net_->ShareWeights();
 }
 
 template <typename Dtype>
@@ -202,7 +318,19 @@ void RecurrentLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   for (int i = 0; i < recur_input_shapes.size(); ++i) {
     recur_input_blobs_[i]->Reshape(recur_input_shapes[i]);
   }
-  unrolled_net_->Reshape();
+  if (unrolled_net_) {
+    unrolled_net_->Reshape();
+  } else {
+    for (int i = 0; i < recur_output_blobs_.size(); ++i) {
+      recur_output_blobs_[i]->Reshape(recur_input_shapes[i]);
+    }
+    for (int i = 0; i < output_blobs_.size(); ++i) {
+      vector<int> output_shape(output_shapes_[i]);
+      output_shape[0] = T_;
+      output_shape[1] = N_;
+      output_blobs_[i]->Reshape(output_shape);
+    }
+  }
   x_input_blob_->ShareData(*bottom[0]);
   x_input_blob_->ShareDiff(*bottom[0]);
   cont_input_blob_->ShareData(*bottom[1]);
@@ -230,6 +358,14 @@ void RecurrentLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       top[i]->ReshapeLike(*recur_output_blobs_[j]);
     }
   }
+  if (fused_cpu_) {
+    vector<int> multiplier_shape(1, T_ * N_);
+    if (bias_multiplier_.count() != T_ * N_) {
+      bias_multiplier_.Reshape(multiplier_shape);
+      caffe_set(bias_multiplier_.count(), Dtype(1),
+                bias_multiplier_.mutable_cpu_data());
+    }
+  }
 }
 
 template <typename Dtype>
@@ -244,12 +380,10 @@ void RecurrentLayer<Dtype>::Reset() {
 template <typename Dtype>
 void RecurrentLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  // Hacky fix for test time: reshare all the internal shared blobs, which may
-  // currently point to a stale owner blob that was dropped when Solver::Test
-  // called test_net->ShareTrainedLayersWith(net_.get()).
-  // TODO: somehow make this work non-hackily.
-  if (this->phase_ == TEST) {
-    unrolled_net_->ShareWeights();
+  // The fused path reads this->blobs_ directly and needs no resharing.
+  const bool fused = use_fused_cpu();
+  if (!fused) {
+    PrepareUnrolledNet(bottom, top);
   }
 
   DCHECK_EQ(recur_input_blobs_.size(), recur_output_blobs_.size());
@@ -263,7 +397,11 @@ void RecurrentLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     }
   }
 
-  unrolled_net_->ForwardTo(last_layer_index_);
+  if (fused) {
+    FusedForward_cpu();
+  } else {
+    unrolled_net_->ForwardTo(last_layer_index_);
+  }
 
   if (expose_hidden_) {
     const int top_offset = output_blobs_.size();
@@ -278,6 +416,14 @@ void RecurrentLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   CHECK(!propagate_down[1]) << "Cannot backpropagate to sequence indicators.";
 
+  // Backward_gpu falls back to this method, but the forward pass in GPU mode
+  // ran the unrolled net, so only take the fused path in CPU mode.
+  if (use_fused_cpu()) {
+    FusedBackward_cpu(propagate_down[0],
+                      static_input_ && propagate_down[2]);
+    return;
+  }
+
   // TODO: skip backpropagation to inputs and parameters inside the unrolled
   // net according to propagate_down[0] and propagate_down[2]. For now just
   // backprop to inputs and parameters unconditionally, as either the inputs or
@@ -286,6 +432,89 @@ void RecurrentLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   unrolled_net_->BackwardFrom(last_layer_index_);
 }
 
+template <typename Dtype>
+void RecurrentLayer<Dtype>::FusedInputTransform_cpu(Blob<Dtype>* pre_gates) {
+  const int M = T_ * N_;
+  const int K = x_input_blob_->count(2);
+  const int dim = pre_gates->count(2);
+  CHECK_EQ(M * dim, pre_gates->count());
+  Dtype* pre_gate_data = pre_gates->mutable_cpu_data();
+  // Broadcast the bias to every row; the static input contributes the same
+  // term at every timestep, so project it once per stream and add it T times.
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M, dim, 1, Dtype(1),
+      bias_multiplier_.cpu_data(), this->blobs_[1]->cpu_data(), Dtype(0),
+      pre_gate_data);
+  if (static_input_) {
+    const int K_static = x_static_input_blob_->count(1);
+    vector<int> static_shape(2);
+    static_shape[0] = N_;
+    static_shape[1] = dim;
+    static_transform_.Reshape(static_shape);
+    Dtype* static_data = static_transform_.mutable_cpu_data();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, N_, dim, K_static,
+        Dtype(1), x_static_input_blob_->cpu_data(),
+        this->blobs_[2]->cpu_data(), Dtype(0), static_data);
+    for (int t = 0; t < T_; ++t) {
+      caffe_axpy<Dtype>(N_ * dim, Dtype(1), static_data,
+                        pre_gate_data + t * N_ * dim);
+    }
+  }
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M, dim, K, Dtype(1),
+      x_input_blob_->cpu_data(), this->blobs_[0]->cpu_data(), Dtype(1),
+      pre_gate_data);
+}
+
+template <typename Dtype>
+void RecurrentLayer<Dtype>::FusedInputTransformBackward_cpu(
+    const Blob<Dtype>& pre_gates, bool propagate_x, bool propagate_static) {
+  const int M = T_ * N_;
+  const int K = x_input_blob_->count(2);
+  const int dim = pre_gates.count(2);
+  const Dtype* pre_gate_diff = pre_gates.cpu_diff();
+  caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, dim, K, M, Dtype(1),
+      pre_gate_diff, x_input_blob_->cpu_data(), Dtype(1),
+      this->blobs_[0]->mutable_cpu_diff());
+  caffe_cpu_gemv<Dtype>(CblasTrans, M, dim, Dtype(1), pre_gate_diff,
+      bias_multiplier_.cpu_data(), Dtype(1),
+      this->blobs_[1]->mutable_cpu_diff());
+  if (propagate_x) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M, K, dim, Dtype(1),
+        pre_gate_diff, this->blobs_[0]->cpu_data(), Dtype(0),
+        x_input_blob_->mutable_cpu_diff());
+  }
+  if (static_input_) {
+    // Sum the gradient over timesteps (the first T entries of
+    // bias_multiplier_ serve as the ones vector).
+    const int K_static = x_static_input_blob_->count(1);
+    Dtype* static_diff = static_transform_.mutable_cpu_diff();
+    caffe_cpu_gemv<Dtype>(CblasTrans, T_, N_ * dim, Dtype(1), pre_gate_diff,
+        bias_multiplier_.cpu_data(), Dtype(0), static_diff);
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, dim, K_static, N_,
+        Dtype(1), static_diff, x_static_input_blob_->cpu_data(), Dtype(1),
+        this->blobs_[2]->mutable_cpu_diff());
+    if (propagate_static) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, N_, K_static, dim,
+          Dtype(1), static_diff, this->blobs_[2]->cpu_data(), Dtype(0),
+          x_static_input_blob_->mutable_cpu_diff());
+    }
+  }
+}
+
+template <typename Dtype>
+bool RecurrentLayer<Dtype>::ContHidden_cpu(const int dim, const Dtype* cont_t,
+    const Dtype* h, Dtype* h_conted) const {
+  bool any_cont = false;
+  for (int n = 0; n < N_; ++n) {
+    if (cont_t[n] == 0) {
+      caffe_set(dim, Dtype(0), h_conted + n * dim);
+    } else {
+      caffe_cpu_scale(dim, cont_t[n], h + n * dim, h_conted + n * dim);
+      any_cont = true;
+    }
+  }
+  return any_cont;
+}
+
 #ifdef CPU_ONLY
 STUB_GPU_FORWARD(RecurrentLayer, Forward);
 #endif
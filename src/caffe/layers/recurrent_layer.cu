@@ -12,11 +12,7 @@ namespace caffe {
 template <typename Dtype>
 void RecurrentLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  // Hacky fix for test time... reshare all the shared blobs.
-  // TODO: somehow make this work non-hackily.
-  if (this->phase_ == TEST) {
-    unrolled_net_->ShareWeights();
-  }
+  PrepareUnrolledNet(bottom, top);
 
   DCHECK_EQ(recur_input_blobs_.size(), recur_output_blobs_.size());
   if (!expose_hidden_) {
@@ -1,3 +1,4 @@
+#include <cmath>
 #include <string>
 #include <vector>
 
@@ -230,6 +231,116 @@ void RNNLayer<Dtype>::FillUnrolledNet(NetParameter* net_param) const {
   net_param->add_layer()->CopyFrom(output_concat_layer);
 }
 
+template <typename Dtype>
+void RNNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  RecurrentLayer<Dtype>::Reshape(bottom, top);
+  if (!this->fused_cpu_) { return; }
+  const int num_output = this->layer_param_.recurrent_param().num_output();
+  vector<int> shape(3);
+  shape[0] = this->T_;
+  shape[1] = this->N_;
+  shape[2] = num_output;
+  hidden_.Reshape(shape);
+  hidden_conted_.Reshape(shape);
+  output_delta_.Reshape(shape);
+  shape[0] = 1;
+  hidden_diff_.Reshape(shape);
+}
+
+template <typename Dtype>
+void RNNLayer<Dtype>::FusedForward_cpu() {
+  const int T = this->T_;
+  const int N = this->N_;
+  const int H = this->layer_param_.recurrent_param().num_output();
+  const int param_offset = 2 + this->static_input_;
+  const Dtype* W_hh = this->blobs_[param_offset]->cpu_data();
+  const Dtype* W_ho = this->blobs_[param_offset + 1]->cpu_data();
+  const Dtype* b_o = this->blobs_[param_offset + 2]->cpu_data();
+  const Dtype* cont = this->cont_input_blob_->cpu_data();
+  this->FusedInputTransform_cpu(&hidden_);
+  Dtype* h_data = hidden_.mutable_cpu_data();
+  Dtype* h_conted = hidden_conted_.mutable_cpu_data();
+  const Dtype* h_prev = this->recur_input_blobs_[0]->cpu_data();
+  for (int t = 0; t < T; ++t) {
+    Dtype* h_t = h_data + t * N * H;
+    Dtype* h_conted_t = h_conted + t * N * H;
+    if (this->ContHidden_cpu(H, cont + t * N, h_prev, h_conted_t)) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, N, H, H, Dtype(1),
+          h_conted_t, W_hh, Dtype(1), h_t);
+    }
+    for (int k = 0; k < N * H; ++k) {
+      h_t[k] = tanh(h_t[k]);
+    }
+    h_prev = h_t;
+  }
+  caffe_copy(N * H, h_prev, this->recur_output_blobs_[0]->mutable_cpu_data());
+  // The output projection doesn't feed back, so do all timesteps at once.
+  Dtype* o_data = this->output_blobs_[0]->mutable_cpu_data();
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, T * N, H, 1, Dtype(1),
+      this->bias_multiplier_.cpu_data(), b_o, Dtype(0), o_data);
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, T * N, H, H, Dtype(1),
+      h_data, W_ho, Dtype(1), o_data);
+  for (int k = 0; k < T * N * H; ++k) {
+    o_data[k] = tanh(o_data[k]);
+  }
+}
+
+template <typename Dtype>
+void RNNLayer<Dtype>::FusedBackward_cpu(bool propagate_x,
+    bool propagate_static) {
+  const int T = this->T_;
+  const int N = this->N_;
+  const int H = this->layer_param_.recurrent_param().num_output();
+  const int param_offset = 2 + this->static_input_;
+  const Dtype* W_hh = this->blobs_[param_offset]->cpu_data();
+  const Dtype* W_ho = this->blobs_[param_offset + 1]->cpu_data();
+  const Dtype* cont = this->cont_input_blob_->cpu_data();
+  const Dtype* h_data = hidden_.cpu_data();
+  Dtype* h_diff = hidden_.mutable_cpu_diff();
+  // Output layer: o_t = tanh(W_ho h_t + b_o).
+  {
+    const Dtype* o_data = this->output_blobs_[0]->cpu_data();
+    const Dtype* o_diff = this->output_blobs_[0]->cpu_diff();
+    Dtype* delta = output_delta_.mutable_cpu_data();
+    for (int k = 0; k < T * N * H; ++k) {
+      delta[k] = o_diff[k] * (1 - o_data[k] * o_data[k]);
+    }
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, H, H, T * N, Dtype(1),
+        delta, h_data, Dtype(1),
+        this->blobs_[param_offset + 1]->mutable_cpu_diff());
+    caffe_cpu_gemv<Dtype>(CblasTrans, T * N, H, Dtype(1), delta,
+        this->bias_multiplier_.cpu_data(), Dtype(1),
+        this->blobs_[param_offset + 2]->mutable_cpu_diff());
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, T * N, H, H, Dtype(1),
+        delta, W_ho, Dtype(0), h_diff);
+  }
+  // Backpropagate through time, turning h_diff into the gradient w.r.t. the
+  // hidden pre-activations in place.
+  Dtype* h_next_diff = hidden_diff_.mutable_cpu_data();
+  caffe_set(N * H, Dtype(0), h_next_diff);
+  for (int t = T - 1; t >= 0; --t) {
+    const Dtype* h_t = h_data + t * N * H;
+    Dtype* h_diff_t = h_diff + t * N * H;
+    for (int k = 0; k < N * H; ++k) {
+      h_diff_t[k] = (h_diff_t[k] + h_next_diff[k]) * (1 - h_t[k] * h_t[k]);
+    }
+    if (t > 0) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, N, H, H, Dtype(1),
+          h_diff_t, W_hh, Dtype(0), h_next_diff);
+      const Dtype* cont_t = cont + t * N;
+      for (int n = 0; n < N; ++n) {
+        caffe_scal(H, cont_t[n], h_next_diff + n * H);
+      }
+    }
+  }
+  caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, H, H, T * N, Dtype(1),
+      h_diff, hidden_conted_.cpu_data(), Dtype(1),
+      this->blobs_[param_offset]->mutable_cpu_diff());
+  this->FusedInputTransformBackward_cpu(hidden_, propagate_x,
+                                        propagate_static);
+}
+
 INSTANTIATE_CLASS(RNNLayer);
 REGISTER_LAYER_CLASS(RNN);
 
@@ -12,10 +12,6 @@ void SoftmaxLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   softmax_axis_ =
       bottom[0]->CanonicalAxisIndex(this->layer_param_.softmax_param().axis());
   top[0]->ReshapeLike(*bottom[0]);
-  vector<int> mult_dims(1, bottom[0]->shape(softmax_axis_));
-  sum_multiplier_.Reshape(mult_dims);
-  Dtype* multiplier_data = sum_multiplier_.mutable_cpu_data();
-  caffe_set(sum_multiplier_.count(), Dtype(1), multiplier_data);
   outer_num_ = bottom[0]->count(0, softmax_axis_);
   inner_num_ = bottom[0]->count(softmax_axis_ + 1);
   vector<int> scale_dims = bottom[0]->shape();
@@ -31,30 +27,52 @@ void SoftmaxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   Dtype* scale_data = scale_.mutable_cpu_data();
   int channels = bottom[0]->shape(softmax_axis_);
   int dim = bottom[0]->count() / outer_num_;
-  caffe_copy(bottom[0]->count(), bottom_data, top_data);
   // We need to subtract the max to avoid numerical issues, compute the exp,
-  // and then normalize.
+  // and then normalize.  The exp and its sum are computed in the same pass.
+  if (inner_num_ == 1) {
+    // The classifier case: each softmax is one contiguous row.
+    for (int i = 0; i < outer_num_; ++i) {
+      const Dtype* x = bottom_data + i * dim;
+      Dtype* y = top_data + i * dim;
+      Dtype max_val = x[0];
+      for (int j = 1; j < channels; ++j) {
+        max_val = std::max(max_val, x[j]);
+      }
+      Dtype sum = 0;
+      for (int j = 0; j < channels; ++j) {
+        y[j] = std::exp(x[j] - max_val);
+        sum += y[j];
+      }
+      caffe_scal(channels, Dtype(1) / sum, y);
+    }
+    return;
+  }
   for (int i = 0; i < outer_num_; ++i) {
-    // initialize scale_data to the first plane
-    caffe_copy(inner_num_, bottom_data + i * dim, scale_data);
+    const Dtype* x = bottom_data + i * dim;
+    Dtype* y = top_data + i * dim;
+    // scale_data holds the max over channels, then the sum of the exps
+    caffe_copy(inner_num_, x, scale_data);
+    for (int j = 1; j < channels; j++) {
+      const Dtype* x_j = x + j * inner_num_;
+      for (int k = 0; k < inner_num_; k++) {
+        scale_data[k] = std::max(scale_data[k], x_j[k]);
+      }
+    }
     for (int j = 0; j < channels; j++) {
+      const Dtype* x_j = x + j * inner_num_;
+      Dtype* y_j = y + j * inner_num_;
       for (int k = 0; k < inner_num_; k++) {
-        scale_data[k] = std::max(scale_data[k],
-            bottom_data[i * dim + j * inner_num_ + k]);
+        y_j[k] = std::exp(x_j[k] - scale_data[k]);
       }
     }
-    // subtraction
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels, inner_num_,
-        1, -1., sum_multiplier_.cpu_data(), scale_data, 1., top_data);
-    // exponentiation
-    caffe_exp<Dtype>(dim, top_data, top_data);
-    // sum after exp
-    caffe_cpu_gemv<Dtype>(CblasTrans, channels, inner_num_, 1.,
-        top_data, sum_multiplier_.cpu_data(), 0., scale_data);
+    caffe_copy(inner_num_, y, scale_data);
+    for (int j = 1; j < channels; j++) {
+      caffe_axpy(inner_num_, Dtype(1), y + j * inner_num_, scale_data);
+    }
     // division
     for (int j = 0; j < channels; j++) {
-      caffe_div(inner_num_, top_data, scale_data, top_data);
-      top_data += inner_num_;
+      caffe_div(inner_num_, y + j * inner_num_, scale_data,
+          y + j * inner_num_);
     }
   }
 }
@@ -69,20 +87,37 @@ void SoftmaxLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   Dtype* scale_data = scale_.mutable_cpu_data();
   int channels = top[0]->shape(softmax_axis_);
   int dim = top[0]->count() / outer_num_;
-  caffe_copy(top[0]->count(), top_diff, bottom_diff);
+  // bottom_diff = (top_diff - dot(top_diff, top_data)) * top_data
+  if (inner_num_ == 1) {
+    for (int i = 0; i < outer_num_; ++i) {
+      const Dtype* dy = top_diff + i * dim;
+      const Dtype* y = top_data + i * dim;
+      Dtype* dx = bottom_diff + i * dim;
+      const Dtype dot = caffe_cpu_dot(channels, dy, y);
+      for (int j = 0; j < channels; ++j) {
+        dx[j] = (dy[j] - dot) * y[j];
+      }
+    }
+    return;
+  }
   for (int i = 0; i < outer_num_; ++i) {
-    // compute dot(top_diff, top_data) and subtract them from the bottom diff
-    for (int k = 0; k < inner_num_; ++k) {
-      scale_data[k] = caffe_cpu_strided_dot<Dtype>(channels,
-          bottom_diff + i * dim + k, inner_num_,
-          top_data + i * dim + k, inner_num_);
+    const Dtype* dy = top_diff + i * dim;
+    const Dtype* y = top_data + i * dim;
+    Dtype* dx = bottom_diff + i * dim;
+    caffe_mul(inner_num_, dy, y, scale_data);
+    for (int j = 1; j < channels; ++j) {
+      const int offset = j * inner_num_;
+      for (int k = 0; k < inner_num_; ++k) {
+        scale_data[k] += dy[offset + k] * y[offset + k];
+      }
+    }
+    for (int j = 0; j < channels; ++j) {
+      const int offset = j * inner_num_;
+      for (int k = 0; k < inner_num_; ++k) {
+        dx[offset + k] = (dy[offset + k] - scale_data[k]) * y[offset + k];
+      }
     }
-    // subtraction
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels, inner_num_, 1,
-        -1., sum_multiplier_.cpu_data(), scale_data, 1., bottom_diff + i * dim);
   }
-  // elementwise multiplication
-  caffe_mul(top[0]->count(), bottom_diff, top_data, bottom_diff);
 }
 
 
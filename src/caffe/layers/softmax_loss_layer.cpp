@@ -13,6 +13,7 @@ void SoftmaxWithLossLayer<Dtype>::LayerSetUp(
   LossLayer<Dtype>::LayerSetUp(bottom, top);
   LayerParameter softmax_param(this->layer_param_);
   softmax_param.set_type("Softmax");
+  softmax_param.clear_loss_weight();
   softmax_layer_ = LayerRegistry<Dtype>::CreateLayer(softmax_param);
   softmax_bottom_vec_.clear();
   softmax_bottom_vec_.push_back(bottom[0]);
@@ -53,6 +54,10 @@ void SoftmaxWithLossLayer<Dtype>::Reshape(
     // softmax output
     top[1]->ReshapeLike(*bottom[0]);
   }
+  vector<int> log_normalizer_dims = bottom[0]->shape();
+  log_normalizer_dims[softmax_axis_] = 1;
+  log_normalizer_.Reshape(log_normalizer_dims);
+  sum_exp_.Reshape(vector<int>(1, inner_num_));
 }
 
 template <typename Dtype>
@@ -85,16 +90,85 @@ Dtype SoftmaxWithLossLayer<Dtype>::get_normalizer(
   return std::max(Dtype(1.0), normalizer);
 }
 
+template <typename Dtype>
+void SoftmaxWithLossLayer<Dtype>::ComputeLogNormalizer_cpu(
+    const Dtype* bottom_data) {
+  Dtype* log_norm = log_normalizer_.mutable_cpu_data();
+  const int channels = prob_.shape(softmax_axis_);
+  const int dim = channels * inner_num_;
+  if (inner_num_ == 1) {
+    for (int i = 0; i < outer_num_; ++i) {
+      const Dtype* x = bottom_data + i * dim;
+      Dtype max_val = x[0];
+      for (int c = 1; c < channels; ++c) {
+        max_val = std::max(max_val, x[c]);
+      }
+      Dtype sum = 0;
+      for (int c = 0; c < channels; ++c) {
+        sum += exp(x[c] - max_val);
+      }
+      log_norm[i] = max_val + log(sum);
+    }
+    return;
+  }
+  Dtype* sum = sum_exp_.mutable_cpu_data();
+  for (int i = 0; i < outer_num_; ++i) {
+    const Dtype* x = bottom_data + i * dim;
+    Dtype* max_val = log_norm + i * inner_num_;
+    caffe_copy(inner_num_, x, max_val);
+    for (int c = 1; c < channels; ++c) {
+      const Dtype* x_c = x + c * inner_num_;
+      for (int j = 0; j < inner_num_; ++j) {
+        max_val[j] = std::max(max_val[j], x_c[j]);
+      }
+    }
+    caffe_set(inner_num_, Dtype(0), sum);
+    for (int c = 0; c < channels; ++c) {
+      const Dtype* x_c = x + c * inner_num_;
+      for (int j = 0; j < inner_num_; ++j) {
+        sum[j] += exp(x_c[j] - max_val[j]);
+      }
+    }
+    for (int j = 0; j < inner_num_; ++j) {
+      max_val[j] += log(sum[j]);
+    }
+  }
+}
+
 template <typename Dtype>
 void SoftmaxWithLossLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  // The forward pass computes the softmax prob values.
-  softmax_layer_->Forward(softmax_bottom_vec_, softmax_top_vec_);
-  const Dtype* prob_data = prob_.cpu_data();
   const Dtype* label = bottom[1]->cpu_data();
   int dim = prob_.count() / outer_num_;
   int count = 0;
   Dtype loss = 0;
+  if (top.size() == 2) {
+    // The probabilities are an output, so run the softmax itself.
+    softmax_layer_->Forward(softmax_bottom_vec_, softmax_top_vec_);
+    const Dtype* prob_data = prob_.cpu_data();
+    for (int i = 0; i < outer_num_; ++i) {
+      for (int j = 0; j < inner_num_; j++) {
+        const int label_value = static_cast<int>(label[i * inner_num_ + j]);
+        if (has_ignore_label_ && label_value == ignore_label_) {
+          continue;
+        }
+        DCHECK_GE(label_value, 0);
+        DCHECK_LT(label_value, prob_.shape(softmax_axis_));
+        loss -= log(std::max(prob_data[i * dim + label_value * inner_num_ + j],
+                             Dtype(FLT_MIN)));
+        ++count;
+      }
+    }
+    top[0]->mutable_cpu_data()[0] =
+        loss / get_normalizer(normalization_, count);
+    top[1]->ShareData(prob_);
+    return;
+  }
+  // Otherwise -log(p) = log(sum(exp(x))) - x_label, without materializing p.
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  ComputeLogNormalizer_cpu(bottom_data);
+  const Dtype* log_norm = log_normalizer_.cpu_data();
+  const Dtype max_loss = -log(Dtype(FLT_MIN));
   for (int i = 0; i < outer_num_; ++i) {
     for (int j = 0; j < inner_num_; j++) {
       const int label_value = static_cast<int>(label[i * inner_num_ + j]);
@@ -103,15 +177,12 @@ void SoftmaxWithLossLayer<Dtype>::Forward_cpu(
       }
       DCHECK_GE(label_value, 0);
       DCHECK_LT(label_value, prob_.shape(softmax_axis_));
-      loss -= log(std::max(prob_data[i * dim + label_value * inner_num_ + j],
-                           Dtype(FLT_MIN)));
+      loss += std::min(log_norm[i * inner_num_ + j] -
+          bottom_data[i * dim + label_value * inner_num_ + j], max_loss);
       ++count;
     }
   }
   top[0]->mutable_cpu_data()[0] = loss / get_normalizer(normalization_, count);
-  if (top.size() == 2) {
-    top[1]->ShareData(prob_);
-  }
 }
 
 template <typename Dtype>
@@ -121,18 +192,22 @@ void SoftmaxWithLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     LOG(FATAL) << this->type()
                << " Layer cannot backpropagate to label inputs.";
   }
-  if (propagate_down[0]) {
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  if (!propagate_down[0]) {
+    return;
+  }
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  const Dtype* label = bottom[1]->cpu_data();
+  const int channels = bottom[0]->shape(softmax_axis_);
+  int dim = prob_.count() / outer_num_;
+  int count = 0;
+  if (top.size() == 2) {
     const Dtype* prob_data = prob_.cpu_data();
     caffe_copy(prob_.count(), prob_data, bottom_diff);
-    const Dtype* label = bottom[1]->cpu_data();
-    int dim = prob_.count() / outer_num_;
-    int count = 0;
     for (int i = 0; i < outer_num_; ++i) {
       for (int j = 0; j < inner_num_; ++j) {
         const int label_value = static_cast<int>(label[i * inner_num_ + j]);
         if (has_ignore_label_ && label_value == ignore_label_) {
-          for (int c = 0; c < bottom[0]->shape(softmax_axis_); ++c) {
+          for (int c = 0; c < channels; ++c) {
             bottom_diff[i * dim + c * inner_num_ + j] = 0;
           }
         } else {
@@ -145,6 +220,40 @@ void SoftmaxWithLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     Dtype loss_weight = top[0]->cpu_diff()[0] /
                         get_normalizer(normalization_, count);
     caffe_scal(prob_.count(), loss_weight, bottom_diff);
+    return;
+  }
+  // Recompute p = exp(x - log(sum(exp(x)))) and write the scaled gradient
+  // (p - 1{label}) in one pass, so the loss weight is needed up front.
+  for (int i = 0; i < outer_num_ * inner_num_; ++i) {
+    if (!has_ignore_label_ || static_cast<int>(label[i]) != ignore_label_) {
+      ++count;
+    }
+  }
+  const Dtype loss_weight = top[0]->cpu_diff()[0] /
+                            get_normalizer(normalization_, count);
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* log_norm = log_normalizer_.cpu_data();
+  for (int i = 0; i < outer_num_; ++i) {
+    const Dtype* x = bottom_data + i * dim;
+    Dtype* dx = bottom_diff + i * dim;
+    for (int c = 0; c < channels; ++c) {
+      const Dtype* x_c = x + c * inner_num_;
+      const Dtype* log_norm_i = log_norm + i * inner_num_;
+      Dtype* dx_c = dx + c * inner_num_;
+      for (int j = 0; j < inner_num_; ++j) {
+        dx_c[j] = loss_weight * exp(x_c[j] - log_norm_i[j]);
+      }
+    }
+    for (int j = 0; j < inner_num_; ++j) {
+      const int label_value = static_cast<int>(label[i * inner_num_ + j]);
+      if (has_ignore_label_ && label_value == ignore_label_) {
+        for (int c = 0; c < channels; ++c) {
+          dx[c * inner_num_ + j] = 0;
+        }
+      } else {
+        dx[label_value * inner_num_ + j] -= loss_weight;
+      }
+    }
   }
 }
 
@@ -1,3 +1,5 @@
+#include <boost/filesystem.hpp>
+
 #include <algorithm>
 #include <map>
 #include <set>
@@ -15,14 +17,67 @@
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/hdf5.hpp"
-#include "caffe/util/insert_splits.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/net_cache.hpp"
 #include "caffe/util/upgrade_proto.hpp"
+#include "caffe/util/weight_registry.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
 namespace caffe {
 
+namespace {
+
+// The memory of the data (or diff) of a blob, which blobs sharing it have in
+// common; the blob itself while it holds no memory.
+template <typename Dtype>
+const void* DataMemory(const Blob<Dtype>* blob) {
+  return blob->count() > 0 ? static_cast<const void*>(blob->data().get()) :
+      blob;
+}
+
+template <typename Dtype>
+const void* DiffMemory(const Blob<Dtype>* blob) {
+  return blob->count() > 0 ? static_cast<const void*>(blob->diff().get()) :
+      blob;
+}
+
+}  // namespace
+
+// Runs the forward or backward pass of single layers for the schedulers.
+template <typename Dtype>
+class Net<Dtype>::LayerTask : public ParallelTask {
+ public:
+  LayerTask(Net* net, bool forward)
+      : net_(net), forward_(forward), rng_(&Caffe::rng_stream()) {}
+
+  virtual void Run(int layer_id, int thread) {
+    // Pool threads keep the mode they were started in.
+    if (Caffe::mode() != Caffe::CPU) {
+      Caffe::set_mode(Caffe::CPU);
+    }
+    Net& net = *net_;
+    if (forward_) {
+      // Layers that may draw random numbers take turns on the generator of
+      // the calling thread (see InitLayerSchedulers), as they do without
+      // the schedulers, whichever thread runs them.
+      if (!net.layers_[layer_id]->ForwardIsRepeatable()) {
+        Caffe::rng_stream() = *rng_;
+      }
+      net.layer_losses_[layer_id] = net.layers_[layer_id]->Forward(
+          net.bottom_vecs_[layer_id], net.top_vecs_[layer_id]);
+    } else if (net.layer_need_backward_[layer_id]) {
+      net.layers_[layer_id]->Backward(net.top_vecs_[layer_id],
+          net.bottom_need_backward_[layer_id], net.bottom_vecs_[layer_id]);
+    }
+  }
+
+ private:
+  Net* net_;
+  const bool forward_;
+  Caffe::RNG* rng_;
+};
+
 template <typename Dtype>
 Net<Dtype>::Net(const NetParameter& param, const Net* root_net)
     : root_net_(root_net) {
@@ -34,17 +89,21 @@ Net<Dtype>::Net(const string& param_file, Phase phase,
     const int level, const vector<string>* stages,
     const Net* root_net)
     : root_net_(root_net) {
-  NetParameter param;
-  ReadNetParamsFromTextFileOrDie(param_file, &param);
   // Set phase, stages and level
-  param.mutable_state()->set_phase(phase);
+  NetState state;
+  state.set_phase(phase);
   if (stages != NULL) {
     for (int i = 0; i < stages->size(); i++) {
-      param.mutable_state()->add_stage((*stages)[i]);
+      state.add_stage((*stages)[i]);
     }
   }
-  param.mutable_state()->set_level(level);
-  Init(param);
+  state.set_level(level);
+  Init(*NetCache::Get(param_file, state));
+}
+
+template <typename Dtype>
+Net<Dtype>::~Net() {
+  WeightRegistry<Dtype>::Detach(this);
 }
 
 template <typename Dtype>
@@ -53,16 +112,12 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       << "root_net_ needs to be set for all non-root solvers";
   // Set phase from the state.
   phase_ = in_param.state().phase();
-  // Filter layers based on their include/exclude rules and
-  // the current NetState.
-  NetParameter filtered_param;
-  FilterNet(in_param, &filtered_param);
+  // Filter layers based on their include/exclude rules and the current
+  // NetState, and add splits where necessary, unless an earlier net did.
+  NetParameter param(*NetCache::Compile(in_param));
   LOG_IF(INFO, Caffe::root_solver())
       << "Initializing net from parameters: " << std::endl
-      << filtered_param.DebugString();
-  // Create a copy of filtered_param with splits added where necessary.
-  NetParameter param;
-  InsertSplits(filtered_param, &param);
+      << param.DebugString();
   // Basically, build all the layers and set up their connections.
   name_ = param.name();
   map<string, int> blob_name_to_idx;
@@ -281,6 +336,22 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  if (param.flat_params()) {
+    FlattenParams();
+  }
+  if (param.layer_threads() > 0) {
+    InitLayerSchedulers(param.layer_threads());
+  }
+  // Layers whose forward is not repeatable may update their parameters in
+  // training, as BatchNorm does its statistics.
+  forward_writes_params_ = false;
+  for (int i = 0; i < layers_.size() && phase_ == TRAIN; ++i) {
+    forward_writes_params_ |= !layers_[i]->ForwardIsRepeatable() &&
+        !layers_[i]->blobs().empty();
+  }
+  if (phase_ == TRAIN && param.checkpoint_layer_size() > 0) {
+    InitCheckpoints(param);
+  }
   debug_info_ = param.debug_info();
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
@@ -546,7 +617,42 @@ template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
+  if (forward_writes_params_) {
+    WeightRegistry<Dtype>::BeginUpdate(this);
+  }
   Dtype loss = 0;
+  if (segment_begins_.empty()) {
+    loss = ForwardLayers(start, end);
+  }
+  for (int s = 0; s < segment_begins_.size(); ++s) {
+    const int first = std::max(start, segment_begins_[s]);
+    const int last = std::min(end, segment_end(s));
+    if (first > last) { continue; }
+    // Starting within a segment needs the blobs freed before the start.
+    RecomputeSegment(s, first - 1);
+    loss += ForwardLayers(first, last);
+    // Backward starts with the last segment, so keep its activations.
+    if (last == segment_end(s) && s + 1 < segment_begins_.size()) {
+      ReleaseSegment(s, false);
+    }
+  }
+  if (forward_writes_params_) {
+    WeightRegistry<Dtype>::EndUpdate(this);
+  }
+  return loss;
+}
+
+template <typename Dtype>
+Dtype Net<Dtype>::ForwardLayers(int start, int end) {
+  Dtype loss = 0;
+  if (use_layer_schedulers()) {
+    LayerTask task(this, true);
+    forward_scheduler_->Run(start, end, &task);
+    for (int i = start; i <= end; ++i) {
+      loss += layer_losses_[i];
+    }
+    return loss;
+  }
   for (int i = start; i <= end; ++i) {
     // LOG(ERROR) << "Forwarding " << layer_names_[i];
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
@@ -592,6 +698,30 @@ template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
+  if (segment_begins_.empty()) {
+    BackwardLayers(start, end);
+    return;
+  }
+  for (int s = segment_begins_.size() - 1; s >= 0; --s) {
+    const int first = std::min(start, segment_end(s));
+    const int last = std::max(end, segment_begins_[s]);
+    if (first < last) { continue; }
+    RecomputeSegment(s, first);
+    BackwardLayers(first, last);
+    // The diffs of a segment are done with once it is through.
+    if (last == segment_begins_[s]) {
+      ReleaseSegment(s, true);
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::BackwardLayers(int start, int end) {
+  if (use_layer_schedulers()) {
+    LayerTask task(this, false);
+    backward_scheduler_->Run(end, start, &task);
+    return;
+  }
   for (int i = start; i >= end; --i) {
     if (layer_need_backward_[i]) {
       layers_[i]->Backward(
@@ -601,6 +731,244 @@ void Net<Dtype>::BackwardFromTo(int start, int end) {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::MapDataMemory(
+    map<const Blob<Dtype>*, const void*>* data_memory) const {
+  for (int i = 0; i < blobs_.size(); ++i) {
+    (*data_memory)[blobs_[i].get()] = DataMemory(blobs_[i].get());
+  }
+  // Split layers share the data of their bottom only once they run.
+  for (int i = 0; i < layers_.size(); ++i) {
+    if (layers_[i]->type() == string("Split")) {
+      for (int j = 0; j < top_vecs_[i].size(); ++j) {
+        (*data_memory)[top_vecs_[i][j]] =
+            (*data_memory)[bottom_vecs_[i][0]];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::InitLayerSchedulers(int num_threads) {
+  const int num_layers = layers_.size();
+  // The memory each layer accesses.
+  map<const Blob<Dtype>*, const void*> data_memory;
+  MapDataMemory(&data_memory);
+  vector<vector<const void*> > forward_reads(num_layers);
+  vector<vector<const void*> > forward_writes(num_layers);
+  vector<vector<const void*> > backward_reads(num_layers);
+  vector<vector<const void*> > backward_writes(num_layers);
+  vector<int> forward_order(num_layers);
+  vector<int> backward_order(num_layers);
+  for (int i = 0; i < num_layers; ++i) {
+    forward_order[i] = i;
+    backward_order[i] = num_layers - 1 - i;
+    for (int j = 0; j < bottom_vecs_[i].size(); ++j) {
+      const Blob<Dtype>* bottom = bottom_vecs_[i][j];
+      forward_reads[i].push_back(data_memory[bottom]);
+      backward_reads[i].push_back(data_memory[bottom]);
+      backward_writes[i].push_back(DiffMemory(bottom));
+    }
+    for (int j = 0; j < top_vecs_[i].size(); ++j) {
+      const Blob<Dtype>* top = top_vecs_[i][j];
+      forward_writes[i].push_back(data_memory[top]);
+      backward_reads[i].push_back(data_memory[top]);
+      backward_reads[i].push_back(DiffMemory(top));
+    }
+    // Shared parameters are read by every layer that has them, and their
+    // gradients accumulated in turn.
+    const vector<shared_ptr<Blob<Dtype> > >& layer_blobs =
+        layers_[i]->blobs();
+    for (int j = 0; j < layer_blobs.size(); ++j) {
+      forward_reads[i].push_back(DataMemory(layer_blobs[j].get()));
+      backward_reads[i].push_back(DataMemory(layer_blobs[j].get()));
+      backward_writes[i].push_back(DiffMemory(layer_blobs[j].get()));
+    }
+    // Layers whose forward is not repeatable, e.g. Dropout or DummyData with
+    // random fillers, may draw from the random generator, so they run in
+    // turn, in layer order.
+    if (!layers_[i]->ForwardIsRepeatable()) {
+      forward_writes[i].push_back(this);
+    }
+  }
+  layer_pool_.reset(new ThreadPool(num_threads));
+  forward_scheduler_.reset(new DagScheduler(DagScheduler::Dependencies(
+      forward_order, forward_reads, forward_writes), layer_pool_));
+  backward_scheduler_.reset(new DagScheduler(DagScheduler::Dependencies(
+      backward_order, backward_reads, backward_writes), layer_pool_));
+  layer_losses_.resize(num_layers);
+}
+
+template <typename Dtype>
+bool Net<Dtype>::use_layer_schedulers() const {
+  return forward_scheduler_ && Caffe::mode() == Caffe::CPU && !debug_info_;
+}
+
+template <typename Dtype>
+void Net<Dtype>::InitCheckpoints(const NetParameter& param) {
+  const int num_layers = layers_.size();
+  vector<bool> is_checkpoint(num_layers, false);
+  for (int i = 0; i < param.checkpoint_layer_size(); ++i) {
+    const string& name = param.checkpoint_layer(i);
+    CHECK(has_layer(name)) << "Unknown checkpoint layer " << name;
+    is_checkpoint[layer_names_index_[name]] = true;
+  }
+  vector<int> segment_of(num_layers);
+  segment_begins_.push_back(0);
+  for (int i = 0; i < num_layers; ++i) {
+    segment_of[i] = segment_begins_.size() - 1;
+    if (is_checkpoint[i] && i + 1 < num_layers) {
+      segment_begins_.push_back(i + 1);
+    }
+  }
+  // The layers writing and reading each data memory, in order.
+  map<const Blob<Dtype>*, const void*> data_memory;
+  MapDataMemory(&data_memory);
+  map<const void*, vector<int> > writers;
+  map<const void*, vector<int> > readers;
+  for (int i = 0; i < num_layers; ++i) {
+    for (int j = 0; j < top_vecs_[i].size(); ++j) {
+      writers[data_memory[top_vecs_[i][j]]].push_back(i);
+    }
+    for (int j = 0; j < bottom_vecs_[i].size(); ++j) {
+      readers[data_memory[bottom_vecs_[i][j]]].push_back(i);
+    }
+  }
+  // Memory can be freed if all of its writers can be rerun and it is used
+  // within their segment only...
+  set<const void*> dropped;
+  for (map<const void*, vector<int> >::const_iterator it = writers.begin();
+       it != writers.end(); ++it) {
+    const vector<int>& layer_ids = it->second;
+    const int segment = segment_of[layer_ids[0]];
+    bool droppable = true;
+    for (int i = 0; i < layer_ids.size(); ++i) {
+      const int layer_id = layer_ids[i];
+      droppable &= !is_checkpoint[layer_id] &&
+          segment_of[layer_id] == segment &&
+          !bottom_vecs_[layer_id].empty() &&
+          layers_[layer_id]->ForwardIsRepeatable();
+    }
+    const vector<int>& reader_ids = readers[it->first];
+    for (int i = 0; i < reader_ids.size(); ++i) {
+      droppable &= segment_of[reader_ids[i]] == segment;
+    }
+    if (droppable) {
+      dropped.insert(it->first);
+    }
+  }
+  // ...and is neither an output nor a loss...
+  for (int i = 0; i < net_output_blobs_.size(); ++i) {
+    dropped.erase(data_memory[net_output_blobs_[i]]);
+  }
+  for (int i = 0; i < num_layers; ++i) {
+    for (int j = 0; j < top_vecs_[i].size(); ++j) {
+      if (layers_[i]->loss(j) != 0) {
+        dropped.erase(data_memory[top_vecs_[i][j]]);
+      }
+    }
+  }
+  // ...and if rerunning its writers neither reads memory that has changed
+  // since nor overwrites kept memory that has.
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (set<const void*>::iterator it = dropped.begin();
+         it != dropped.end(); ++it) {
+      const vector<int>& layer_ids = writers[*it];
+      bool stale = false;
+      for (int i = 0; i < layer_ids.size() && !stale; ++i) {
+        const int layer_id = layer_ids[i];
+        vector<Blob<Dtype>*> accessed(bottom_vecs_[layer_id]);
+        accessed.insert(accessed.end(), top_vecs_[layer_id].begin(),
+                        top_vecs_[layer_id].end());
+        for (int j = 0; j < accessed.size() && !stale; ++j) {
+          const void* memory = data_memory[accessed[j]];
+          stale = !dropped.count(memory) && writers.count(memory) &&
+              writers[memory].back() > layer_id;
+        }
+      }
+      if (stale) {
+        dropped.erase(it);
+        changed = true;
+        break;
+      }
+    }
+  }
+  // Diffs are freed along with the data if all blobs sharing them are.
+  map<const void*, bool> diff_dropped;
+  for (int i = 0; i < blobs_.size(); ++i) {
+    const void* diff = DiffMemory(blobs_[i].get());
+    const bool data_dropped = dropped.count(data_memory[blobs_[i].get()]);
+    diff_dropped[diff] = data_dropped &&
+        (!diff_dropped.count(diff) || diff_dropped[diff]);
+  }
+  const int num_segments = segment_begins_.size();
+  segment_recompute_.resize(num_segments);
+  segment_data_.resize(num_segments);
+  segment_diff_.resize(num_segments);
+  segment_released_.resize(num_segments, false);
+  for (int i = 0; i < blobs_.size(); ++i) {
+    Blob<Dtype>* blob = blobs_[i].get();
+    const void* memory = data_memory[blob];
+    if (!dropped.count(memory)) { continue; }
+    const int segment = segment_of[writers[memory][0]];
+    segment_data_[segment].push_back(blob);
+    if (diff_dropped[DiffMemory(blob)]) {
+      segment_diff_[segment].push_back(blob);
+    }
+  }
+  int num_recomputed = 0;
+  for (int i = 0; i < num_layers; ++i) {
+    for (int j = 0; j < top_vecs_[i].size(); ++j) {
+      if (dropped.count(data_memory[top_vecs_[i][j]])) {
+        segment_recompute_[segment_of[i]].push_back(i);
+        ++num_recomputed;
+        break;
+      }
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Gradient checkpointing: " << num_segments << " segments, "
+      << dropped.size() << " freed activations, " << num_recomputed
+      << " of " << num_layers << " layers recomputed in backward.";
+}
+
+template <typename Dtype>
+int Net<Dtype>::segment_end(int segment) const {
+  return segment + 1 < segment_begins_.size() ?
+      segment_begins_[segment + 1] - 1 : layers_.size() - 1;
+}
+
+template <typename Dtype>
+void Net<Dtype>::RecomputeSegment(int segment, int end) {
+  if (!segment_released_[segment]) { return; }
+  const vector<int>& layer_ids = segment_recompute_[segment];
+  for (int i = 0; i < layer_ids.size() && layer_ids[i] <= end; ++i) {
+    const int layer_id = layer_ids[i];
+    layers_[layer_id]->Forward(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+  }
+  segment_released_[segment] = false;
+}
+
+template <typename Dtype>
+void Net<Dtype>::ReleaseSegment(int segment, bool release_diff) {
+  for (int i = 0; i < segment_data_[segment].size(); ++i) {
+    Blob<Dtype>* blob = segment_data_[segment][i];
+    if (blob->count() > 0) {
+      blob->data()->Release();
+    }
+  }
+  if (release_diff) {
+    for (int i = 0; i < segment_diff_[segment].size(); ++i) {
+      Blob<Dtype>* blob = segment_diff_[segment][i];
+      if (blob->count() > 0) {
+        blob->diff()->Release();
+      }
+    }
+  }
+  segment_released_[segment] = true;
+}
+
 template <typename Dtype>
 void Net<Dtype>::ForwardDebugInfo(const int layer_id) {
   for (int top_id = 0; top_id < top_vecs_[layer_id].size(); ++top_id) {
@@ -712,6 +1080,40 @@ void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::OwnParamData() {
+  if (has_flat_params()) {
+    // A new data arena, laid out like the old one; the diffs stay in place.
+    shared_ptr<Blob<Dtype> > flat(new Blob<Dtype>(flat_params_->shape()));
+    flat->ShareDiff(*flat_params_);
+    Dtype* data = flat->mutable_cpu_data();
+    for (int i = 0; i < learnable_params_.size(); ++i) {
+      Blob<Dtype>* blob = learnable_params_[i];
+      if (blob->count() > 0) {
+        caffe_copy(blob->count(), blob->cpu_data(), data);
+        Blob<Dtype> view(blob->shape());
+        view.data()->set_cpu_data(data);
+        blob->ShareData(view);
+      }
+      data += blob->count();
+    }
+    flat_params_ = flat;
+  } else {
+    for (int i = 0; i < learnable_params_.size(); ++i) {
+      Blob<Dtype>* blob = learnable_params_[i];
+      if (blob->count() == 0) { continue; }
+      Blob<Dtype> copy;
+      copy.CopyFrom(*blob, false, true);
+      blob->ShareData(copy);
+    }
+  }
+  for (int i = 0; i < params_.size(); ++i) {
+    if (param_owners_[i] >= 0) {
+      params_[i]->ShareData(*params_[param_owners_[i]]);
+    }
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::BackwardFrom(int start) {
   BackwardFromTo(start, 0);
@@ -727,11 +1129,20 @@ void Net<Dtype>::Backward() {
   BackwardFromTo(layers_.size() - 1, 0);
   if (debug_info_) {
     Dtype asum_data = 0, asum_diff = 0, sumsq_data = 0, sumsq_diff = 0;
-    for (int i = 0; i < learnable_params_.size(); ++i) {
-      asum_data += learnable_params_[i]->asum_data();
-      asum_diff += learnable_params_[i]->asum_diff();
-      sumsq_data += learnable_params_[i]->sumsq_data();
-      sumsq_diff += learnable_params_[i]->sumsq_diff();
+    if (has_flat_params() && Caffe::mode() == Caffe::CPU) {
+      const Dtype* data = mutable_flat_cpu_data();
+      const Dtype* diff = mutable_flat_cpu_diff();
+      asum_data = caffe_cpu_asum(flat_count(), data);
+      asum_diff = caffe_cpu_asum(flat_count(), diff);
+      sumsq_data = caffe_cpu_dot(flat_count(), data, data);
+      sumsq_diff = caffe_cpu_dot(flat_count(), diff, diff);
+    } else {
+      for (int i = 0; i < learnable_params_.size(); ++i) {
+        asum_data += learnable_params_[i]->asum_data();
+        asum_diff += learnable_params_[i]->asum_diff();
+        sumsq_data += learnable_params_[i]->sumsq_data();
+        sumsq_diff += learnable_params_[i]->sumsq_diff();
+      }
     }
     const Dtype l2norm_data = std::sqrt(sumsq_data);
     const Dtype l2norm_diff = std::sqrt(sumsq_diff);
@@ -750,6 +1161,7 @@ void Net<Dtype>::Reshape() {
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
+  WeightRegistry<Dtype>::BeginUpdate(this);
   int num_source_layers = param.layer_size();
   for (int i = 0; i < num_source_layers; ++i) {
     const LayerParameter& source_layer = param.layer(i);
@@ -784,6 +1196,7 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
       target_blobs[j]->FromProto(source_layer.blobs(j), kReshape);
     }
   }
+  WeightRegistry<Dtype>::EndUpdate(this);
 }
 
 template <typename Dtype>
@@ -801,17 +1214,26 @@ void Net<Dtype>::CopyTrainedLayersFromBinaryProto(
     const string trained_filename) {
   NetParameter param;
   ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
+  if (param.has_base_net()) {
+    // A relative base is in the directory of this file.
+    const boost::filesystem::path base(param.base_net());
+    CopyTrainedLayersFrom(base.is_absolute() ? base.string() :
+        (boost::filesystem::path(trained_filename).parent_path() / base)
+        .string());
+  }
   CopyTrainedLayersFrom(param);
 }
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
 #ifdef USE_HDF5
+  boost::mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_hid = H5Fopen(trained_filename.c_str(), H5F_ACC_RDONLY,
                            H5P_DEFAULT);
   CHECK_GE(file_hid, 0) << "Couldn't open " << trained_filename;
   hid_t data_hid = H5Gopen2(file_hid, "data", H5P_DEFAULT);
   CHECK_GE(data_hid, 0) << "Error reading weights from " << trained_filename;
+  WeightRegistry<Dtype>::BeginUpdate(this);
   int num_layers = hdf5_get_num_links(data_hid);
   for (int i = 0; i < num_layers; ++i) {
     string source_layer_name = hdf5_get_name_by_idx(data_hid, i);
@@ -851,6 +1273,7 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
     }
     H5Gclose(layer_hid);
   }
+  WeightRegistry<Dtype>::EndUpdate(this);
   H5Gclose(data_hid);
   H5Fclose(file_hid);
 #else
@@ -874,6 +1297,7 @@ void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
 template <typename Dtype>
 void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
 #ifdef USE_HDF5
+  boost::mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -934,13 +1358,24 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::Update() {
-  for (int i = 0; i < learnable_params_.size(); ++i) {
-    learnable_params_[i]->Update();
+  WeightRegistry<Dtype>::BeginUpdate(this);
+  if (has_flat_params() && Caffe::mode() == Caffe::CPU) {
+    caffe_axpy<Dtype>(flat_count(), Dtype(-1), mutable_flat_cpu_diff(),
+                      mutable_flat_cpu_data());
+  } else {
+    for (int i = 0; i < learnable_params_.size(); ++i) {
+      learnable_params_[i]->Update();
+    }
   }
+  WeightRegistry<Dtype>::EndUpdate(this);
 }
 
 template <typename Dtype>
 void Net<Dtype>::ClearParamDiffs() {
+  if (has_flat_params() && Caffe::mode() == Caffe::CPU) {
+    caffe_set(flat_count(), static_cast<Dtype>(0), mutable_flat_cpu_diff());
+    return;
+  }
   for (int i = 0; i < learnable_params_.size(); ++i) {
     Blob<Dtype>* blob = learnable_params_[i];
     switch (Caffe::mode()) {
@@ -969,6 +1404,48 @@ void Net<Dtype>::ShareWeights() {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::FlattenParams() {
+  CHECK(!has_flat_params()) << "Parameters are already flattened.";
+  int count = 0;
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    count += learnable_params_[i]->count();
+  }
+  // Blobs of zero count still need a valid pointer.
+  flat_params_.reset(new Blob<Dtype>(vector<int>(1, std::max(count, 1))));
+  Dtype* data = flat_params_->mutable_cpu_data();
+  Dtype* diff = flat_params_->mutable_cpu_diff();
+  caffe_set(flat_params_->count(), static_cast<Dtype>(0), diff);
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    Blob<Dtype>* blob = learnable_params_[i];
+    caffe_copy(blob->count(), blob->cpu_data(), data);
+    blob->data()->set_cpu_data(data);
+    blob->diff()->set_cpu_data(diff);
+    data += blob->count();
+    diff += blob->count();
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Flattened " << count
+      << " learnable parameters of " << learnable_params_.size() << " blobs.";
+}
+
+template <typename Dtype>
+Dtype* Net<Dtype>::mutable_flat_cpu_data() {
+  CHECK(has_flat_params());
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    learnable_params_[i]->mutable_cpu_data();
+  }
+  return flat_params_->mutable_cpu_data();
+}
+
+template <typename Dtype>
+Dtype* Net<Dtype>::mutable_flat_cpu_diff() {
+  CHECK(has_flat_params());
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    learnable_params_[i]->mutable_cpu_diff();
+  }
+  return flat_params_->mutable_cpu_diff();
+}
+
 template <typename Dtype>
 bool Net<Dtype>::has_blob(const string& blob_name) const {
   return blob_names_index_.find(blob_name) != blob_names_index_.end();
@@ -0,0 +1,189 @@
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "caffe/internal_thread.hpp"
+#include "caffe/net_pipeline.hpp"
+#include "caffe/util/benchmark.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Forward passes timed to balance the stages when no layer times are given,
+// after one untimed pass that sets up the memory.
+const int kProfileIterations = 3;
+
+}  // namespace
+
+template <typename Dtype>
+class NetPipeline<Dtype>::Stage : public InternalThread {
+ public:
+  Stage(NetPipeline* pipeline, int index, int begin, int end)
+      : pipeline_(pipeline), index_(index), begin_(begin), end_(end) {}
+  virtual ~Stage() {
+    StopInternalThread();
+  }
+
+ protected:
+  virtual void InternalThreadEntry() {
+    RingQueue<int>* in = pipeline_->queues_[index_].get();
+    RingQueue<int>* out = pipeline_->queues_[index_ + 1].get();
+    try {
+      while (!must_stop()) {
+        const int slot = in->pop();
+        // The queues order the slot's blobs and loss between the stages.
+        pipeline_->losses_[slot] +=
+            pipeline_->nets_[slot]->ForwardFromTo(begin_, end_ - 1);
+        out->push(slot);
+      }
+    } catch (boost::thread_interrupted&) {
+      // Interrupted exception is expected on shutdown
+    }
+  }
+
+  NetPipeline* pipeline_;
+  const int index_;
+  const int begin_;
+  const int end_;
+};
+
+template <typename Dtype>
+NetPipeline<Dtype>::NetPipeline(const NetParameter& param, int num_stages,
+    const vector<double>& layer_times)
+    : free_(num_stages + 1, RingQueue<int>::MPMC) {
+  CHECK_GT(num_stages, 0);
+  // TRAIN layers such as BatchNorm write their shared blobs in Forward.
+  CHECK_EQ(param.state().phase(), TEST)
+      << "Only TEST nets can be pipelined, as the slots share parameters.";
+  nets_.push_back(shared_ptr<Net<Dtype> >(new Net<Dtype>(param)));
+  const int num_layers = net()->layers().size();
+  CHECK_GT(num_layers, 0) << "Cannot pipeline an empty net.";
+  if (num_stages > num_layers) {
+    LOG(WARNING) << "Reducing the pipeline to " << num_layers
+                 << " stages, one per layer.";
+    num_stages = num_layers;
+  }
+  if (layer_times.empty()) {
+    stage_begins_ = Partition(ProfileLayers(), num_stages);
+  } else {
+    CHECK_EQ(layer_times.size(), num_layers)
+        << "Need the time of every layer.";
+    stage_begins_ = Partition(layer_times, num_stages);
+  }
+  for (int slot = 1; slot <= num_stages; ++slot) {
+    nets_.push_back(shared_ptr<Net<Dtype> >(new Net<Dtype>(param)));
+    nets_.back()->ShareTrainedLayersWith(net());
+  }
+  losses_.resize(nets_.size(), Dtype(0));
+  for (int s = 0; s <= num_stages; ++s) {
+    queues_.push_back(shared_ptr<RingQueue<int> >(
+        new RingQueue<int>(nets_.size(), RingQueue<int>::SPSC)));
+  }
+  for (int slot = 0; slot < nets_.size(); ++slot) {
+    free_.push(slot);
+  }
+  for (int s = 0; s < num_stages; ++s) {
+    const int end = s + 1 < num_stages ? stage_begins_[s + 1] : num_layers;
+    LOG(INFO) << "Pipeline stage " << s << ": layers "
+              << net()->layer_names()[stage_begins_[s]] << " to "
+              << net()->layer_names()[end - 1];
+    stages_.push_back(shared_ptr<Stage>(
+        new Stage(this, s, stage_begins_[s], end)));
+    stages_.back()->StartInternalThread();
+  }
+}
+
+template <typename Dtype>
+NetPipeline<Dtype>::~NetPipeline() {
+  // Stop the stages before the queues and nets they use go away.
+  stages_.clear();
+}
+
+template <typename Dtype>
+int NetPipeline<Dtype>::Acquire() {
+  return free_.pop();
+}
+
+template <typename Dtype>
+void NetPipeline<Dtype>::Submit(int slot) {
+  CHECK_GE(slot, 0);
+  CHECK_LT(slot, num_slots());
+  losses_[slot] = 0;
+  queues_[0]->push(slot);
+}
+
+template <typename Dtype>
+int NetPipeline<Dtype>::Collect() {
+  return queues_.back()->pop();
+}
+
+template <typename Dtype>
+void NetPipeline<Dtype>::Release(int slot) {
+  CHECK_GE(slot, 0);
+  CHECK_LT(slot, num_slots());
+  free_.push(slot);
+}
+
+template <typename Dtype>
+vector<int> NetPipeline<Dtype>::Partition(const vector<double>& layer_times,
+    int num_stages) {
+  const int n = layer_times.size();
+  CHECK_GT(n, 0);
+  const int k = std::min(num_stages, n);
+  CHECK_GT(k, 0);
+  vector<double> prefix(n + 1, 0);
+  for (int i = 0; i < n; ++i) {
+    prefix[i + 1] = prefix[i] + layer_times[i];
+  }
+  // slowest[s][i] is the time of the slowest stage when splitting the first
+  // i layers into s + 1 stages optimally, and split[s][i] the first layer
+  // of the last of them.
+  vector<vector<double> > slowest(k, vector<double>(n + 1,
+      std::numeric_limits<double>::max()));
+  vector<vector<int> > split(k, vector<int>(n + 1, 0));
+  for (int i = 1; i <= n; ++i) {
+    slowest[0][i] = prefix[i];
+  }
+  for (int s = 1; s < k; ++s) {
+    for (int i = s + 1; i <= n; ++i) {
+      for (int j = s; j < i; ++j) {
+        const double time = std::max(slowest[s - 1][j], prefix[i] - prefix[j]);
+        if (time < slowest[s][i]) {
+          slowest[s][i] = time;
+          split[s][i] = j;
+        }
+      }
+    }
+  }
+  vector<int> begins(k, 0);
+  int end = n;
+  for (int s = k - 1; s > 0; --s) {
+    begins[s] = split[s][end];
+    end = begins[s];
+  }
+  return begins;
+}
+
+template <typename Dtype>
+vector<double> NetPipeline<Dtype>::ProfileLayers() {
+  Net<Dtype>* profiled = net();
+  const int num_layers = profiled->layers().size();
+  vector<double> layer_times(num_layers, 0);
+  profiled->Forward();
+  Timer timer;
+  for (int iter = 0; iter < kProfileIterations; ++iter) {
+    for (int i = 0; i < num_layers; ++i) {
+      timer.Start();
+      profiled->ForwardFromTo(i, i);
+      layer_times[i] += timer.MicroSeconds();
+    }
+  }
+  return layer_times;
+}
+
+INSTANTIATE_CLASS(NetPipeline);
+
+}  // namespace caffe
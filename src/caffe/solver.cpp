@@ -1,16 +1,47 @@
-#include <cstdio>
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "caffe/solver.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/net_cache.hpp"
 #include "caffe/util/upgrade_proto.hpp"
+#include "caffe/util/weight_registry.hpp"
 
 namespace caffe {
 
+namespace {
+
+void WriteSnapshotProtos(const vector<pair<
+    shared_ptr<const google::protobuf::Message>, string> >& protos) {
+  for (int i = 0; i < protos.size(); ++i) {
+    WriteProtoToBinaryFile(*protos[i].first, protos[i].second);
+  }
+}
+
+// The largest change of an element of blob from base.
+template <typename Dtype>
+Dtype MaxChange(const Blob<Dtype>& blob, const Blob<Dtype>& base) {
+  CHECK_EQ(blob.count(), base.count());
+  const Dtype* data = blob.cpu_data();
+  const Dtype* base_data = base.cpu_data();
+  Dtype change = 0;
+  for (int i = 0; i < blob.count(); ++i) {
+    change = std::max(change, std::abs(data[i] - base_data[i]));
+  }
+  return change;
+}
+
+}  // namespace
+
 template<typename Dtype>
 void Solver<Dtype>::SetActionFunction(ActionCallback func) {
   action_request_function_ = func;
@@ -61,6 +92,12 @@ void Solver<Dtype>::Init(const SolverParameter& param) {
   }
   iter_ = 0;
   current_step_ = 0;
+  snapshots_since_full_ = 0;
+}
+
+template <typename Dtype>
+Solver<Dtype>::~Solver() {
+  WaitForSnapshot();
 }
 
 template <typename Dtype>
@@ -80,7 +117,7 @@ void Solver<Dtype>::InitTrainNet() {
   } else if (param_.has_train_net()) {
     LOG_IF(INFO, Caffe::root_solver())
         << "Creating training net from train_net file: " << param_.train_net();
-    ReadNetParamsFromTextFileOrDie(param_.train_net(), &net_param);
+    NetCache::ReadNetParams(param_.train_net(), &net_param);
   }
   if (param_.has_net_param()) {
     LOG_IF(INFO, Caffe::root_solver())
@@ -90,7 +127,7 @@ void Solver<Dtype>::InitTrainNet() {
   if (param_.has_net()) {
     LOG_IF(INFO, Caffe::root_solver())
         << "Creating training net from net file: " << param_.net();
-    ReadNetParamsFromTextFileOrDie(param_.net(), &net_param);
+    NetCache::ReadNetParams(param_.net(), &net_param);
   }
   // Set the correct NetState.  We start with the solver defaults (lowest
   // precedence); then, merge in any NetState specified by the net_param itself;
@@ -149,7 +186,7 @@ void Solver<Dtype>::InitTestNets() {
   }
   for (int i = 0; i < num_test_net_files; ++i, ++test_net_id) {
       sources[test_net_id] = "test_net file: " + param_.test_net(i);
-      ReadNetParamsFromTextFileOrDie(param_.test_net(i),
+      NetCache::ReadNetParams(param_.test_net(i),
           &net_params[test_net_id]);
   }
   const int remaining_test_nets = param_.test_iter_size() - test_net_id;
@@ -162,7 +199,7 @@ void Solver<Dtype>::InitTestNets() {
   if (has_net_file) {
     for (int i = 0; i < remaining_test_nets; ++i, ++test_net_id) {
       sources[test_net_id] = "net file: " + param_.net();
-      ReadNetParamsFromTextFileOrDie(param_.net(), &net_params[test_net_id]);
+      NetCache::ReadNetParams(param_.net(), &net_params[test_net_id]);
     }
   }
   test_nets_.resize(num_test_net_instances);
@@ -188,6 +225,13 @@ void Solver<Dtype>::InitTestNets() {
     }
     test_nets_[i]->set_debug_info(param_.debug_info());
   }
+  // The test nets read the weights of the training net in place.
+  const string model =
+      WeightRegistry<Dtype>::Attach(param_.weight_model(), net_.get());
+  for (int i = 0; i < test_nets_.size(); ++i) {
+    WeightRegistry<Dtype>::Attach(model, test_nets_[i].get(),
+                                  WeightRegistry<Dtype>::FOLLOW);
+  }
 }
 
 template <typename Dtype>
@@ -297,6 +341,7 @@ void Solver<Dtype>::Solve(const char* resume_file) {
       && (!param_.snapshot() || iter_ % param_.snapshot() != 0)) {
     Snapshot();
   }
+  WaitForSnapshot();
   if (requested_early_exit_) {
     LOG(INFO) << "Optimization stopped early.";
     return;
@@ -336,8 +381,8 @@ void Solver<Dtype>::Test(const int test_net_id) {
   CHECK(Caffe::root_solver());
   LOG(INFO) << "Iteration " << iter_
             << ", Testing net (#" << test_net_id << ")";
-  CHECK_NOTNULL(test_nets_[test_net_id].get())->
-      ShareTrainedLayersWith(net_.get());
+  WeightRegistry<Dtype>::Refresh(
+      CHECK_NOTNULL(test_nets_[test_net_id].get()));
   vector<Dtype> test_score;
   vector<int> test_score_output_id;
   const shared_ptr<Net<Dtype> >& test_net = test_nets_[test_net_id];
@@ -412,6 +457,8 @@ void Solver<Dtype>::Test(const int test_net_id) {
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
   CHECK(Caffe::root_solver());
+  // One snapshot is written at a time.
+  WaitForSnapshot();
   string model_filename;
   switch (param_.snapshot_format()) {
   case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
@@ -425,6 +472,29 @@ void Solver<Dtype>::Snapshot() {
   }
 
   SnapshotSolverState(model_filename);
+  if (snapshot_protos_.empty()) { return; }
+  if (param_.snapshot_async()) {
+    snapshot_thread_.reset(new boost::thread(&WriteSnapshotProtos,
+        snapshot_protos_));
+  } else {
+    WriteSnapshotProtos(snapshot_protos_);
+  }
+  snapshot_protos_.clear();
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WaitForSnapshot() {
+  if (snapshot_thread_) {
+    snapshot_thread_->join();
+    snapshot_thread_.reset();
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WriteSnapshotProto(
+    shared_ptr<const google::protobuf::Message> proto,
+    const string& filename) {
+  snapshot_protos_.push_back(make_pair(proto, filename));
 }
 
 template <typename Dtype>
@@ -454,10 +524,51 @@ string Solver<Dtype>::SnapshotFilename(const string extension) {
 template <typename Dtype>
 string Solver<Dtype>::SnapshotToBinaryProto() {
   string model_filename = SnapshotFilename(".caffemodel");
-  LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
-  NetParameter net_param;
-  net_->ToProto(&net_param, param_.snapshot_diff());
-  WriteProtoToBinaryFile(net_param, model_filename);
+  shared_ptr<NetParameter> net_param(new NetParameter());
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net_->layers();
+  const float threshold = param_.snapshot_delta_threshold();
+  if (threshold < 0 || snapshot_base_file_.empty() ||
+      snapshots_since_full_ + 1 >= param_.snapshot_full_interval()) {
+    LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
+    net_->ToProto(net_param.get(), param_.snapshot_diff());
+    if (threshold >= 0) {
+      snapshot_base_.clear();
+      for (int i = 0; i < layers.size(); ++i) {
+        for (int j = 0; j < layers[i]->blobs().size(); ++j) {
+          shared_ptr<Blob<Dtype> > copy(new Blob<Dtype>());
+          copy->CopyFrom(*layers[i]->blobs()[j], false, true);
+          snapshot_base_.push_back(copy);
+        }
+      }
+      snapshot_base_file_ = model_filename;
+      snapshots_since_full_ = 0;
+    }
+  } else {
+    LOG(INFO) << "Snapshotting changes since " << snapshot_base_file_
+              << " to binary proto file " << model_filename;
+    net_param->set_name(net_->name());
+    // Both files share the snapshot prefix, so the base is named relative
+    // to this one, wherever the snapshots are moved.
+    net_param->set_base_net(
+        boost::filesystem::path(snapshot_base_file_).filename().string());
+    int base_id = 0;
+    for (int i = 0; i < layers.size(); ++i) {
+      const vector<shared_ptr<Blob<Dtype> > >& blobs = layers[i]->blobs();
+      bool changed = false;
+      for (int j = 0; j < blobs.size() && !changed; ++j) {
+        changed = MaxChange(*blobs[j], *snapshot_base_[base_id + j]) >
+            threshold;
+      }
+      base_id += blobs.size();
+      if (changed) {
+        layers[i]->ToProto(net_param->add_layer(), param_.snapshot_diff());
+      }
+    }
+    ++snapshots_since_full_;
+    LOG(INFO) << net_param->layer_size() << " of " << layers.size()
+              << " layers changed.";
+  }
+  WriteSnapshotProto(net_param, model_filename);
   return model_filename;
 }
 
@@ -472,6 +583,7 @@ string Solver<Dtype>::SnapshotToHDF5() {
 template <typename Dtype>
 void Solver<Dtype>::Restore(const char* state_file) {
   CHECK(Caffe::root_solver());
+  WaitForSnapshot();
   string state_filename(state_file);
   if (state_filename.size() >= 3 &&
       state_filename.compare(state_filename.size() - 3, 3, ".h5") == 0) {
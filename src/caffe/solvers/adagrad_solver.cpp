@@ -4,6 +4,16 @@
 
 namespace caffe {
 
+template <typename Dtype>
+void adagrad_update_cpu(int N, Dtype* g, Dtype* h, Dtype delta,
+    Dtype local_rate) {
+  for (int i = 0; i < N; ++i) {
+    Dtype gi = g[i];
+    Dtype hi = h[i] = h[i] + gi*gi;
+    g[i] = local_rate * gi / (std::sqrt(hi) + delta);
+  }
+}
+
 #ifndef CPU_ONLY
 template <typename Dtype>
 void adagrad_update_gpu(int N, Dtype* g, Dtype* h, Dtype delta,
@@ -19,34 +29,9 @@ void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   Dtype local_rate = rate * net_params_lr[param_id];
   switch (Caffe::mode()) {
   case Caffe::CPU: {
-    // compute square of gradient in update
-    caffe_powx(net_params[param_id]->count(),
-        net_params[param_id]->cpu_diff(), Dtype(2),
-        this->update_[param_id]->mutable_cpu_data());
-
-    // update history
-    caffe_add(net_params[param_id]->count(),
-        this->update_[param_id]->cpu_data(),
-        this->history_[param_id]->cpu_data(),
-        this->history_[param_id]->mutable_cpu_data());
-
-    // prepare update
-    caffe_powx(net_params[param_id]->count(),
-              this->history_[param_id]->cpu_data(), Dtype(0.5),
-              this->update_[param_id]->mutable_cpu_data());
-
-    caffe_add_scalar(net_params[param_id]->count(),
-              delta, this->update_[param_id]->mutable_cpu_data());
-
-    caffe_div(net_params[param_id]->count(),
-              net_params[param_id]->cpu_diff(),
-              this->update_[param_id]->cpu_data(),
-              this->update_[param_id]->mutable_cpu_data());
-
-    // scale and copy
-    caffe_cpu_axpby(net_params[param_id]->count(), local_rate,
-        this->update_[param_id]->cpu_data(), Dtype(0),
-        net_params[param_id]->mutable_cpu_diff());
+    adagrad_update_cpu(net_params[param_id]->count(),
+        net_params[param_id]->mutable_cpu_diff(),
+        this->history_[param_id]->mutable_cpu_data(), delta, local_rate);
     break;
   }
   case Caffe::GPU: {
@@ -64,6 +49,15 @@ void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdaGradSolver<Dtype>::ComputeUpdateValueCPU(int param_id, Dtype rate,
+    int begin, int end) {
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  adagrad_update_cpu(end - begin, this->diff_ptrs_[param_id] + begin,
+      this->history_ptrs_[param_id] + begin, Dtype(this->param_.delta()),
+      local_rate);
+}
+
 INSTANTIATE_CLASS(AdaGradSolver);
 REGISTER_SOLVER_CLASS(AdaGrad);
 
@@ -16,6 +16,17 @@ void AdamSolver<Dtype>::AdamPreSolve() {
   }
 }
 
+template <typename Dtype>
+void adam_update_cpu(int N, Dtype* g, Dtype* m, Dtype* v, Dtype beta1,
+    Dtype beta2, Dtype eps_hat, Dtype corrected_local_rate) {
+  for (int i = 0; i < N; ++i) {
+    Dtype gi = g[i];
+    Dtype mi = m[i] = m[i]*beta1 + gi*(1-beta1);
+    Dtype vi = v[i] = v[i]*beta2 + gi*gi*(1-beta2);
+    g[i] = corrected_local_rate * mi / (std::sqrt(vi) + eps_hat);
+  }
+}
+
 #ifndef CPU_ONLY
 template <typename Dtype>
 void adam_update_gpu(int N, Dtype* g, Dtype* m, Dtype* v, Dtype beta1,
@@ -34,7 +45,6 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   size_t update_history_offset = net_params.size();
   Blob<Dtype>* val_m = this->history_[param_id].get();
   Blob<Dtype>* val_v = this->history_[param_id + update_history_offset].get();
-  Blob<Dtype>* val_t = this->temp_[param_id].get();
 
   const int t = this->iter_ + 1;
   const Dtype correction = std::sqrt(Dtype(1) - pow(beta2, t)) /
@@ -43,34 +53,10 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   const Dtype eps_hat = this->param_.delta();
 
   switch (Caffe::mode()) {
-    case Caffe::CPU: {
-    // update m <- \beta_1 m_{t-1} + (1-\beta_1)g_t
-    caffe_cpu_axpby(N, Dtype(1)-beta1,
-        net_params[param_id]->cpu_diff(), beta1,
-        val_m->mutable_cpu_data());
-
-    // update v <- \beta_2 m_{t-1} + (1-\beta_2)g_t^2
-    caffe_mul(N,
-        net_params[param_id]->cpu_diff(),
-        net_params[param_id]->cpu_diff(),
-    val_t->mutable_cpu_data());
-    caffe_cpu_axpby(N, Dtype(1)-beta2,
-        val_t->cpu_data(), beta2,
-        val_v->mutable_cpu_data());
-
-    // set update
-    caffe_powx(N,
-        val_v->cpu_data(), Dtype(0.5),
-        val_t->mutable_cpu_data());
-    caffe_add_scalar(N, eps_hat, val_t->mutable_cpu_data());
-    caffe_div(N,
-        val_m->cpu_data(),
-        val_t->cpu_data(),
-        val_t->mutable_cpu_data());
-
-    caffe_cpu_scale(N, local_rate*correction,
-        val_t->cpu_data(),
-        net_params[param_id]->mutable_cpu_diff());
+  case Caffe::CPU: {
+    adam_update_cpu(N, net_params[param_id]->mutable_cpu_diff(),
+        val_m->mutable_cpu_data(), val_v->mutable_cpu_data(), beta1, beta2,
+        eps_hat, local_rate*correction);
     break;
   }
   case Caffe::GPU: {
@@ -88,6 +74,22 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdamSolver<Dtype>::ComputeUpdateValueCPU(int param_id, Dtype rate,
+    int begin, int end) {
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  const Dtype beta1 = this->param_.momentum();
+  const Dtype beta2 = this->param_.momentum2();
+  const int t = this->iter_ + 1;
+  const Dtype correction = std::sqrt(Dtype(1) - pow(beta2, t)) /
+      (Dtype(1.) - pow(beta1, t));
+  const size_t update_history_offset = this->net_->learnable_params().size();
+  adam_update_cpu(end - begin, this->diff_ptrs_[param_id] + begin,
+      this->history_ptrs_[param_id] + begin,
+      this->history_ptrs_[update_history_offset + param_id] + begin,
+      beta1, beta2, Dtype(this->param_.delta()), local_rate * correction);
+}
+
 INSTANTIATE_CLASS(AdamSolver);
 REGISTER_SOLVER_CLASS(Adam);
 
@@ -1,6 +1,7 @@
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
+#include "caffe/util/half.hpp"
 
 namespace caffe {
 
@@ -116,6 +117,7 @@ int DistroSolver<Dtype>::Half_iter(ostream *outstream) {
 	Step_stage_0(average_loss, start_iter);
 	NetParameter export_param;
 	this->net_->ToProto(&export_param, true);
+	ConvertNetPrecision(&export_param, this->param_.payload_precision());
 	export_param.SerializeToOstream(outstream);
 	// this->net_->ClearParamDiffs();
 	return 0;
@@ -126,6 +128,7 @@ template <typename Dtype>
 int DistroSolver<Dtype>::GetAccumulatedNet(ostream* outstream) {
 	NetParameter export_param;
 	this->pair_net->ToProto(&export_param, true);
+	ConvertNetPrecision(&export_param, this->param_.payload_precision());
     // LOG(INFO) << "SerializeToOstream";
 	export_param.SerializeToOstream(outstream);
 	// this->net_->ClearParamDiffs();
@@ -278,31 +281,10 @@ int DistroSolver<Dtype>::SetNet(istream* instream) {
 	return 0;
 }
 
-/*Oveeriding normalize to do the normalization according to the preset normlize scale*/
+/*Overriding the normalization to use the preset normalize scale*/
 template <typename Dtype>
-void DistroSolver<Dtype>::Normalize(int param_id) {
-	// Scale gradient to counterbalance accumulation.
-	// LOG(INFO)<<"Distro Normalization called";
-	const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
-	const Dtype accum_normalization = Dtype(1.) / this->normalize_scale;
-	switch (Caffe::mode()) {
-		case Caffe::CPU: {
-			caffe_scal(net_params[param_id]->count(), accum_normalization,
-			    net_params[param_id]->mutable_cpu_diff());
-		break;
-		}
-		case Caffe::GPU: {
-	#ifndef CPU_ONLY
-			caffe_gpu_scal(net_params[param_id]->count(), accum_normalization,
-		    	net_params[param_id]->mutable_gpu_diff());
-	#else
-			NO_GPU;
-	#endif
-			break;
-		}
-		default:
-		LOG(FATAL) << "Unknown caffe mode: " << Caffe::mode();
-	}
+Dtype DistroSolver<Dtype>::AccumNormalization() {
+	return Dtype(1.) / this->normalize_scale;
 }
 
 template <typename Dtype>
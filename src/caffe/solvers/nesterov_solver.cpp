@@ -4,6 +4,16 @@
 
 namespace caffe {
 
+template <typename Dtype>
+void nesterov_update_cpu(int N, Dtype* g, Dtype* h, Dtype momentum,
+    Dtype local_rate) {
+  for (int i = 0; i < N; ++i) {
+    Dtype hi = h[i];
+    Dtype hi_new = h[i] = momentum * hi + local_rate * g[i];
+    g[i] = (1+momentum) * hi_new - momentum * hi;
+  }
+}
+
 #ifndef CPU_ONLY
 template <typename Dtype>
 void nesterov_update_gpu(int N, Dtype* g, Dtype* h, Dtype momentum,
@@ -19,25 +29,10 @@ void NesterovSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   Dtype local_rate = rate * net_params_lr[param_id];
   switch (Caffe::mode()) {
   case Caffe::CPU: {
-    // save history momentum for stepping back
-    caffe_copy(net_params[param_id]->count(),
-        this->history_[param_id]->cpu_data(),
-        this->update_[param_id]->mutable_cpu_data());
-
-    // update history
-    caffe_cpu_axpby(net_params[param_id]->count(), local_rate,
-              net_params[param_id]->cpu_diff(), momentum,
-              this->history_[param_id]->mutable_cpu_data());
-
-    // compute update: step back then over step
-    caffe_cpu_axpby(net_params[param_id]->count(), Dtype(1) + momentum,
-        this->history_[param_id]->cpu_data(), -momentum,
-        this->update_[param_id]->mutable_cpu_data());
-
-    // copy
-    caffe_copy(net_params[param_id]->count(),
-        this->update_[param_id]->cpu_data(),
-        net_params[param_id]->mutable_cpu_diff());
+    nesterov_update_cpu(net_params[param_id]->count(),
+        net_params[param_id]->mutable_cpu_diff(),
+        this->history_[param_id]->mutable_cpu_data(),
+        momentum, local_rate);
     break;
   }
   case Caffe::GPU: {
@@ -56,6 +51,15 @@ void NesterovSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void NesterovSolver<Dtype>::ComputeUpdateValueCPU(int param_id, Dtype rate,
+    int begin, int end) {
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  nesterov_update_cpu(end - begin, this->diff_ptrs_[param_id] + begin,
+      this->history_ptrs_[param_id] + begin, Dtype(this->param_.momentum()),
+      local_rate);
+}
+
 INSTANTIATE_CLASS(NesterovSolver);
 REGISTER_SOLVER_CLASS(Nesterov);
 
@@ -4,6 +4,16 @@
 
 namespace caffe {
 
+template <typename Dtype>
+void rmsprop_update_cpu(int N, Dtype* g, Dtype* h, Dtype rms_decay,
+    Dtype delta, Dtype local_rate) {
+  for (int i = 0; i < N; ++i) {
+    Dtype gi = g[i];
+    Dtype hi = h[i] = rms_decay*h[i] + (1-rms_decay)*gi*gi;
+    g[i] = local_rate * gi / (std::sqrt(hi) + delta);
+  }
+}
+
 #ifndef CPU_ONLY
 template <typename Dtype>
 void rmsprop_update_gpu(int N, Dtype* g, Dtype* h, Dtype rms_decay,
@@ -22,32 +32,10 @@ void RMSPropSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
 
   switch (Caffe::mode()) {
   case Caffe::CPU:
-    // compute square of gradient in update
-    caffe_powx(net_params[param_id]->count(),
-        net_params[param_id]->cpu_diff(), Dtype(2),
-        this->update_[param_id]->mutable_cpu_data());
-
-    // update history
-    caffe_cpu_axpby(net_params[param_id] -> count(),
-        Dtype(1-rms_decay), this->update_[param_id]->cpu_data(),
-        rms_decay, this->history_[param_id]-> mutable_cpu_data());
-
-    // prepare update
-    caffe_powx(net_params[param_id]->count(),
-        this->history_[param_id]->cpu_data(), Dtype(0.5),
-        this->update_[param_id]->mutable_cpu_data());
-
-    caffe_add_scalar(net_params[param_id]->count(),
-        delta, this->update_[param_id]->mutable_cpu_data());
-
-    caffe_div(net_params[param_id]->count(),
-        net_params[param_id]->cpu_diff(), this->update_[param_id]->cpu_data(),
-        this->update_[param_id]->mutable_cpu_data());
-
-    // scale and copy
-    caffe_cpu_axpby(net_params[param_id]->count(), local_rate,
-        this->update_[param_id]->cpu_data(), Dtype(0),
-        net_params[param_id]->mutable_cpu_diff());
+    rmsprop_update_cpu(net_params[param_id]->count(),
+        net_params[param_id]->mutable_cpu_diff(),
+        this->history_[param_id]->mutable_cpu_data(),
+        rms_decay, delta, local_rate);
     break;
   case Caffe::GPU:
 #ifndef CPU_ONLY
@@ -64,6 +52,15 @@ void RMSPropSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void RMSPropSolver<Dtype>::ComputeUpdateValueCPU(int param_id, Dtype rate,
+    int begin, int end) {
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  rmsprop_update_cpu(end - begin, this->diff_ptrs_[param_id] + begin,
+      this->history_ptrs_[param_id] + begin, Dtype(this->param_.rms_decay()),
+      Dtype(this->param_.delta()), local_rate);
+}
+
 INSTANTIATE_CLASS(RMSPropSolver);
 REGISTER_SOLVER_CLASS(RMSProp);
 
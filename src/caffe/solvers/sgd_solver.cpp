@@ -1,13 +1,40 @@
+#include <algorithm>
 #include <string>
+#include <typeinfo>
+#include <utility>
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/upgrade_proto.hpp"
+#include "caffe/util/weight_registry.hpp"
 
 namespace caffe {
 
+// The number of elements of a parameter ApplyUpdateCPU processes at a time,
+// small enough for the chunk of the data, the diff and the history to stay
+// in cache between the passes over it.
+const int kUpdateChunk = 8192;
+
+template <typename Dtype>
+class SGDSolver<Dtype>::UpdateTask : public ParallelTask {
+ public:
+  UpdateTask(SGDSolver<Dtype>* solver, Dtype rate, Dtype normalization,
+      bool l1)
+      : solver_(solver), rate_(rate), normalization_(normalization),
+        l1_(l1) {}
+  virtual void Run(int item, int thread) {
+    solver_->UpdateChunk(item, rate_, normalization_, l1_);
+  }
+
+ private:
+  SGDSolver<Dtype>* solver_;
+  const Dtype rate_;
+  const Dtype normalization_;
+  const bool l1_;
+};
+
 // Return the current learning rate. The currently implemented learning rate
 // policies are as follows:
 //    - fixed: always return base_lr.
@@ -75,6 +102,15 @@ void SGDSolver<Dtype>::PreSolve() {
     update_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
     temp_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
   }
+  // Split the parameters into chunks for ApplyUpdateCPU.
+  update_chunks_.clear();
+  for (int i = 0; i < net_params.size(); ++i) {
+    for (int offset = 0; offset < net_params[i]->count();
+         offset += kUpdateChunk) {
+      update_chunks_.push_back(std::make_pair(i, offset));
+    }
+  }
+  update_pool_.reset(new ThreadPool(this->param_.update_threads()));
 }
 
 template <typename Dtype>
@@ -82,9 +118,17 @@ void SGDSolver<Dtype>::ClipGradients() {
   const Dtype clip_gradients = this->param_.clip_gradients();
   if (clip_gradients < 0) { return; }
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  // With flat parameters, the norm and the scaling cover the diff arena.
+  const bool flat = this->net_->has_flat_params() &&
+      Caffe::mode() == Caffe::CPU;
+  Dtype* flat_diff = flat ? this->net_->mutable_flat_cpu_diff() : NULL;
   Dtype sumsq_diff = 0;
-  for (int i = 0; i < net_params.size(); ++i) {
-    sumsq_diff += net_params[i]->sumsq_diff();
+  if (flat) {
+    sumsq_diff = caffe_cpu_dot(this->net_->flat_count(), flat_diff, flat_diff);
+  } else {
+    for (int i = 0; i < net_params.size(); ++i) {
+      sumsq_diff += net_params[i]->sumsq_diff();
+    }
   }
   const Dtype l2norm_diff = std::sqrt(sumsq_diff);
   if (l2norm_diff > clip_gradients) {
@@ -92,8 +136,12 @@ void SGDSolver<Dtype>::ClipGradients() {
     LOG(INFO) << "Gradient clipping: scaling down gradients (L2 norm "
         << l2norm_diff << " > " << clip_gradients << ") "
         << "by scale factor " << scale_factor;
-    for (int i = 0; i < net_params.size(); ++i) {
-      net_params[i]->scale_diff(scale_factor);
+    if (flat) {
+      caffe_scal(this->net_->flat_count(), scale_factor, flat_diff);
+    } else {
+      for (int i = 0; i < net_params.size(); ++i) {
+        net_params[i]->scale_diff(scale_factor);
+      }
     }
   }
 }
@@ -106,6 +154,12 @@ void SGDSolver<Dtype>::ApplyUpdate() {
     LOG(INFO) << "Iteration " << this->iter_ << ", lr = " << rate;
   }
   ClipGradients();//need net_->learnable_param
+  if (Caffe::mode() == Caffe::CPU && typeid(*this) == fused_update_type()) {
+    WeightRegistry<Dtype>::BeginUpdate(this->net_.get());
+    ApplyUpdateCPU(rate);
+    WeightRegistry<Dtype>::EndUpdate(this->net_.get());
+    return;
+  }
   for (int param_id = 0; param_id < this->net_->learnable_params().size();
        ++param_id) {
     Normalize(param_id);
@@ -115,12 +169,75 @@ void SGDSolver<Dtype>::ApplyUpdate() {
   this->net_->Update();
 }
 
+template <typename Dtype>
+void SGDSolver<Dtype>::ApplyUpdateCPU(Dtype rate) {
+  const string& regularization_type = this->param_.regularization_type();
+  const bool l1 = regularization_type == "L1";
+  if (this->param_.weight_decay() && !l1 && regularization_type != "L2") {
+    LOG(FATAL) << "Unknown regularization type: " << regularization_type;
+  }
+  for (int param_id = 0; param_id < this->net_->learnable_params().size();
+       ++param_id) {
+    GatherCPUPointers(param_id);
+  }
+  UpdateTask task(this, rate, AccumNormalization(), l1);
+  update_pool_->Run(&task, update_chunks_.size());
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::UpdateChunk(int chunk, Dtype rate,
+    Dtype normalization, bool l1) {
+  const int param_id = update_chunks_[chunk].first;
+  const int begin = update_chunks_[chunk].second;
+  const int end = std::min(begin + kUpdateChunk,
+      this->net_->learnable_params()[param_id]->count());
+  const int count = end - begin;
+  Dtype* data = data_ptrs_[param_id] + begin;
+  Dtype* diff = diff_ptrs_[param_id] + begin;
+  if (normalization != Dtype(1)) {
+    caffe_scal(count, normalization, diff);
+  }
+  const Dtype local_decay = this->param_.weight_decay() *
+      this->net_->params_weight_decay()[param_id];
+  if (local_decay) {
+    if (l1) {
+      for (int i = 0; i < count; ++i) {
+        diff[i] += local_decay * caffe_sign(data[i]);
+      }
+    } else {
+      caffe_axpy(count, local_decay, data, diff);
+    }
+  }
+  ComputeUpdateValueCPU(param_id, rate, begin, end);
+  caffe_axpy(count, Dtype(-1), diff, data);
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::GatherCPUPointers(int param_id) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  data_ptrs_.resize(net_params.size());
+  diff_ptrs_.resize(net_params.size());
+  history_ptrs_.resize(history_.size());
+  data_ptrs_[param_id] = net_params[param_id]->mutable_cpu_data();
+  diff_ptrs_[param_id] = net_params[param_id]->mutable_cpu_diff();
+  // Solvers with several histories per param keep them net_params.size()
+  // apart.
+  for (int i = param_id; i < history_.size(); i += net_params.size()) {
+    history_ptrs_[i] = history_[i]->mutable_cpu_data();
+  }
+}
+
+template <typename Dtype>
+Dtype SGDSolver<Dtype>::AccumNormalization() {
+  return Dtype(1.) / this->param_.iter_size();
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::Normalize(int param_id) {
-  if (this->param_.iter_size() == 1) { return; }
   // Scale gradient to counterbalance accumulation.
+  const Dtype accum_normalization = AccumNormalization();
+  if (accum_normalization == Dtype(1)) { return; }
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
-  const Dtype accum_normalization = Dtype(1.) / this->param_.iter_size();
   switch (Caffe::mode()) {
   case Caffe::CPU: {
     caffe_scal(net_params[param_id]->count(), accum_normalization,
@@ -203,6 +320,14 @@ void SGDSolver<Dtype>::Regularize(int param_id) {
   }
 }
 
+template <typename Dtype>
+void sgd_update_cpu(int N, Dtype* g, Dtype* h, Dtype momentum,
+    Dtype local_rate) {
+  for (int i = 0; i < N; ++i) {
+    g[i] = h[i] = momentum*h[i] + local_rate*g[i];
+  }
+}
+
 #ifndef CPU_ONLY
 template <typename Dtype>
 void sgd_update_gpu(int N, Dtype* g, Dtype* h, Dtype momentum,
@@ -218,12 +343,10 @@ void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   // Compute the update to history, then copy it to the parameter diff.
   switch (Caffe::mode()) {
   case Caffe::CPU: {
-    caffe_cpu_axpby(net_params[param_id]->count(), local_rate,
-              net_params[param_id]->cpu_diff(), momentum,
-              history_[param_id]->mutable_cpu_data());
-    caffe_copy(net_params[param_id]->count(),
-        history_[param_id]->cpu_data(),
-        net_params[param_id]->mutable_cpu_diff());
+    sgd_update_cpu(net_params[param_id]->count(),
+        net_params[param_id]->mutable_cpu_diff(),
+        history_[param_id]->mutable_cpu_data(),
+        momentum, local_rate);
     break;
   }
   case Caffe::GPU: {
@@ -242,6 +365,15 @@ void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void SGDSolver<Dtype>::ComputeUpdateValueCPU(int param_id, Dtype rate,
+    int begin, int end) {
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  sgd_update_cpu(end - begin, diff_ptrs_[param_id] + begin,
+      history_ptrs_[param_id] + begin, Dtype(this->param_.momentum()),
+      local_rate);
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
   switch (this->param_.snapshot_format()) {
@@ -259,20 +391,20 @@ void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
 template <typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
     const string& model_filename) {
-  SolverState state;
-  state.set_iter(this->iter_);
-  state.set_learned_net(model_filename);
-  state.set_current_step(this->current_step_);
-  state.clear_history();
+  shared_ptr<SolverState> state(new SolverState());
+  state->set_iter(this->iter_);
+  state->set_learned_net(model_filename);
+  state->set_current_step(this->current_step_);
+  state->clear_history();
   for (int i = 0; i < history_.size(); ++i) {
     // Add history
-    BlobProto* history_blob = state.add_history();
+    BlobProto* history_blob = state->add_history();
     history_[i]->ToProto(history_blob);
   }
   string snapshot_filename = Solver<Dtype>::SnapshotFilename(".solverstate");
   LOG(INFO)
     << "Snapshotting solver state to binary proto file " << snapshot_filename;
-  WriteProtoToBinaryFile(state, snapshot_filename.c_str());
+  this->WriteSnapshotProto(state, snapshot_filename);
 }
 
 template <typename Dtype>
@@ -282,6 +414,7 @@ void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(
   string snapshot_filename =
       Solver<Dtype>::SnapshotFilename(".solverstate.h5");
   LOG(INFO) << "Snapshotting solver state to HDF5 file " << snapshot_filename;
+  boost::mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_hid = H5Fcreate(snapshot_filename.c_str(), H5F_ACC_TRUNC,
       H5P_DEFAULT, H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -329,6 +462,7 @@ void SGDSolver<Dtype>::RestoreSolverStateFromBinaryProto(
 template <typename Dtype>
 void SGDSolver<Dtype>::RestoreSolverStateFromHDF5(const string& state_file) {
 #ifdef USE_HDF5
+  boost::mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_hid = H5Fopen(state_file.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
   CHECK_GE(file_hid, 0) << "Couldn't open solver state file " << state_file;
   this->iter_ = hdf5_load_int(file_hid, "iter");
@@ -6,7 +6,7 @@ namespace caffe {
 
 SyncedMemory::~SyncedMemory() {
   if (cpu_ptr_ && own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+    CaffeFreeHost(cpu_ptr_, size_, cpu_malloc_use_cuda_, cpu_malloc_use_pool_);
   }
 
 #ifndef CPU_ONLY
@@ -22,10 +22,37 @@ SyncedMemory::~SyncedMemory() {
 #endif  // CPU_ONLY
 }
 
+void SyncedMemory::Release() {
+  if ((cpu_ptr_ && !own_cpu_data_) || (gpu_ptr_ && !own_gpu_data_)) {
+    return;
+  }
+  if (cpu_ptr_) {
+    CaffeFreeHost(cpu_ptr_, size_, cpu_malloc_use_cuda_, cpu_malloc_use_pool_);
+    cpu_ptr_ = NULL;
+    own_cpu_data_ = false;
+  }
+#ifndef CPU_ONLY
+  if (gpu_ptr_) {
+    int initial_device;
+    cudaGetDevice(&initial_device);
+    if (gpu_device_ != -1) {
+      CUDA_CHECK(cudaSetDevice(gpu_device_));
+    }
+    CUDA_CHECK(cudaFree(gpu_ptr_));
+    cudaSetDevice(initial_device);
+    gpu_ptr_ = NULL;
+    own_gpu_data_ = false;
+  }
+#endif  // CPU_ONLY
+  head_ = UNINITIALIZED;
+  ++version_;
+}
+
 inline void SyncedMemory::to_cpu() {
   switch (head_) {
   case UNINITIALIZED:
-    CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+    CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_,
+        &cpu_malloc_use_pool_);
     caffe_memset(size_, 0, cpu_ptr_);
     head_ = HEAD_AT_CPU;
     own_cpu_data_ = true;
@@ -33,7 +60,8 @@ inline void SyncedMemory::to_cpu() {
   case HEAD_AT_GPU:
 #ifndef CPU_ONLY
     if (cpu_ptr_ == NULL) {
-      CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+      CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_,
+          &cpu_malloc_use_pool_);
       own_cpu_data_ = true;
     }
     caffe_gpu_memcpy(size_, gpu_ptr_, cpu_ptr_);
@@ -84,9 +112,10 @@ const void* SyncedMemory::cpu_data() {
 void SyncedMemory::set_cpu_data(void* data) {
   CHECK(data);
   if (own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+    CaffeFreeHost(cpu_ptr_, size_, cpu_malloc_use_cuda_, cpu_malloc_use_pool_);
   }
   cpu_ptr_ = data;
+  ++version_;
   head_ = HEAD_AT_CPU;
   own_cpu_data_ = false;
 }
@@ -114,6 +143,7 @@ void SyncedMemory::set_gpu_data(void* data) {
     cudaSetDevice(initial_device);
   }
   gpu_ptr_ = data;
+  ++version_;
   head_ = HEAD_AT_GPU;
   own_gpu_data_ = false;
 #else
@@ -123,6 +153,7 @@ void SyncedMemory::set_gpu_data(void* data) {
 
 void* SyncedMemory::mutable_cpu_data() {
   to_cpu();
+  ++version_;
   head_ = HEAD_AT_CPU;
   return cpu_ptr_;
 }
@@ -130,6 +161,7 @@ void* SyncedMemory::mutable_cpu_data() {
 void* SyncedMemory::mutable_gpu_data() {
 #ifndef CPU_ONLY
   to_gpu();
+  ++version_;
   head_ = HEAD_AT_GPU;
   return gpu_ptr_;
 #else
@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -5,6 +6,8 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/half.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -112,6 +115,71 @@ TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   EXPECT_FALSE(this->blob_->ShapeEquals(blob_proto));
 }
 
+TYPED_TEST(BlobSimpleTest, TestFromSparseProto) {
+  // The (3 x 4) matrix
+  //   [ 0 1 0 0 ]
+  //   [ 0 0 0 0 ]
+  //   [ 2 0 0 3 ]
+  // in compressed sparse row form.
+  BlobProto blob_proto;
+  blob_proto.mutable_shape()->add_dim(3);
+  blob_proto.mutable_shape()->add_dim(4);
+  blob_proto.add_data(1);
+  blob_proto.add_data(2);
+  blob_proto.add_data(3);
+  blob_proto.add_sparse_col_index(1);
+  blob_proto.add_sparse_col_index(0);
+  blob_proto.add_sparse_col_index(3);
+  blob_proto.add_sparse_row_ptr(0);
+  blob_proto.add_sparse_row_ptr(1);
+  blob_proto.add_sparse_row_ptr(1);
+  blob_proto.add_sparse_row_ptr(3);
+  this->blob_->FromProto(blob_proto);
+  ASSERT_EQ(12, this->blob_->count());
+  const TypeParam expected[] = {0, 1, 0, 0, 0, 0, 0, 0, 2, 0, 0, 3};
+  for (int i = 0; i < 12; ++i) {
+    EXPECT_EQ(expected[i], this->blob_->cpu_data()[i]);
+  }
+  // The same nonzero values in 16-bit precision.
+  blob_proto.clear_data();
+  blob_proto.set_precision(BlobProto::FLOAT16);
+  const char half_data[] = {0x00, 0x3c, 0x00, 0x40, 0x00, 0x42};
+  blob_proto.set_half_data(half_data, sizeof(half_data));
+  this->blob_->FromProto(blob_proto);
+  for (int i = 0; i < 12; ++i) {
+    EXPECT_EQ(expected[i], this->blob_->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(BlobSimpleTest, TestHalfProto) {
+  this->blob_->Reshape(2, 3, 4, 5);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_);
+  caffe_copy(this->blob_->count(), this->blob_->cpu_data(),
+      this->blob_->mutable_cpu_diff());
+  for (int p = BlobProto::FLOAT16; p <= BlobProto::BFLOAT16; ++p) {
+    BlobProto blob_proto;
+    this->blob_->ToProto(&blob_proto, true);
+    ConvertBlobPrecision(&blob_proto, static_cast<BlobProto::Precision>(p));
+    EXPECT_EQ(2 * this->blob_->count(), blob_proto.half_data().size());
+    Blob<TypeParam> blob;
+    blob.FromProto(blob_proto);
+    EXPECT_TRUE(blob.ShapeEquals(blob_proto));
+    // The relative rounding error of the 11 and 8 bit mantissas.
+    const TypeParam epsilon = p == BlobProto::FLOAT16 ? 1e-3 : 1e-2;
+    for (int i = 0; i < blob.count(); ++i) {
+      const TypeParam value = this->blob_->cpu_data()[i];
+      EXPECT_NEAR(value, blob.cpu_data()[i], epsilon * std::fabs(value));
+      EXPECT_NEAR(value, blob.cpu_diff()[i], epsilon * std::fabs(value));
+    }
+    // Writing the blob again replaces the 16-bit values.
+    blob.ToProto(&blob_proto);
+    EXPECT_FALSE(blob_proto.has_precision());
+    EXPECT_FALSE(blob_proto.has_half_data());
+  }
+}
+
 template <typename TypeParam>
 class BlobMathTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -0,0 +1,131 @@
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/dag_scheduler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Records when each node started and finished, on one shared clock.
+class OrderingTask : public ParallelTask {
+ public:
+  explicit OrderingTask(int count)
+      : clock_(0), starts_(count, -1), finishes_(count, -1), runs_(count, 0) {}
+
+  virtual void Run(int node, int thread) {
+    starts_[node] = clock_.fetch_add(1);
+    ++runs_[node];
+    boost::this_thread::yield();
+    finishes_[node] = clock_.fetch_add(1);
+  }
+
+  boost::atomic<int> clock_;
+  vector<int> starts_;
+  vector<int> finishes_;
+  vector<int> runs_;
+};
+
+class DagSchedulerTest : public ::testing::Test {
+ protected:
+  // Checks that the nodes in [begin, end] ran once, after their predecessors
+  // in the range, and that the others did not run.
+  void CheckOrder(const DagScheduler& scheduler, const OrderingTask& task,
+      int begin, int end) {
+    for (int node = 0; node < scheduler.num_nodes(); ++node) {
+      const bool in_range = node >= begin && node <= end;
+      EXPECT_EQ(in_range ? 1 : 0, task.runs_[node]);
+      if (!in_range) { continue; }
+      const vector<int>& predecessors = scheduler.predecessors(node);
+      for (int i = 0; i < predecessors.size(); ++i) {
+        const int predecessor = predecessors[i];
+        if (predecessor >= begin && predecessor <= end) {
+          EXPECT_GT(task.starts_[node], task.finishes_[predecessor]);
+        }
+      }
+    }
+  }
+};
+
+TEST_F(DagSchedulerTest, TestDependencies) {
+  // Five steps on resources a, b, c: 0 writes a; 1 reads a and writes b;
+  // 2 reads a and writes c; 3 updates b in place; 4 writes a again.
+  const int a = 0, b = 1, c = 2;
+  vector<vector<const void*> > reads(5);
+  vector<vector<const void*> > writes(5);
+  writes[0].push_back(&a);
+  reads[1].push_back(&a);
+  writes[1].push_back(&b);
+  reads[2].push_back(&a);
+  writes[2].push_back(&c);
+  reads[3].push_back(&b);
+  writes[3].push_back(&b);
+  writes[4].push_back(&a);
+  vector<int> order(5);
+  for (int i = 0; i < 5; ++i) {
+    order[i] = i;
+  }
+  vector<vector<int> > predecessors =
+      DagScheduler::Dependencies(order, reads, writes);
+  ASSERT_EQ(5, predecessors.size());
+  EXPECT_EQ(0, predecessors[0].size());
+  ASSERT_EQ(1, predecessors[1].size());
+  EXPECT_EQ(0, predecessors[1][0]);
+  ASSERT_EQ(1, predecessors[2].size());
+  EXPECT_EQ(0, predecessors[2][0]);
+  ASSERT_EQ(1, predecessors[3].size());
+  EXPECT_EQ(1, predecessors[3][0]);
+  // Overwriting a waits for its last writer and all of its readers.
+  ASSERT_EQ(3, predecessors[4].size());
+  EXPECT_EQ(0, predecessors[4][0]);
+  EXPECT_EQ(1, predecessors[4][1]);
+  EXPECT_EQ(2, predecessors[4][2]);
+  // In reverse order, as in a backward pass, the writers come last.
+  for (int i = 0; i < 5; ++i) {
+    order[i] = 4 - i;
+  }
+  predecessors = DagScheduler::Dependencies(order, reads, writes);
+  EXPECT_EQ(0, predecessors[4].size());
+  EXPECT_EQ(0, predecessors[3].size());
+  ASSERT_EQ(1, predecessors[2].size());
+  EXPECT_EQ(4, predecessors[2][0]);
+  ASSERT_EQ(2, predecessors[1].size());
+  EXPECT_EQ(3, predecessors[1][0]);
+  EXPECT_EQ(4, predecessors[1][1]);
+}
+
+TEST_F(DagSchedulerTest, TestRun) {
+  // Two diamonds in a row, with an extra edge skipping the first one.
+  const int num_nodes = 8;
+  vector<vector<int> > predecessors(num_nodes);
+  predecessors[1].push_back(0);
+  predecessors[2].push_back(0);
+  predecessors[3].push_back(1);
+  predecessors[3].push_back(2);
+  predecessors[4].push_back(3);
+  predecessors[5].push_back(3);
+  predecessors[6].push_back(4);
+  predecessors[6].push_back(5);
+  predecessors[7].push_back(6);
+  predecessors[7].push_back(0);
+  for (int threads = 0; threads <= 3; ++threads) {
+    shared_ptr<ThreadPool> pool(new ThreadPool(threads));
+    DagScheduler scheduler(predecessors, pool);
+    EXPECT_EQ(num_nodes, scheduler.num_nodes());
+    for (int pass = 0; pass < 3; ++pass) {
+      OrderingTask task(num_nodes);
+      scheduler.Run(0, num_nodes - 1, &task);
+      CheckOrder(scheduler, task, 0, num_nodes - 1);
+    }
+    // Dependencies on nodes outside of the range are ignored.
+    OrderingTask task(num_nodes);
+    scheduler.Run(2, 6, &task);
+    CheckOrder(scheduler, task, 2, 6);
+  }
+}
+
+}  // namespace caffe
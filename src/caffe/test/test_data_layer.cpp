@@ -1,4 +1,4 @@
-#ifdef USE_OPENCV
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -67,7 +67,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     db->Close();
   }
 
-  void TestRead() {
+  void TestRead(const int prefetch = 4, const int prefetch_max = 0) {
     const Dtype scale = 3;
     LayerParameter param;
     param.set_phase(TRAIN);
@@ -75,6 +75,8 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(5);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_prefetch(prefetch);
+    data_param->set_prefetch_max(prefetch_max);
 
     TransformationParameter* transform_param =
         param.mutable_transform_param();
@@ -103,6 +105,45 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
         }
       }
     }
+    EXPECT_GE(layer.prefetch_count(), prefetch);
+    EXPECT_LE(layer.prefetch_count(), std::max(prefetch, prefetch_max));
+  }
+
+  // Check that every batch (here one epoch) is a new permutation of the db.
+  void TestReadShuffle() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_shuffle(true);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    vector<vector<int> > epochs;
+    for (int iter = 0; iter < 10; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      vector<int> labels;
+      for (int i = 0; i < 5; ++i) {
+        const int label = blob_top_label_->cpu_data()[i];
+        // All pixels of an image equal its label.
+        for (int j = 0; j < 24; ++j) {
+          EXPECT_EQ(label, blob_top_data_->cpu_data()[i * 24 + j]);
+        }
+        labels.push_back(label);
+      }
+      epochs.push_back(labels);
+      std::sort(labels.begin(), labels.end());
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(i, labels[i]);
+      }
+    }
+    int num_orders = 0;
+    for (int iter = 1; iter < epochs.size(); ++iter) {
+      num_orders += (epochs[iter] != epochs[iter - 1]);
+    }
+    EXPECT_GT(num_orders, 0);
   }
 
   void TestReshape(DataParameter_DB backend) {
@@ -279,6 +320,58 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
+  // Check that parallel transformation yields the same (seeded) random crops
+  // for any number of transform threads, with items in their own slots.
+  void TestReadCropTrainParallel() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_transform_threads(1);
+
+    TransformationParameter* transform_param =
+        param.mutable_transform_param();
+    transform_param->set_crop_size(1);
+    transform_param->set_mirror(true);
+
+    Caffe::set_random_seed(seed_);
+    vector<vector<Dtype> > crop_sequence;
+    {
+      DataLayer<Dtype> layer1(param);
+      layer1.SetUp(blob_bottom_vec_, blob_top_vec_);
+      for (int iter = 0; iter < 2; ++iter) {
+        layer1.Forward(blob_bottom_vec_, blob_top_vec_);
+        for (int i = 0; i < 5; ++i) {
+          EXPECT_EQ(i, blob_top_label_->cpu_data()[i]);
+        }
+        vector<Dtype> iter_crop_sequence;
+        for (int i = 0; i < 10; ++i) {
+          iter_crop_sequence.push_back(blob_top_data_->cpu_data()[i]);
+        }
+        crop_sequence.push_back(iter_crop_sequence);
+      }
+      EXPECT_EQ(2, layer1.batches_consumed());
+    }  // destroy 1st data layer and unlock the db
+
+    data_param->set_transform_threads(3);
+    Caffe::set_random_seed(seed_);
+    DataLayer<Dtype> layer2(param);
+    layer2.SetUp(blob_bottom_vec_, blob_top_vec_);
+    for (int iter = 0; iter < 2; ++iter) {
+      layer2.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(i, blob_top_label_->cpu_data()[i]);
+      }
+      for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(crop_sequence[iter][i], blob_top_data_->cpu_data()[i])
+            << "debug: iter " << iter << " i " << i;
+      }
+    }
+    EXPECT_LE(layer2.prefetch_stalls(), layer2.batches_consumed());
+  }
+
   void TestReadCropTrainSequenceUnseeded() {
     LayerParameter param;
     param.set_phase(TRAIN);
@@ -356,6 +449,12 @@ TYPED_TEST(DataLayerTest, TestReadLevelDB) {
   this->TestRead();
 }
 
+TYPED_TEST(DataLayerTest, TestReadPrefetchDepthLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestRead(1, 3);
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLevelDB) {
   this->TestReshape(DataParameter_DB_LEVELDB);
 }
@@ -382,6 +481,14 @@ TYPED_TEST(DataLayerTest, TestReadCropTrainSequenceUnseededLevelDB) {
   this->TestReadCropTrainSequenceUnseeded();
 }
 
+// Test that parallel transformation is deterministic and independent of the
+// number of transform threads.
+TYPED_TEST(DataLayerTest, TestReadCropTrainParallelLevelDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestReadCropTrainParallel();
+}
+
 TYPED_TEST(DataLayerTest, TestReadCropTestLevelDB) {
   const bool unique_pixels = true;  // all images the same; pixels different
   this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
@@ -396,6 +503,12 @@ TYPED_TEST(DataLayerTest, TestReadLMDB) {
   this->TestRead();
 }
 
+TYPED_TEST(DataLayerTest, TestReadPrefetchDepthLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestRead(1, 3);
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLMDB) {
   this->TestReshape(DataParameter_DB_LMDB);
 }
@@ -422,6 +535,14 @@ TYPED_TEST(DataLayerTest, TestReadCropTrainSequenceUnseededLMDB) {
   this->TestReadCropTrainSequenceUnseeded();
 }
 
+// Test that parallel transformation is deterministic and independent of the
+// number of transform threads.
+TYPED_TEST(DataLayerTest, TestReadCropTrainParallelLMDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestReadCropTrainParallel();
+}
+
 TYPED_TEST(DataLayerTest, TestReadCropTestLMDB) {
   const bool unique_pixels = true;  // all images the same; pixels different
   this->Fill(unique_pixels, DataParameter_DB_LMDB);
@@ -429,5 +550,33 @@ TYPED_TEST(DataLayerTest, TestReadCropTestLMDB) {
 }
 
 #endif  // USE_LMDB
+
+TYPED_TEST(DataLayerTest, TestReadMmap) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_MMAP);
+  this->TestRead();
+}
+
+TYPED_TEST(DataLayerTest, TestReadPrefetchDepthMmap) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_MMAP);
+  this->TestRead(1, 3);
+}
+
+TYPED_TEST(DataLayerTest, TestReadShuffleMmap) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_MMAP);
+  this->TestReadShuffle();
+}
+
+TYPED_TEST(DataLayerTest, TestReshapeMmap) {
+  this->TestReshape(DataParameter_DB_MMAP);
+}
+
+TYPED_TEST(DataLayerTest, TestReadCropTrainParallelMmap) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_MMAP);
+  this->TestReadCropTrainParallel();
+}
+
 }  // namespace caffe
-#endif  // USE_OPENCV
@@ -303,6 +303,41 @@ TYPED_TEST(DataTransformTest, TestMeanValues) {
   }
 }
 
+TYPED_TEST(DataTransformTest, TestMeanValuesFloatData) {
+  TransformationParameter transform_param;
+  const int channels = 3;
+  const int height = 4;
+  const int width = 5;
+  const int crop_size = 2;
+  const float scale = 0.5;
+
+  transform_param.add_mean_value(0);
+  transform_param.add_mean_value(1);
+  transform_param.add_mean_value(2);
+  transform_param.set_scale(scale);
+  transform_param.set_crop_size(crop_size);
+  Datum datum;
+  datum.set_channels(channels);
+  datum.set_height(height);
+  datum.set_width(width);
+  for (int j = 0; j < channels * height * width; ++j) {
+    datum.add_float_data(j);
+  }
+  Blob<TypeParam> blob(1, channels, crop_size, crop_size);
+  DataTransformer<TypeParam> transformer(transform_param, TEST);
+  transformer.InitRand();
+  transformer.Transform(datum, &blob);
+  // The center crop starts at (1, 1).
+  for (int c = 0; c < channels; ++c) {
+    for (int h = 0; h < crop_size; ++h) {
+      for (int w = 0; w < crop_size; ++w) {
+        const int index = (c * height + 1 + h) * width + 1 + w;
+        EXPECT_EQ(blob.data_at(0, c, h, w), (index - c) * scale);
+      }
+    }
+  }
+}
+
 TYPED_TEST(DataTransformTest, TestMeanFile) {
   TransformationParameter transform_param;
   const bool unique_pixels = true;  // pixels are consecutive ints [0,size]
@@ -0,0 +1,103 @@
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/data_transformer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/datum_view.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class DatumViewTest : public ::testing::Test {
+ protected:
+  DatumViewTest() {
+    datum_.set_channels(2);
+    datum_.set_height(3);
+    datum_.set_width(4);
+    datum_.set_label(-7);
+    for (int i = 0; i < 24; ++i) {
+      datum_.mutable_data()->push_back(static_cast<char>(i * 10));
+    }
+  }
+
+  Datum datum_;
+};
+
+TEST_F(DatumViewTest, TestViewUint8) {
+  string bytes;
+  datum_.SerializeToString(&bytes);
+  DatumView view;
+  view.Parse(bytes.data(), bytes.size());
+  ASSERT_TRUE(view.is_view());
+  EXPECT_EQ(2, view.channels());
+  EXPECT_EQ(3, view.height());
+  EXPECT_EQ(4, view.width());
+  EXPECT_EQ(-7, view.label());
+  // The pixels are read in place.
+  EXPECT_GE(reinterpret_cast<const char*>(view.data()), bytes.data());
+  EXPECT_LT(reinterpret_cast<const char*>(view.data()),
+            bytes.data() + bytes.size());
+  EXPECT_EQ(datum_.data(), string(reinterpret_cast<const char*>(view.data()),
+                                  view.data_size()));
+}
+
+TEST_F(DatumViewTest, TestFallback) {
+  // Float and encoded Datums are parsed in full.
+  Datum float_datum;
+  float_datum.set_channels(1);
+  float_datum.set_height(1);
+  float_datum.set_width(2);
+  float_datum.set_label(3);
+  float_datum.add_float_data(0.5);
+  float_datum.add_float_data(1.5);
+  string bytes;
+  float_datum.SerializeToString(&bytes);
+  DatumView view;
+  view.Parse(bytes.data(), bytes.size());
+  EXPECT_FALSE(view.is_view());
+  EXPECT_EQ(3, view.label());
+  ASSERT_EQ(2, view.datum().float_data_size());
+  EXPECT_EQ(1.5, view.datum().float_data(1));
+
+  datum_.set_encoded(true);
+  datum_.SerializeToString(&bytes);
+  view.Parse(bytes.data(), bytes.size());
+  EXPECT_FALSE(view.is_view());
+  EXPECT_TRUE(view.datum().encoded());
+  EXPECT_EQ(-7, view.label());
+}
+
+TEST_F(DatumViewTest, TestTransform) {
+  TransformationParameter param;
+  param.set_crop_size(2);
+  param.set_mirror(true);
+  param.set_scale(0.5);
+  param.add_mean_value(3);
+  string bytes;
+  datum_.SerializeToString(&bytes);
+  DatumView view;
+  view.Parse(bytes.data(), bytes.size());
+  ASSERT_TRUE(view.is_view());
+
+  DataTransformer<float> transformer(param, TRAIN);
+  vector<int> shape = transformer.InferBlobShape(view);
+  EXPECT_EQ(transformer.InferBlobShape(datum_), shape);
+  Blob<float> expected(shape);
+  Blob<float> transformed(shape);
+  for (int i = 0; i < 10; ++i) {
+    transformer.SeedRand(i);
+    transformer.Transform(datum_, &expected);
+    transformer.SeedRand(i);
+    transformer.Transform(view, &transformed);
+    for (int j = 0; j < expected.count(); ++j) {
+      EXPECT_EQ(expected.cpu_data()[j], transformed.cpu_data()[j]);
+    }
+  }
+}
+
+}  // namespace caffe
@@ -57,8 +57,13 @@ struct TypeLMDB {
 };
 DataParameter_DB TypeLMDB::backend = DataParameter_DB_LMDB;
 
+struct TypeMmap {
+  static DataParameter_DB backend;
+};
+DataParameter_DB TypeMmap::backend = DataParameter_DB_MMAP;
+
 // typedef ::testing::Types<TypeLmdb> TestTypes;
-typedef ::testing::Types<TypeLevelDB, TypeLMDB> TestTypes;
+typedef ::testing::Types<TypeLevelDB, TypeLMDB, TypeMmap> TestTypes;
 
 TYPED_TEST_CASE(DBTest, TestTypes);
 
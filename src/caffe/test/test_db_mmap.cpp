@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "boost/scoped_ptr.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/db_mmap.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+using boost::scoped_ptr;
+
+class MmapDBTest : public ::testing::Test {
+ protected:
+  MmapDBTest() : num_records_(10) {}
+
+  virtual void SetUp() {
+    MakeTempDir(&source_);
+    source_ += "/db";
+    // Small shards, so that the records span several of them.
+    db::MmapDB db(64);
+    db.Open(source_, db::NEW);
+    scoped_ptr<db::Transaction> txn(db.NewTransaction());
+    for (int i = 0; i < num_records_; ++i) {
+      txn->Put(key(i), value(i));
+    }
+    txn->Commit();
+  }
+
+  string key(int i) { return format_int(i, 3); }
+  string value(int i) { return string(5 + i, 'a' + i); }
+
+  // Reads a pass over the db, returning the records in the order visited.
+  vector<int> ReadPass(db::Cursor* cursor) {
+    vector<int> records;
+    for (cursor->SeekToFirst(); cursor->valid(); cursor->Next()) {
+      const int i = atoi(cursor->key().c_str());
+      EXPECT_EQ(value(i), cursor->value());
+      records.push_back(i);
+    }
+    return records;
+  }
+
+  string source_;
+  const int num_records_;
+};
+
+TEST_F(MmapDBTest, TestRead) {
+  db::MmapDB db;
+  db.Open(source_, db::READ);
+  EXPECT_EQ(num_records_, db.num_records());
+  EXPECT_GT(db.num_shards(), 1);
+  scoped_ptr<db::Cursor> cursor(db.NewCursor());
+  vector<int> records = ReadPass(cursor.get());
+  ASSERT_EQ(num_records_, records.size());
+  for (int i = 0; i < num_records_; ++i) {
+    EXPECT_EQ(i, records[i]);
+  }
+}
+
+TEST_F(MmapDBTest, TestValueView) {
+  db::MmapDB db;
+  db.Open(source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db.NewCursor());
+  cursor->Next();
+  const char* data;
+  size_t size;
+  ASSERT_TRUE(cursor->value_view(&data, &size));
+  EXPECT_EQ(value(1), string(data, size));
+}
+
+TEST_F(MmapDBTest, TestAppend) {
+  {
+    db::MmapDB db;
+    db.Open(source_, db::WRITE);
+    scoped_ptr<db::Transaction> txn(db.NewTransaction());
+    txn->Put(key(num_records_), value(num_records_));
+    txn->Commit();
+  }
+  db::MmapDB db;
+  db.Open(source_, db::READ);
+  EXPECT_EQ(num_records_ + 1, db.num_records());
+  scoped_ptr<db::Cursor> cursor(db.NewCursor());
+  EXPECT_EQ(num_records_, ReadPass(cursor.get()).back());
+}
+
+TEST_F(MmapDBTest, TestShuffle) {
+  db::MmapDB db;
+  db.Open(source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db.NewCursor());
+  ASSERT_TRUE(cursor->Shuffle(1701));
+  vector<int> first = ReadPass(cursor.get());
+  vector<int> second = ReadPass(cursor.get());
+  // Every pass is a permutation of the records, and a different one.
+  EXPECT_NE(first, second);
+  std::sort(second.begin(), second.end());
+  for (int i = 0; i < num_records_; ++i) {
+    EXPECT_EQ(i, second[i]);
+  }
+  // The same seed gives the same order.
+  scoped_ptr<db::Cursor> other(db.NewCursor());
+  ASSERT_TRUE(other->Shuffle(1701));
+  EXPECT_EQ(first, ReadPass(other.get()));
+}
+
+}  // namespace caffe
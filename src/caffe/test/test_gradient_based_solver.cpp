@@ -1,3 +1,5 @@
+#include <boost/filesystem.hpp>
+
 #include <algorithm>
 #include <string>
 #include <utility>
@@ -12,6 +14,7 @@
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/sgd_solvers.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -26,7 +29,9 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
  protected:
   GradientBasedSolverTest() :
       seed_(1701), num_(4), channels_(3), height_(10), width_(10),
-      share_(false) {
+      share_(false), wide_(false), unfused_(false), unfused_updates_(0),
+      update_threads_(0), snapshot_async_(false),
+      snapshot_delta_threshold_(-1) {
         input_file_ = new string(
         CMAKE_SOURCE_DIR "caffe/test/test_data/solver_data_list.txt" CMAKE_EXT);
       }
@@ -42,6 +47,15 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
   // TODO this is brittle and the hdf5 file should be checked instead.
   int num_, channels_, height_, width_;
   bool share_;
+  // Adds a param spanning several update chunks, outside of the loss.
+  bool wide_;
+  // Makes the solver take the per-param update instead of the fused one,
+  // counting its calls of ComputeUpdateValue.
+  bool unfused_;
+  int unfused_updates_;
+  int update_threads_;
+  bool snapshot_async_;
+  float snapshot_delta_threshold_;
   Dtype delta_;  // Stability constant for RMSProp, AdaGrad, AdaDelta and Adam
 
   // Test data: check out generate_sample_data.py in the same directory.
@@ -162,6 +176,28 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
          "    } "
          "  } ";
     }
+    if (wide_) {
+      // 300 x 30 weights, updated by weight decay and momentum only.
+      proto <<
+         "  layer { "
+         "    name: 'wide' "
+         "    type: 'InnerProduct' "
+         "    inner_product_param { "
+         "      num_output: 30 "
+         "      weight_filler { "
+         "        type: 'gaussian' "
+         "        std: 1.0 "
+         "      } "
+         "    } "
+         "    bottom: 'data' "
+         "    top: 'wide' "
+         "  } "
+         "  layer { "
+         "    name: 'silence' "
+         "    type: 'Silence' "
+         "    bottom: 'wide' "
+         "  } ";
+    }
     proto <<
        "  layer { "
        "    name: 'loss' "
@@ -176,10 +212,22 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     if (momentum != 0) {
       proto << "momentum: " << momentum << " ";
     }
+    if (update_threads_ != 0) {
+      proto << "update_threads: " << update_threads_ << " ";
+    }
     MakeTempDir(&snapshot_prefix_);
     proto << "snapshot_prefix: '" << snapshot_prefix_ << "/' ";
     if (snapshot) {
-      proto << "snapshot: " << num_iters << " ";
+      // Incremental snapshots refer to the full one taken first.
+      proto << "snapshot: "
+            << (snapshot_delta_threshold_ < 0 ? num_iters : 1) << " ";
+    }
+    if (snapshot_async_) {
+      proto << "snapshot_async: true ";
+    }
+    if (snapshot_delta_threshold_ >= 0) {
+      proto << "snapshot_delta_threshold: " << snapshot_delta_threshold_
+            << " ";
     }
     Caffe::set_random_seed(this->seed_);
     this->InitSolverFromProtoString(proto.str());
@@ -556,6 +604,53 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
       }
     }
   }
+
+  // Checks that the fused CPU update on several threads matches the
+  // per-param update, for a param spanning several update chunks.
+  void TestWideUpdateThreads(const Dtype learning_rate,
+      const Dtype weight_decay, const Dtype momentum, const int num_iters) {
+    wide_ = true;
+    update_threads_ = 2;
+    RunLeastSquaresSolver(learning_rate, weight_decay, momentum, num_iters);
+    const vector<Blob<Dtype>*>& fused_params =
+        solver_->net()->learnable_params();
+    vector<shared_ptr<Blob<Dtype> > > param_copies(fused_params.size());
+    for (int i = 0; i < fused_params.size(); ++i) {
+      param_copies[i].reset(new Blob<Dtype>());
+      param_copies[i]->CopyFrom(*fused_params[i], false, true);
+    }
+    ASSERT_GT(param_copies[2]->count(), 8192);
+    unfused_ = true;
+    update_threads_ = 0;
+    RunLeastSquaresSolver(learning_rate, weight_decay, momentum, num_iters);
+    EXPECT_GT(unfused_updates_, 0);
+    const vector<Blob<Dtype>*>& params = solver_->net()->learnable_params();
+    ASSERT_EQ(param_copies.size(), params.size());
+    for (int i = 0; i < params.size(); ++i) {
+      for (int j = 0; j < params[i]->count(); ++j) {
+        EXPECT_NEAR(param_copies[i]->cpu_data()[j], params[i]->cpu_data()[j],
+            1e-5 * std::max(Dtype(1), fabs(params[i]->cpu_data()[j])))
+            << "param " << i << " differed at dim " << j;
+      }
+    }
+  }
+};
+
+// Counts the calls of ComputeUpdateValue, whose override makes ApplyUpdate
+// take the per-param update instead of the fused one.
+template <template <typename> class SolverType, typename Dtype>
+class UnfusedSolver : public SolverType<Dtype> {
+ public:
+  UnfusedSolver(const SolverParameter& param, int* updates)
+      : SolverType<Dtype>(param), updates_(updates) {}
+
+ protected:
+  virtual void ComputeUpdateValue(int param_id, Dtype rate) {
+    ++*updates_;
+    SolverType<Dtype>::ComputeUpdateValue(param_id, rate);
+  }
+
+  int* updates_;
 };
 
 
@@ -565,7 +660,12 @@ class SGDSolverTest : public GradientBasedSolverTest<TypeParam> {
 
  protected:
   virtual void InitSolver(const SolverParameter& param) {
-    this->solver_.reset(new SGDSolver<Dtype>(param));
+    if (this->unfused_) {
+      this->solver_.reset(new UnfusedSolver<SGDSolver, Dtype>(param,
+          &this->unfused_updates_));
+    } else {
+      this->solver_.reset(new SGDSolver<Dtype>(param));
+    }
   }
 };
 
@@ -648,6 +748,28 @@ TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingShare) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.5;
+  const int kNumIters = 4;
+  this->update_threads_ = 2;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestWideUpdateThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.5;
+  const int kNumIters = 4;
+  this->TestWideUpdateThreads(kLearningRate, kWeightDecay, kMomentum,
+                              kNumIters);
+}
+
 TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -694,6 +816,73 @@ TYPED_TEST(SGDSolverTest, TestSnapshotShare) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestSnapshotAsync) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->snapshot_async_ = true;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestSnapshotIncremental) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->share_ = true;
+  this->snapshot_async_ = true;
+  this->snapshot_delta_threshold_ = 0;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+  // Above any change, the later snapshots hold no layers.
+  this->snapshot_delta_threshold_ = 1e9;
+  const int kIterSize = 1;
+  const int kDevices = 1;
+  const bool kSnapshot = true;
+  this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum,
+      kNumIters, kIterSize, kDevices, kSnapshot);
+  NetParameter param;
+  ReadProtoFromBinaryFileOrDie(
+      this->snapshot_prefix_ + "/_iter_4.caffemodel", &param);
+  EXPECT_EQ("_iter_1.caffemodel", param.base_net());
+  EXPECT_EQ(0, param.layer_size());
+  // The base is found next to the delta, wherever the snapshots are moved
+  // and whichever directory they are loaded from.
+  string moved;
+  MakeTempDir(&moved);
+  boost::filesystem::rename(this->snapshot_prefix_, moved);
+  NetParameter base;
+  ReadProtoFromBinaryFileOrDie(moved + "/_iter_1.caffemodel", &base);
+  int base_id = 0;
+  while (base.layer(base_id).blobs_size() == 0) { ++base_id; }
+  Blob<Dtype> expected;
+  expected.FromProto(base.layer(base_id).blobs(0));
+  Blob<Dtype>* weights = this->solver_->net()->params()[0].get();
+  const boost::filesystem::path working_directory =
+      boost::filesystem::current_path();
+  for (int relative = 0; relative <= 1; ++relative) {
+    caffe_set(weights->count(), Dtype(0), weights->mutable_cpu_data());
+    if (relative) {
+      boost::filesystem::current_path(moved);
+      this->solver_->net()->CopyTrainedLayersFrom("_iter_4.caffemodel");
+      boost::filesystem::current_path(working_directory);
+    } else {
+      this->solver_->net()->CopyTrainedLayersFrom(
+          moved + "/_iter_4.caffemodel");
+    }
+    ASSERT_EQ(expected.count(), weights->count());
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_EQ(expected.cpu_data()[i], weights->cpu_data()[i]);
+    }
+  }
+}
+
 
 template <typename TypeParam>
 class AdaGradSolverTest : public GradientBasedSolverTest<TypeParam> {
@@ -1068,7 +1257,12 @@ class AdamSolverTest : public GradientBasedSolverTest<TypeParam> {
     new_param.set_momentum(momentum);
     const Dtype momentum2 = 0.999;
     new_param.set_momentum2(momentum2);
-    this->solver_.reset(new AdamSolver<Dtype>(new_param));
+    if (this->unfused_) {
+      this->solver_.reset(new UnfusedSolver<AdamSolver, Dtype>(new_param,
+          &this->unfused_updates_));
+    } else {
+      this->solver_.reset(new AdamSolver<Dtype>(new_param));
+    }
   }
 };
 
@@ -1113,6 +1307,28 @@ TYPED_TEST(AdamSolverTest, TestAdamLeastSquaresUpdateWithEverythingShare) {
   }
 }
 
+TYPED_TEST(AdamSolverTest, TestAdamLeastSquaresUpdateWithEverythingThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->update_threads_ = 2;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(AdamSolverTest, TestWideUpdateThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->TestWideUpdateThreads(kLearningRate, kWeightDecay, kMomentum,
+                              kNumIters);
+}
+
 TYPED_TEST(AdamSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
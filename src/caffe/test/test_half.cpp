@@ -0,0 +1,193 @@
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/half.hpp"
+#include "caffe/util/half_matrix.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class HalfTest : public ::testing::Test {};
+
+TEST_F(HalfTest, TestFP16) {
+  EXPECT_EQ(0x0000, float_to_fp16(0.f));
+  EXPECT_EQ(0x8000, float_to_fp16(-0.f));
+  EXPECT_EQ(0x3c00, float_to_fp16(1.f));
+  EXPECT_EQ(0xc000, float_to_fp16(-2.f));
+  EXPECT_EQ(0x7bff, float_to_fp16(65504.f));
+  EXPECT_EQ(0x7c00, float_to_fp16(65520.f));
+  EXPECT_EQ(0x7c00, float_to_fp16(std::numeric_limits<float>::infinity()));
+  EXPECT_EQ(0x7e00, float_to_fp16(std::numeric_limits<float>::quiet_NaN()));
+  // The smallest subnormal, and values that round to zero or to it.
+  EXPECT_EQ(0x0001, float_to_fp16(5.9604645e-8f));
+  EXPECT_EQ(0x0000, float_to_fp16(2.9802322e-8f));
+  EXPECT_EQ(0x0001, float_to_fp16(4e-8f));
+  // Ties round to even: 1 + 2^-11 lies halfway between 1 and 1 + 2^-10.
+  EXPECT_EQ(0x3c00, float_to_fp16(1.f + 1.f / 2048));
+  EXPECT_EQ(0x3c02, float_to_fp16(1.f + 3.f / 2048));
+  // Every half but the NaNs survives a round trip through float.
+  for (int h = 0; h < 0x10000; ++h) {
+    if ((h & 0x7c00) == 0x7c00 && (h & 0x3ff)) { continue; }
+    EXPECT_EQ(h, float_to_fp16(fp16_to_float(h)));
+  }
+  EXPECT_EQ(5.9604645e-8f, fp16_to_float(0x0001));
+  EXPECT_EQ(65504.f, fp16_to_float(0x7bff));
+  EXPECT_NE(fp16_to_float(0x7e00), fp16_to_float(0x7e00));
+}
+
+TEST_F(HalfTest, TestBF16) {
+  EXPECT_EQ(0x3f80, float_to_bf16(1.f));
+  EXPECT_EQ(0xc000, float_to_bf16(-2.f));
+  EXPECT_EQ(0x7f80, float_to_bf16(std::numeric_limits<float>::infinity()));
+  EXPECT_NEAR(1e30f, bf16_to_float(float_to_bf16(1e30f)), 1e28f);
+  // Ties round to even.
+  EXPECT_EQ(0x3f80, float_to_bf16(bits_float(0x3f808000u)));
+  EXPECT_EQ(0x3f82, float_to_bf16(bits_float(0x3f818000u)));
+  EXPECT_EQ(0x3f81, float_to_bf16(bits_float(0x3f808001u)));
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  EXPECT_NE(bf16_to_float(float_to_bf16(nan)),
+            bf16_to_float(float_to_bf16(nan)));
+  EXPECT_NEAR(3.14159f, bf16_to_float(float_to_bf16(3.14159f)), 1e-2);
+}
+
+TEST_F(HalfTest, TestConvertBlobPrecision) {
+  BlobProto blob;
+  blob.mutable_shape()->add_dim(2);
+  blob.mutable_shape()->add_dim(3);
+  const float data[] = {0, 1, -2.5, 3e-3, 1000, -65504};
+  for (int i = 0; i < 6; ++i) {
+    blob.add_data(data[i]);
+    blob.add_diff(-data[i]);
+  }
+  ConvertBlobPrecision(&blob, BlobProto::FLOAT16);
+  EXPECT_EQ(BlobProto::FLOAT16, blob.precision());
+  EXPECT_EQ(0, blob.data_size());
+  EXPECT_EQ(0, blob.diff_size());
+  EXPECT_EQ(12, blob.half_data().size());
+  EXPECT_EQ(12, blob.half_diff().size());
+  Blob<float> expanded;
+  expanded.FromProto(blob);
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_NEAR(data[i], expanded.cpu_data()[i], 1e-3 * std::fabs(data[i]));
+    EXPECT_NEAR(-data[i], expanded.cpu_diff()[i], 1e-3 * std::fabs(data[i]));
+  }
+  // Converting between 16-bit precisions, and back to float.
+  ConvertBlobPrecision(&blob, BlobProto::BFLOAT16);
+  EXPECT_EQ(BlobProto::BFLOAT16, blob.precision());
+  ConvertBlobPrecision(&blob, BlobProto::FLOAT);
+  EXPECT_FALSE(blob.has_precision());
+  EXPECT_EQ(0, blob.half_data().size());
+  ASSERT_EQ(6, blob.data_size());
+  ASSERT_EQ(6, blob.diff_size());
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_NEAR(data[i], blob.data(i), 1e-2 * std::fabs(data[i]));
+  }
+}
+
+template <typename Dtype>
+class HalfMatrixTest : public ::testing::Test {
+ protected:
+  HalfMatrixTest()
+      : rows_(37), cols_(2500), N_(5), weights_(rows_, cols_, 1, 1),
+        abs_weights_(rows_, cols_, 1, 1) {}
+
+  virtual void SetUp() {
+    FillerParameter filler_param;
+    filler_param.set_min(-1);
+    filler_param.set_max(1);
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(&weights_);
+    caffe_abs(weights_.count(), weights_.cpu_data(),
+        abs_weights_.mutable_cpu_data());
+  }
+
+  // Checks C = op(X) * op(Y) as computed by the full precision gemm, up to
+  // the rounding of the weights: entry i may be off by unit times the
+  // same product of the absolute values, plus the rounding of the sums.
+  void Check(const Blob<Dtype>& C, const CBLAS_TRANSPOSE trans_x,
+      const CBLAS_TRANSPOSE trans_y, const int M, const int N, const int K,
+      const Blob<Dtype>& X, const Blob<Dtype>& abs_X, const Blob<Dtype>& Y,
+      const Blob<Dtype>& abs_Y, BlobProto::Precision precision) {
+    Blob<Dtype> expected(M, N, 1, 1);
+    Blob<Dtype> bound(M, N, 1, 1);
+    caffe_cpu_gemm<Dtype>(trans_x, trans_y, M, N, K, 1., X.cpu_data(),
+        Y.cpu_data(), 0., expected.mutable_cpu_data());
+    caffe_cpu_gemm<Dtype>(trans_x, trans_y, M, N, K, 1., abs_X.cpu_data(),
+        abs_Y.cpu_data(), 0., bound.mutable_cpu_data());
+    const Dtype unit = (precision == BlobProto::BFLOAT16 ? 1. / 256 :
+        1. / 2048) + K * 2 * std::numeric_limits<float>::epsilon();
+    ASSERT_EQ(expected.count(), C.count());
+    for (int i = 0; i < C.count(); ++i) {
+      EXPECT_NEAR(expected.cpu_data()[i], C.cpu_data()[i],
+                  unit * bound.cpu_data()[i]);
+    }
+  }
+
+  // Fills a (rows x cols) blob and its absolute values.
+  void Fill(int rows, int cols, Blob<Dtype>* blob, Blob<Dtype>* abs_blob) {
+    blob->Reshape(rows, cols, 1, 1);
+    abs_blob->Reshape(rows, cols, 1, 1);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob);
+    caffe_abs(blob->count(), blob->cpu_data(), abs_blob->mutable_cpu_data());
+  }
+
+  const int rows_;
+  const int cols_;
+  const int N_;
+  Blob<Dtype> weights_;
+  Blob<Dtype> abs_weights_;
+};
+
+TYPED_TEST_CASE(HalfMatrixTest, TestDtypes);
+
+TYPED_TEST(HalfMatrixTest, TestProducts) {
+  typedef TypeParam Dtype;
+  const int rows = this->rows_;
+  const int cols = this->cols_;
+  const int N = this->N_;
+  for (int p = BlobProto::FLOAT16; p <= BlobProto::BFLOAT16; ++p) {
+    const BlobProto::Precision precision =
+        static_cast<BlobProto::Precision>(p);
+    HalfMatrix<Dtype> half;
+    ASSERT_TRUE(half.Update(this->weights_, rows, precision));
+    // Rows 3 to 30 of A times B, spanning several panels.
+    Blob<Dtype> B, abs_B;
+    this->Fill(cols, N, &B, &abs_B);
+    Blob<Dtype> C(27, N, 1, 1);
+    half.Multiply(3, 30, N, B.cpu_data(), C.mutable_cpu_data());
+    Blob<Dtype> A_rows(27, cols, 1, 1);
+    Blob<Dtype> abs_A_rows(27, cols, 1, 1);
+    caffe_copy(A_rows.count(), this->weights_.cpu_data() + 3 * cols,
+        A_rows.mutable_cpu_data());
+    caffe_copy(A_rows.count(), this->abs_weights_.cpu_data() + 3 * cols,
+        abs_A_rows.mutable_cpu_data());
+    this->Check(C, CblasNoTrans, CblasNoTrans, 27, N, cols, A_rows,
+        abs_A_rows, B, abs_B, precision);
+    // B * A^T, with B (N x cols).
+    this->Fill(N, cols, &B, &abs_B);
+    C.Reshape(N, rows, 1, 1);
+    half.MultiplyTransposedLeft(N, B.cpu_data(), C.mutable_cpu_data());
+    this->Check(C, CblasNoTrans, CblasTrans, N, rows, cols, B, abs_B,
+        this->weights_, this->abs_weights_, precision);
+    // B * A, with B (N x rows).
+    this->Fill(N, rows, &B, &abs_B);
+    C.Reshape(N, cols, 1, 1);
+    half.MultiplyLeft(N, B.cpu_data(), C.mutable_cpu_data());
+    this->Check(C, CblasNoTrans, CblasNoTrans, N, cols, rows, B, abs_B,
+        this->weights_, this->abs_weights_, precision);
+  }
+  HalfMatrix<Dtype> half;
+  EXPECT_FALSE(half.Update(this->weights_, rows, BlobProto::FLOAT));
+}
+
+}  // namespace caffe
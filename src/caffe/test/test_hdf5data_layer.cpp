@@ -1,8 +1,10 @@
 #ifdef USE_HDF5
+#include <algorithm>
 #include <string>
 #include <vector>
 
 #include "hdf5.h"
+#include "hdf5_hl.h"
 
 #include "gtest/gtest.h"
 
@@ -10,6 +12,7 @@
 #include "caffe/common.hpp"
 #include "caffe/layers/hdf5_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/hdf5.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -43,6 +46,87 @@ class HDF5DataLayerTest : public MultiDeviceTest<TypeParam> {
     delete filename;
   }
 
+  void TestRead(int chunk_size) {
+    // Create LayerParameter with the known parameters.
+    // The data file we are reading has 10 rows and 8 columns,
+    // with values from 0 to 10*8 reshaped in row-major order.
+    LayerParameter param;
+    param.add_top("data");
+    param.add_top("label");
+    param.add_top("label2");
+
+    HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+    int batch_size = 5;
+    hdf5_data_param->set_batch_size(batch_size);
+    hdf5_data_param->set_source(*filename);
+    hdf5_data_param->set_chunk_size(chunk_size);
+    int num_cols = 8;
+    int height = 6;
+    int width = 5;
+
+    // Test that the layer setup got the correct parameters.
+    HDF5DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    EXPECT_EQ(blob_top_data_->num(), batch_size);
+    EXPECT_EQ(blob_top_data_->channels(), num_cols);
+    EXPECT_EQ(blob_top_data_->height(), height);
+    EXPECT_EQ(blob_top_data_->width(), width);
+
+    EXPECT_EQ(blob_top_label_->num_axes(), 2);
+    EXPECT_EQ(blob_top_label_->shape(0), batch_size);
+    EXPECT_EQ(blob_top_label_->shape(1), 1);
+
+    EXPECT_EQ(blob_top_label2_->num_axes(), 2);
+    EXPECT_EQ(blob_top_label2_->shape(0), batch_size);
+    EXPECT_EQ(blob_top_label2_->shape(1), 1);
+
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+
+    // Go through the data 10 times (5 batches).
+    const int data_size = num_cols * height * width;
+    for (int iter = 0; iter < 10; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+
+      // On even iterations, we're reading the first half of the data.
+      // On odd iterations, we're reading the second half of the data.
+      // NB: label is 1-indexed
+      int label_offset = 1 + ((iter % 2 == 0) ? 0 : batch_size);
+      int label2_offset = 1 + label_offset;
+      int data_offset = (iter % 2 == 0) ? 0 : batch_size * data_size;
+
+      // Every two iterations we are reading the second file,
+      // which has the same labels, but data is offset by total data size,
+      // which is 2400 (see generate_sample_data).
+      int file_offset = (iter % 4 < 2) ? 0 : 2400;
+
+      for (int i = 0; i < batch_size; ++i) {
+        EXPECT_EQ(
+          label_offset + i,
+          blob_top_label_->cpu_data()[i]);
+        EXPECT_EQ(
+          label2_offset + i,
+          blob_top_label2_->cpu_data()[i]);
+      }
+      for (int i = 0; i < batch_size; ++i) {
+        for (int j = 0; j < num_cols; ++j) {
+          for (int h = 0; h < height; ++h) {
+            for (int w = 0; w < width; ++w) {
+              int idx = (
+                i * num_cols * height * width +
+                j * height * width +
+                h * width + w);
+              EXPECT_EQ(
+                file_offset + data_offset + idx,
+                blob_top_data_->cpu_data()[idx])
+                << "debug: i " << i << " j " << j
+                << " iter " << iter;
+            }
+          }
+        }
+      }
+    }
+  }
+
   string* filename;
   Blob<Dtype>* const blob_top_data_;
   Blob<Dtype>* const blob_top_label_;
@@ -54,83 +138,75 @@ class HDF5DataLayerTest : public MultiDeviceTest<TypeParam> {
 TYPED_TEST_CASE(HDF5DataLayerTest, TestDtypesAndDevices);
 
 TYPED_TEST(HDF5DataLayerTest, TestRead) {
+  this->TestRead(0);
+}
+
+TYPED_TEST(HDF5DataLayerTest, TestReadChunked) {
+  // Chunks of 3 of the 10 rows, so that batches span chunks.
+  this->TestRead(3);
+}
+
+TYPED_TEST(HDF5DataLayerTest, TestLoadRows) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string filename(
+      CMAKE_SOURCE_DIR "caffe/test/test_data/sample_data.h5");
+  hid_t file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  ASSERT_GE(file_id, 0) << "Failed to open HDF5 file " << filename;
+  // Rows 3 to 6 of the 10 rows of 8 x 6 x 5 values 0, 1, ...
+  const int row_size = 8 * 6 * 5;
+  Blob<Dtype> blob;
+  hdf5_load_nd_dataset_rows(file_id, "data", 4, 4, 3, 4, &blob);
+  EXPECT_EQ(4, blob.shape(0));
+  EXPECT_EQ(row_size, blob.count(1));
+  for (int i = 0; i < blob.count(); ++i) {
+    EXPECT_EQ(3 * row_size + i, blob.cpu_data()[i]);
+  }
+  // Only the rows are allocated, not the whole dataset.
+  EXPECT_EQ(4 * row_size * sizeof(Dtype), blob.data()->size());
+  EXPECT_EQ(10, hdf5_get_nd_dataset_dims(file_id, "data", 4, 4)[0]);
+  EXPECT_GE(H5Fclose(file_id), 0);
+}
+
+TYPED_TEST(HDF5DataLayerTest, TestShuffleChunked) {
   typedef typename TypeParam::Dtype Dtype;
-  // Create LayerParameter with the known parameters.
-  // The data file we are reading has 10 rows and 8 columns,
-  // with values from 0 to 10*8 reshaped in row-major order.
   LayerParameter param;
   param.add_top("data");
   param.add_top("label");
   param.add_top("label2");
-
   HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
-  int batch_size = 5;
+  const int batch_size = 5;
   hdf5_data_param->set_batch_size(batch_size);
   hdf5_data_param->set_source(*(this->filename));
-  int num_cols = 8;
-  int height = 6;
-  int width = 5;
-
-  // Test that the layer setup got the correct parameters.
+  hdf5_data_param->set_chunk_size(3);
+  hdf5_data_param->set_shuffle(true);
   HDF5DataLayer<Dtype> layer(param);
-  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
-  EXPECT_EQ(this->blob_top_data_->num(), batch_size);
-  EXPECT_EQ(this->blob_top_data_->channels(), num_cols);
-  EXPECT_EQ(this->blob_top_data_->height(), height);
-  EXPECT_EQ(this->blob_top_data_->width(), width);
-
-  EXPECT_EQ(this->blob_top_label_->num_axes(), 2);
-  EXPECT_EQ(this->blob_top_label_->shape(0), batch_size);
-  EXPECT_EQ(this->blob_top_label_->shape(1), 1);
-
-  EXPECT_EQ(this->blob_top_label2_->num_axes(), 2);
-  EXPECT_EQ(this->blob_top_label2_->shape(0), batch_size);
-  EXPECT_EQ(this->blob_top_label2_->shape(1), 1);
-
   layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
 
-  // Go through the data 10 times (5 batches).
-  const int data_size = num_cols * height * width;
-  for (int iter = 0; iter < 10; ++iter) {
-    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
-
-    // On even iterations, we're reading the first half of the data.
-    // On odd iterations, we're reading the second half of the data.
-    // NB: label is 1-indexed
-    int label_offset = 1 + ((iter % 2 == 0) ? 0 : batch_size);
-    int label2_offset = 1 + label_offset;
-    int data_offset = (iter % 2 == 0) ? 0 : batch_size * data_size;
-
-    // Every two iterations we are reading the second file,
-    // which has the same labels, but data is offset by total data size,
-    // which is 2400 (see generate_sample_data).
-    int file_offset = (iter % 4 < 2) ? 0 : 2400;
-
-    for (int i = 0; i < batch_size; ++i) {
-      EXPECT_EQ(
-        label_offset + i,
-        this->blob_top_label_->cpu_data()[i]);
-      EXPECT_EQ(
-        label2_offset + i,
-        this->blob_top_label2_->cpu_data()[i]);
-    }
-    for (int i = 0; i < batch_size; ++i) {
-      for (int j = 0; j < num_cols; ++j) {
-        for (int h = 0; h < height; ++h) {
-          for (int w = 0; w < width; ++w) {
-            int idx = (
-              i * num_cols * height * width +
-              j * height * width +
-              h * width + w);
-            EXPECT_EQ(
-              file_offset + data_offset + idx,
-              this->blob_top_data_->cpu_data()[idx])
-              << "debug: i " << i << " j " << j
-              << " iter " << iter;
-          }
+  // Each file is output whole, in two batches, before the next one; rows
+  // stay intact.
+  const int data_size = this->blob_top_data_->count(1);
+  for (int file = 0; file < 4; ++file) {
+    vector<int> labels;
+    int file_offset = -1;
+    for (int iter = 0; iter < 2; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      for (int i = 0; i < batch_size; ++i) {
+        const int label = this->blob_top_label_->cpu_data()[i];
+        EXPECT_EQ(label + 1, this->blob_top_label2_->cpu_data()[i]);
+        const int offset = this->blob_top_data_->cpu_data()[i * data_size]
+            - (label - 1) * data_size;
+        if (file_offset < 0) {
+          file_offset = offset;
         }
+        EXPECT_EQ(file_offset, offset);
+        EXPECT_TRUE(offset == 0 || offset == 2400);
+        labels.push_back(label);
       }
     }
+    std::sort(labels.begin(), labels.end());
+    for (int i = 0; i < labels.size(); ++i) {
+      EXPECT_EQ(i + 1, labels[i]);
+    }
   }
 }
 
@@ -0,0 +1,94 @@
+#include <stdint.h>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/host_allocator.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class HostAllocatorTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    HostAllocator::set_type(HostAllocator::POOL);
+    HostAllocator::ReleaseCached();
+  }
+  virtual void TearDown() {
+    HostAllocator::set_type(HostAllocator::MALLOC);
+    HostAllocator::set_max_bytes_cached(0);
+    HostAllocator::ReleaseCached();
+  }
+};
+
+TEST_F(HostAllocatorTest, TestSizeClass) {
+  EXPECT_EQ(64, HostAllocator::SizeClass(0));
+  EXPECT_EQ(64, HostAllocator::SizeClass(64));
+  EXPECT_EQ(80, HostAllocator::SizeClass(65));
+  EXPECT_EQ(128, HostAllocator::SizeClass(128));
+  EXPECT_EQ(160, HostAllocator::SizeClass(129));
+  EXPECT_EQ(1024, HostAllocator::SizeClass(1000));
+  EXPECT_EQ(1280, HostAllocator::SizeClass(1100));
+  for (size_t size = 1; size < 100000; size = size * 3 + 1) {
+    EXPECT_GE(HostAllocator::SizeClass(size), size);
+    EXPECT_LE(HostAllocator::SizeClass(size), size + size / 2 + 64);
+  }
+}
+
+TEST_F(HostAllocatorTest, TestReuse) {
+  const HostAllocatorStats before = HostAllocator::stats();
+  bool pooled;
+  void* first = HostAllocator::Allocate(1000, &pooled);
+  ASSERT_TRUE(pooled);
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(first) % 64);
+  HostAllocatorStats stats = HostAllocator::stats();
+  EXPECT_EQ(before.bytes_in_use + 1024, stats.bytes_in_use);
+  HostAllocator::Free(first, 1000, pooled);
+  EXPECT_EQ(1024, HostAllocator::stats().bytes_cached);
+  // Another size of the same class reuses the buffer.
+  void* second = HostAllocator::Allocate(1024, &pooled);
+  EXPECT_EQ(first, second);
+  stats = HostAllocator::stats();
+  EXPECT_EQ(before.allocations + 2, stats.allocations);
+  EXPECT_EQ(before.hits + 1, stats.hits);
+  EXPECT_EQ(0, stats.bytes_cached);
+  EXPECT_GE(stats.peak_bytes_in_use, before.bytes_in_use + 1024);
+  HostAllocator::Free(second, 1024, pooled);
+}
+
+TEST_F(HostAllocatorTest, TestMaxBytesCached) {
+  HostAllocator::set_max_bytes_cached(128);
+  bool pooled;
+  void* small = HostAllocator::Allocate(100, &pooled);
+  void* large = HostAllocator::Allocate(1000, &pooled);
+  HostAllocator::Free(large, 1000, pooled);
+  HostAllocator::Free(small, 100, pooled);
+  // Only the small buffer fits in the cache.
+  EXPECT_EQ(112, HostAllocator::stats().bytes_cached);
+}
+
+TEST_F(HostAllocatorTest, TestSyncedMemory) {
+  const HostAllocatorStats before = HostAllocator::stats();
+  void* cpu_data;
+  {
+    SyncedMemory mem(1000);
+    cpu_data = mem.mutable_cpu_data();
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(cpu_data) % 64);
+  }
+  // Memory allocated while pooling is returned to the pool, and zeroed on
+  // reuse.
+  HostAllocator::set_type(HostAllocator::MALLOC);
+  EXPECT_EQ(1024, HostAllocator::stats().bytes_cached);
+  HostAllocator::set_type(HostAllocator::POOL);
+  SyncedMemory mem(1024);
+  EXPECT_EQ(cpu_data, mem.cpu_data());
+  const char* bytes = static_cast<const char*>(mem.cpu_data());
+  for (int i = 0; i < mem.size(); ++i) {
+    EXPECT_EQ(0, bytes[i]);
+  }
+  EXPECT_EQ(before.hits + 1, HostAllocator::stats().hits);
+}
+
+}  // namespace caffe
@@ -0,0 +1,39 @@
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/image_cache.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ImageCacheTest : public ::testing::Test {};
+
+TEST_F(ImageCacheTest, TestLRU) {
+  // Room for two 10 x 10 color images.
+  ImageCache cache(600);
+  cv::Mat a(10, 10, CV_8UC3), b(10, 10, CV_8UC3), c(10, 10, CV_8UC3);
+  cache.Put("a", a);
+  cache.Put("b", b);
+  EXPECT_EQ(600, cache.size());
+  // The images are shared, not copied.
+  EXPECT_EQ(a.data, cache.Get("a").data);
+  // "b" is now the least recently used.
+  cache.Put("c", c);
+  EXPECT_EQ(600, cache.size());
+  EXPECT_TRUE(cache.Get("b").empty());
+  EXPECT_EQ(a.data, cache.Get("a").data);
+  EXPECT_EQ(c.data, cache.Get("c").data);
+  EXPECT_EQ(3, cache.hits());
+  EXPECT_EQ(1, cache.misses());
+  // Images larger than the cache are not kept.
+  cache.Put("d", cv::Mat(20, 20, CV_8UC3));
+  EXPECT_TRUE(cache.Get("d").empty());
+  EXPECT_EQ(600, cache.size());
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
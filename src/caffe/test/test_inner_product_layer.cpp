@@ -208,6 +208,89 @@ TYPED_TEST(InnerProductLayerTest, TestForwardTranspose) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestForwardSparse) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  for (int transpose = 0; transpose < 2; ++transpose) {
+    LayerParameter layer_param;
+    InnerProductParameter* inner_product_param =
+        layer_param.mutable_inner_product_param();
+    inner_product_param->set_num_output(10);
+    inner_product_param->set_transpose(transpose);
+    inner_product_param->mutable_weight_filler()->set_type("uniform");
+    inner_product_param->mutable_bias_filler()->set_type("uniform");
+    InnerProductLayer<Dtype> dense_layer(layer_param);
+    dense_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    // Prune all but every 7th weight.
+    Blob<Dtype>* weights = dense_layer.blobs()[0].get();
+    for (int i = 0; i < weights->count(); ++i) {
+      if (i % 7) { weights->mutable_cpu_data()[i] = 0; }
+    }
+    dense_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> expected;
+    expected.CopyFrom(*this->blob_top_, false, true);
+    layer_param.set_phase(TEST);
+    InnerProductLayer<Dtype> sparse_layer(layer_param);
+    sparse_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    sparse_layer.blobs()[0]->ShareData(*weights);
+    sparse_layer.blobs()[1]->ShareData(*dense_layer.blobs()[1]);
+    sparse_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    if (Caffe::mode() == Caffe::CPU) {
+      EXPECT_TRUE(sparse_layer.sparse_weight().active());
+      EXPECT_EQ((weights->count() + 6) / 7,
+                sparse_layer.sparse_weight().nnz());
+    }
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_NEAR(expected.cpu_data()[i], this->blob_top_->cpu_data()[i],
+                  1e-5);
+    }
+    // Updating the weights must invalidate the sparse copy.
+    caffe_scal(weights->count(), Dtype(2), weights->mutable_cpu_data());
+    dense_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    expected.CopyFrom(*this->blob_top_, false, true);
+    sparse_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_NEAR(expected.cpu_data()[i], this->blob_top_->cpu_data()[i],
+                  1e-5);
+    }
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardHalf) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  for (int transpose = 0; transpose < 2; ++transpose) {
+    for (int p = BlobProto::FLOAT16; p <= BlobProto::BFLOAT16; ++p) {
+      LayerParameter layer_param;
+      InnerProductParameter* inner_product_param =
+          layer_param.mutable_inner_product_param();
+      inner_product_param->set_num_output(10);
+      inner_product_param->set_transpose(transpose);
+      inner_product_param->mutable_weight_filler()->set_type("uniform");
+      inner_product_param->mutable_bias_filler()->set_type("uniform");
+      InnerProductLayer<Dtype> dense_layer(layer_param);
+      dense_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      dense_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      Blob<Dtype> expected;
+      expected.CopyFrom(*this->blob_top_, false, true);
+      layer_param.set_phase(TEST);
+      inner_product_param->set_weight_precision(
+          static_cast<BlobProto::Precision>(p));
+      InnerProductLayer<Dtype> half_layer(layer_param);
+      half_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      half_layer.blobs()[0]->ShareData(*dense_layer.blobs()[0]);
+      half_layer.blobs()[1]->ShareData(*dense_layer.blobs()[1]);
+      half_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      // Each of the 60 products rounds its weight.
+      const Dtype tolerance = p == BlobProto::FLOAT16 ? 1e-2 : 1e-1;
+      for (int i = 0; i < expected.count(); ++i) {
+        EXPECT_NEAR(expected.cpu_data()[i], this->blob_top_->cpu_data()[i],
+                    tolerance);
+      }
+    }
+  }
+}
+
 TYPED_TEST(InnerProductLayerTest, TestForwardNoBatch) {
   typedef typename TypeParam::Dtype Dtype;
   this->blob_bottom_vec_.push_back(this->blob_bottom_nobatch_);
@@ -211,6 +211,28 @@ TEST_F(IOTest, TestReadImageToCVMatResizedSquare) {
   EXPECT_EQ(cv_img.cols, 256);
 }
 
+TEST_F(IOTest, TestReadImageToCVMatResizedSmall) {
+  // Small enough that the JPEG may be decoded at reduced resolution, which
+  // must stay close to resizing the full resolution image.
+  string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+  cv::Mat cv_img = ReadImageToCVMat(filename, 45, 60);
+  EXPECT_EQ(cv_img.channels(), 3);
+  EXPECT_EQ(cv_img.rows, 45);
+  EXPECT_EQ(cv_img.cols, 60);
+  cv::Mat cv_img_ref;
+  cv::resize(cv::imread(filename, CV_LOAD_IMAGE_COLOR), cv_img_ref,
+      cv::Size(60, 45), 0, 0, cv::INTER_AREA);
+  double diff = 0;
+  for (int h = 0; h < cv_img.rows; ++h) {
+    const uchar* ptr = cv_img.ptr<uchar>(h);
+    const uchar* ptr_ref = cv_img_ref.ptr<uchar>(h);
+    for (int i = 0; i < cv_img.cols * 3; ++i) {
+      diff += std::abs(static_cast<int>(ptr[i]) - ptr_ref[i]);
+    }
+  }
+  EXPECT_LT(diff / (45 * 60 * 3), 16);
+}
+
 TEST_F(IOTest, TestReadImageToCVMatGray) {
   string filename = EXAMPLES_SOURCE_DIR "images/cat.jpg";
   const bool is_color = false;
@@ -158,6 +158,28 @@ TYPED_TEST(LRNLayerTest, TestForwardAcrossChannelsLargeRegion) {
   }
 }
 
+TYPED_TEST(LRNLayerTest, TestForwardAcrossChannelsMultipleTiles) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Enough spatial positions to span several tiles of the CPU kernel, and a
+  // beta off the specialized 0.75 path.
+  this->blob_bottom_->Reshape(2, 7, 29, 31);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  layer_param.mutable_lrn_param()->set_beta(0.6);
+  LRNLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> top_reference;
+  this->ReferenceLRNForward(*(this->blob_bottom_), layer_param,
+      &top_reference);
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i], top_reference.cpu_data()[i],
+                this->epsilon_);
+  }
+}
+
 TYPED_TEST(LRNLayerTest, TestGradientAcrossChannels) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -201,6 +223,26 @@ TYPED_TEST(LRNLayerTest, TestGradientAcrossChannelsLargeRegion) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(LRNLayerTest, TestGradientAcrossChannelsMultipleTiles) {
+  typedef typename TypeParam::Dtype Dtype;
+  // 575 spatial positions: one full tile of the CPU kernel and a partial one.
+  const int spatial_dim = 23 * 25;
+  this->blob_bottom_->Reshape(1, 4, 23, 25);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  LRNLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Outputs at both ends of each tile, against every input.
+  const int positions[] = {0, 511, 512, spatial_dim - 1};
+  for (int i = 0; i < 4; ++i) {
+    checker.CheckGradientSingle(&layer, this->blob_bottom_vec_,
+        this->blob_top_vec_, 0, 0, spatial_dim + positions[i]);
+  }
+}
+
 TYPED_TEST(LRNLayerTest, TestSetupWithinChannel) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -10,6 +10,7 @@
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
+#include "caffe/test/test_recurrent_util.hpp"
 
 namespace caffe {
 
@@ -284,5 +285,23 @@ TYPED_TEST(LSTMLayerTest, TestGradientNonZeroContBufferSize2WithStaticInput) {
       this->blob_top_vec_, 2);
 }
 
+TYPED_TEST(LSTMLayerTest, TestFusedMatchesUnrolled) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int kNumTimesteps = 3;
+  const int num = 2;
+  this->ReshapeBlobs(kNumTimesteps, num);
+  FillerParameter filler_param;
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(&this->blob_bottom_static_);
+  this->blob_bottom_vec_.push_back(&this->blob_bottom_static_);
+  // Stream 0 restarts at the last timestep; stream 1 continues throughout.
+  Dtype* cont_data = this->blob_bottom_cont_.mutable_cpu_data();
+  cont_data[0] = 0; cont_data[1] = 0;
+  cont_data[2] = 1; cont_data[3] = 1;
+  cont_data[4] = 0; cont_data[5] = 1;
+
+  CheckFusedMatchesUnrolled<LSTMLayer>(this->layer_param_,
+      this->blob_bottom_vec_, this->blob_top_vec_);
+}
 
 }  // namespace caffe
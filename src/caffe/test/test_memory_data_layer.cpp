@@ -2,9 +2,13 @@
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
 
+#include <set>
 #include <string>
 #include <vector>
 
+#include "boost/bind.hpp"
+#include "boost/thread.hpp"
+
 #include "caffe/filler.hpp"
 #include "caffe/layers/memory_data_layer.hpp"
 
@@ -115,6 +119,82 @@ TYPED_TEST(MemoryDataLayerTest, TestForward) {
   }
 }
 
+// Adds batches of batch_size items from data and labels, as a producer thread.
+template <typename Dtype>
+void AddBatches(MemoryDataLayer<Dtype>* layer, const Dtype* data,
+    const Dtype* labels, int batches, int batch_size, int item_size) {
+  for (int i = 0; i < batches; ++i) {
+    layer->AddBatch(data + i * batch_size * item_size,
+                    labels + i * batch_size);
+  }
+}
+
+TYPED_TEST(MemoryDataLayerTest, TestForwardBuffered) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  LayerParameter layer_param;
+  MemoryDataParameter* md_param = layer_param.mutable_memory_data_param();
+  md_param->set_batch_size(this->batch_size_);
+  md_param->set_channels(this->channels_);
+  md_param->set_height(this->height_);
+  md_param->set_width(this->width_);
+  md_param->set_buffers(2);
+  MemoryDataLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  boost::thread producer(boost::bind(&AddBatches<Dtype>, &layer,
+      this->data_->cpu_data(), this->labels_->cpu_data(), this->batches_,
+      this->batch_size_, this->data_->count(1)));
+  std::set<const Dtype*> buffers;
+  for (int batch_num = 0; batch_num < this->batches_; ++batch_num) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    ASSERT_EQ(this->batch_size_, this->data_blob_->num());
+    for (int j = 0; j < this->data_blob_->count(); ++j) {
+      EXPECT_EQ(this->data_blob_->cpu_data()[j],
+          this->data_->cpu_data()[
+              this->data_->offset(1) * this->batch_size_ * batch_num + j]);
+    }
+    for (int j = 0; j < this->label_blob_->count(); ++j) {
+      EXPECT_EQ(this->label_blob_->cpu_data()[j],
+          this->labels_->cpu_data()[this->batch_size_ * batch_num + j]);
+    }
+    buffers.insert(this->data_blob_->cpu_data());
+  }
+  producer.join();
+  // Every batch went through one of the two preallocated buffers.
+  EXPECT_EQ(2, buffers.size());
+}
+
+TYPED_TEST(MemoryDataLayerTest, TestTryAddBatch) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  LayerParameter layer_param;
+  MemoryDataParameter* md_param = layer_param.mutable_memory_data_param();
+  md_param->set_batch_size(this->batch_size_);
+  md_param->set_channels(this->channels_);
+  md_param->set_height(this->height_);
+  md_param->set_width(this->width_);
+  md_param->set_buffers(1);
+  MemoryDataLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(1, layer.buffers());
+  const Dtype* data = this->data_->cpu_data();
+  const Dtype* labels = this->labels_->cpu_data();
+  const int batch_count = this->batch_size_ * this->data_->count(1);
+  EXPECT_TRUE(layer.TryAddBatch(data, labels));
+  // The only batch is queued, and then held by the tops, until the next
+  // Forward frees it.
+  EXPECT_FALSE(layer.TryAddBatch(data, labels));
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_FALSE(layer.TryAddBatch(data, labels));
+  EXPECT_EQ(data[0], this->data_blob_->cpu_data()[0]);
+  boost::thread producer(boost::bind(&AddBatches<Dtype>, &layer,
+      data + batch_count, labels + this->batch_size_, 1, this->batch_size_,
+      this->data_->count(1)));
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  producer.join();
+  EXPECT_EQ(data[batch_count], this->data_blob_->cpu_data()[0]);
+}
+
 #ifdef USE_OPENCV
 TYPED_TEST(MemoryDataLayerTest, AddDatumVectorDefaultTransform) {
   typedef typename TypeParam::Dtype Dtype;
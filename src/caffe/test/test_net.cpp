@@ -1342,6 +1342,439 @@ TYPED_TEST(NetTest, TestSharedWeightsResume) {
   }
 }
 
+TYPED_TEST(NetTest, TestFlatParams) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  const bool kForceBackward = false;
+  const bool kBiasTerm = true;
+  this->InitUnsharedWeightsNet(NULL, NULL, kForceBackward, kBiasTerm);
+  NetParameter param;
+  this->net_->ToProto(&param);
+  // Train the same net with and without flat parameters.
+  vector<shared_ptr<Net<Dtype> > > nets;
+  for (int flat = 0; flat < 2; ++flat) {
+    param.set_flat_params(flat);
+    Caffe::set_random_seed(this->seed_);
+    nets.push_back(shared_ptr<Net<Dtype> >(new Net<Dtype>(param)));
+    for (int iter = 0; iter < 2; ++iter) {
+      nets.back()->ClearParamDiffs();
+      nets.back()->Forward();
+      nets.back()->Backward();
+      nets.back()->Update();
+    }
+  }
+  EXPECT_FALSE(nets[0]->has_flat_params());
+  ASSERT_TRUE(nets[1]->has_flat_params());
+  // The flat parameters are laid out in the order of learnable_params.
+  const vector<Blob<Dtype>*>& params = nets[0]->learnable_params();
+  const vector<Blob<Dtype>*>& flat_params = nets[1]->learnable_params();
+  ASSERT_EQ(4, flat_params.size());
+  int offset = 0;
+  for (int i = 0; i < flat_params.size(); ++i) {
+    EXPECT_EQ(flat_params[0]->cpu_data() + offset, flat_params[i]->cpu_data());
+    EXPECT_EQ(flat_params[0]->cpu_diff() + offset, flat_params[i]->cpu_diff());
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(params[i]->cpu_data()[j], flat_params[i]->cpu_data()[j]);
+      EXPECT_EQ(params[i]->cpu_diff()[j], flat_params[i]->cpu_diff()[j]);
+    }
+    offset += flat_params[i]->count();
+  }
+  EXPECT_EQ(offset, nets[1]->flat_count());
+  nets[1]->ClearParamDiffs();
+  const Dtype* flat_diff = nets[1]->mutable_flat_cpu_diff();
+  for (int i = 0; i < offset; ++i) {
+    EXPECT_EQ(0, flat_diff[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestLayerThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Two branches with shared parameters off a split input, one with an
+  // in-place layer, joined again before the loss.
+  const string& proto =
+      "name: 'BranchedNetwork' "
+      "layer { "
+      "  name: 'input' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  top: 'target' "
+      "  input_param { "
+      "    shape { dim: 4 dim: 6 } "
+      "    shape { dim: 4 dim: 3 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'innerproduct1' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 3 "
+      "    weight_filler { type: 'gaussian' std: 1 } "
+      "    bias_filler { type: 'gaussian' std: 1 } "
+      "  } "
+      "  param { name: 'sharedweights' } "
+      "  param { name: 'sharedbias' } "
+      "  bottom: 'data' "
+      "  top: 'innerproduct1' "
+      "} "
+      "layer { "
+      "  name: 'relu1' "
+      "  type: 'ReLU' "
+      "  bottom: 'innerproduct1' "
+      "  top: 'innerproduct1' "
+      "} "
+      "layer { "
+      "  name: 'innerproduct2' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 3 "
+      "  } "
+      "  param { name: 'sharedweights' } "
+      "  param { name: 'sharedbias' } "
+      "  bottom: 'data' "
+      "  top: 'innerproduct2' "
+      "} "
+      "layer { "
+      "  name: 'tanh2' "
+      "  type: 'TanH' "
+      "  bottom: 'innerproduct2' "
+      "  top: 'tanh2' "
+      "} "
+      "layer { "
+      "  name: 'sum' "
+      "  type: 'Eltwise' "
+      "  bottom: 'innerproduct1' "
+      "  bottom: 'tanh2' "
+      "  top: 'sum' "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'EuclideanLoss' "
+      "  bottom: 'sum' "
+      "  bottom: 'target' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  // Run the same net with all layers in turn and on two threads.
+  vector<shared_ptr<Net<Dtype> > > nets;
+  vector<Dtype> losses;
+  for (int threads = 0; threads <= 2; threads += 2) {
+    param.set_layer_threads(threads);
+    Caffe::set_random_seed(this->seed_);
+    nets.push_back(shared_ptr<Net<Dtype> >(new Net<Dtype>(param)));
+    // Starting the layer threads draws seeds from the generator.
+    Caffe::set_random_seed(this->seed_);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    for (int i = 0; i < nets.back()->input_blobs().size(); ++i) {
+      filler.Fill(nets.back()->input_blobs()[i]);
+    }
+    nets.back()->ClearParamDiffs();
+    losses.push_back(nets.back()->ForwardBackward());
+  }
+  EXPECT_EQ(losses[0], losses[1]);
+  for (int i = 0; i < nets[0]->blobs().size(); ++i) {
+    const Blob<Dtype>& blob = *nets[0]->blobs()[i];
+    const Blob<Dtype>& threaded_blob = *nets[1]->blobs()[i];
+    for (int j = 0; j < blob.count(); ++j) {
+      EXPECT_EQ(blob.cpu_data()[j], threaded_blob.cpu_data()[j]);
+      EXPECT_EQ(blob.cpu_diff()[j], threaded_blob.cpu_diff()[j]);
+    }
+  }
+  const vector<Blob<Dtype>*>& params = nets[0]->learnable_params();
+  const vector<Blob<Dtype>*>& threaded_params = nets[1]->learnable_params();
+  ASSERT_EQ(2, params.size());
+  ASSERT_EQ(2, threaded_params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(params[i]->cpu_diff()[j], threaded_params[i]->cpu_diff()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestLayerThreadsDropout) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Two branches, each with a Dropout layer, joined again before the loss.
+  const string& proto =
+      "name: 'DropoutBranches' "
+      "layer { "
+      "  name: 'input' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  top: 'target' "
+      "  input_param { "
+      "    shape { dim: 4 dim: 6 } "
+      "    shape { dim: 4 dim: 3 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'innerproduct1' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 3 "
+      "    weight_filler { type: 'gaussian' std: 1 } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'innerproduct1' "
+      "} "
+      "layer { "
+      "  name: 'dropout1' "
+      "  type: 'Dropout' "
+      "  bottom: 'innerproduct1' "
+      "  top: 'dropout1' "
+      "} "
+      "layer { "
+      "  name: 'innerproduct2' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 3 "
+      "    weight_filler { type: 'gaussian' std: 1 } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'innerproduct2' "
+      "} "
+      "layer { "
+      "  name: 'dropout2' "
+      "  type: 'Dropout' "
+      "  bottom: 'innerproduct2' "
+      "  top: 'dropout2' "
+      "} "
+      "layer { "
+      "  name: 'sum' "
+      "  type: 'Eltwise' "
+      "  bottom: 'dropout1' "
+      "  bottom: 'dropout2' "
+      "  top: 'sum' "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'EuclideanLoss' "
+      "  bottom: 'sum' "
+      "  bottom: 'target' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  param.mutable_state()->set_phase(TRAIN);
+  // The masks follow the random seed, whichever threads the layers run on.
+  vector<shared_ptr<Net<Dtype> > > nets;
+  for (int threads = 0; threads <= 2; threads += 2) {
+    param.set_layer_threads(threads);
+    Caffe::set_random_seed(this->seed_);
+    nets.push_back(shared_ptr<Net<Dtype> >(new Net<Dtype>(param)));
+  }
+  Caffe::set_random_seed(this->seed_);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int i = 0; i < nets[0]->input_blobs().size(); ++i) {
+    filler.Fill(nets[0]->input_blobs()[i]);
+    nets[1]->input_blobs()[i]->CopyFrom(*nets[0]->input_blobs()[i]);
+  }
+  for (int iter = 0; iter < 5; ++iter) {
+    vector<Dtype> losses;
+    for (int n = 0; n < nets.size(); ++n) {
+      Caffe::set_random_seed(this->seed_ + iter);
+      losses.push_back(nets[n]->ForwardBackward());
+    }
+    EXPECT_EQ(losses[0], losses[1]);
+    for (int i = 0; i < nets[0]->blobs().size(); ++i) {
+      const Blob<Dtype>& blob = *nets[0]->blobs()[i];
+      const Blob<Dtype>& threaded_blob = *nets[1]->blobs()[i];
+      for (int j = 0; j < blob.count(); ++j) {
+        EXPECT_EQ(blob.cpu_data()[j], threaded_blob.cpu_data()[j]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestLayerThreadsDummyData) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Two DummyData layers refill their tops from random fillers.
+  const string& proto =
+      "name: 'DummyDataBranches' "
+      "layer { "
+      "  name: 'data1' "
+      "  type: 'DummyData' "
+      "  dummy_data_param { "
+      "    shape { dim: 4 dim: 3 } "
+      "    data_filler { type: 'gaussian' } "
+      "  } "
+      "  top: 'data1' "
+      "} "
+      "layer { "
+      "  name: 'data2' "
+      "  type: 'DummyData' "
+      "  dummy_data_param { "
+      "    shape { dim: 4 dim: 3 } "
+      "    data_filler { type: 'uniform' } "
+      "  } "
+      "  top: 'data2' "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'EuclideanLoss' "
+      "  bottom: 'data1' "
+      "  bottom: 'data2' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  // The data follows the random seed, whichever threads the layers run on.
+  vector<shared_ptr<Net<Dtype> > > nets;
+  for (int threads = 0; threads <= 2; threads += 2) {
+    param.set_layer_threads(threads);
+    Caffe::set_random_seed(this->seed_);
+    nets.push_back(shared_ptr<Net<Dtype> >(new Net<Dtype>(param)));
+  }
+  for (int iter = 0; iter < 5; ++iter) {
+    vector<Dtype> losses;
+    for (int n = 0; n < nets.size(); ++n) {
+      Caffe::set_random_seed(this->seed_ + iter);
+      losses.push_back(nets[n]->ForwardBackward());
+    }
+    EXPECT_EQ(losses[0], losses[1]);
+    for (int i = 0; i < nets[0]->blobs().size(); ++i) {
+      const Blob<Dtype>& blob = *nets[0]->blobs()[i];
+      const Blob<Dtype>& threaded_blob = *nets[1]->blobs()[i];
+      for (int j = 0; j < blob.count(); ++j) {
+        EXPECT_EQ(blob.cpu_data()[j], threaded_blob.cpu_data()[j]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestCheckpoint) {
+  typedef typename TypeParam::Dtype Dtype;
+  // A skip connection from innerproduct1 across the checkpoint at sigmoid2.
+  const string& proto =
+      "name: 'CheckpointedNetwork' "
+      "layer { "
+      "  name: 'input' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  top: 'target' "
+      "  input_param { "
+      "    shape { dim: 4 dim: 6 } "
+      "    shape { dim: 4 dim: 2 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'innerproduct1' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 5 "
+      "    weight_filler { type: 'gaussian' std: 1 } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'innerproduct1' "
+      "} "
+      "layer { "
+      "  name: 'relu1' "
+      "  type: 'ReLU' "
+      "  bottom: 'innerproduct1' "
+      "  top: 'innerproduct1' "
+      "} "
+      "layer { "
+      "  name: 'innerproduct2' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 5 "
+      "    weight_filler { type: 'gaussian' std: 1 } "
+      "  } "
+      "  bottom: 'innerproduct1' "
+      "  top: 'innerproduct2' "
+      "} "
+      "layer { "
+      "  name: 'sigmoid2' "
+      "  type: 'Sigmoid' "
+      "  bottom: 'innerproduct2' "
+      "  top: 'sigmoid2' "
+      "} "
+      "layer { "
+      "  name: 'sum' "
+      "  type: 'Eltwise' "
+      "  bottom: 'innerproduct1' "
+      "  bottom: 'sigmoid2' "
+      "  top: 'sum' "
+      "} "
+      "layer { "
+      "  name: 'innerproduct3' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 2 "
+      "    weight_filler { type: 'gaussian' std: 1 } "
+      "  } "
+      "  bottom: 'sum' "
+      "  top: 'innerproduct3' "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'EuclideanLoss' "
+      "  bottom: 'innerproduct3' "
+      "  bottom: 'target' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  param.mutable_state()->set_phase(TRAIN);
+  // Train without checkpoints, with one, and with one on two threads.
+  vector<shared_ptr<Net<Dtype> > > nets;
+  vector<vector<Dtype> > losses(3);
+  for (int n = 0; n < 3; ++n) {
+    if (n == 1) {
+      param.add_checkpoint_layer("sigmoid2");
+    } else if (n == 2) {
+      param.set_layer_threads(2);
+    }
+    Caffe::set_random_seed(this->seed_);
+    nets.push_back(shared_ptr<Net<Dtype> >(new Net<Dtype>(param)));
+    Caffe::set_random_seed(this->seed_);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    for (int iter = 0; iter < 2; ++iter) {
+      for (int i = 0; i < nets.back()->input_blobs().size(); ++i) {
+        filler.Fill(nets.back()->input_blobs()[i]);
+      }
+      nets.back()->ClearParamDiffs();
+      losses[n].push_back(nets.back()->ForwardBackward());
+      nets.back()->Update();
+    }
+  }
+  for (int n = 1; n < 3; ++n) {
+    Net<Dtype>& net = *nets[n];
+    // Blobs used within a segment only are freed; outputs, checkpoints and
+    // blobs used across segments are kept. The last segment, which backward
+    // starts with, is only freed by backward (below).
+    net.Forward();
+    EXPECT_EQ(SyncedMemory::UNINITIALIZED,
+              net.blob_by_name("innerproduct2")->data()->head());
+    EXPECT_NE(SyncedMemory::UNINITIALIZED,
+              net.blob_by_name("sum")->data()->head());
+    EXPECT_NE(SyncedMemory::UNINITIALIZED,
+              net.blob_by_name("innerproduct3")->data()->head());
+    EXPECT_NE(SyncedMemory::UNINITIALIZED,
+              net.blob_by_name("innerproduct1")->data()->head());
+    EXPECT_NE(SyncedMemory::UNINITIALIZED,
+              net.blob_by_name("sigmoid2")->data()->head());
+    // The recomputed backward pass gives the same gradients.
+    for (int iter = 0; iter < 2; ++iter) {
+      EXPECT_EQ(losses[0][iter], losses[n][iter]);
+    }
+    const vector<Blob<Dtype>*>& params = nets[0]->learnable_params();
+    const vector<Blob<Dtype>*>& checkpointed_params = net.learnable_params();
+    ASSERT_EQ(params.size(), checkpointed_params.size());
+    for (int i = 0; i < params.size(); ++i) {
+      for (int j = 0; j < params[i]->count(); ++j) {
+        EXPECT_EQ(params[i]->cpu_data()[j],
+                  checkpointed_params[i]->cpu_data()[j]);
+        EXPECT_EQ(params[i]->cpu_diff()[j],
+                  checkpointed_params[i]->cpu_diff()[j]);
+      }
+    }
+    net.Backward();
+    EXPECT_EQ(SyncedMemory::UNINITIALIZED,
+              net.blob_by_name("sum")->data()->head());
+    EXPECT_EQ(SyncedMemory::UNINITIALIZED,
+              net.blob_by_name("innerproduct3")->data()->head());
+  }
+}
+
 TYPED_TEST(NetTest, TestParamPropagateDown) {
   typedef typename TypeParam::Dtype Dtype;
   const bool kBiasTerm = true, kForceBackward = false;
@@ -0,0 +1,164 @@
+#include <boost/filesystem.hpp>
+#include <string>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/net_cache.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class NetCacheTest : public ::testing::Test {
+ protected:
+  NetCacheTest() {
+    MakeTempFilename(&param_file_);
+    // The data feeds two layers, so compiling adds a split; the loss is
+    // filtered out at TEST.
+    WriteNet(
+        "name: 'CachedNet' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 2 dim: 3 } } "
+        "} "
+        "layer { "
+        "  name: 'innerproduct' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { num_output: 3 } "
+        "  bottom: 'data' "
+        "  top: 'innerproduct' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'innerproduct' "
+        "  bottom: 'data' "
+        "  include { phase: TRAIN } "
+        "} ");
+    NetCache::Clear();
+  }
+
+  virtual ~NetCacheTest() {
+    NetCache::set_directory("");
+    NetCache::Clear();
+  }
+
+  void WriteNet(const string& proto) {
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    WriteProtoToTextFile(param, param_file_);
+  }
+
+  static NetState State(Phase phase) {
+    NetState state;
+    state.set_phase(phase);
+    return state;
+  }
+
+  string param_file_;
+};
+
+TEST_F(NetCacheTest, TestGet) {
+  shared_ptr<const NetParameter> train =
+      NetCache::Get(param_file_, State(TRAIN));
+  EXPECT_EQ(TRAIN, train->state().phase());
+  ASSERT_EQ(4, train->layer_size());
+  EXPECT_EQ("Split", train->layer(1).type());
+  // A second net from the file shares the compiled definition.
+  const int misses = NetCache::misses();
+  EXPECT_EQ(train, NetCache::Get(param_file_, State(TRAIN)));
+  EXPECT_EQ(misses, NetCache::misses());
+  EXPECT_GT(NetCache::hits(), 0);
+  // Compiling it again changes nothing.
+  EXPECT_EQ(train, NetCache::Compile(*train));
+  // Other states compile separately.
+  shared_ptr<const NetParameter> test =
+      NetCache::Get(param_file_, State(TEST));
+  EXPECT_NE(train, test);
+  EXPECT_EQ(2, test->layer_size());
+  // Nets are built from the compiled definitions.
+  Net<float> net(param_file_, TRAIN);
+  EXPECT_EQ(train->layer_size(), net.layers().size());
+  // Editing the file is picked up.
+  WriteNet(
+      "name: 'EditedNet' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 } } "
+      "} ");
+  shared_ptr<const NetParameter> edited =
+      NetCache::Get(param_file_, State(TRAIN));
+  EXPECT_EQ("EditedNet", edited->name());
+  EXPECT_EQ(1, edited->layer_size());
+}
+
+TEST_F(NetCacheTest, TestDirectory) {
+  string directory;
+  MakeTempDir(&directory);
+  NetCache::set_directory(directory);
+  NetParameter param;
+  NetCache::ReadNetParams(param_file_, &param);
+  EXPECT_EQ(1, NetCache::misses());
+  int num_files = 0;
+  for (boost::filesystem::directory_iterator it(directory);
+       it != boost::filesystem::directory_iterator(); ++it) {
+    ++num_files;
+  }
+  EXPECT_EQ(1, num_files);
+  // Another process, with nothing in memory, reads the stored definition.
+  NetCache::Clear();
+  NetParameter stored;
+  NetCache::ReadNetParams(param_file_, &stored);
+  EXPECT_EQ(0, NetCache::misses());
+  EXPECT_EQ(1, NetCache::hits());
+  EXPECT_EQ(param.SerializeAsString(), stored.SerializeAsString());
+}
+
+TEST_F(NetCacheTest, TestDirectoryOtherSource) {
+  string directory;
+  MakeTempDir(&directory);
+  NetCache::set_directory(directory);
+  NetParameter param;
+  NetCache::ReadNetParams(param_file_, &param);
+  const boost::filesystem::path stored =
+      boost::filesystem::directory_iterator(directory)->path();
+  // Put the file of another prototxt under its key, as a hash collision
+  // would.
+  const string cached_file = param_file_;
+  MakeTempFilename(&param_file_);
+  WriteNet("name: 'OtherNet' ");
+  boost::filesystem::remove(stored);
+  NetCache::ReadNetParams(param_file_, &param);
+  EXPECT_EQ("OtherNet", param.name());
+  boost::filesystem::rename(
+      boost::filesystem::directory_iterator(directory)->path(), stored);
+  // The stored file does not match the prototxt, which is parsed instead.
+  NetCache::Clear();
+  NetCache::ReadNetParams(cached_file, &param);
+  EXPECT_EQ("CachedNet", param.name());
+  EXPECT_EQ(1, NetCache::misses());
+  EXPECT_EQ(0, NetCache::hits());
+}
+
+TEST_F(NetCacheTest, TestDirectoryUnwritable) {
+  string directory;
+  MakeTempDir(&directory);
+  NetCache::set_directory(directory);
+  boost::filesystem::remove_all(directory);
+  // Failing to store the definition leaves reading it unaffected.
+  NetParameter param;
+  NetCache::ReadNetParams(param_file_, &param);
+  EXPECT_EQ("CachedNet", param.name());
+  EXPECT_FALSE(boost::filesystem::exists(directory));
+}
+
+}  // namespace caffe
@@ -0,0 +1,133 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/net_pipeline.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class NetPipelineTest : public CPUDeviceTest<Dtype> {
+ protected:
+  NetPipelineTest() {
+    const string proto =
+        "name: 'PipelinedNet' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "    shape { dim: 2 dim: 8 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip1' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'ip1' "
+        "  inner_product_param { "
+        "    num_output: 16 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'ip1' "
+        "  top: 'ip1' "
+        "} "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'ip1' "
+        "  top: 'ip2' "
+        "  inner_product_param { "
+        "    num_output: 4 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "} ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param_));
+  }
+
+  NetParameter param_;
+};
+
+TYPED_TEST_CASE(NetPipelineTest, TestDtypes);
+
+TYPED_TEST(NetPipelineTest, TestPartition) {
+  vector<double> times(4, 1);
+  vector<int> begins = NetPipeline<TypeParam>::Partition(times, 2);
+  ASSERT_EQ(2, begins.size());
+  EXPECT_EQ(0, begins[0]);
+  EXPECT_EQ(2, begins[1]);
+  // A slow first layer gets a stage to itself.
+  const double skewed[] = {5, 1, 1, 1, 1, 1};
+  times.assign(skewed, skewed + 6);
+  begins = NetPipeline<TypeParam>::Partition(times, 2);
+  ASSERT_EQ(2, begins.size());
+  EXPECT_EQ(1, begins[1]);
+  // The best split of 1..5 into three stages is [1 2 3] [4] [5].
+  const double rising[] = {1, 2, 3, 4, 5};
+  times.assign(rising, rising + 5);
+  begins = NetPipeline<TypeParam>::Partition(times, 3);
+  ASSERT_EQ(3, begins.size());
+  EXPECT_EQ(0, begins[0]);
+  EXPECT_EQ(3, begins[1]);
+  EXPECT_EQ(4, begins[2]);
+  // No more stages than layers.
+  times.assign(2, 1);
+  begins = NetPipeline<TypeParam>::Partition(times, 5);
+  ASSERT_EQ(2, begins.size());
+  EXPECT_EQ(1, begins[1]);
+}
+
+TYPED_TEST(NetPipelineTest, TestForward) {
+  typedef TypeParam Dtype;
+  NetPipeline<Dtype> pipeline(this->param_, 3);
+  EXPECT_EQ(3, pipeline.num_stages());
+  EXPECT_EQ(4, pipeline.num_slots());
+  Net<Dtype> reference(this->param_);
+  reference.ShareTrainedLayersWith(pipeline.net());
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  const int num_batches = 10;
+  vector<shared_ptr<Blob<Dtype> > > inputs;
+  int collected = 0;
+  for (int i = 0; i < num_batches + pipeline.num_slots(); ++i) {
+    if (i >= pipeline.num_slots()) {
+      // Slots come back in submission order, with the outputs of a
+      // sequential forward pass.
+      const int slot = pipeline.Collect();
+      reference.input_blobs()[0]->CopyFrom(*inputs[collected]);
+      reference.Forward();
+      const Blob<Dtype>* expected = reference.output_blobs()[0];
+      const Blob<Dtype>* output = pipeline.net(slot)->output_blobs()[0];
+      ASSERT_EQ(expected->count(), output->count());
+      for (int j = 0; j < output->count(); ++j) {
+        EXPECT_EQ(expected->cpu_data()[j], output->cpu_data()[j]);
+      }
+      pipeline.Release(slot);
+      ++collected;
+    }
+    if (i < num_batches) {
+      const int slot = pipeline.Acquire();
+      Blob<Dtype>* input = pipeline.net(slot)->input_blobs()[0];
+      filler.Fill(input);
+      inputs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      inputs.back()->CopyFrom(*input, false, true);
+      pipeline.Submit(slot);
+    }
+  }
+  EXPECT_EQ(num_batches, collected);
+}
+
+}  // namespace caffe
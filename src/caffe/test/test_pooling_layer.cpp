@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -609,6 +610,122 @@ TYPED_TEST(PoolingLayerTest, TestGradientAvePadded) {
   }
 }
 
+TYPED_TEST(PoolingLayerTest, TestForwardTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The TEST phase takes the separable kernels. MAX must match the TRAIN
+  // phase, which keeps the argmax mask, and AVE the windowed sums below,
+  // which divide by the window size including the padding.
+  const int kernels[] = {2, 3, 3, 4};
+  const int strides[] = {2, 2, 1, 3};
+  const int pads[] = {0, 0, 1, 1};
+  this->blob_bottom_->Reshape(2, 3, 13, 11);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  const int height = this->blob_bottom_->height();
+  const int width = this->blob_bottom_->width();
+  for (int method = 0; method < 2; ++method) {
+    for (int i = 0; i < 4; ++i) {
+      LayerParameter layer_param;
+      PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+      pooling_param->set_kernel_size(kernels[i]);
+      pooling_param->set_stride(strides[i]);
+      pooling_param->set_pad(pads[i]);
+      pooling_param->set_pool(method == 0 ? PoolingParameter_PoolMethod_MAX :
+          PoolingParameter_PoolMethod_AVE);
+      PoolingLayer<Dtype> train_layer(layer_param);
+      train_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      Blob<Dtype> expected;
+      if (method == 0) {
+        train_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+        expected.CopyFrom(*this->blob_top_, false, true);
+      } else {
+        expected.ReshapeLike(*this->blob_top_);
+        const int pooled_height = expected.height();
+        const int pooled_width = expected.width();
+        const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+        Dtype* expected_data = expected.mutable_cpu_data();
+        for (int plane = 0; plane < expected.num() * expected.channels();
+             ++plane) {
+          for (int ph = 0; ph < pooled_height; ++ph) {
+            for (int pw = 0; pw < pooled_width; ++pw) {
+              const int hstart = ph * strides[i] - pads[i];
+              const int wstart = pw * strides[i] - pads[i];
+              const int hend = std::min(hstart + kernels[i], height + pads[i]);
+              const int wend = std::min(wstart + kernels[i], width + pads[i]);
+              Dtype sum = 0;
+              for (int h = std::max(hstart, 0); h < std::min(hend, height);
+                   ++h) {
+                for (int w = std::max(wstart, 0); w < std::min(wend, width);
+                     ++w) {
+                  sum += bottom_data[h * width + w];
+                }
+              }
+              *expected_data++ = sum / ((hend - hstart) * (wend - wstart));
+            }
+          }
+          bottom_data += height * width;
+        }
+      }
+      layer_param.set_phase(TEST);
+      PoolingLayer<Dtype> test_layer(layer_param);
+      test_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      test_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      ASSERT_EQ(expected.count(), this->blob_top_->count());
+      for (int j = 0; j < expected.count(); ++j) {
+        EXPECT_NEAR(expected.cpu_data()[j], this->blob_top_->cpu_data()[j],
+            1e-5);
+      }
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestForwardGlobalPooling) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int plane = this->blob_bottom_->height() * this->blob_bottom_->width();
+  for (int method = 0; method < 2; ++method) {
+    for (int phase = 0; phase < 2; ++phase) {
+      LayerParameter layer_param;
+      layer_param.set_phase(phase == 0 ? TRAIN : TEST);
+      PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+      pooling_param->set_global_pooling(true);
+      pooling_param->set_pool(method == 0 ? PoolingParameter_PoolMethod_MAX :
+          PoolingParameter_PoolMethod_AVE);
+      PoolingLayer<Dtype> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+      for (int i = 0; i < this->blob_top_->count(); ++i) {
+        Dtype expected = method == 0 ? bottom_data[i * plane] : 0;
+        for (int j = 0; j < plane; ++j) {
+          const Dtype x = bottom_data[i * plane + j];
+          expected = method == 0 ? std::max(expected, x) : expected + x;
+        }
+        if (method == 1) {
+          expected /= plane;
+        }
+        EXPECT_NEAR(this->blob_top_->cpu_data()[i], expected, 1e-5);
+      }
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestGradientMaxTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Backward after a TEST phase forward has to rebuild the skipped mask.
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+  pooling_param->set_kernel_size(3);
+  pooling_param->set_stride(2);
+  pooling_param->set_pad(1);
+  pooling_param->set_pool(PoolingParameter_PoolMethod_MAX);
+  PoolingLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-4, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNPoolingLayerTest : public GPUDeviceTest<Dtype> {
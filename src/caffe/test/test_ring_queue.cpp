@@ -0,0 +1,120 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/ring_queue.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class RingQueueTest : public ::testing::Test {
+ protected:
+  // Pushes first, first + stride, ... up to count.
+  static void Produce(RingQueue<int>* queue, int first, int stride,
+      int count) {
+    for (int i = first; i < count; i += stride) {
+      queue->push(i);
+    }
+  }
+
+  // Pops count items, marking each as seen.
+  static void Consume(RingQueue<int>* queue, int count, vector<int>* seen) {
+    for (int i = 0; i < count; ++i) {
+      ++(*seen)[queue->pop()];
+    }
+  }
+};
+
+TEST_F(RingQueueTest, TestTryPushPop) {
+  RingQueue<int> queue(3, RingQueue<int>::SPSC);
+  EXPECT_EQ(4, queue.capacity());
+  int item;
+  EXPECT_FALSE(queue.try_pop(&item));
+  EXPECT_FALSE(queue.try_peek(&item));
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(queue.try_push(i));
+  }
+  EXPECT_FALSE(queue.try_push(4));
+  EXPECT_EQ(4, queue.size());
+  EXPECT_EQ(0, queue.peek());
+  // Wraps around the ring.
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_TRUE(queue.try_pop(&item));
+    EXPECT_EQ(i, item);
+    EXPECT_TRUE(queue.try_push(i + 4));
+  }
+  EXPECT_EQ(4, queue.size());
+}
+
+TEST_F(RingQueueTest, TestSPSC) {
+  const int count = 10000;
+  // A small ring, so that both threads wait on each other.
+  RingQueue<int> queue(2, RingQueue<int>::SPSC);
+  boost::thread producer(boost::bind(&Produce, &queue, 0, 1, count));
+  for (int i = 0; i < count; ++i) {
+    ASSERT_EQ(i, queue.pop());
+  }
+  producer.join();
+  EXPECT_EQ(0, queue.size());
+}
+
+TEST_F(RingQueueTest, TestMPMC) {
+  const int count = 10000;
+  const int num_threads = 3;
+  RingQueue<int> queue(4, RingQueue<int>::MPMC);
+  vector<vector<int> > seen(num_threads, vector<int>(count, 0));
+  boost::thread_group threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.create_thread(boost::bind(&Produce, &queue, i, num_threads,
+                                      count));
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    threads.create_thread(boost::bind(&Consume, &queue,
+        count / num_threads + (i < count % num_threads), &seen[i]));
+  }
+  threads.join_all();
+  // Every item was popped exactly once.
+  for (int i = 0; i < count; ++i) {
+    int times = 0;
+    for (int j = 0; j < num_threads; ++j) {
+      times += seen[j][i];
+    }
+    EXPECT_EQ(1, times);
+  }
+}
+
+TEST_F(RingQueueTest, TestStats) {
+  RingQueue<int> queue(4, RingQueue<int>::SPSC);
+  queue.push(0);
+  queue.push(1);
+  queue.pop();
+  queue.pop();
+  queue.push(2);
+  QueueStats stats = queue.stats();
+  EXPECT_EQ(3, stats.pushes);
+  EXPECT_EQ(2, stats.pops);
+  EXPECT_EQ(0, stats.full_waits);
+  EXPECT_EQ(0, stats.empty_waits);
+  // The pops saw 2 and 1 items.
+  EXPECT_EQ(3, stats.occupancy_sum);
+  EXPECT_EQ(2, stats.max_occupancy);
+  EXPECT_EQ(1.5, stats.mean_occupancy());
+}
+
+TEST_F(RingQueueTest, TestInterrupt) {
+  // A thread blocked on an empty queue can be interrupted, as with
+  // BlockingQueue.
+  RingQueue<int> queue(1, RingQueue<int>::SPSC);
+  vector<int> seen(1, 0);
+  boost::thread consumer(boost::bind(&Consume, &queue, 1, &seen));
+  consumer.interrupt();
+  consumer.join();
+  EXPECT_EQ(0, seen[0]);
+  EXPECT_EQ(1, queue.stats().empty_waits);
+}
+
+}  // namespace caffe
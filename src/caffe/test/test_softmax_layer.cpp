@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include <vector>
 
@@ -83,6 +84,48 @@ TYPED_TEST(SoftmaxLayerTest, TestGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(SoftmaxLayerTest, TestForwardInnerOne) {
+  typedef typename TypeParam::Dtype Dtype;
+  // A classifier-shaped (N x C) input, where each softmax is one row.
+  this->blob_bottom_->Reshape(4, 10, 1, 1);
+  FillerParameter filler_param;
+  filler_param.set_std(10);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  SoftmaxLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < this->blob_bottom_->num(); ++i) {
+    Dtype max_val = this->blob_bottom_->data_at(i, 0, 0, 0);
+    for (int j = 1; j < this->blob_bottom_->channels(); ++j) {
+      max_val = std::max(max_val, this->blob_bottom_->data_at(i, j, 0, 0));
+    }
+    Dtype scale = 0;
+    for (int j = 0; j < this->blob_bottom_->channels(); ++j) {
+      scale += exp(this->blob_bottom_->data_at(i, j, 0, 0) - max_val);
+    }
+    for (int j = 0; j < this->blob_bottom_->channels(); ++j) {
+      EXPECT_NEAR(this->blob_top_->data_at(i, j, 0, 0),
+          exp(this->blob_bottom_->data_at(i, j, 0, 0) - max_val) / scale,
+          1e-4);
+    }
+  }
+}
+
+TYPED_TEST(SoftmaxLayerTest, TestGradientInnerOne) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(4, 10, 1, 1);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  SoftmaxLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNSoftmaxLayerTest : public GPUDeviceTest<Dtype> {
@@ -95,6 +95,39 @@ TYPED_TEST(SoftmaxWithLossLayerTest, TestGradientIgnoreLabel) {
       this->blob_top_vec_, 0);
 }
 
+TYPED_TEST(SoftmaxWithLossLayerTest, TestProbTopMatchesFused) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Without a probability top the loss and gradient are computed from the
+  // predictions directly; they must match the path that runs the softmax.
+  LayerParameter layer_param;
+  layer_param.mutable_loss_param()->set_ignore_label(1);
+  SoftmaxWithLossLayer<Dtype> fused_layer(layer_param);
+  fused_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  fused_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype fused_loss = this->blob_top_loss_->cpu_data()[0];
+  vector<bool> propagate_down(2, false);
+  propagate_down[0] = true;
+  fused_layer.Backward(this->blob_top_vec_, propagate_down,
+      this->blob_bottom_vec_);
+  Blob<Dtype> fused_diff;
+  fused_diff.CopyFrom(*this->blob_bottom_data_, true, true);
+
+  Blob<Dtype> prob;
+  vector<Blob<Dtype>*> top_vec(this->blob_top_vec_);
+  top_vec.push_back(&prob);
+  layer_param.add_loss_weight(1);
+  layer_param.add_loss_weight(0);
+  SoftmaxWithLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, top_vec);
+  layer.Forward(this->blob_bottom_vec_, top_vec);
+  EXPECT_NEAR(fused_loss, this->blob_top_loss_->cpu_data()[0], 1e-4);
+  layer.Backward(top_vec, propagate_down, this->blob_bottom_vec_);
+  for (int i = 0; i < fused_diff.count(); ++i) {
+    EXPECT_NEAR(fused_diff.cpu_diff()[i],
+        this->blob_bottom_data_->cpu_diff()[i], 1e-5);
+  }
+}
+
 TYPED_TEST(SoftmaxWithLossLayerTest, TestGradientUnnormalized) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -0,0 +1,108 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/sparse_matrix.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class SparseMatrixTest : public ::testing::Test {
+ protected:
+  SparseMatrixTest() : rows_(12), cols_(20), N_(5) {}
+
+  // Fills a (rows x cols) blob, keeping every stride-th value only.
+  void Fill(int rows, int cols, int stride, Blob<Dtype>* blob) {
+    blob->Reshape(rows, cols, 1, 1);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob);
+    Dtype* data = blob->mutable_cpu_data();
+    for (int i = 0; i < blob->count(); ++i) {
+      if (i % stride) { data[i] = 0; }
+    }
+  }
+
+  void Check(const Blob<Dtype>& expected, const Blob<Dtype>& actual) {
+    ASSERT_EQ(expected.count(), actual.count());
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_NEAR(expected.cpu_data()[i], actual.cpu_data()[i], 1e-5);
+    }
+  }
+
+  const int rows_;
+  const int cols_;
+  const int N_;
+};
+
+TYPED_TEST_CASE(SparseMatrixTest, TestDtypes);
+
+TYPED_TEST(SparseMatrixTest, TestUpdate) {
+  typedef TypeParam Dtype;
+  Blob<Dtype> weights;
+  this->Fill(this->rows_, this->cols_, 4, &weights);
+  SparseMatrix<Dtype> sparse;
+  EXPECT_FALSE(sparse.Update(weights, this->rows_, 0.8));
+  EXPECT_FALSE(sparse.active());
+  ASSERT_TRUE(sparse.Update(weights, this->rows_, 0.5));
+  EXPECT_EQ(this->rows_, sparse.rows());
+  EXPECT_EQ(this->cols_, sparse.cols());
+  EXPECT_EQ(weights.count() / 4, sparse.nnz());
+  // Writing the weights rebuilds the copy.
+  weights.mutable_cpu_data()[1] = 1;
+  ASSERT_TRUE(sparse.Update(weights, this->rows_, 0.5));
+  EXPECT_EQ(weights.count() / 4 + 1, sparse.nnz());
+  // So do new weights, which may be allocated where the old ones were.
+  shared_ptr<Blob<Dtype> > other(new Blob<Dtype>());
+  this->Fill(this->rows_, this->cols_, 5, other.get());
+  weights.ShareData(*other);
+  other.reset(new Blob<Dtype>());
+  this->Fill(this->rows_, this->cols_, 2, other.get());
+  ASSERT_TRUE(sparse.Update(*other, this->rows_, 0.5));
+  EXPECT_EQ(other->count() / 2, sparse.nnz());
+}
+
+TYPED_TEST(SparseMatrixTest, TestProducts) {
+  typedef TypeParam Dtype;
+  const int rows = this->rows_;
+  const int cols = this->cols_;
+  const int N = this->N_;
+  Blob<Dtype> A;
+  this->Fill(rows, cols, 3, &A);
+  SparseMatrix<Dtype> sparse;
+  ASSERT_TRUE(sparse.Update(A, rows, 0.5));
+  // Rows 2 to 9 of A times B.
+  Blob<Dtype> B;
+  this->Fill(cols, N, 1, &B);
+  Blob<Dtype> C(7, N, 1, 1);
+  Blob<Dtype> expected(7, N, 1, 1);
+  sparse.Multiply(2, 9, N, B.cpu_data(), C.mutable_cpu_data());
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, 7, N, cols, 1.,
+      A.cpu_data() + 2 * cols, B.cpu_data(), 0., expected.mutable_cpu_data());
+  this->Check(expected, C);
+  // B * A^T, with B (N x cols).
+  this->Fill(N, cols, 1, &B);
+  C.Reshape(N, rows, 1, 1);
+  expected.Reshape(N, rows, 1, 1);
+  sparse.MultiplyTransposedLeft(N, B.cpu_data(), C.mutable_cpu_data());
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, N, rows, cols, 1.,
+      B.cpu_data(), A.cpu_data(), 0., expected.mutable_cpu_data());
+  this->Check(expected, C);
+  // B * A, with B (N x rows) about half zeros, which are skipped.
+  this->Fill(N, rows, 2, &B);
+  C.Reshape(N, cols, 1, 1);
+  expected.Reshape(N, cols, 1, 1);
+  caffe_set(C.count(), Dtype(1), C.mutable_cpu_data());
+  sparse.MultiplyLeft(N, B.cpu_data(), C.mutable_cpu_data());
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, N, cols, rows, 1.,
+      B.cpu_data(), A.cpu_data(), 0., expected.mutable_cpu_data());
+  this->Check(expected, C);
+}
+
+}  // namespace caffe
@@ -67,6 +67,27 @@ TEST_F(SyncedMemoryTest, TestCPUWrite) {
   }
 }
 
+TEST_F(SyncedMemoryTest, TestRelease) {
+  SyncedMemory mem(10);
+  caffe_memset(mem.size(), 1, mem.mutable_cpu_data());
+  const size_t version = mem.version();
+  mem.Release();
+  EXPECT_EQ(mem.head(), SyncedMemory::UNINITIALIZED);
+  EXPECT_EQ(10, mem.size());
+  EXPECT_GT(mem.version(), version);
+  // The memory comes back zero-filled.
+  const char* cpu_data = static_cast<const char*>(mem.cpu_data());
+  for (int i = 0; i < mem.size(); ++i) {
+    EXPECT_EQ(0, cpu_data[i]);
+  }
+  // Memory from outside stays.
+  char external[10] = {3, 3, 3, 3, 3, 3, 3, 3, 3, 3};
+  mem.set_cpu_data(external);
+  mem.Release();
+  EXPECT_EQ(mem.head(), SyncedMemory::HEAD_AT_CPU);
+  EXPECT_EQ(external, mem.cpu_data());
+}
+
 #ifndef CPU_ONLY  // GPU test
 
 TEST_F(SyncedMemoryTest, TestGPURead) {
@@ -0,0 +1,62 @@
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Records which thread ran each item, and how often.
+class RecordingTask : public ParallelTask {
+ public:
+  explicit RecordingTask(int count)
+      : threads_(count, -1), runs_(count, 0), thread_ids_(count) {}
+
+  virtual void Run(int item, int thread) {
+    threads_[item] = thread;
+    ++runs_[item];
+    thread_ids_[item] = boost::this_thread::get_id();
+  }
+
+  vector<int> threads_;
+  vector<int> runs_;
+  vector<boost::thread::id> thread_ids_;
+};
+
+class ThreadPoolTest : public ::testing::Test {};
+
+TEST_F(ThreadPoolTest, TestRun) {
+  ThreadPool pool(3);
+  EXPECT_EQ(3, pool.size());
+  for (int pass = 0; pass < 2; ++pass) {
+    const int count = 10 + pass;
+    RecordingTask task(count);
+    pool.Run(&task, count);
+    for (int i = 0; i < count; ++i) {
+      EXPECT_EQ(1, task.runs_[i]);
+      EXPECT_EQ(i % 3, task.threads_[i]);
+      EXPECT_NE(boost::this_thread::get_id(), task.thread_ids_[i]);
+      // Items of a thread run on the same thread.
+      if (i >= 3) {
+        EXPECT_EQ(task.thread_ids_[i - 3], task.thread_ids_[i]);
+      }
+    }
+  }
+}
+
+TEST_F(ThreadPoolTest, TestInline) {
+  ThreadPool pool(0);
+  RecordingTask task(5);
+  pool.Run(&task, 5);
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(1, task.runs_[i]);
+    EXPECT_EQ(0, task.threads_[i]);
+    EXPECT_EQ(boost::this_thread::get_id(), task.thread_ids_[i]);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,152 @@
+#include <string>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/weight_registry.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class WeightRegistryTest : public ::testing::Test {
+ protected:
+  typedef WeightRegistry<Dtype> Registry;
+
+  shared_ptr<Net<Dtype> > MakeNet(bool flat) {
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        "name: 'SharedNet' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 2 dim: 3 } } "
+        "} "
+        "layer { "
+        "  name: 'innerproduct' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 4 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'innerproduct' "
+        "} ", &param));
+    param.set_flat_params(flat);
+    param.mutable_state()->set_phase(TEST);
+    return shared_ptr<Net<Dtype> >(new Net<Dtype>(param));
+  }
+
+  static const Dtype* weights(const shared_ptr<Net<Dtype> >& net) {
+    return net->params()[0]->cpu_data();
+  }
+};
+
+TYPED_TEST_CASE(WeightRegistryTest, TestDtypes);
+
+TYPED_TEST(WeightRegistryTest, TestCopyOnWrite) {
+  typedef typename TestFixture::Registry Registry;
+  shared_ptr<Net<TypeParam> > writer = this->MakeNet(false);
+  shared_ptr<Net<TypeParam> > snapshot = this->MakeNet(false);
+  shared_ptr<Net<TypeParam> > follower = this->MakeNet(false);
+  const string model = Registry::Attach("", writer.get());
+  Registry::Attach(model, snapshot.get());
+  Registry::Attach(model, follower.get(), Registry::FOLLOW);
+  // The later nets read the weights of the first one.
+  EXPECT_EQ(this->weights(writer), this->weights(snapshot));
+  EXPECT_EQ(this->weights(writer), this->weights(follower));
+  EXPECT_EQ(0, Registry::version(model));
+  // Updating copies the weights away from the snapshot, and moves the
+  // follower along once done.
+  const TypeParam* old_weights = this->weights(writer);
+  const TypeParam value = old_weights[0];
+  Registry::BeginUpdate(writer.get());
+  EXPECT_NE(old_weights, this->weights(writer));
+  EXPECT_EQ(value, this->weights(writer)[0]);
+  EXPECT_EQ(0, Registry::version(model));
+  EXPECT_EQ(old_weights, this->weights(follower));
+  writer->params()[0]->mutable_cpu_data()[0] = value + 1;
+  Registry::EndUpdate(writer.get());
+  EXPECT_EQ(old_weights, this->weights(snapshot));
+  EXPECT_EQ(this->weights(writer), this->weights(follower));
+  EXPECT_EQ(1, Registry::version(model));
+  EXPECT_EQ(0, Registry::version(snapshot.get()));
+  EXPECT_EQ(1, Registry::version(follower.get()));
+  EXPECT_EQ(value, this->weights(snapshot)[0]);
+  EXPECT_EQ(value + 1, this->weights(follower)[0]);
+  // Later updates write in place, until the snapshot catches up, which it
+  // only does to completed versions.
+  const TypeParam* new_weights = this->weights(writer);
+  Registry::BeginUpdate(writer.get());
+  EXPECT_EQ(new_weights, this->weights(writer));
+  EXPECT_FALSE(Registry::Refresh(snapshot.get()));
+  EXPECT_EQ(old_weights, this->weights(snapshot));
+  Registry::EndUpdate(writer.get());
+  EXPECT_TRUE(Registry::Refresh(snapshot.get()));
+  EXPECT_FALSE(Registry::Refresh(snapshot.get()));
+  EXPECT_EQ(new_weights, this->weights(snapshot));
+  Registry::BeginUpdate(writer.get());
+  EXPECT_NE(new_weights, this->weights(writer));
+  EXPECT_FALSE(Registry::Refresh(snapshot.get()));
+  Registry::EndUpdate(writer.get());
+  EXPECT_EQ(2, Registry::version(model));
+  // The model goes with its last net.
+  writer.reset();
+  follower.reset();
+  EXPECT_TRUE(Registry::attached(snapshot.get()));
+  EXPECT_EQ(new_weights, this->weights(snapshot));
+  snapshot.reset();
+  shared_ptr<Net<TypeParam> > net = this->MakeNet(false);
+  Registry::Attach(model, net.get());
+  EXPECT_EQ(0, Registry::version(model));
+}
+
+TYPED_TEST(WeightRegistryTest, TestFlatParams) {
+  typedef typename TestFixture::Registry Registry;
+  shared_ptr<Net<TypeParam> > publisher = this->MakeNet(true);
+  shared_ptr<Net<TypeParam> > flat = this->MakeNet(true);
+  const string model = Registry::Attach("", publisher.get());
+  Registry::Attach(model, flat.get());
+  EXPECT_EQ(this->weights(publisher), this->weights(flat));
+  // The arena of the publisher outlives it.
+  const TypeParam value = this->weights(publisher)[0];
+  publisher.reset();
+  EXPECT_EQ(value, this->weights(flat)[0]);
+  // Updating brings the data back into the arena of the flat net.
+  Registry::BeginUpdate(flat.get());
+  Registry::EndUpdate(flat.get());
+  const vector<Blob<TypeParam>*>& params = flat->learnable_params();
+  ASSERT_EQ(2, params.size());
+  EXPECT_EQ(value, params[0]->cpu_data()[0]);
+  EXPECT_EQ(flat->flat_params()->cpu_data(), params[0]->cpu_data());
+  EXPECT_EQ(params[0]->cpu_data() + params[0]->count(),
+            params[1]->cpu_data());
+}
+
+TYPED_TEST(WeightRegistryTest, TestCopyTrainedLayers) {
+  typedef typename TestFixture::Registry Registry;
+  shared_ptr<Net<TypeParam> > writer = this->MakeNet(false);
+  shared_ptr<Net<TypeParam> > snapshot = this->MakeNet(false);
+  const string model = Registry::Attach("", writer.get());
+  Registry::Attach(model, snapshot.get());
+  const TypeParam* old_weights = this->weights(writer);
+  const TypeParam value = old_weights[0];
+  // Loading weights into the writer is an update too.
+  NetParameter trained;
+  shared_ptr<Net<TypeParam> > source = this->MakeNet(false);
+  source->params()[0]->mutable_cpu_data()[0] = value + 1;
+  source->ToProto(&trained);
+  writer->CopyTrainedLayersFrom(trained);
+  EXPECT_EQ(value + 1, this->weights(writer)[0]);
+  EXPECT_EQ(old_weights, this->weights(snapshot));
+  EXPECT_EQ(value, this->weights(snapshot)[0]);
+  EXPECT_EQ(1, Registry::version(model));
+}
+
+}  // namespace caffe
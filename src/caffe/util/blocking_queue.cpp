@@ -2,7 +2,6 @@
 #include <string>
 
 #include "caffe/data_reader.hpp"
-#include "caffe/layers/base_data_layer.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/util/blocking_queue.hpp"
 
@@ -86,8 +85,6 @@ size_t BlockingQueue<T>::size() const {
   return queue_.size();
 }
 
-template class BlockingQueue<Batch<float>*>;
-template class BlockingQueue<Batch<double>*>;
 template class BlockingQueue<Datum*>;
 template class BlockingQueue<shared_ptr<DataReader::QueuePair> >;
 template class BlockingQueue<P2PSync<float>*>;
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "caffe/util/dag_scheduler.hpp"
+
+namespace caffe {
+
+// Runs ready nodes on one pool thread until a stop marker (-1) comes up.
+class DagScheduler::Worker : public ParallelTask {
+ public:
+  Worker(DagScheduler* scheduler, ParallelTask* task, int num_workers)
+      : scheduler_(scheduler), task_(task), num_workers_(num_workers) {}
+
+  virtual void Run(int item, int thread) {
+    DagScheduler& s = *scheduler_;
+    for (;;) {
+      const int node = s.ready_.pop();
+      if (node < 0) { return; }
+      task_->Run(node, thread);
+      // The last predecessor to finish makes a node ready; the ordering of
+      // the counter passes all their writes on to the node.
+      const vector<int>& successors = s.successors_[node];
+      for (int i = 0; i < successors.size(); ++i) {
+        const int next = successors[i];
+        if (next >= s.begin_ && next <= s.end_ &&
+            s.pending_[next].fetch_sub(1, boost::memory_order_acq_rel) == 1) {
+          s.ready_.push(next);
+        }
+      }
+      if (s.remaining_.fetch_sub(1, boost::memory_order_acq_rel) == 1) {
+        for (int i = 0; i < num_workers_; ++i) {
+          s.ready_.push(-1);
+        }
+      }
+    }
+  }
+
+ private:
+  DagScheduler* scheduler_;
+  ParallelTask* task_;
+  const int num_workers_;
+};
+
+DagScheduler::DagScheduler(const vector<vector<int> >& predecessors,
+    shared_ptr<ThreadPool> pool)
+    : predecessors_(predecessors), successors_(predecessors.size()),
+      pool_(pool), begin_(0), end_(-1),
+      pending_(new boost::atomic<int>[predecessors.size()]), remaining_(0),
+      ready_(predecessors.size() + std::max(pool->size(), 1),
+             RingQueue<int>::MPMC) {
+  for (int node = 0; node < predecessors_.size(); ++node) {
+    for (int i = 0; i < predecessors_[node].size(); ++i) {
+      const int predecessor = predecessors_[node][i];
+      CHECK_GE(predecessor, 0);
+      CHECK_LT(predecessor, num_nodes());
+      CHECK_NE(predecessor, node);
+      successors_[predecessor].push_back(node);
+    }
+  }
+}
+
+void DagScheduler::Run(int begin, int end, ParallelTask* task) {
+  CHECK_GE(begin, 0);
+  CHECK_LT(end, num_nodes());
+  if (begin > end) { return; }
+  begin_ = begin;
+  end_ = end;
+  for (int node = begin; node <= end; ++node) {
+    int pending = 0;
+    for (int i = 0; i < predecessors_[node].size(); ++i) {
+      const int predecessor = predecessors_[node][i];
+      pending += (predecessor >= begin && predecessor <= end);
+    }
+    pending_[node].store(pending, boost::memory_order_relaxed);
+  }
+  remaining_.store(end - begin + 1, boost::memory_order_relaxed);
+  for (int node = begin; node <= end; ++node) {
+    if (pending_[node].load(boost::memory_order_relaxed) == 0) {
+      ready_.push(node);
+    }
+  }
+  const int num_workers = std::max(pool_->size(), 1);
+  Worker worker(this, task, num_workers);
+  pool_->Run(&worker, num_workers);
+}
+
+vector<vector<int> > DagScheduler::Dependencies(const vector<int>& order,
+    const vector<vector<const void*> >& reads,
+    const vector<vector<const void*> >& writes) {
+  CHECK_EQ(reads.size(), writes.size());
+  vector<vector<int> > predecessors(reads.size());
+  std::map<const void*, int> last_writer;
+  std::map<const void*, vector<int> > readers;
+  for (int i = 0; i < order.size(); ++i) {
+    const int step = order[i];
+    vector<int>& depends = predecessors[step];
+    for (int j = 0; j < reads[step].size(); ++j) {
+      std::map<const void*, int>::const_iterator writer =
+          last_writer.find(reads[step][j]);
+      if (writer != last_writer.end()) {
+        depends.push_back(writer->second);
+      }
+    }
+    for (int j = 0; j < writes[step].size(); ++j) {
+      const void* resource = writes[step][j];
+      std::map<const void*, int>::const_iterator writer =
+          last_writer.find(resource);
+      if (writer != last_writer.end()) {
+        depends.push_back(writer->second);
+      }
+      const vector<int>& resource_readers = readers[resource];
+      depends.insert(depends.end(), resource_readers.begin(),
+                     resource_readers.end());
+    }
+    for (int j = 0; j < reads[step].size(); ++j) {
+      readers[reads[step][j]].push_back(step);
+    }
+    for (int j = 0; j < writes[step].size(); ++j) {
+      last_writer[writes[step][j]] = step;
+      readers[writes[step][j]].clear();
+    }
+    std::sort(depends.begin(), depends.end());
+    depends.erase(std::unique(depends.begin(), depends.end()), depends.end());
+  }
+  return predecessors;
+}
+
+}  // namespace caffe
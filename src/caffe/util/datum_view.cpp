@@ -0,0 +1,97 @@
+#include <string>
+
+#include "caffe/util/datum_view.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Protocol buffer wire types.
+enum { kVarint = 0, kFixed64 = 1, kLengthDelimited = 2, kFixed32 = 5 };
+
+// Reads a base 128 varint at *p, advancing *p; returns false on overrun.
+bool read_varint(const uint8_t** p, const uint8_t* end, uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+    const uint8_t byte = *(*p)++;
+    *value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+void DatumView::Parse(const char* bytes, size_t size) {
+  is_view_ = ParseInPlace(bytes, size);
+  if (!is_view_) {
+    CHECK(datum_.ParseFromArray(bytes, size)) << "Failed to parse Datum";
+  }
+}
+
+void DatumView::Parse(const string& bytes) {
+  is_view_ = false;
+  CHECK(datum_.ParseFromString(bytes)) << "Failed to parse Datum";
+}
+
+bool DatumView::ParseInPlace(const char* bytes, size_t size) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(bytes);
+  const uint8_t* end = p + size;
+  channels_ = height_ = width_ = label_ = 0;
+  data_ = NULL;
+  data_size_ = 0;
+  while (p < end) {
+    uint64_t tag, value;
+    if (!read_varint(&p, end, &tag)) {
+      return false;
+    }
+    const int field = tag >> 3;
+    switch (tag & 7) {
+    case kVarint:
+      if (!read_varint(&p, end, &value)) {
+        return false;
+      }
+      switch (field) {
+      case 1: channels_ = static_cast<int32_t>(value); break;
+      case 2: height_ = static_cast<int32_t>(value); break;
+      case 3: width_ = static_cast<int32_t>(value); break;
+      case 5: label_ = static_cast<int32_t>(value); break;
+      case 7: if (value) { return false; } break;  // encoded
+      }
+      break;
+    case kLengthDelimited:
+      if (!read_varint(&p, end, &value) ||
+          value > static_cast<uint64_t>(end - p)) {
+        return false;
+      }
+      if (field == 4) {
+        data_ = p;
+        data_size_ = value;
+      } else if (field == 6) {
+        return false;  // packed float_data
+      }
+      p += value;
+      break;
+    case kFixed32:
+      if (field == 6 || end - p < 4) {
+        return false;  // float_data
+      }
+      p += 4;
+      break;
+    case kFixed64:
+      if (end - p < 8) {
+        return false;
+      }
+      p += 8;
+      break;
+    default:
+      return false;
+    }
+  }
+  return data_size_ > 0 &&
+      data_size_ == static_cast<size_t>(channels_) * height_ * width_;
+}
+
+}  // namespace caffe
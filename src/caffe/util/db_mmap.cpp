@@ -0,0 +1,212 @@
+#include "caffe/util/db_mmap.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "caffe/util/format.hpp"
+#include "caffe/util/rng.hpp"
+
+namespace caffe { namespace db {
+
+static const char kMmapMagic[8] = {'C', 'A', 'F', 'F', 'E', 'M', 'M', '1'};
+
+static string shard_filename(const string& source, int shard) {
+  return source + "/shard_" + format_int(shard, 5);
+}
+
+void MmapDB::Open(const string& source, Mode mode) {
+  CHECK(shards_.empty() && file_ == NULL) << "DB already open";
+  source_ = source;
+  if (mode == NEW) {
+    CHECK_EQ(mkdir(source.c_str(), 0744), 0) << "mkdir " << source << " failed";
+  }
+  struct stat st;
+  for (num_shards_ = 0;
+       stat(shard_filename(source, num_shards_).c_str(), &st) == 0;
+       ++num_shards_) {
+    if (mode == READ) {
+      MapShard(shard_filename(source, num_shards_));
+    }
+  }
+  if (mode != READ) {
+    // Records are appended in new shards.
+    LOG(INFO) << "Opened mmap db " << source;
+    return;
+  }
+  CHECK(!shards_.empty()) << "No shards in mmap db " << source;
+  LOG(INFO) << "Opened mmap db " << source << " with " << num_records_
+            << " records in " << shards_.size() << " shards";
+}
+
+void MmapDB::MapShard(const string& filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_GE(fd, 0) << "Failed to open " << filename;
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0) << "Failed to stat " << filename;
+  const size_t size = st.st_size;
+  CHECK_GE(size, sizeof(MmapFooter)) << "Truncated shard " << filename;
+  void* data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  CHECK(data != MAP_FAILED) << "Failed to map " << filename;
+
+  Shard shard;
+  shard.data = static_cast<const char*>(data);
+  shard.size = size;
+  const MmapFooter* footer = reinterpret_cast<const MmapFooter*>(
+      shard.data + size - sizeof(MmapFooter));
+  CHECK_EQ(memcmp(footer->magic, kMmapMagic, sizeof(kMmapMagic)), 0)
+      << "Not an mmap db shard (or not finished): " << filename;
+  CHECK_LE(footer->index_offset + footer->count * sizeof(MmapIndexEntry),
+           size - sizeof(MmapFooter)) << "Corrupt index in " << filename;
+  shard.index = reinterpret_cast<const MmapIndexEntry*>(
+      shard.data + footer->index_offset);
+  shards_.push_back(shard);
+  num_records_ += footer->count;
+  shard_ends_.push_back(num_records_);
+}
+
+void MmapDB::Close() {
+  if (file_ != NULL) {
+    FinishShard();
+  }
+  for (int i = 0; i < shards_.size(); ++i) {
+    munmap(const_cast<char*>(shards_[i].data), shards_[i].size);
+  }
+  shards_.clear();
+  shard_ends_.clear();
+  num_records_ = 0;
+}
+
+MmapCursor* MmapDB::NewCursor() {
+  return new MmapCursor(this);
+}
+
+MmapTransaction* MmapDB::NewTransaction() {
+  return new MmapTransaction(this);
+}
+
+void MmapDB::Append(const string& key, const string& value) {
+  if (file_ == NULL) {
+    const string filename = shard_filename(source_, num_shards_);
+    file_ = fopen(filename.c_str(), "wb");
+    CHECK(file_ != NULL) << "Failed to create " << filename;
+  }
+  MmapIndexEntry entry;
+  entry.offset = shard_bytes_;
+  entry.key_size = key.size();
+  entry.value_size = value.size();
+  CHECK_EQ(fwrite(key.data(), 1, key.size(), file_), key.size());
+  CHECK_EQ(fwrite(value.data(), 1, value.size(), file_), value.size());
+  index_.push_back(entry);
+  shard_bytes_ += key.size() + value.size();
+  ++num_records_;
+  if (shard_bytes_ >= max_shard_bytes_) {
+    FinishShard();
+  }
+}
+
+void MmapDB::Flush() {
+  if (file_ != NULL) {
+    CHECK_EQ(fflush(file_), 0) << "Failed to write mmap db " << source_;
+  }
+}
+
+void MmapDB::FinishShard() {
+  // Align the index for direct access through the mapping.
+  const char padding[8] = {0};
+  const size_t padding_size = (8 - shard_bytes_ % 8) % 8;
+  CHECK_EQ(fwrite(padding, 1, padding_size, file_), padding_size);
+  MmapFooter footer;
+  footer.index_offset = shard_bytes_ + padding_size;
+  footer.count = index_.size();
+  memcpy(footer.magic, kMmapMagic, sizeof(kMmapMagic));
+  if (!index_.empty()) {
+    CHECK_EQ(fwrite(&index_[0], sizeof(MmapIndexEntry), index_.size(), file_),
+             index_.size());
+  }
+  CHECK_EQ(fwrite(&footer, sizeof(footer), 1, file_), 1);
+  CHECK_EQ(fclose(file_), 0) << "Failed to write mmap db " << source_;
+  file_ = NULL;
+  ++num_shards_;
+  shard_bytes_ = 0;
+  index_.clear();
+}
+
+void MmapTransaction::Put(const string& key, const string& value) {
+  db_->Append(key, value);
+}
+
+void MmapTransaction::Commit() {
+  db_->Flush();
+}
+
+MmapCursor::MmapCursor(const MmapDB* db)
+    : db_(db), order_(db->num_records()), position_(0) {
+  for (size_t i = 0; i < order_.size(); ++i) {
+    order_[i] = i;
+  }
+}
+
+void MmapCursor::SeekToFirst() {
+  position_ = 0;
+  if (rng_) {
+    shuffle(order_.begin(), order_.end(),
+            static_cast<caffe::rng_t*>(rng_->generator()));
+  }
+}
+
+void MmapCursor::Next() {
+  ++position_;
+}
+
+bool MmapCursor::Shuffle(unsigned int seed) {
+  rng_.reset(new Caffe::RNG(seed));
+  // Reads no longer follow the file order, so read ahead is wasted.
+  for (int i = 0; i < db_->shards_.size(); ++i) {
+    madvise(const_cast<char*>(db_->shards_[i].data), db_->shards_[i].size,
+            MADV_RANDOM);
+  }
+  SeekToFirst();
+  return true;
+}
+
+const MmapIndexEntry& MmapCursor::entry(const char** shard_data) const {
+  DCHECK_LT(position_, order_.size());
+  const size_t record = order_[position_];
+  const int shard = std::upper_bound(db_->shard_ends_.begin(),
+      db_->shard_ends_.end(), record) - db_->shard_ends_.begin();
+  const size_t shard_begin = shard > 0 ? db_->shard_ends_[shard - 1] : 0;
+  *shard_data = db_->shards_[shard].data;
+  return db_->shards_[shard].index[record - shard_begin];
+}
+
+string MmapCursor::key() {
+  const char* shard;
+  const MmapIndexEntry& e = entry(&shard);
+  return string(shard + e.offset, e.key_size);
+}
+
+string MmapCursor::value() {
+  const char* data;
+  size_t size;
+  value_view(&data, &size);
+  return string(data, size);
+}
+
+bool MmapCursor::value_view(const char** data, size_t* size) {
+  const char* shard;
+  const MmapIndexEntry& e = entry(&shard);
+  *data = shard + e.offset + e.key_size;
+  *size = e.value_size;
+  return true;
+}
+
+}  // namespace db
+}  // namespace caffe
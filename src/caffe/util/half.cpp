@@ -0,0 +1,82 @@
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/half.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Reads the data (or diff) of blob, in whichever field holds it.
+void ReadValues(const BlobProto& blob, bool diff, vector<double>* values) {
+  const string& half = diff ? blob.half_diff() : blob.half_data();
+  const int double_size = diff ? blob.double_diff_size() :
+      blob.double_data_size();
+  const int float_size = diff ? blob.diff_size() : blob.data_size();
+  values->clear();
+  if (!half.empty()) {
+    CHECK_EQ(half.size() % 2, 0) << "Truncated half precision values.";
+    for (int i = 0; i < half_count(half); ++i) {
+      values->push_back(half_value(half, i, blob.precision()));
+    }
+  } else if (double_size > 0) {
+    for (int i = 0; i < double_size; ++i) {
+      values->push_back(diff ? blob.double_diff(i) : blob.double_data(i));
+    }
+  } else {
+    for (int i = 0; i < float_size; ++i) {
+      values->push_back(diff ? blob.diff(i) : blob.data(i));
+    }
+  }
+}
+
+}  // namespace
+
+void ConvertBlobPrecision(BlobProto* blob, BlobProto::Precision precision) {
+  if (blob->precision() == precision) { return; }
+  vector<double> data;
+  vector<double> diff;
+  ReadValues(*blob, false, &data);
+  ReadValues(*blob, true, &diff);
+  blob->clear_data();
+  blob->clear_diff();
+  blob->clear_double_data();
+  blob->clear_double_diff();
+  blob->clear_half_data();
+  blob->clear_half_diff();
+  if (precision == BlobProto::FLOAT) {
+    blob->clear_precision();
+    for (int i = 0; i < data.size(); ++i) {
+      blob->add_data(data[i]);
+    }
+    for (int i = 0; i < diff.size(); ++i) {
+      blob->add_diff(diff[i]);
+    }
+    return;
+  }
+  blob->set_precision(precision);
+  string* half_data = blob->mutable_half_data();
+  half_data->reserve(2 * data.size());
+  for (int i = 0; i < data.size(); ++i) {
+    append_half(data[i], precision, half_data);
+  }
+  if (!diff.empty()) {
+    string* half_diff = blob->mutable_half_diff();
+    half_diff->reserve(2 * diff.size());
+    for (int i = 0; i < diff.size(); ++i) {
+      append_half(diff[i], precision, half_diff);
+    }
+  }
+}
+
+void ConvertNetPrecision(NetParameter* net, BlobProto::Precision precision) {
+  for (int i = 0; i < net->layer_size(); ++i) {
+    LayerParameter* layer = net->mutable_layer(i);
+    for (int j = 0; j < layer->blobs_size(); ++j) {
+      ConvertBlobPrecision(layer->mutable_blobs(j), precision);
+    }
+  }
+}
+
+}  // namespace caffe
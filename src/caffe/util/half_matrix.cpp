@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/util/half.hpp"
+#include "caffe/util/half_matrix.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+namespace {
+
+// The bytes of the expanded panel of rows, sized to stay in the L2 cache
+// while the BLAS works through it.
+const int kPanelBytes = 64 * 1024;
+
+// Row-major GEMM with explicit leading dimensions, for the column slices
+// of B and C.
+inline void gemm(const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const float* A, const int lda,
+    const float* B, const int ldb, const float beta, float* C,
+    const int ldc) {
+  cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, 1.f, A, lda, B, ldb,
+      beta, C, ldc);
+}
+
+inline void gemm(const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const double* A, const int lda,
+    const double* B, const int ldb, const double beta, double* C,
+    const int ldc) {
+  cblas_dgemm(CblasRowMajor, TransA, TransB, M, N, K, 1., A, lda, B, ldb,
+      beta, C, ldc);
+}
+
+}  // namespace
+
+template <typename Dtype>
+bool HalfMatrix<Dtype>::Update(const Blob<Dtype>& weights, const int rows,
+    const BlobProto::Precision precision) {
+  const shared_ptr<SyncedMemory>& source = weights.data();
+  if (source == source_.lock() && source->version() == source_version_ &&
+      precision == precision_) {
+    return active();
+  }
+  precision_ = precision;
+  if (!active()) {
+    source_.reset();
+    std::vector<uint16_t>().swap(values_);
+    std::vector<Dtype>().swap(panel_);
+    return false;
+  }
+  CHECK_GT(rows, 0);
+  CHECK_EQ(weights.count() % rows, 0);
+  const int count = weights.count();
+  const Dtype* dense = weights.cpu_data();
+  source_ = source;
+  source_version_ = source->version();
+  rows_ = rows;
+  cols_ = count / rows;
+  values_.resize(count);
+  if (precision_ == BlobProto::BFLOAT16) {
+    for (int i = 0; i < count; ++i) {
+      values_[i] = float_to_bf16(dense[i]);
+    }
+  } else {
+    for (int i = 0; i < count; ++i) {
+      values_[i] = float_to_fp16(dense[i]);
+    }
+  }
+  panel_rows_ = std::min(rows_, std::max(1,
+      kPanelBytes / static_cast<int>(cols_ * sizeof(Dtype))));
+  panel_.resize(panel_rows_ * cols_);
+  return true;
+}
+
+template <typename Dtype>
+void HalfMatrix<Dtype>::ExpandRows(const int row_begin, const int row_end) {
+  DCHECK_LE(row_end - row_begin, panel_rows_);
+  const uint16_t* half = &values_[row_begin * cols_];
+  const int count = (row_end - row_begin) * cols_;
+  Dtype* panel = &panel_[0];
+  if (precision_ == BlobProto::BFLOAT16) {
+    for (int i = 0; i < count; ++i) {
+      panel[i] = bf16_to_float(half[i]);
+    }
+  } else {
+    for (int i = 0; i < count; ++i) {
+      panel[i] = fp16_to_float(half[i]);
+    }
+  }
+}
+
+template <typename Dtype>
+void HalfMatrix<Dtype>::Multiply(const int row_begin, const int row_end,
+    const int N, const Dtype* B, Dtype* C) {
+  DCHECK(active());
+  DCHECK_GE(row_begin, 0);
+  DCHECK_LE(row_end, rows_);
+  for (int r = row_begin; r < row_end; r += panel_rows_) {
+    const int panel_end = std::min(r + panel_rows_, row_end);
+    ExpandRows(r, panel_end);
+    gemm(CblasNoTrans, CblasNoTrans, panel_end - r, N, cols_, &panel_[0],
+        cols_, B, N, Dtype(0), C + (r - row_begin) * N, N);
+  }
+}
+
+template <typename Dtype>
+void HalfMatrix<Dtype>::MultiplyTransposedLeft(const int M, const Dtype* B,
+    Dtype* C) {
+  DCHECK(active());
+  for (int r = 0; r < rows_; r += panel_rows_) {
+    const int panel_end = std::min(r + panel_rows_, rows_);
+    ExpandRows(r, panel_end);
+    // C[:, r:panel_end] = B * panel^T
+    gemm(CblasNoTrans, CblasTrans, M, panel_end - r, cols_, B, cols_,
+        &panel_[0], cols_, Dtype(0), C + r, rows_);
+  }
+}
+
+template <typename Dtype>
+void HalfMatrix<Dtype>::MultiplyLeft(const int M, const Dtype* B, Dtype* C) {
+  DCHECK(active());
+  for (int r = 0; r < rows_; r += panel_rows_) {
+    const int panel_end = std::min(r + panel_rows_, rows_);
+    ExpandRows(r, panel_end);
+    // C += B[:, r:panel_end] * panel
+    gemm(CblasNoTrans, CblasNoTrans, M, cols_, panel_end - r, B + r, rows_,
+        &panel_[0], cols_, Dtype(r > 0), C, cols_);
+  }
+}
+
+INSTANTIATE_CLASS(HalfMatrix);
+
+}  // namespace caffe
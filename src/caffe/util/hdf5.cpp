@@ -6,11 +6,8 @@
 
 namespace caffe {
 
-// Verifies format of data stored in HDF5 file and reshapes blob accordingly.
-template <typename Dtype>
-void hdf5_load_nd_dataset_helper(
-    hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
-    Blob<Dtype>* blob) {
+std::vector<hsize_t> hdf5_get_nd_dataset_dims(
+    hid_t file_id, const char* dataset_name_, int min_dim, int max_dim) {
   // Verify that the dataset exists.
   CHECK(H5LTfind_dataset(file_id, dataset_name_))
       << "Failed to find HDF5 dataset " << dataset_name_;
@@ -56,7 +53,16 @@ void hdf5_load_nd_dataset_helper(
   default:
     LOG(FATAL) << "Datatype class unknown";
   }
+  return dims;
+}
 
+// Verifies format of data stored in HDF5 file and reshapes blob accordingly.
+template <typename Dtype>
+void hdf5_load_nd_dataset_helper(
+    hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
+    Blob<Dtype>* blob) {
+  const std::vector<hsize_t> dims =
+      hdf5_get_nd_dataset_dims(file_id, dataset_name_, min_dim, max_dim);
   vector<int> blob_dims(dims.size());
   for (int i = 0; i < dims.size(); ++i) {
     blob_dims[i] = dims[i];
@@ -82,6 +88,53 @@ void hdf5_load_nd_dataset<double>(hid_t file_id, const char* dataset_name_,
   CHECK_GE(status, 0) << "Failed to read double dataset " << dataset_name_;
 }
 
+template <typename Dtype>
+static void hdf5_load_nd_dataset_rows_helper(
+    hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
+    hsize_t row_begin, hsize_t num_rows, hid_t mem_type, Blob<Dtype>* blob) {
+  // Only the rows are shaped, so the dataset may be larger than a Blob.
+  const std::vector<hsize_t> dims =
+      hdf5_get_nd_dataset_dims(file_id, dataset_name_, min_dim, max_dim);
+  CHECK_LE(row_begin + num_rows, dims[0])
+      << "Rows out of range for " << dataset_name_;
+  vector<int> shape(dims.begin(), dims.end());
+  shape[0] = num_rows;
+  blob->Reshape(shape);
+
+  hid_t dataset = H5Dopen2(file_id, dataset_name_, H5P_DEFAULT);
+  CHECK_GE(dataset, 0) << "Failed to open dataset " << dataset_name_;
+  hid_t file_space = H5Dget_space(dataset);
+  std::vector<hsize_t> start(shape.size(), 0);
+  std::vector<hsize_t> count(shape.begin(), shape.end());
+  start[0] = row_begin;
+  herr_t status = H5Sselect_hyperslab(file_space, H5S_SELECT_SET,
+      start.data(), NULL, count.data(), NULL);
+  CHECK_GE(status, 0) << "Failed to select rows of " << dataset_name_;
+  hid_t mem_space = H5Screate_simple(count.size(), count.data(), NULL);
+  status = H5Dread(dataset, mem_type, mem_space, file_space, H5P_DEFAULT,
+      blob->mutable_cpu_data());
+  CHECK_GE(status, 0) << "Failed to read rows of " << dataset_name_;
+  H5Sclose(mem_space);
+  H5Sclose(file_space);
+  H5Dclose(dataset);
+}
+
+template <>
+void hdf5_load_nd_dataset_rows<float>(hid_t file_id, const char* dataset_name_,
+    int min_dim, int max_dim, hsize_t row_begin, hsize_t num_rows,
+    Blob<float>* blob) {
+  hdf5_load_nd_dataset_rows_helper(file_id, dataset_name_, min_dim, max_dim,
+      row_begin, num_rows, H5T_NATIVE_FLOAT, blob);
+}
+
+template <>
+void hdf5_load_nd_dataset_rows<double>(hid_t file_id, const char* dataset_name_,
+    int min_dim, int max_dim, hsize_t row_begin, hsize_t num_rows,
+    Blob<double>* blob) {
+  hdf5_load_nd_dataset_rows_helper(file_id, dataset_name_, min_dim, max_dim,
+      row_begin, num_rows, H5T_NATIVE_DOUBLE, blob);
+}
+
 template <>
 void hdf5_save_nd_dataset<float>(
     const hid_t file_id, const string& dataset_name, const Blob<float>& blob,
@@ -185,5 +238,10 @@ string hdf5_get_name_by_idx(hid_t loc_id, int idx) {
   return result;
 }
 
+boost::mutex& hdf5_mutex() {
+  static boost::mutex mutex;
+  return mutex;
+}
+
 }  // namespace caffe
 #endif  // USE_HDF5
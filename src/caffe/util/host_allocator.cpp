@@ -0,0 +1,137 @@
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/host_allocator.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Alignment of pooled buffers, a cache line and the widest SIMD register.
+const size_t kAlignment = 64;
+
+struct Pool {
+  Pool() : type(HostAllocator::MALLOC), max_bytes_cached(0) {}
+
+  boost::atomic<int> type;
+  boost::mutex mutex;
+  // Freed buffers, by size class.
+  std::map<size_t, std::vector<void*> > free_lists;
+  size_t max_bytes_cached;
+  HostAllocatorStats stats;
+};
+
+// Never destroyed, as blobs may be freed by static destructors.
+Pool& pool() {
+  static Pool* pool = new Pool();
+  return *pool;
+}
+
+}  // namespace
+
+void HostAllocator::set_type(Type type) {
+  pool().type.store(type, boost::memory_order_relaxed);
+}
+
+HostAllocator::Type HostAllocator::type() {
+  return static_cast<Type>(pool().type.load(boost::memory_order_relaxed));
+}
+
+void HostAllocator::set_max_bytes_cached(size_t bytes) {
+  Pool& p = pool();
+  boost::mutex::scoped_lock lock(p.mutex);
+  p.max_bytes_cached = bytes;
+}
+
+size_t HostAllocator::SizeClass(size_t size) {
+  if (size <= kAlignment) {
+    return kAlignment;
+  }
+  // Four classes per power of two bound the waste to a quarter.
+  size_t base = 1;
+  while (base * 2 < size) {
+    base *= 2;
+  }
+  const size_t step = base / 4;
+  return (size + step - 1) / step * step;
+}
+
+void* HostAllocator::Allocate(size_t size, bool* pooled) {
+  if (type() == MALLOC) {
+    *pooled = false;
+    return malloc(size);
+  }
+  *pooled = true;
+  const size_t size_class = SizeClass(size);
+  Pool& p = pool();
+  {
+    boost::mutex::scoped_lock lock(p.mutex);
+    ++p.stats.allocations;
+    p.stats.bytes_in_use += size_class;
+    if (p.stats.bytes_in_use > p.stats.peak_bytes_in_use) {
+      p.stats.peak_bytes_in_use = p.stats.bytes_in_use;
+    }
+    std::vector<void*>& free_list = p.free_lists[size_class];
+    if (!free_list.empty()) {
+      void* ptr = free_list.back();
+      free_list.pop_back();
+      ++p.stats.hits;
+      p.stats.bytes_cached -= size_class;
+      return ptr;
+    }
+  }
+  void* ptr = NULL;
+  if (posix_memalign(&ptr, kAlignment, size_class) != 0) {
+    ptr = NULL;
+  }
+  return ptr;
+}
+
+void HostAllocator::Free(void* ptr, size_t size, bool pooled) {
+  if (!pooled) {
+    free(ptr);
+    return;
+  }
+  const size_t size_class = SizeClass(size);
+  Pool& p = pool();
+  {
+    boost::mutex::scoped_lock lock(p.mutex);
+    p.stats.bytes_in_use -= size_class;
+    if (p.max_bytes_cached == 0 ||
+        p.stats.bytes_cached + size_class <= p.max_bytes_cached) {
+      p.free_lists[size_class].push_back(ptr);
+      p.stats.bytes_cached += size_class;
+      return;
+    }
+  }
+  free(ptr);
+}
+
+void HostAllocator::ReleaseCached() {
+  std::map<size_t, std::vector<void*> > free_lists;
+  Pool& p = pool();
+  {
+    boost::mutex::scoped_lock lock(p.mutex);
+    free_lists.swap(p.free_lists);
+    p.stats.bytes_cached = 0;
+  }
+  for (std::map<size_t, std::vector<void*> >::iterator it =
+       free_lists.begin(); it != free_lists.end(); ++it) {
+    for (int i = 0; i < it->second.size(); ++i) {
+      free(it->second[i]);
+    }
+  }
+}
+
+HostAllocatorStats HostAllocator::stats() {
+  Pool& p = pool();
+  boost::mutex::scoped_lock lock(p.mutex);
+  return p.stats;
+}
+
+}  // namespace caffe
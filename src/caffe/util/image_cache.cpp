@@ -0,0 +1,70 @@
+#ifdef USE_OPENCV
+#include <boost/thread.hpp>
+#include <opencv2/core/core.hpp>
+
+#include <string>
+#include <utility>
+
+#include "caffe/util/image_cache.hpp"
+
+namespace caffe {
+
+static size_t image_bytes(const cv::Mat& image) {
+  return image.total() * image.elemSize();
+}
+
+ImageCache::ImageCache(size_t capacity)
+    : capacity_(capacity), size_(0), hits_(0), misses_(0),
+      mutex_(new boost::mutex()) {
+}
+
+cv::Mat ImageCache::Get(const string& key) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  std::map<string, Entries::iterator>::iterator it = index_.find(key);
+  if (it == index_.end()) {
+    ++misses_;
+    return cv::Mat();
+  }
+  ++hits_;
+  // Move the entry to the front.
+  entries_.splice(entries_.begin(), entries_, it->second);
+  return it->second->second;
+}
+
+void ImageCache::Put(const string& key, const cv::Mat& image) {
+  const size_t bytes = image_bytes(image);
+  if (bytes > capacity_) {
+    return;
+  }
+  boost::mutex::scoped_lock lock(*mutex_);
+  if (index_.count(key)) {
+    // Decoded concurrently by another thread.
+    return;
+  }
+  while (size_ + bytes > capacity_) {
+    size_ -= image_bytes(entries_.back().second);
+    index_.erase(entries_.back().first);
+    entries_.pop_back();
+  }
+  entries_.push_front(std::make_pair(key, image));
+  index_[key] = entries_.begin();
+  size_ += bytes;
+}
+
+size_t ImageCache::size() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return size_;
+}
+
+int ImageCache::hits() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return hits_;
+}
+
+int ImageCache::misses() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return misses_;
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
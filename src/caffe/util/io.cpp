@@ -70,11 +70,77 @@ void WriteProtoToBinaryFile(const Message& proto, const char* filename) {
 }
 
 #ifdef USE_OPENCV
+// imread can decode JPEGs at 1/2, 1/4 or 1/8 scale since OpenCV 3.1.
+#if CV_MAJOR_VERSION > 3 || (CV_MAJOR_VERSION == 3 && CV_MINOR_VERSION >= 1)
+#define CAFFE_REDUCED_IMREAD
+#endif
+
+#ifdef CAFFE_REDUCED_IMREAD
+// Reads the dimensions of a JPEG from its frame header, without decoding it;
+// returns false for other formats.
+static bool ReadJPEGSize(const string& filename, int* height, int* width) {
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  unsigned char b[9];
+  if (!file.read(reinterpret_cast<char*>(b), 2) ||
+      b[0] != 0xFF || b[1] != 0xD8) {
+    return false;
+  }
+  // Skip the segments before the first start of frame (SOF0 to SOF15,
+  // except DHT, JPG and DAC).
+  while (file.read(reinterpret_cast<char*>(b), 4) && b[0] == 0xFF) {
+    const int marker = b[1];
+    if (marker >= 0xC0 && marker <= 0xCF &&
+        marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+      if (!file.read(reinterpret_cast<char*>(b + 4), 5)) {
+        return false;
+      }
+      *height = (b[5] << 8) | b[6];
+      *width = (b[7] << 8) | b[8];
+      return *height > 0 && *width > 0;
+    }
+    file.seekg(((b[2] << 8) | b[3]) - 2, std::ios::cur);
+  }
+  return false;
+}
+
+// The imread flag that decodes a JPEG at the smallest scale that still
+// covers height x width, or cv_read_flag if none does.
+static int ReducedReadFlag(const string& filename, const int height,
+    const int width, const int cv_read_flag) {
+  int jpeg_height, jpeg_width;
+  if (!ReadJPEGSize(filename, &jpeg_height, &jpeg_width)) {
+    return cv_read_flag;
+  }
+  // EXIF orientation may transpose the decoded image.
+  const int jpeg_size = std::min(jpeg_height, jpeg_width);
+  const int size = std::max(height, width);
+  const bool is_color = cv_read_flag == CV_LOAD_IMAGE_COLOR;
+  if (jpeg_size >= 8 * size) {
+    return is_color ? cv::IMREAD_REDUCED_COLOR_8 :
+        cv::IMREAD_REDUCED_GRAYSCALE_8;
+  } else if (jpeg_size >= 4 * size) {
+    return is_color ? cv::IMREAD_REDUCED_COLOR_4 :
+        cv::IMREAD_REDUCED_GRAYSCALE_4;
+  } else if (jpeg_size >= 2 * size) {
+    return is_color ? cv::IMREAD_REDUCED_COLOR_2 :
+        cv::IMREAD_REDUCED_GRAYSCALE_2;
+  }
+  return cv_read_flag;
+}
+#endif  // CAFFE_REDUCED_IMREAD
+
 cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width, const bool is_color) {
   cv::Mat cv_img;
   int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR :
     CV_LOAD_IMAGE_GRAYSCALE);
+#ifdef CAFFE_REDUCED_IMREAD
+  // When resizing down, let libjpeg scale in the DCT domain, which is several
+  // times faster than a full decode.
+  if (height > 0 && width > 0) {
+    cv_read_flag = ReducedReadFlag(filename, height, width, cv_read_flag);
+  }
+#endif
   cv::Mat cv_img_origin = cv::imread(filename, cv_read_flag);
   if (!cv_img_origin.data) {
     LOG(ERROR) << "Could not open or find file " << filename;
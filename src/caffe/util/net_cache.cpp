@@ -0,0 +1,265 @@
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+#include <google/protobuf/text_format.h>
+#include <stdint.h>
+
+#include <fstream>  // NOLINT(readability/streams)
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include "caffe/net.hpp"
+#include "caffe/util/insert_splits.hpp"
+#include "caffe/util/net_cache.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+namespace caffe {
+
+namespace {
+
+// The version of the files stored in the directory; bump it when their
+// layout changes or UpgradeNetAsNeeded changes what it produces, so that
+// stale files are not loaded.
+const int kFormatVersion = 2;
+
+// A definition, with the bytes it was read or compiled from.
+struct Entry {
+  string source;
+  shared_ptr<const NetParameter> param;
+};
+
+typedef std::map<string, Entry> Entries;
+
+struct Cache {
+  Cache() : hits(0), misses(0) {}
+
+  boost::mutex mutex;
+  // Upgraded definitions by the key of their prototxt, compiled ones by the
+  // key of the definition they were compiled from.
+  Entries read;
+  Entries compiled;
+  string directory;
+  int hits;
+  int misses;
+};
+
+Cache& cache() {
+  static Cache* cache = new Cache();
+  return *cache;
+}
+
+// A key for some bytes: their 64-bit FNV-1a hash and their length.
+string Key(const string& bytes) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    hash ^= static_cast<unsigned char>(bytes[i]);
+    hash *= 1099511628211ULL;
+  }
+  std::ostringstream key;
+  key << std::hex << hash << "-" << bytes.size();
+  return key.str();
+}
+
+// Returns the entry for key, if it was made from the same source; keys of
+// different sources only match by a hash collision.
+shared_ptr<const NetParameter> Find(const Entries& entries,
+    const string& key, const string& source) {
+  Cache& c = cache();
+  boost::mutex::scoped_lock lock(c.mutex);
+  Entries::const_iterator it = entries.find(key);
+  if (it == entries.end() || it->second.source != source) {
+    return shared_ptr<const NetParameter>();
+  }
+  ++c.hits;
+  return it->second.param;
+}
+
+// Returns the entry for key, which another thread may have added first. On
+// a collision with another source, param is returned and not kept.
+shared_ptr<const NetParameter> Insert(Entries* entries, const string& key,
+    const string& source, shared_ptr<const NetParameter> param) {
+  Cache& c = cache();
+  boost::mutex::scoped_lock lock(c.mutex);
+  Entry entry;
+  entry.source = source;
+  entry.param = param;
+  std::pair<Entries::iterator, bool> inserted =
+      entries->insert(std::make_pair(key, entry));
+  if (inserted.first->second.source != source) {
+    return param;
+  }
+  return inserted.first->second.param;
+}
+
+string Path(const string& key) {
+  const string directory = NetCache::directory();
+  if (directory.empty()) {
+    return string();
+  }
+  std::ostringstream path;
+  path << directory << "/" << key << ".v" << kFormatVersion << ".binaryproto";
+  return path.str();
+}
+
+// A stored file holds the length of the source, the source, and the
+// definition read from it. It is only loaded for the same source.
+bool Load(const string& key, const string& source, NetParameter* param) {
+  const string path = Path(key);
+  if (path.empty()) {
+    return false;
+  }
+  std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+  size_t size = 0;
+  if (!(file >> size) || file.get() != '\n' || size != source.size()) {
+    return false;
+  }
+  string stored(size, '\0');
+  if (size > 0 && !file.read(&stored[0], size)) {
+    return false;
+  }
+  if (stored != source || !param->ParseFromIstream(&file)) {
+    return false;
+  }
+  Cache& c = cache();
+  boost::mutex::scoped_lock lock(c.mutex);
+  ++c.hits;
+  return true;
+}
+
+void Store(const string& key, const string& source,
+    const NetParameter& param) {
+  const string path = Path(key);
+  if (path.empty()) {
+    return;
+  }
+  // Write aside and rename, so that readers never see a partial file. The
+  // cache is optional, so failing to write it (e.g. to a read-only or full
+  // directory) only warns.
+  const boost::filesystem::path temp =
+      boost::filesystem::unique_path(path + ".%%%%%%%%");
+  boost::system::error_code error;
+  {
+    std::ofstream file(temp.string().c_str(),
+        std::ios::out | std::ios::trunc | std::ios::binary);
+    file << source.size() << '\n' << source;
+    if (!file || !param.SerializeToOstream(&file) || !file.flush()) {
+      LOG(WARNING) << "Failed to cache " << path << ": cannot write "
+                   << temp.string();
+      file.close();
+      boost::filesystem::remove(temp, error);
+      return;
+    }
+  }
+  boost::filesystem::rename(temp, path, error);
+  if (error) {
+    LOG(WARNING) << "Failed to cache " << path << ": " << error.message();
+    boost::filesystem::remove(temp, error);
+  }
+}
+
+}  // namespace
+
+void NetCache::ReadNetParams(const string& param_file, NetParameter* param) {
+  std::ifstream file(param_file.c_str(), std::ios::in | std::ios::binary);
+  CHECK(file) << "Failed to open NetParameter file: " << param_file;
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  const string source = contents.str();
+  const string key = Key(source);
+  shared_ptr<const NetParameter> entry = Find(cache().read, key, source);
+  if (!entry) {
+    shared_ptr<NetParameter> read(new NetParameter());
+    if (!Load(key, source, read.get())) {
+      CHECK(google::protobuf::TextFormat::ParseFromString(source,
+          read.get())) << "Failed to parse NetParameter file: " << param_file;
+      UpgradeNetAsNeeded(param_file, read.get());
+      {
+        boost::mutex::scoped_lock lock(cache().mutex);
+        ++cache().misses;
+      }
+      Store(key, source, *read);
+    }
+    entry = Insert(&cache().read, key, source, read);
+  }
+  param->CopyFrom(*entry);
+}
+
+shared_ptr<const NetParameter> NetCache::Compile(const NetParameter& param) {
+  // Definitions carrying weights are compiled but not kept.
+  bool has_blobs = false;
+  for (int i = 0; i < param.layer_size() && !has_blobs; ++i) {
+    has_blobs = param.layer(i).blobs_size() > 0;
+  }
+  const string source = has_blobs ? string() : param.SerializeAsString();
+  const string key = has_blobs ? string() : Key(source);
+  shared_ptr<const NetParameter> entry;
+  if (!has_blobs) {
+    entry = Find(cache().compiled, key, source);
+    if (entry) {
+      return entry;
+    }
+  }
+  {
+    boost::mutex::scoped_lock lock(cache().mutex);
+    ++cache().misses;
+  }
+  NetParameter filtered;
+  Net<float>::FilterNet(param, &filtered);
+  shared_ptr<NetParameter> compiled(new NetParameter());
+  InsertSplits(filtered, compiled.get());
+  if (has_blobs) {
+    return compiled;
+  }
+  entry = Insert(&cache().compiled, key, source, compiled);
+  // Compiling a compiled definition changes nothing.
+  const string compiled_source = entry->SerializeAsString();
+  Insert(&cache().compiled, Key(compiled_source), compiled_source, entry);
+  return entry;
+}
+
+shared_ptr<const NetParameter> NetCache::Get(const string& param_file,
+    const NetState& state) {
+  NetParameter param;
+  ReadNetParams(param_file, &param);
+  param.mutable_state()->MergeFrom(state);
+  return Compile(param);
+}
+
+void NetCache::set_directory(const string& directory) {
+  if (!directory.empty()) {
+    boost::filesystem::create_directories(directory);
+  }
+  Cache& c = cache();
+  boost::mutex::scoped_lock lock(c.mutex);
+  c.directory = directory;
+}
+
+string NetCache::directory() {
+  Cache& c = cache();
+  boost::mutex::scoped_lock lock(c.mutex);
+  return c.directory;
+}
+
+void NetCache::Clear() {
+  Cache& c = cache();
+  boost::mutex::scoped_lock lock(c.mutex);
+  c.read.clear();
+  c.compiled.clear();
+  c.hits = 0;
+  c.misses = 0;
+}
+
+int NetCache::hits() {
+  Cache& c = cache();
+  boost::mutex::scoped_lock lock(c.mutex);
+  return c.hits;
+}
+
+int NetCache::misses() {
+  Cache& c = cache();
+  boost::mutex::scoped_lock lock(c.mutex);
+  return c.misses;
+}
+
+}  // namespace caffe
@@ -0,0 +1,299 @@
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <string>
+
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/datum_view.hpp"
+#include "caffe/util/ring_queue.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Bounds of the number of spins before a wait blocks, and the number of
+// yields in between. Spinning only helps if the other end of the queue runs
+// on another core, so single core machines just yield.
+const int kMinSpins = 16;
+const int kMaxSpins = 16384;
+const int kYields = 4;
+
+inline void cpu_relax() {
+#if defined(__i386__) || defined(__x86_64__)
+  __asm__ __volatile__("pause");
+#elif defined(__aarch64__) || (defined(__arm__) && __ARM_ARCH >= 7)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+// Keeps the producer and consumer indices on separate cache lines.
+struct CacheLinePad {
+  char bytes[64];
+};
+
+}  // namespace
+
+template<typename T>
+class RingQueue<T>::state {
+ public:
+  struct Cell {
+    boost::atomic<size_t> sequence;
+    T value;
+  };
+
+  state(size_t capacity, Mode mode)
+      : mode_(mode), mask_(capacity - 1), cells_(new Cell[capacity]),
+        max_spins_(boost::thread::hardware_concurrency() > 1 ? kMaxSpins : 0),
+        min_spins_(std::min(kMinSpins, max_spins_)),
+        tail_(0), head_(0), waiters_(0), spin_limit_(min_spins_ * 16),
+        full_waits_(0), empty_waits_(0), parks_(0), occupancy_sum_(0),
+        max_occupancy_(0) {
+    for (size_t i = 0; i < capacity; ++i) {
+      cells_[i].sequence.store(i, boost::memory_order_relaxed);
+    }
+  }
+
+  // A slot is free for the push at position pos when its sequence is pos,
+  // and holds the item for the pop at pos when its sequence is pos + 1.
+  inline intptr_t free_slot(size_t pos) const {
+    return static_cast<intptr_t>(sequence(pos) - pos);
+  }
+  inline intptr_t full_slot(size_t pos) const {
+    return static_cast<intptr_t>(sequence(pos) - (pos + 1));
+  }
+  inline size_t sequence(size_t pos) const {
+    return cells_[pos & mask_].sequence.load(boost::memory_order_acquire);
+  }
+
+  // Claims position pos of an index, unless another thread did in MPMC mode.
+  inline bool claim(boost::atomic<size_t>* index, size_t* pos) {
+    if (mode_ == SPSC) {
+      index->store(*pos + 1, boost::memory_order_relaxed);
+      return true;
+    }
+    return index->compare_exchange_weak(*pos, *pos + 1,
+                                        boost::memory_order_relaxed);
+  }
+
+  // Wakes up blocked waiters, if any. The fence pairs with the one in wait,
+  // so that either the waiter sees the change or the waker sees the waiter.
+  inline void notify() {
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    if (waiters_.load(boost::memory_order_relaxed) > 0) {
+      boost::mutex::scoped_lock lock(mutex_);
+      condition_.notify_all();
+    }
+  }
+
+  // Whether a push (or pop) would currently succeed.
+  inline bool ready(bool for_push) const {
+    return for_push ?
+        free_slot(tail_.load(boost::memory_order_relaxed)) >= 0 :
+        full_slot(head_.load(boost::memory_order_relaxed)) >= 0;
+  }
+
+  const Mode mode_;
+  const size_t mask_;
+  boost::scoped_array<Cell> cells_;
+  const int max_spins_;
+  const int min_spins_;
+  CacheLinePad pad0_;
+  boost::atomic<size_t> tail_;
+  CacheLinePad pad1_;
+  boost::atomic<size_t> head_;
+  CacheLinePad pad2_;
+  boost::atomic<int> waiters_;
+  boost::atomic<int> spin_limit_;
+  boost::atomic<uint64_t> full_waits_;
+  boost::atomic<uint64_t> empty_waits_;
+  boost::atomic<uint64_t> parks_;
+  boost::atomic<uint64_t> occupancy_sum_;
+  boost::atomic<uint64_t> max_occupancy_;
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+};
+
+template<typename T>
+RingQueue<T>::RingQueue(size_t capacity, Mode mode) {
+  CHECK_GT(capacity, 0) << "RingQueue must hold an item.";
+  size_t rounded = 1;
+  while (rounded < capacity) {
+    rounded <<= 1;
+  }
+  state_.reset(new state(rounded, mode));
+}
+
+template<typename T>
+bool RingQueue<T>::try_push(const T& t) {
+  state& s = *state_;
+  size_t pos = s.tail_.load(boost::memory_order_relaxed);
+  for (;;) {
+    const intptr_t diff = s.free_slot(pos);
+    if (diff == 0) {
+      if (s.claim(&s.tail_, &pos)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return false;  // full
+    } else {
+      pos = s.tail_.load(boost::memory_order_relaxed);
+    }
+  }
+  typename state::Cell& cell = s.cells_[pos & s.mask_];
+  cell.value = t;
+  cell.sequence.store(pos + 1, boost::memory_order_release);
+  s.notify();
+  return true;
+}
+
+template<typename T>
+void RingQueue<T>::push(const T& t) {
+  while (!try_push(t)) {
+    wait(true, "");
+  }
+}
+
+template<typename T>
+bool RingQueue<T>::try_pop(T* t) {
+  state& s = *state_;
+  size_t pos = s.head_.load(boost::memory_order_relaxed);
+  for (;;) {
+    const intptr_t diff = s.full_slot(pos);
+    if (diff == 0) {
+      if (s.claim(&s.head_, &pos)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return false;  // empty
+    } else {
+      pos = s.head_.load(boost::memory_order_relaxed);
+    }
+  }
+  typename state::Cell& cell = s.cells_[pos & s.mask_];
+  *t = cell.value;
+  cell.value = T();
+  cell.sequence.store(pos + s.mask_ + 1, boost::memory_order_release);
+  // Occupancy as seen by this pop. In MPMC mode the maximum is only
+  // approximate, as concurrent pops may race on it.
+  const uint64_t occupancy = s.tail_.load(boost::memory_order_relaxed) - pos;
+  if (s.mode_ == SPSC) {
+    s.occupancy_sum_.store(s.occupancy_sum_.load(boost::memory_order_relaxed)
+        + occupancy, boost::memory_order_relaxed);
+  } else {
+    s.occupancy_sum_.fetch_add(occupancy, boost::memory_order_relaxed);
+  }
+  if (occupancy > s.max_occupancy_.load(boost::memory_order_relaxed)) {
+    s.max_occupancy_.store(occupancy, boost::memory_order_relaxed);
+  }
+  s.notify();
+  return true;
+}
+
+template<typename T>
+T RingQueue<T>::pop(const string& log_on_wait) {
+  T t;
+  while (!try_pop(&t)) {
+    wait(false, log_on_wait);
+  }
+  return t;
+}
+
+template<typename T>
+bool RingQueue<T>::try_peek(T* t) {
+  state& s = *state_;
+  DCHECK_EQ(s.mode_, SPSC) << "Peeking needs a single consumer";
+  const size_t pos = s.head_.load(boost::memory_order_relaxed);
+  if (s.full_slot(pos) != 0) {
+    return false;
+  }
+  *t = s.cells_[pos & s.mask_].value;
+  return true;
+}
+
+template<typename T>
+T RingQueue<T>::peek() {
+  T t;
+  while (!try_peek(&t)) {
+    wait(false, "");
+  }
+  return t;
+}
+
+template<typename T>
+void RingQueue<T>::wait(bool for_push, const string& log_on_wait) {
+  state& s = *state_;
+  (for_push ? s.full_waits_ : s.empty_waits_).fetch_add(1,
+      boost::memory_order_relaxed);
+  // Spin, then yield, as most hand-offs between threads that keep up with
+  // each other are short; the budget doubles after a wait ends while
+  // spinning and halves after one blocks.
+  const int spins = s.spin_limit_.load(boost::memory_order_relaxed);
+  for (int i = 0; i < spins + kYields; ++i) {
+    if (s.ready(for_push)) {
+      s.spin_limit_.store(std::min(std::max(2 * spins, s.min_spins_),
+                                   s.max_spins_),
+                          boost::memory_order_relaxed);
+      return;
+    }
+    if (i < spins) {
+      cpu_relax();
+    } else {
+      boost::this_thread::yield();
+    }
+  }
+  s.spin_limit_.store(std::max(spins / 2, s.min_spins_),
+                      boost::memory_order_relaxed);
+  s.parks_.fetch_add(1, boost::memory_order_relaxed);
+  boost::mutex::scoped_lock lock(s.mutex_);
+  s.waiters_.fetch_add(1, boost::memory_order_relaxed);
+  boost::atomic_thread_fence(boost::memory_order_seq_cst);
+  try {
+    while (!s.ready(for_push)) {
+      if (!log_on_wait.empty()) {
+        LOG_EVERY_N(INFO, 1000)<< log_on_wait;
+      }
+      s.condition_.wait(lock);
+    }
+  } catch (boost::thread_interrupted&) {
+    s.waiters_.fetch_sub(1, boost::memory_order_relaxed);
+    throw;
+  }
+  s.waiters_.fetch_sub(1, boost::memory_order_relaxed);
+}
+
+template<typename T>
+size_t RingQueue<T>::size() const {
+  const size_t head = state_->head_.load(boost::memory_order_acquire);
+  const size_t tail = state_->tail_.load(boost::memory_order_acquire);
+  return tail > head ? tail - head : 0;
+}
+
+template<typename T>
+size_t RingQueue<T>::capacity() const {
+  return state_->mask_ + 1;
+}
+
+template<typename T>
+QueueStats RingQueue<T>::stats() const {
+  const state& s = *state_;
+  QueueStats stats;
+  stats.pushes = s.tail_.load(boost::memory_order_relaxed);
+  stats.pops = s.head_.load(boost::memory_order_relaxed);
+  stats.full_waits = s.full_waits_.load(boost::memory_order_relaxed);
+  stats.empty_waits = s.empty_waits_.load(boost::memory_order_relaxed);
+  stats.parks = s.parks_.load(boost::memory_order_relaxed);
+  stats.occupancy_sum = s.occupancy_sum_.load(boost::memory_order_relaxed);
+  stats.max_occupancy = s.max_occupancy_.load(boost::memory_order_relaxed);
+  return stats;
+}
+
+template class RingQueue<int>;
+template class RingQueue<Batch<float>*>;
+template class RingQueue<Batch<double>*>;
+template class RingQueue<DatumView*>;
+template class RingQueue<ParallelTask*>;
+
+}  // namespace caffe
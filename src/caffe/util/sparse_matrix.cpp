@@ -0,0 +1,107 @@
+#include <vector>
+
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/sparse_matrix.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+bool SparseMatrix<Dtype>::Update(const Blob<Dtype>& weights, const int rows,
+    const float threshold) {
+  const shared_ptr<SyncedMemory>& source = weights.data();
+  if (source == source_.lock() && source->version() == source_version_ &&
+      threshold == threshold_) {
+    return active_;
+  }
+  CHECK_GT(rows, 0);
+  CHECK_EQ(weights.count() % rows, 0);
+  const int count = weights.count();
+  const Dtype* dense = weights.cpu_data();
+  source_ = source;
+  source_version_ = source->version();
+  threshold_ = threshold;
+  rows_ = rows;
+  cols_ = count / rows;
+  values_.clear();
+  col_index_.clear();
+  row_ptr_.clear();
+  int num_nonzero = 0;
+  for (int i = 0; i < count; ++i) {
+    num_nonzero += (dense[i] != 0);
+  }
+  active_ = (count - num_nonzero) >= threshold * count;
+  if (!active_) { return false; }
+  values_.reserve(num_nonzero);
+  col_index_.reserve(num_nonzero);
+  row_ptr_.resize(rows_ + 1);
+  for (int r = 0; r < rows_; ++r) {
+    row_ptr_[r] = values_.size();
+    const Dtype* row = dense + r * cols_;
+    for (int c = 0; c < cols_; ++c) {
+      if (row[c] != 0) {
+        values_.push_back(row[c]);
+        col_index_.push_back(c);
+      }
+    }
+  }
+  row_ptr_[rows_] = values_.size();
+  return true;
+}
+
+template <typename Dtype>
+void SparseMatrix<Dtype>::Multiply(const int row_begin, const int row_end,
+    const int N, const Dtype* B, Dtype* C) const {
+  DCHECK(active_);
+  DCHECK_GE(row_begin, 0);
+  DCHECK_LE(row_end, rows_);
+  for (int r = row_begin; r < row_end; ++r) {
+    Dtype* C_row = C + (r - row_begin) * N;
+    caffe_set(N, Dtype(0), C_row);
+    for (int j = row_ptr_[r]; j < row_ptr_[r + 1]; ++j) {
+      const Dtype value = values_[j];
+      const Dtype* B_row = B + col_index_[j] * N;
+      for (int n = 0; n < N; ++n) {
+        C_row[n] += value * B_row[n];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void SparseMatrix<Dtype>::MultiplyTransposedLeft(const int M, const Dtype* B,
+    Dtype* C) const {
+  DCHECK(active_);
+  for (int m = 0; m < M; ++m) {
+    const Dtype* B_row = B + m * cols_;
+    Dtype* C_row = C + m * rows_;
+    for (int r = 0; r < rows_; ++r) {
+      Dtype sum = 0;
+      for (int j = row_ptr_[r]; j < row_ptr_[r + 1]; ++j) {
+        sum += values_[j] * B_row[col_index_[j]];
+      }
+      C_row[r] = sum;
+    }
+  }
+}
+
+template <typename Dtype>
+void SparseMatrix<Dtype>::MultiplyLeft(const int M, const Dtype* B,
+    Dtype* C) const {
+  DCHECK(active_);
+  caffe_set(M * cols_, Dtype(0), C);
+  for (int m = 0; m < M; ++m) {
+    const Dtype* B_row = B + m * rows_;
+    Dtype* C_row = C + m * cols_;
+    for (int r = 0; r < rows_; ++r) {
+      const Dtype b = B_row[r];
+      if (b == 0) { continue; }
+      for (int j = row_ptr_[r]; j < row_ptr_[r + 1]; ++j) {
+        C_row[col_index_[j]] += b * values_[j];
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(SparseMatrix);
+
+}  // namespace caffe
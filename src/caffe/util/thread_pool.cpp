@@ -0,0 +1,79 @@
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "caffe/internal_thread.hpp"
+#include "caffe/util/ring_queue.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+class ThreadPool::Worker : public InternalThread {
+ public:
+  explicit Worker(int index)
+      : index_(index), stride_(1), count_(0),
+        jobs_(1, RingQueue<ParallelTask*>::SPSC),
+        done_(1, RingQueue<ParallelTask*>::SPSC) {}
+  virtual ~Worker() {
+    StopInternalThread();
+  }
+
+  void Submit(ParallelTask* task, int stride, int count) {
+    stride_ = stride;
+    count_ = count;
+    jobs_.push(task);
+  }
+  void Wait() {
+    done_.pop();
+  }
+
+ protected:
+  virtual void InternalThreadEntry() {
+    try {
+      while (!must_stop()) {
+        ParallelTask* task = jobs_.pop();
+        for (int item = index_; item < count_; item += stride_) {
+          task->Run(item, index_);
+        }
+        done_.push(task);
+      }
+    } catch (boost::thread_interrupted&) {
+      // Interrupted exception is expected on shutdown
+    }
+  }
+
+  const int index_;
+  int stride_;
+  int count_;
+  // Hand the task to the worker and back; pushing and popping also order
+  // the job fields above between the two threads.
+  RingQueue<ParallelTask*> jobs_;
+  RingQueue<ParallelTask*> done_;
+};
+
+ThreadPool::ThreadPool(int num_threads) {
+  CHECK_GE(num_threads, 0);
+  for (int i = 0; i < num_threads; ++i) {
+    workers_.push_back(shared_ptr<Worker>(new Worker(i)));
+    workers_.back()->StartInternalThread();
+  }
+}
+
+ThreadPool::~ThreadPool() {
+}
+
+void ThreadPool::Run(ParallelTask* task, int count) {
+  if (workers_.empty()) {
+    for (int item = 0; item < count; ++item) {
+      task->Run(item, 0);
+    }
+    return;
+  }
+  for (int i = 0; i < workers_.size(); ++i) {
+    workers_[i]->Submit(task, workers_.size(), count);
+  }
+  for (int i = 0; i < workers_.size(); ++i) {
+    workers_[i]->Wait();
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,284 @@
+#include <boost/thread.hpp>
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/weight_registry.hpp"
+
+namespace caffe {
+
+namespace {
+
+template <typename Dtype>
+struct Model {
+  Model() : version(0), writer(NULL), in_place(false) {}
+
+  // Blobs sharing the data of the latest version, by parameter name, and the
+  // arenas of the nets with flat parameters that published some of it, by
+  // net (or by arena, once the net is gone).
+  std::map<string, shared_ptr<Blob<Dtype> > > params;
+  std::map<const void*, shared_ptr<Blob<Dtype> > > arenas;
+  int version;
+  // The net between BeginUpdate and EndUpdate, if any, and whether it writes
+  // the data of the latest version rather than a copy.
+  const Net<Dtype>* writer;
+  bool in_place;
+};
+
+template <typename Dtype>
+struct Reader {
+  Net<Dtype>* net;
+  string model;
+  typename WeightRegistry<Dtype>::Mode mode;
+  int version;
+  // Whether the net has flat parameters but shares data outside its arena.
+  bool adopted;
+  // The depth of nested BeginUpdate calls.
+  int updates;
+  // Keeps the arenas of the version the net shares alive.
+  vector<shared_ptr<Blob<Dtype> > > arenas;
+};
+
+template <typename Dtype>
+struct Registry {
+  Registry() : num_models(0) {}
+
+  boost::mutex mutex;
+  std::map<string, Model<Dtype> > models;
+  std::map<const Net<Dtype>*, Reader<Dtype> > readers;
+  // Names the models attached under an empty name.
+  int num_models;
+};
+
+template <typename Dtype>
+Registry<Dtype>& registry() {
+  static Registry<Dtype>* registry = new Registry<Dtype>();
+  return *registry;
+}
+
+template <typename Dtype>
+string ParamName(const Net<Dtype>& net, int param_id) {
+  const pair<int, int>& index = net.param_layer_indices()[param_id];
+  std::ostringstream name;
+  name << net.layer_names()[index.first] << "/" << index.second;
+  return name.str();
+}
+
+// Makes the data of the parameters of net the latest version of model.
+template <typename Dtype>
+void Publish(Model<Dtype>* model, Reader<Dtype>* reader) {
+  const Net<Dtype>& net = *reader->net;
+  const vector<shared_ptr<Blob<Dtype> > >& params = net.params();
+  for (int i = 0; i < params.size(); ++i) {
+    if (net.param_owners()[i] >= 0 || params[i]->count() == 0) { continue; }
+    shared_ptr<Blob<Dtype> >& published = model->params[ParamName(net, i)];
+    if (!published) {
+      published.reset(new Blob<Dtype>());
+    }
+    published->ReshapeLike(*params[i]);
+    published->ShareData(*params[i]);
+  }
+  if (net.has_flat_params()) {
+    model->arenas[&net] = net.flat_params();
+  }
+  reader->arenas.clear();
+  reader->adopted = false;
+  reader->version = ++model->version;
+}
+
+// Points the parameters of net at the latest version of model, first
+// publishing those the model lacks.
+template <typename Dtype>
+void Share(Model<Dtype>* model, Reader<Dtype>* reader) {
+  Net<Dtype>* net = reader->net;
+  const vector<shared_ptr<Blob<Dtype> > >& params = net->params();
+  const vector<int>& owners = net->param_owners();
+  for (int i = 0; i < params.size(); ++i) {
+    if (owners[i] >= 0 || params[i]->count() == 0) { continue; }
+    const string name = ParamName(*net, i);
+    shared_ptr<Blob<Dtype> >& published = model->params[name];
+    if (!published) {
+      published.reset(new Blob<Dtype>());
+      published->ReshapeLike(*params[i]);
+      published->ShareData(*params[i]);
+      if (net->has_flat_params()) {
+        model->arenas[net] = net->flat_params();
+      }
+      continue;
+    }
+    if (published->data() == params[i]->data()) { continue; }
+    CHECK(published->shape() == params[i]->shape())
+        << "Cannot share param " << name << "; shape mismatch.  Published "
+        << "shape is " << published->shape_string() << "; target param "
+        << "shape is " << params[i]->shape_string();
+    params[i]->ShareData(*published);
+    reader->adopted = net->has_flat_params();
+  }
+  for (int i = 0; i < params.size(); ++i) {
+    if (owners[i] >= 0) {
+      params[i]->ShareData(*params[owners[i]]);
+    }
+  }
+  reader->arenas.clear();
+  typename std::map<const void*, shared_ptr<Blob<Dtype> > >::iterator it;
+  for (it = model->arenas.begin(); it != model->arenas.end(); ++it) {
+    reader->arenas.push_back(it->second);
+  }
+  reader->version = model->version;
+}
+
+}  // namespace
+
+template <typename Dtype>
+string WeightRegistry<Dtype>::Attach(const string& model, Net<Dtype>* net,
+    Mode mode) {
+  Registry<Dtype>& r = registry<Dtype>();
+  boost::mutex::scoped_lock lock(r.mutex);
+  CHECK(r.readers.find(net) == r.readers.end())
+      << "Net " << net->name() << " is already attached.";
+  string name = model;
+  if (name.empty()) {
+    std::ostringstream unique;
+    unique << "#" << r.num_models++;
+    name = unique.str();
+    CHECK(r.models.find(name) == r.models.end());
+  }
+  Reader<Dtype>& reader = r.readers[net];
+  reader.net = net;
+  reader.model = name;
+  reader.mode = mode;
+  reader.adopted = false;
+  reader.updates = 0;
+  Share(&r.models[name], &reader);
+  return name;
+}
+
+template <typename Dtype>
+void WeightRegistry<Dtype>::Detach(const Net<Dtype>* net) {
+  Registry<Dtype>& r = registry<Dtype>();
+  boost::mutex::scoped_lock lock(r.mutex);
+  typename std::map<const Net<Dtype>*, Reader<Dtype> >::iterator it =
+      r.readers.find(net);
+  if (it == r.readers.end()) { return; }
+  const string model = it->second.model;
+  r.readers.erase(it);
+  if (r.models[model].writer == net) {
+    r.models[model].writer = NULL;
+  }
+  for (it = r.readers.begin(); it != r.readers.end(); ++it) {
+    if (it->second.model == model) { break; }
+  }
+  if (it == r.readers.end()) {
+    r.models.erase(model);
+    return;
+  }
+  // What net published stays, and so does its arena.
+  std::map<const void*, shared_ptr<Blob<Dtype> > >& arenas =
+      r.models[model].arenas;
+  typename std::map<const void*, shared_ptr<Blob<Dtype> > >::iterator arena =
+      arenas.find(net);
+  if (arena != arenas.end()) {
+    shared_ptr<Blob<Dtype> > blob = arena->second;
+    arenas.erase(arena);
+    arenas[blob.get()] = blob;
+  }
+}
+
+template <typename Dtype>
+void WeightRegistry<Dtype>::BeginUpdate(Net<Dtype>* net) {
+  Registry<Dtype>& r = registry<Dtype>();
+  boost::mutex::scoped_lock lock(r.mutex);
+  typename std::map<const Net<Dtype>*, Reader<Dtype> >::iterator writer =
+      r.readers.find(net);
+  if (writer == r.readers.end()) { return; }
+  if (writer->second.updates++ > 0) { return; }
+  Model<Dtype>& model = r.models[writer->second.model];
+  CHECK(model.writer == NULL) << "Model " << writer->second.model
+      << " is already being updated by net " << model.writer->name();
+  bool snapshot = false;
+  typename std::map<const Net<Dtype>*, Reader<Dtype> >::iterator it;
+  for (it = r.readers.begin(); it != r.readers.end(); ++it) {
+    snapshot |= it != writer && it->second.model == writer->second.model &&
+        it->second.mode == SNAPSHOT &&
+        it->second.version == writer->second.version;
+  }
+  // Writing through the arena of a flat net needs the data back in it.
+  const bool copy = snapshot || writer->second.adopted;
+  if (copy) {
+    net->OwnParamData();
+  }
+  model.writer = net;
+  model.in_place = !copy && writer->second.version == model.version;
+}
+
+template <typename Dtype>
+void WeightRegistry<Dtype>::EndUpdate(Net<Dtype>* net) {
+  Registry<Dtype>& r = registry<Dtype>();
+  boost::mutex::scoped_lock lock(r.mutex);
+  typename std::map<const Net<Dtype>*, Reader<Dtype> >::iterator writer =
+      r.readers.find(net);
+  if (writer == r.readers.end()) { return; }
+  CHECK_GT(writer->second.updates, 0) << "EndUpdate without BeginUpdate.";
+  if (--writer->second.updates > 0) { return; }
+  Model<Dtype>& model = r.models[writer->second.model];
+  model.writer = NULL;
+  // Data written in place already is the latest version.
+  if (model.in_place) { return; }
+  Publish(&model, &writer->second);
+  typename std::map<const Net<Dtype>*, Reader<Dtype> >::iterator it;
+  for (it = r.readers.begin(); it != r.readers.end(); ++it) {
+    if (it != writer && it->second.model == writer->second.model &&
+        it->second.mode == FOLLOW) {
+      Share(&model, &it->second);
+    }
+  }
+}
+
+template <typename Dtype>
+bool WeightRegistry<Dtype>::Refresh(Net<Dtype>* net) {
+  Registry<Dtype>& r = registry<Dtype>();
+  boost::mutex::scoped_lock lock(r.mutex);
+  typename std::map<const Net<Dtype>*, Reader<Dtype> >::iterator it =
+      r.readers.find(net);
+  CHECK(it != r.readers.end()) << "Net " << net->name() << " is not attached.";
+  Model<Dtype>& model = r.models[it->second.model];
+  if (it->second.version == model.version) { return false; }
+  // The latest version is being written in place; it completes at EndUpdate.
+  if (model.writer && model.in_place) { return false; }
+  Share(&model, &it->second);
+  return true;
+}
+
+template <typename Dtype>
+bool WeightRegistry<Dtype>::attached(const Net<Dtype>* net) {
+  Registry<Dtype>& r = registry<Dtype>();
+  boost::mutex::scoped_lock lock(r.mutex);
+  return r.readers.find(net) != r.readers.end();
+}
+
+template <typename Dtype>
+int WeightRegistry<Dtype>::version(const string& model) {
+  Registry<Dtype>& r = registry<Dtype>();
+  boost::mutex::scoped_lock lock(r.mutex);
+  typename std::map<string, Model<Dtype> >::const_iterator it =
+      r.models.find(model);
+  CHECK(it != r.models.end()) << "Unknown model " << model;
+  return it->second.version;
+}
+
+template <typename Dtype>
+int WeightRegistry<Dtype>::version(const Net<Dtype>* net) {
+  Registry<Dtype>& r = registry<Dtype>();
+  boost::mutex::scoped_lock lock(r.mutex);
+  typename std::map<const Net<Dtype>*, Reader<Dtype> >::const_iterator it =
+      r.readers.find(net);
+  CHECK(it != r.readers.end()) << "Net " << net->name() << " is not attached.";
+  return it->second.version;
+}
+
+INSTANTIATE_CLASS(WeightRegistry);
+
+}  // namespace caffe
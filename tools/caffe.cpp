@@ -13,11 +13,17 @@ namespace bp = boost::python;
 
 #include "boost/algorithm/string.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/net_pipeline.hpp"
+#include "caffe/util/host_allocator.hpp"
+#include "caffe/util/net_cache.hpp"
 #include "caffe/util/signal_handler.h"
 
 using caffe::Blob;
 using caffe::Caffe;
+using caffe::HostAllocator;
 using caffe::Net;
+using caffe::NetCache;
+using caffe::NetPipeline;
 using caffe::Layer;
 using caffe::Solver;
 using caffe::shared_ptr;
@@ -54,6 +60,15 @@ DEFINE_string(sigint_effect, "stop",
 DEFINE_string(sighup_effect, "snapshot",
              "Optional; action to take when a SIGHUP signal is received: "
              "snapshot, stop or none.");
+DEFINE_string(host_allocator, "malloc",
+    "Optional; the allocator of host memory: malloc, or pool to reuse "
+    "freed buffers.");
+DEFINE_int32(pipeline_stages, 0,
+    "Optional; for time, also time the forward pass pipelined over this "
+    "many stages, balanced by the measured layer times.");
+DEFINE_string(net_cache_dir, "",
+    "Optional; a directory to keep parsed net definitions in, so that "
+    "later runs skip parsing and upgrading the prototxt files.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -331,6 +346,40 @@ RegisterBrewFunction(test);
 
 
 // Time: benchmark the execution time of a model.
+// Time the forward pass pipelined over FLAGS_pipeline_stages stages. The
+// replicas share parameters, so they run in TEST whatever the phase flag.
+void time_pipeline(const vector<string>& stages,
+    const vector<double>& layer_times) {
+  caffe::NetParameter param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &param);
+  param.mutable_state()->set_phase(caffe::TEST);
+  for (int i = 0; i < stages.size(); ++i) {
+    param.mutable_state()->add_stage(stages[i]);
+  }
+  param.mutable_state()->set_level(FLAGS_level);
+  NetPipeline<float> pipeline(param, FLAGS_pipeline_stages, layer_times);
+  LOG(INFO) << "*** Pipeline benchmark begins ***";
+  Timer timer;
+  timer.Start();
+  // Keep every slot of the pipeline busy.
+  int in_flight = 0;
+  for (int j = 0; j < FLAGS_iterations; ++j) {
+    if (in_flight == pipeline.num_slots()) {
+      pipeline.Release(pipeline.Collect());
+      --in_flight;
+    }
+    pipeline.Submit(pipeline.Acquire());
+    ++in_flight;
+  }
+  for (; in_flight > 0; --in_flight) {
+    pipeline.Release(pipeline.Collect());
+  }
+  LOG(INFO) << "Average pipelined Forward pass over "
+    << pipeline.num_stages() << " stages: "
+    << timer.MilliSeconds() / FLAGS_iterations << " ms.";
+  LOG(INFO) << "*** Pipeline benchmark ends ***";
+}
+
 int time() {
   CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
   caffe::Phase phase = get_phase_from_flags(caffe::TRAIN);
@@ -417,6 +466,15 @@ int time() {
     FLAGS_iterations << " ms.";
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
   LOG(INFO) << "*** Benchmark ends ***";
+  if (FLAGS_pipeline_stages > 1) {
+    if (phase == caffe::TEST) {
+      time_pipeline(stages, forward_time_per_layer);
+    } else {
+      // The TEST net may have other layers; let the pipeline time them.
+      LOG(INFO) << "Timing the pipeline in the TEST phase.";
+      time_pipeline(stages, vector<double>());
+    }
+  }
   return 0;
 }
 RegisterBrewFunction(time);
@@ -436,11 +494,27 @@ int main(int argc, char** argv) {
       "  time            benchmark model execution time");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  if (FLAGS_host_allocator == "pool") {
+    HostAllocator::set_type(HostAllocator::POOL);
+  } else {
+    CHECK_EQ(FLAGS_host_allocator, "malloc")
+        << "Unknown host allocator: " << FLAGS_host_allocator;
+  }
+  if (FLAGS_net_cache_dir.size()) {
+    NetCache::set_directory(FLAGS_net_cache_dir);
+  }
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
 #endif
-      return GetBrewFunction(caffe::string(argv[1]))();
+      const int status = GetBrewFunction(caffe::string(argv[1]))();
+      if (HostAllocator::type() == HostAllocator::POOL) {
+        const caffe::HostAllocatorStats stats = HostAllocator::stats();
+        LOG(INFO) << "Host memory pool: peak " << stats.peak_bytes_in_use
+            << " bytes in use, " << stats.bytes_cached << " bytes cached, "
+            << "hit rate " << stats.hit_rate();
+      }
+      return status;
 #ifdef WITH_PYTHON_LAYER
     } catch (bp::error_already_set) {
       PyErr_Print();
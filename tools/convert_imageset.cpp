@@ -1,5 +1,5 @@
-// This program converts a set of images to a lmdb/leveldb by storing them
-// as Datum proto buffers.
+// This program converts a set of images to a lmdb/leveldb/mmap db by storing
+// them as Datum proto buffers.
 // Usage:
 //   convert_imageset [FLAGS] ROOTFOLDER/ LISTFILE DB_NAME
 //
@@ -33,7 +33,8 @@ DEFINE_bool(gray, false,
 DEFINE_bool(shuffle, false,
     "Randomly shuffle the order of images and their labels");
 DEFINE_string(backend, "lmdb",
-        "The backend {lmdb, leveldb} for storing the result");
+        "The backend {lmdb, leveldb, mmap} for storing the result. mmap "
+        "dbs support shuffling in the data layer (DataParameter.shuffle)");
 DEFINE_int32(resize_width, 0, "Width images are resized to");
 DEFINE_int32(resize_height, 0, "Height images are resized to");
 DEFINE_bool(check_size, false,
@@ -53,7 +54,7 @@ int main(int argc, char** argv) {
   namespace gflags = google;
 #endif
 
-  gflags::SetUsageMessage("Convert a set of images to the leveldb/lmdb\n"
+  gflags::SetUsageMessage("Convert a set of images to the leveldb/lmdb/mmap\n"
         "format used as input for Caffe.\n"
         "Usage:\n"
         "    convert_imageset [FLAGS] ROOTFOLDER/ LISTFILE DB_NAME\n"
@@ -0,0 +1,93 @@
+// This program rewrites the weights of a trained model in 16-bit (fp16 or
+// bfloat16) precision, halving the size of the model file, or back to
+// 32-bit floats. Blob::FromProto expands 16-bit weights on load; set
+// weight_precision in the InnerProduct and Convolution layers of the deploy
+// net to also keep them in 16 bits for the forward pass.
+// Usage:
+//    convert_net_precision [FLAGS] INPUT_CAFFEMODEL OUTPUT_CAFFEMODEL
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/half.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using std::string;
+using std::vector;
+
+DEFINE_string(precision, "fp16",
+    "The precision to write the weights in: fp16, bf16 or float.");
+DEFINE_string(layers, "",
+    "Optional; a comma-separated list of the layer names to convert. "
+    "By default the weights of all layers are converted.");
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Rewrite the weights of a trained model in 16-bit "
+        "or 32-bit floating point\n"
+        "Usage:\n"
+        "    convert_net_precision [FLAGS] INPUT_CAFFEMODEL "
+        "OUTPUT_CAFFEMODEL\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/convert_net_precision");
+    return 1;
+  }
+  BlobProto::Precision precision = BlobProto::FLOAT;
+  if (FLAGS_precision == "fp16") {
+    precision = BlobProto::FLOAT16;
+  } else if (FLAGS_precision == "bf16") {
+    precision = BlobProto::BFLOAT16;
+  } else {
+    CHECK_EQ(FLAGS_precision, "float")
+        << "Unknown precision: " << FLAGS_precision;
+  }
+
+  NetParameter net_param;
+  ReadNetParamsFromBinaryFileOrDie(argv[1], &net_param);
+
+  vector<string> layer_names;
+  if (!FLAGS_layers.empty()) {
+    string::size_type begin = 0;
+    while (begin <= FLAGS_layers.size()) {
+      string::size_type end = FLAGS_layers.find(',', begin);
+      if (end == string::npos) { end = FLAGS_layers.size(); }
+      layer_names.push_back(FLAGS_layers.substr(begin, end - begin));
+      begin = end + 1;
+    }
+  }
+
+  int num_converted = 0;
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    LayerParameter* layer = net_param.mutable_layer(i);
+    if (layer->blobs_size() == 0) { continue; }
+    if (!layer_names.empty() && std::find(layer_names.begin(),
+        layer_names.end(), layer->name()) == layer_names.end()) {
+      continue;
+    }
+    for (int j = 0; j < layer->blobs_size(); ++j) {
+      ConvertBlobPrecision(layer->mutable_blobs(j), precision);
+    }
+    ++num_converted;
+  }
+  LOG(INFO) << "Converted the weights of " << num_converted << " layers to "
+            << FLAGS_precision;
+
+  WriteProtoToBinaryFile(net_param, argv[2]);
+  LOG(INFO) << "Wrote converted model to " << argv[2];
+  return 0;
+}
@@ -0,0 +1,157 @@
+// This program prunes the weights of the InnerProduct and Convolution layers
+// of a trained model by magnitude and stores the pruned weights in compressed
+// sparse row form (see BlobProto), which Blob::FromProto expands on load.
+// Usage:
+//    prune_net [FLAGS] INPUT_CAFFEMODEL OUTPUT_CAFFEMODEL
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using std::string;
+using std::vector;
+
+DEFINE_double(sparsity, 0.9,
+    "The fraction of weights to zero in each pruned layer.");
+DEFINE_string(layers, "",
+    "Optional; a comma-separated list of the layer names to prune. "
+    "By default all InnerProduct and Convolution layers are pruned.");
+DEFINE_int32(min_weights, 1024,
+    "Layers with fewer weights than this are left dense.");
+
+namespace {
+
+double blob_value(const BlobProto& blob, int i) {
+  return blob.double_data_size() > 0 ? blob.double_data(i) : blob.data(i);
+}
+
+// Zeros the smallest-magnitude weights of blob and rewrites it in compressed
+// sparse row form. Returns the number of nonzero weights kept.
+int PruneBlob(BlobProto* blob) {
+  CHECK_EQ(blob->sparse_row_ptr_size(), 0) << "Blob is already sparse.";
+  if (blob->has_num() || blob->has_channels() ||
+      blob->has_height() || blob->has_width()) {
+    // Legacy 4D dimensions; the sparse form needs the row count in shape.
+    BlobShape* shape = blob->mutable_shape();
+    shape->add_dim(blob->num());
+    shape->add_dim(blob->channels());
+    shape->add_dim(blob->height());
+    shape->add_dim(blob->width());
+  }
+  CHECK_GT(blob->shape().dim_size(), 0) << "Weights must have a shape.";
+  const bool use_double = blob->double_data_size() > 0;
+  const int count = use_double ? blob->double_data_size() : blob->data_size();
+  const int rows = blob->shape().dim(0);
+  const int cols = count / rows;
+  CHECK_EQ(rows * cols, count);
+  vector<double> magnitudes(count);
+  for (int i = 0; i < count; ++i) {
+    magnitudes[i] = std::fabs(blob_value(*blob, i));
+  }
+  const int num_pruned = std::min(count - 1,
+      static_cast<int>(FLAGS_sparsity * count));
+  std::nth_element(magnitudes.begin(), magnitudes.begin() + num_pruned,
+                   magnitudes.end());
+  // Keep weights at or above the cutoff magnitude.
+  const double cutoff = magnitudes[num_pruned];
+  BlobProto sparse;
+  sparse.mutable_shape()->CopyFrom(blob->shape());
+  sparse.add_sparse_row_ptr(0);
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      const double value = blob_value(*blob, r * cols + c);
+      if (value != 0 && std::fabs(value) >= cutoff) {
+        if (use_double) {
+          sparse.add_double_data(value);
+        } else {
+          sparse.add_data(value);
+        }
+        sparse.add_sparse_col_index(c);
+      }
+    }
+    sparse.add_sparse_row_ptr(sparse.sparse_col_index_size());
+  }
+  blob->Swap(&sparse);
+  return blob->sparse_col_index_size();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Prune the weights of a trained model by magnitude "
+        "and store them in compressed sparse row form\n"
+        "Usage:\n"
+        "    prune_net [FLAGS] INPUT_CAFFEMODEL OUTPUT_CAFFEMODEL\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/prune_net");
+    return 1;
+  }
+  CHECK_GE(FLAGS_sparsity, 0);
+  CHECK_LT(FLAGS_sparsity, 1);
+
+  NetParameter net_param;
+  ReadNetParamsFromBinaryFileOrDie(argv[1], &net_param);
+
+  vector<string> layer_names;
+  if (!FLAGS_layers.empty()) {
+    string::size_type begin = 0;
+    while (begin <= FLAGS_layers.size()) {
+      string::size_type end = FLAGS_layers.find(',', begin);
+      if (end == string::npos) { end = FLAGS_layers.size(); }
+      layer_names.push_back(FLAGS_layers.substr(begin, end - begin));
+      begin = end + 1;
+    }
+  }
+
+  int total_weights = 0;
+  int total_kept = 0;
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    LayerParameter* layer = net_param.mutable_layer(i);
+    if (layer_names.empty()) {
+      if (layer->type() != "InnerProduct" && layer->type() != "Convolution") {
+        continue;
+      }
+    } else if (std::find(layer_names.begin(), layer_names.end(),
+                         layer->name()) == layer_names.end()) {
+      continue;
+    }
+    if (layer->blobs_size() == 0) { continue; }
+    BlobProto* weights = layer->mutable_blobs(0);
+    const int count = weights->double_data_size() > 0 ?
+        weights->double_data_size() : weights->data_size();
+    if (count < FLAGS_min_weights) {
+      LOG(INFO) << "Skipping " << layer->name() << " (" << count
+                << " weights)";
+      continue;
+    }
+    const int kept = PruneBlob(weights);
+    LOG(INFO) << "Pruned " << layer->name() << ": kept " << kept << " of "
+              << count << " weights";
+    total_weights += count;
+    total_kept += kept;
+  }
+  LOG(INFO) << "Kept " << total_kept << " of " << total_weights
+            << " weights in pruned layers";
+
+  WriteProtoToBinaryFile(net_param, argv[2]);
+  LOG(INFO) << "Wrote pruned model to " << argv[2];
+  return 0;
+}